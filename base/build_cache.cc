@@ -0,0 +1,251 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "build_cache.h"
+
+using namespace std;
+
+namespace structured_indoor_modeling {
+
+namespace {
+
+const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+
+uint64_t HashBytes(const void* data, const size_t size, uint64_t hash) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= kFnvPrime;
+  }
+  return hash;
+}
+
+string ToHex(const uint64_t value) {
+  ostringstream ostr;
+  ostr << hex << setw(16) << setfill('0') << value;
+  return ostr.str();
+}
+
+void MakeDirectory(const string& directory) {
+  // Fails harmlessly if the directory exists.
+#ifdef _WIN32
+  _mkdir(directory.c_str());
+#else
+  mkdir(directory.c_str(), 0755);
+#endif
+}
+
+bool GetFileStatus(const string& filename, long long* size, long long* mtime) {
+  struct stat status;
+  if (stat(filename.c_str(), &status) != 0)
+    return false;
+  *size = status.st_size;
+  *mtime = status.st_mtime;
+  return true;
+}
+
+}  // namespace
+
+BuildKey::BuildKey() : hash(kFnvOffsetBasis) {
+}
+
+BuildKey& BuildKey::AddString(const string& value) {
+  // With the length, so that ("ab", "c") and ("a", "bc") differ.
+  const uint64_t length = value.size();
+  hash = HashBytes(&length, sizeof(length), hash);
+  hash = HashBytes(value.data(), value.size(), hash);
+  return *this;
+}
+
+BuildKey& BuildKey::AddBytes(const void* data, const size_t size) {
+  hash = HashBytes(data, size, hash);
+  return *this;
+}
+
+BuildKey& BuildKey::AddHash(const uint64_t value) {
+  hash = HashBytes(&value, sizeof(value), hash);
+  return *this;
+}
+
+string BuildKey::ToString() const {
+  return ToHex(hash);
+}
+
+BuildCache::BuildCache(const FileIO& file_io, const string& stage, const bool enabled)
+  : file_io(file_io), stage(stage), enabled(enabled) {
+  MakeDirectory(file_io.GetBuildCacheDirectory());
+  Load();
+}
+
+uint64_t BuildCache::HashFile(const string& filename) {
+  long long size, mtime;
+  if (!GetFileStatus(filename, &size, &mtime))
+    return BuildKey().AddString("missing").GetHash();
+  {
+    lock_guard<std::mutex> lock(mutex);
+    const auto ite = files.find(filename);
+    if (ite != files.end() && ite->second.size == size && ite->second.mtime == mtime)
+      return ite->second.hash;
+  }
+
+  // Read outside the lock, so that other threads can hash meanwhile.
+  ifstream ifstr;
+  ifstr.open(filename.c_str(), ios::binary);
+  if (!ifstr.is_open())
+    return BuildKey().AddString("missing").GetHash();
+  uint64_t hash = kFnvOffsetBasis;
+  vector<char> buffer(1 << 20);
+  while (ifstr) {
+    ifstr.read(&buffer[0], buffer.size());
+    hash = HashBytes(&buffer[0], static_cast<size_t>(ifstr.gcount()), hash);
+  }
+  ifstr.close();
+
+  lock_guard<std::mutex> lock(mutex);
+  FileEntry& entry = files[filename];
+  entry.hash = hash;
+  entry.size = size;
+  entry.mtime = mtime;
+  return hash;
+}
+
+uint64_t BuildCache::HashPanoramaFiles(const int num_panoramas) {
+  BuildKey key;
+  for (int p = 0; p < num_panoramas; ++p) {
+    key.AddHash(HashFile(file_io.GetPanoramaImage(p)));
+    key.AddHash(HashFile(file_io.GetDepthPanorama(p)));
+    key.AddHash(HashFile(file_io.GetPanoramaToGlobalTransformation(p)));
+  }
+  return key.GetHash();
+}
+
+uint64_t BuildCache::HashPointCloudFiles(const int num_panoramas) {
+  BuildKey key;
+  for (int p = 0; p < num_panoramas; ++p) {
+    key.AddHash(HashFile(file_io.GetLocalPly(p)));
+    key.AddHash(HashFile(file_io.GetLocalToGlobalTransformation(p)));
+  }
+  return key.GetHash();
+}
+
+bool BuildCache::IsUpToDate(const string& unit,
+                            const BuildKey& key,
+                            const vector<string>& outputs) const {
+  if (!enabled)
+    return false;
+  {
+    lock_guard<std::mutex> lock(mutex);
+    const auto ite = units.find(unit);
+    if (ite == units.end() ||
+        ite->second.key != key.ToString() ||
+        ite->second.outputs != outputs)
+      return false;
+  }
+  for (const auto& output : outputs) {
+    long long size, mtime;
+    if (!GetFileStatus(output, &size, &mtime))
+      return false;
+  }
+  return true;
+}
+
+void BuildCache::Record(const string& unit,
+                        const BuildKey& key,
+                        const vector<string>& outputs) {
+  lock_guard<std::mutex> lock(mutex);
+  UnitEntry& entry = units[unit];
+  entry.key = key.ToString();
+  entry.outputs = outputs;
+  Save();
+}
+
+string BuildCache::GetUnitName(const string& prefix, const int index) {
+  char buffer[64];
+  sprintf(buffer, "_%03d", index);
+  return prefix + buffer;
+}
+
+// One entry per line:
+// file <hash> <size> <mtime> <filename>
+// unit <name> <key> <num_outputs>
+// followed by one output filename per line.
+void BuildCache::Load() {
+  ifstream ifstr;
+  ifstr.open(file_io.GetBuildCacheManifest(stage).c_str());
+  if (!ifstr.is_open())
+    return;
+
+  string line;
+  while (getline(ifstr, line)) {
+    istringstream isstr(line);
+    string type;
+    isstr >> type;
+    if (type == "file") {
+      string hash;
+      FileEntry entry;
+      isstr >> hash >> entry.size >> entry.mtime;
+      string filename;
+      isstr.get();
+      getline(isstr, filename);
+      if (filename.empty())
+        continue;
+      entry.hash = strtoull(hash.c_str(), NULL, 16);
+      files[filename] = entry;
+    } else if (type == "unit") {
+      string name;
+      int num_outputs = 0;
+      UnitEntry entry;
+      isstr >> name >> entry.key >> num_outputs;
+      for (int i = 0; i < num_outputs; ++i) {
+        string output;
+        if (!getline(ifstr, output))
+          break;
+        entry.outputs.push_back(output);
+      }
+      // A truncated manifest only loses the last unit.
+      if (static_cast<int>(entry.outputs.size()) == num_outputs)
+        units[name] = entry;
+    }
+  }
+  ifstr.close();
+}
+
+void BuildCache::Save() const {
+  // Written aside and renamed, so that a killed run leaves the old
+  // manifest.
+  const string filename = file_io.GetBuildCacheManifest(stage);
+  const string temporary = filename + ".tmp";
+  ofstream ofstr;
+  ofstr.open(temporary.c_str());
+  if (!ofstr.is_open()) {
+    cerr << "Cannot open a file: " << temporary << endl;
+    return;
+  }
+  for (const auto& file : files) {
+    ofstr << "file " << ToHex(file.second.hash) << ' ' << file.second.size << ' '
+          << file.second.mtime << ' ' << file.first << endl;
+  }
+  for (const auto& unit : units) {
+    ofstr << "unit " << unit.first << ' ' << unit.second.key << ' '
+          << unit.second.outputs.size() << endl;
+    for (const auto& output : unit.second.outputs)
+      ofstr << output << endl;
+  }
+  ofstr.close();
+#ifdef _WIN32
+  remove(filename.c_str());
+#endif
+  if (rename(temporary.c_str(), filename.c_str()) != 0)
+    cerr << "Cannot write a file: " << filename << endl;
+}
+
+}  // namespace structured_indoor_modeling
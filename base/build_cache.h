@@ -0,0 +1,136 @@
+#ifndef BASE_BUILD_CACHE_H_
+#define BASE_BUILD_CACHE_H_
+
+/*
+  Incremental rebuild of the outputs of a stage. A stage splits its
+  work into units (typically one room) and describes the inputs of
+  each unit with a BuildKey: content hashes of the input files, the
+  flag values that change the result, and any in-memory data that the
+  unit reads. After a unit wrote its outputs (FileIO paths), Record()
+  stores its key in the manifest of the stage
+  (FileIO::GetBuildCacheManifest). The next run skips the unit if its
+  key did not change and all its outputs still exist.
+
+  File hashes are memoized in the manifest by size and modification
+  time (in seconds), so unchanged inputs are not read again.
+
+  A disabled cache (--incremental=false in the CLIs) never reports a
+  unit as up to date, but still records keys for the next run.
+
+  All the methods are thread safe.
+
+  < Example >
+
+  BuildCache cache(file_io, "object_segmentation", FLAGS_incremental);
+  for (int room = 0; room < floorplan.GetNumRooms(); ++room) {
+    BuildKey key;
+    key.AddHash(cache.HashFile(file_io.GetFloorplan()));
+    key.Add("point_subsampling_ratio", FLAGS_point_subsampling_ratio);
+    const vector<string> outputs(1, file_io.GetObjectPointClouds(room));
+    const string unit = BuildCache::GetUnitName("room", room);
+    if (cache.IsUpToDate(unit, key, outputs))
+      continue;
+    ProcessRoom(room);
+    cache.Record(unit, key, outputs);
+  }
+*/
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "file_io.h"
+
+namespace structured_indoor_modeling {
+
+// 64 bit FNV-1a hash of the inputs of a unit. Add values field by
+// field (not raw structs, whose padding is undefined).
+class BuildKey {
+ public:
+  BuildKey();
+
+  // Named values, e.g. a flag. Floating point values are written with
+  // 17 digits, so any change of the value changes the key.
+  template <typename T>
+  BuildKey& Add(const std::string& name, const T& value) {
+    std::ostringstream ostr;
+    ostr.precision(17);
+    ostr << value;
+    AddString(name);
+    AddString(ostr.str());
+    return *this;
+  }
+  BuildKey& AddString(const std::string& value);
+  BuildKey& AddBytes(const void* data, const size_t size);
+  BuildKey& AddHash(const uint64_t hash);
+
+  uint64_t GetHash() const { return hash; }
+  // Seed for the random choices of a unit. A unit seeded from its key
+  // gives the same result whether or not the units before it ran.
+  uint32_t GetSeed() const { return static_cast<uint32_t>(hash ^ (hash >> 32)); }
+  // 16 hexadecimal digits.
+  std::string ToString() const;
+
+ private:
+  uint64_t hash;
+};
+
+class BuildCache {
+ public:
+  BuildCache(const FileIO& file_io, const std::string& stage, const bool enabled = true);
+
+  // Content hash of a file. A missing file has its own hash, so that
+  // its creation changes the keys.
+  uint64_t HashFile(const std::string& filename);
+  // All the files read by ReadPanoramas (ReadPanoramaPyramids).
+  uint64_t HashPanoramaFiles(const int num_panoramas);
+  // All the files read by ReadPointClouds.
+  uint64_t HashPointCloudFiles(const int num_panoramas);
+
+  bool IsUpToDate(const std::string& unit,
+                  const BuildKey& key,
+                  const std::vector<std::string>& outputs) const;
+  // Call after all the outputs are written. Saves the manifest.
+  void Record(const std::string& unit,
+              const BuildKey& key,
+              const std::vector<std::string>& outputs);
+
+  // Scratch file of a unit that is not a pipeline output (e.g. an
+  // intermediate texture), to be listed in its outputs.
+  std::string GetBlob(const std::string& unit) const {
+    return file_io.GetBuildCacheBlob(stage, unit);
+  }
+
+  // "room_003" for ("room", 3).
+  static std::string GetUnitName(const std::string& prefix, const int index);
+
+ private:
+  struct FileEntry {
+    uint64_t hash;
+    long long size;
+    long long mtime;
+  };
+  struct UnitEntry {
+    std::string key;
+    std::vector<std::string> outputs;
+  };
+
+  void Load();
+  // Requires mutex.
+  void Save() const;
+
+  const FileIO file_io;
+  const std::string stage;
+  const bool enabled;
+
+  std::map<std::string, FileEntry> files;
+  std::map<std::string, UnitEntry> units;
+  mutable std::mutex mutex;
+};
+
+}  // namespace structured_indoor_modeling
+
+#endif  // BASE_BUILD_CACHE_H_
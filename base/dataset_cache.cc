@@ -0,0 +1,66 @@
+#include <fstream>
+#include <iostream>
+
+#include "dataset_cache.h"
+
+using namespace std;
+
+namespace structured_indoor_modeling {
+
+namespace {
+
+template <typename T>
+void ReadFromFile(const string& filename, T* data) {
+  ifstream ifstr;
+  ifstr.open(filename.c_str());
+  if (!ifstr.is_open()) {
+    cerr << "Cannot open a file: " << filename << endl;
+    exit (1);
+  }
+  ifstr >> *data;
+  ifstr.close();
+}
+
+}  // namespace
+
+DatasetCache::DatasetCache(const string& data_directory) : file_io(data_directory) {
+}
+
+const Floorplan& DatasetCache::GetFloorplan() const {
+  call_once(floorplan.loaded, [this]() {
+      ReadFromFile(file_io.GetFloorplan(), &floorplan.data);
+    });
+  return floorplan.data;
+}
+
+const IndoorPolygon& DatasetCache::GetIndoorPolygon() const {
+  call_once(indoor_polygon.loaded, [this]() {
+      ReadFromFile(file_io.GetIndoorPolygon(), &indoor_polygon.data);
+    });
+  return indoor_polygon.data;
+}
+
+const vector<vector<Panorama> >& DatasetCache::GetPanoramaPyramids(const int num_levels) const {
+  Entry<vector<vector<Panorama> > >* entry;
+  {
+    lock_guard<std::mutex> lock(mutex);
+    auto& slot = panorama_pyramids[num_levels];
+    if (!slot)
+      slot.reset(new Entry<vector<vector<Panorama> > >);
+    entry = slot.get();
+  }
+  // Loaded outside the lock, so that other data can load meanwhile.
+  call_once(entry->loaded, [this, entry, num_levels]() {
+      ReadPanoramaPyramids(file_io, num_levels, &entry->data);
+    });
+  return entry->data;
+}
+
+const vector<PointCloud>& DatasetCache::GetPointClouds() const {
+  call_once(point_clouds.loaded, [this]() {
+      ReadPointClouds(file_io, &point_clouds.data);
+    });
+  return point_clouds.data;
+}
+
+}  // namespace structured_indoor_modeling
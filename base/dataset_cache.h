@@ -0,0 +1,71 @@
+#ifndef BASE_DATASET_CACHE_H_
+#define BASE_DATASET_CACHE_H_
+
+/*
+  Read-only inputs of one data directory, loaded at the first request
+  and shared by everyone after that. Stages of a pipeline running in
+  one process (see pipeline.h) read the same panoramas and point
+  clouds instead of loading their own copies. Only data that no stage
+  writes belongs here.
+
+  All the accessors are thread safe. Concurrent first requests of the
+  same data load it once, the others wait. Returned references stay
+  valid as long as the cache.
+
+  Panoramas are cached as pyramids (ReadPanoramaPyramids), one set per
+  number of levels. Level 0 is the full resolution panorama after
+  MakeOnlyBackgroundBlack.
+
+  < Example >
+
+  DatasetCache dataset("../some_data_directory");
+  const vector<vector<Panorama> >& panoramas = dataset.GetPanoramaPyramids(3);
+  const vector<PointCloud>& point_clouds = dataset.GetPointClouds();
+*/
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "file_io.h"
+#include "floorplan.h"
+#include "indoor_polygon.h"
+#include "panorama.h"
+#include "point_cloud.h"
+
+namespace structured_indoor_modeling {
+
+class DatasetCache {
+ public:
+  DatasetCache(const std::string& data_directory);
+
+  const FileIO& GetFileIO() const { return file_io; }
+
+  const Floorplan& GetFloorplan() const;
+  const IndoorPolygon& GetIndoorPolygon() const;
+  const std::vector<std::vector<Panorama> >& GetPanoramaPyramids(const int num_levels) const;
+  // Point clouds in the global coordinate frame (ReadPointClouds).
+  const std::vector<PointCloud>& GetPointClouds() const;
+
+ private:
+  template <typename T>
+  struct Entry {
+    std::once_flag loaded;
+    T data;
+  };
+
+  const FileIO file_io;
+
+  mutable Entry<Floorplan> floorplan;
+  mutable Entry<IndoorPolygon> indoor_polygon;
+  mutable Entry<std::vector<PointCloud> > point_clouds;
+  // Keyed by the number of levels. mutex guards the map, not the entries.
+  mutable std::map<int, std::unique_ptr<Entry<std::vector<std::vector<Panorama> > > > > panorama_pyramids;
+  mutable std::mutex mutex;
+};
+
+}  // namespace structured_indoor_modeling
+
+#endif  // BASE_DATASET_CACHE_H_
@@ -33,169 +33,191 @@ class FileIO {
     return data_directory;
   }
   std::string GetRawImage(const int panorama, const int image, const int dynamic_range_index) const {
-    sprintf(buffer, "%s/data/%03d/%02d_%d.jpg",
+    sprintf(Buffer(), "%s/data/%03d/%02d_%d.jpg",
             data_directory.c_str(), panorama + 1, image + 1, dynamic_range_index);
-    return buffer;
+    return Buffer();
   }
   std::string GetLocalPly(const int panorama) const {
-    sprintf(buffer, "%s/input/ply/%03d.ply", data_directory.c_str(), panorama);
-    return buffer;
+    sprintf(Buffer(), "%s/input/ply/%03d.ply", data_directory.c_str(), panorama);
+    return Buffer();
   }
   std::string GetSuperPixelFile(const int panorama) const{
-      sprintf(buffer, "%s/input/panorama/SLIC%03d", data_directory.c_str(), panorama);
-      return buffer;
+      sprintf(Buffer(), "%s/input/panorama/SLIC%03d", data_directory.c_str(), panorama);
+      return Buffer();
   }
   std::string GetLocalToGlobalTransformation(const int panorama) const {
-    sprintf(buffer, "%s/input/transformations/%03d.txt", data_directory.c_str(), panorama);
-    return buffer;
+    sprintf(Buffer(), "%s/input/transformations/%03d.txt", data_directory.c_str(), panorama);
+    return Buffer();
   }
   std::string GetMeta(const int panorama) const {
-    sprintf(buffer, "%s/data/%03d/meta.txt", data_directory.c_str(), panorama + 1);
-    return buffer;
+    sprintf(Buffer(), "%s/data/%03d/meta.txt", data_directory.c_str(), panorama + 1);
+    return Buffer();
   }
 
   std::string GetPanoramaImage(const int panorama) const {
-    sprintf(buffer, "%s/input/panorama/%03d.png", data_directory.c_str(), panorama);
-    return buffer;
+    sprintf(Buffer(), "%s/input/panorama/%03d.png", data_directory.c_str(), panorama);
+    return Buffer();
   }
   std::string GetImageAlignmentCalibration(const int panorama) const {
-    sprintf(buffer, "%s/input/calibration/%03d.calibration", data_directory.c_str(), panorama);
-    return buffer;
+    sprintf(Buffer(), "%s/input/calibration/%03d.calibration", data_directory.c_str(), panorama);
+    return Buffer();
   }
   std::string GetPanoramaDepthAlignmentCalibration(const int panorama) const {
-    sprintf(buffer, "%s/input/calibration/%03d.calibration2", data_directory.c_str(), panorama);
-    return buffer;
+    sprintf(Buffer(), "%s/input/calibration/%03d.calibration2", data_directory.c_str(), panorama);
+    return Buffer();
   }
   std::string GetPanoramaDepthAlignmentVisualization(const int panorama) const {
-    sprintf(buffer, "%s/input/panorama/%03d.jpg", data_directory.c_str(), panorama);
-    return buffer;
+    sprintf(Buffer(), "%s/input/panorama/%03d.jpg", data_directory.c_str(), panorama);
+    return Buffer();
   }
   std::string GetPanoramaToGlobalTransformation(const int panorama) const {
-    sprintf(buffer, "%s/input/calibration/%03d.camera_to_global", data_directory.c_str(), panorama);
-    return buffer;
+    sprintf(Buffer(), "%s/input/calibration/%03d.camera_to_global", data_directory.c_str(), panorama);
+    return Buffer();
   }
   std::string GetDepthPanorama(const int panorama) const {
-    sprintf(buffer, "%s/input/panorama/%03d_raw.depth", data_directory.c_str(), panorama);
-    return buffer;
+    sprintf(Buffer(), "%s/input/panorama/%03d_raw.depth", data_directory.c_str(), panorama);
+    return Buffer();
   }
   std::string GetDepthVisualization(const int panorama) const {
-    sprintf(buffer, "%s/input/panorama/%03d_raw_depth.png", data_directory.c_str(), panorama);
-    return buffer;
+    sprintf(Buffer(), "%s/input/panorama/%03d_raw_depth.png", data_directory.c_str(), panorama);
+    return Buffer();
   }
   
   std::string GetSmoothDepthPanorama(const int panorama) const {
-    sprintf(buffer, "%s/input/panorama/%03d.depth", data_directory.c_str(), panorama);
-    return buffer;
+    sprintf(Buffer(), "%s/input/panorama/%03d.depth", data_directory.c_str(), panorama);
+    return Buffer();
   }
   std::string GetSmoothDepthVisualization(const int panorama) const {
-    sprintf(buffer, "%s/input/panorama/%03d_depth.png", data_directory.c_str(), panorama);
-    return buffer;
+    sprintf(Buffer(), "%s/input/panorama/%03d_depth.png", data_directory.c_str(), panorama);
+    return Buffer();
   }
   std::string GetFloorplan() const {
-    sprintf(buffer, "%s/input/floorplan.txt", data_directory.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/input/floorplan.txt", data_directory.c_str());
+    return Buffer();
   }
   std::string GetFloorplanSVG() const {
-    sprintf(buffer, "%s/floorplan/floorplan.svg", data_directory.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/floorplan/floorplan.svg", data_directory.c_str());
+    return Buffer();
   }
   std::string GetIndoorPolygonSimple() const {
-    sprintf(buffer, "%s/input/floorplan_detailed_simple.txt", data_directory.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/input/floorplan_detailed_simple.txt", data_directory.c_str());
+    return Buffer();
   }
   std::string GetIndoorPolygon() const {
-    // sprintf(buffer, "%s/indoor_polygon.txt", data_directory.c_str());
-    sprintf(buffer, "%s/input/floorplan_detailed.txt", data_directory.c_str());
-    return buffer;
+    // sprintf(Buffer(), "%s/indoor_polygon.txt", data_directory.c_str());
+    sprintf(Buffer(), "%s/input/floorplan_detailed.txt", data_directory.c_str());
+    return Buffer();
   }
   std::string GetIndoorPolygonWithCeiling() const {
-    sprintf(buffer, "%s/input/floorplan_detailed_ceil.txt", data_directory.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/input/floorplan_detailed_ceil.txt", data_directory.c_str());
+    return Buffer();
   }
   std::string GetFloorplanFinal() const {
-    sprintf(buffer, "%s/floorplan/floorplan_final.txt", data_directory.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/floorplan/floorplan_final.txt", data_directory.c_str());
+    return Buffer();
   }
   std::string GetIndoorPolygonFinal(const std::string& suffix) const {
-    // sprintf(buffer, "%s/indoor_polygon_final.txt", data_directory.c_str());
+    // sprintf(Buffer(), "%s/indoor_polygon_final.txt", data_directory.c_str());
     if (suffix == "")
-      sprintf(buffer, "%s/floorplan/floorplan_detailed_final.txt", data_directory.c_str());
+      sprintf(Buffer(), "%s/floorplan/floorplan_detailed_final.txt", data_directory.c_str());
     else
-      sprintf(buffer, "%s/floorplan/floorplan_detailed_final_%s.txt", data_directory.c_str(), suffix.c_str());
-    return buffer;
+      sprintf(Buffer(), "%s/floorplan/floorplan_detailed_final_%s.txt", data_directory.c_str(), suffix.c_str());
+    return Buffer();
   }  
 
   std::string GetTextureImage(const int index) const {
-    sprintf(buffer, "%s/texture_atlas/texture_image_%03d.png", data_directory.c_str(), index);
-    return buffer;
+    sprintf(Buffer(), "%s/texture_atlas/texture_image_%03d.png", data_directory.c_str(), index);
+    return Buffer();
   }
 
   std::string GetTextureImageIndoorPolygon(const int index, const std::string& suffix) const {
     if (suffix == "")
-      sprintf(buffer, "%s/texture_atlas/texture_image_detailed_%03d.png", data_directory.c_str(), index);
+      sprintf(Buffer(), "%s/texture_atlas/texture_image_detailed_%03d.png", data_directory.c_str(), index);
     else
-      sprintf(buffer, "%s/texture_atlas/texture_image_detailed_%s_%03d.png", data_directory.c_str(), suffix.c_str(), index);
-    return buffer;
+      sprintf(Buffer(), "%s/texture_atlas/texture_image_detailed_%s_%03d.png", data_directory.c_str(), suffix.c_str(), index);
+    return Buffer();
+  }
+
+  // Block compressed versions (with mipmaps) of the above.
+  std::string GetTextureImageDDS(const int index) const {
+    sprintf(Buffer(), "%s/texture_atlas/texture_image_%03d.dds", data_directory.c_str(), index);
+    return Buffer();
+  }
+
+  std::string GetTextureImageIndoorPolygonDDS(const int index, const std::string& suffix) const {
+    if (suffix == "")
+      sprintf(Buffer(), "%s/texture_atlas/texture_image_detailed_%03d.dds", data_directory.c_str(), index);
+    else
+      sprintf(Buffer(), "%s/texture_atlas/texture_image_detailed_%s_%03d.dds", data_directory.c_str(), suffix.c_str(), index);
+    return Buffer();
   }
   
   std::string GetRoomThumbnail(const int room) const {
-    sprintf(buffer, "%s/thumbnail/room_thumbnail%03d.png", data_directory.c_str(), room);
-    return buffer;
+    sprintf(Buffer(), "%s/thumbnail/room_thumbnail%03d.png", data_directory.c_str(), room);
+    return Buffer();
   }
   std::string GetRoomThumbnailPerPanorama(const int room, const int panorama) const {
-    sprintf(buffer, "%s/thumbnail/room_thumbnail_per_panorama_%03d_%03d.png",
+    sprintf(Buffer(), "%s/thumbnail/room_thumbnail_per_panorama_%03d_%03d.png",
             data_directory.c_str(), room, panorama);
-    return buffer;
+    return Buffer();
   }
   
 
   std::string GetObjectPointCloudsWithColor() const {
-    sprintf(buffer, "%s/object/object_color.ply", data_directory.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/object/object_color.ply", data_directory.c_str());
+    return Buffer();
   }    
   std::string GetObjectPointClouds(const int room) const {
-    sprintf(buffer, "%s/object/object_%03d.ply", data_directory.c_str(), room);
-    return buffer;
+    sprintf(Buffer(), "%s/object/object_%03d.ply", data_directory.c_str(), room);
+    return Buffer();
   }
   
   std::string GetObjectPointCloudsFinal(const int room) const {
-    sprintf(buffer, "%s/object/object_final_%03d.ply", data_directory.c_str(), room);
-    return buffer;
+    sprintf(Buffer(), "%s/object/object_final_%03d.ply", data_directory.c_str(), room);
+    return Buffer();
   }    
 
   std::string GetFloorWallPointClouds(const int room) const {
-    sprintf(buffer, "%s/object/floor_wall_%03d.ply", data_directory.c_str(), room);
-    return buffer;
+    sprintf(Buffer(), "%s/object/floor_wall_%03d.ply", data_directory.c_str(), room);
+    return Buffer();
   }
   std::string GetRefinedObjectClouds(const int room) const{
-    sprintf(buffer, "%s/object/object_refined_room%03d.ply", data_directory.c_str(),room);
-    return buffer;
+    sprintf(Buffer(), "%s/object/object_refined_room%03d.ply", data_directory.c_str(),room);
+    return Buffer();
   }
 
   std::string GetEvaluationDirectory() const {
-    sprintf(buffer, "%s/evaluation", data_directory.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/evaluation", data_directory.c_str());
+    return Buffer();
   }
 
   std::string GetObjectDetections() const {
-    sprintf(buffer, "%s/input/detections.txt", data_directory.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/input/detections.txt", data_directory.c_str());
+    return Buffer();
   }
   std::string GetObjectDetectionsFinal() const {
-    sprintf(buffer, "%s/object_detection/detections_final.txt", data_directory.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/object_detection/detections_final.txt", data_directory.c_str());
+    return Buffer();
   }
 
   std::string GetPoissonInput() const {
-    sprintf(buffer, "%s/evaluation/poisson_input.npts", data_directory.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/evaluation/poisson_input.npts", data_directory.c_str());
+    return Buffer();
+  }
+  std::string GetPoissonInputBinary() const {
+    sprintf(Buffer(), "%s/evaluation/poisson_input.bnpts", data_directory.c_str());
+    return Buffer();
+  }
+  std::string GetPoissonInputPly() const {
+    sprintf(Buffer(), "%s/evaluation/poisson_input.ply", data_directory.c_str());
+    return Buffer();
   }
   std::vector<std::string> GetPoissonMeshes() const {
     std::vector<std::string> filenames;
     const int kNumVersions = 4;
     for (int i = 0; i < kNumVersions; ++i) {
-      sprintf(buffer, "%s/input/poisson/poisson%d.ply", data_directory.c_str(), i);
-      filenames.push_back(buffer);
+      sprintf(Buffer(), "%s/input/poisson/poisson%d.ply", data_directory.c_str(), i);
+      filenames.push_back(Buffer());
     }
     return filenames;
   }
@@ -203,8 +225,8 @@ class FileIO {
     std::vector<std::string> filenames;
     const int kNumVersions = 4;
     for (int i = 0; i < kNumVersions; ++i) {
-      sprintf(buffer, "%s/input/poisson/poisson_filtered%d.ply", data_directory.c_str(), i);
-      filenames.push_back(buffer);
+      sprintf(Buffer(), "%s/input/poisson/poisson_filtered%d.ply", data_directory.c_str(), i);
+      filenames.push_back(Buffer());
     }
     return filenames;
   }
@@ -212,8 +234,8 @@ class FileIO {
     std::vector<std::string> filenames;
     const int kNumVersions = 3;
     for (int i = 0; i < kNumVersions; ++i) {
-      sprintf(buffer, "%s/input/vgcut/vgcut%d.ply", data_directory.c_str(), i);
-      filenames.push_back(buffer);
+      sprintf(Buffer(), "%s/input/vgcut/vgcut%d.ply", data_directory.c_str(), i);
+      filenames.push_back(Buffer());
     }
     return filenames;
   }
@@ -221,39 +243,58 @@ class FileIO {
     std::vector<std::string> filenames;
     const int kNumVersions = 3;
     for (int i = 0; i < kNumVersions; ++i) {
-      sprintf(buffer, "%s/input/vgcut/vgcut_filtered%d.ply", data_directory.c_str(), i);
-      filenames.push_back(buffer);
+      sprintf(Buffer(), "%s/input/vgcut/vgcut_filtered%d.ply", data_directory.c_str(), i);
+      filenames.push_back(Buffer());
     }
     return filenames;
   }
 
   std::string GetColladaSimple() const {
-    sprintf(buffer, "%s/evaluation/floorplan_detailed_simple.dae", data_directory.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/evaluation/floorplan_detailed_simple.dae", data_directory.c_str());
+    return Buffer();
   }
   std::string GetCollada() const {
-    sprintf(buffer, "%s/evaluation/floorplan_detailed.dae", data_directory.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/evaluation/floorplan_detailed.dae", data_directory.c_str());
+    return Buffer();
   }
   std::string GetColladaWithCeiling() const {
-    sprintf(buffer, "%s/evaluation/floorplan_detailed_ceil.dae", data_directory.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/evaluation/floorplan_detailed_ceil.dae", data_directory.c_str());
+    return Buffer();
   }
 
   std::string GetErrorReport(const std::string& prefix) const {
-    sprintf(buffer, "%s/evaluation/error_%s.txt", data_directory.c_str(), prefix.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/evaluation/error_%s.txt", data_directory.c_str(), prefix.c_str());
+    return Buffer();
   }
 
   std::string GetErrorHistogram(const std::string& prefix) const {
-    sprintf(buffer, "%s/evaluation/error_histogram_%s.txt", data_directory.c_str(), prefix.c_str());
-    return buffer;
+    sprintf(Buffer(), "%s/evaluation/error_histogram_%s.txt", data_directory.c_str(), prefix.c_str());
+    return Buffer();
   }
-  
+
+  // Incremental rebuild (see build_cache.h).
+  std::string GetBuildCacheDirectory() const {
+    sprintf(Buffer(), "%s/build_cache", data_directory.c_str());
+    return Buffer();
+  }
+  std::string GetBuildCacheManifest(const std::string& stage) const {
+    sprintf(Buffer(), "%s/build_cache/%s.txt", data_directory.c_str(), stage.c_str());
+    return Buffer();
+  }
+  std::string GetBuildCacheBlob(const std::string& stage, const std::string& unit) const {
+    sprintf(Buffer(), "%s/build_cache/%s_%s.bin", data_directory.c_str(), stage.c_str(), unit.c_str());
+    return Buffer();
+  }
+
   
  private:
   const std::string data_directory;
-  mutable char buffer[1024];
+  // Scratch space of the getters. One per thread, so that threads can
+  // share a FileIO (e.g. the stages of a pipeline).
+  static char* Buffer() {
+    static thread_local char buffer[1024];
+    return buffer;
+  }
 };
 
 inline int GetNumPanoramas(const FileIO& file_io) {
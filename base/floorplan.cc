@@ -302,6 +302,11 @@ Eigen::Vector3d Floorplan::GetRoomCenterFloorGlobal(const int room) const {
   return floorplan_to_global *
     Eigen::Vector3d(center[0], center[1], GetFloorHeight(room));
 }
+
+Eigen::Vector2i Floorplan::GetDoorRooms(const int door) const {
+  return Eigen::Vector2i(line_doors[door].line_door_faces[0].room_id,
+                         line_doors[door].line_door_faces[1].room_id);
+}
   
 istream& operator>>(istream& istr, Floorplan& floorplan) {
   for (int y = 0; y < 3; ++y)
@@ -159,6 +159,9 @@ class Floorplan {
   Eigen::Vector2d GetRoomCenterLocal(const int room) const;
   Eigen::Vector3d GetRoomCenterGlobal(const int room) const;
   Eigen::Vector3d GetRoomCenterFloorGlobal(const int room) const;
+
+  // The two rooms connected by a door.
+  Eigen::Vector2i GetDoorRooms(const int door) const;
   
  private:
   //----------------------------------------------------------------------
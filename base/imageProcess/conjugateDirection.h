@@ -0,0 +1,209 @@
+#ifndef IMAGEPROCESS_CONJUGATEDIRECTION_H
+#define IMAGEPROCESS_CONJUGATEDIRECTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//======================================================================
+// Reentrant Powell conjugate direction minimizer
+//
+// Same role and calling convention as wnlib's
+// wn_conj_direction_method (initial step per coordinate, iteration
+// limit, success/suboptimal codes), but the function to minimize is
+// any callable "double func(const double* x)". All the state lives on
+// the caller's stack, so any number of minimizations can run at the
+// same time, each with its own context captured by func.
+//
+// < Example >
+//
+// double x[2] = {0.0, 0.0};
+// const double steps[2] = {1.0, 1.0};
+// double fmin;
+// const int code = conjugateDirectionMethod
+//   ([&](const double* v) { return cost(v, context); }, x, steps, 2, 8, fmin);
+//======================================================================
+
+namespace ImageProcess {
+
+enum {
+  kConjSuccess = 0,
+  // iteration limit reached before convergence
+  kConjSuboptimal = 1,
+  // the function returned nan/inf at the start point
+  kConjFailure = 2
+};
+
+namespace conjugateDirection {
+
+// 1D minimization of func(x + t * dir) starting from t = 0, where
+// func(x) = fx. x and fx are updated. Returns the decrease of func.
+template <class Function>
+double lineMinimize(const Function& func, double* x, const double* dir,
+		    const int len, double& fx, std::vector<double>& xt) {
+  const double kGold = 1.618034;
+  const int kMaxExpansions = 8;
+  const int kMaxIterations = 12;
+  const double kTolerance = 1.0e-3;
+
+  auto eval = [&](const double t) {
+    for (int i = 0; i < len; ++i)
+      xt[i] = x[i] + t * dir[i];
+    return func(&xt[0]);
+  };
+
+  // Bracket a minimum: b between a and c, f(b) <= f(a), f(c)
+  double a = 0.0, fa = fx;
+  double b = 1.0, fb = eval(b);
+  double c, fc;
+  if (fa < fb) {
+    const double fm = eval(-1.0);
+    if (fa <= fm) {
+      c = b;     fc = fb;
+      b = a;     fb = fa;
+      a = -1.0;  fa = fm;
+    }
+    else {
+      b = -1.0;  fb = fm;
+    }
+  }
+  if (b != 0.0) {
+    // f(b) <= f(a). Expand on the far side of b.
+    c = b + kGold * (b - a);
+    fc = eval(c);
+    for (int e = 0; fc < fb && e < kMaxExpansions; ++e) {
+      a = b;  fa = fb;
+      b = c;  fb = fc;
+      c = b + kGold * (b - a);
+      fc = eval(c);
+    }
+  }
+  if (fc < fb) {
+    // Unbounded within the expansions. Take the best point seen.
+    b = c;  fb = fc;
+  }
+  else {
+    // Golden section search with parabolic steps (Brent) in [a, c]
+    double lo = std::min(a, c), hi = std::max(a, c);
+    double w = b, v = b, fw = fb, fv = fb;
+    double d = 0.0, step = 0.0;
+    for (int it = 0; it < kMaxIterations; ++it) {
+      const double mid = 0.5 * (lo + hi);
+      const double tol = kTolerance * (std::fabs(b) + 0.1);
+      if (std::fabs(b - mid) <= 2.0 * tol - 0.5 * (hi - lo))
+	break;
+      bool golden = true;
+      if (std::fabs(step) > tol) {
+	const double r = (b - w) * (fb - fv);
+	double q = (b - v) * (fb - fw);
+	double p = (b - v) * q - (b - w) * r;
+	q = 2.0 * (q - r);
+	if (q > 0.0)
+	  p = -p;
+	q = std::fabs(q);
+	if (std::fabs(p) < std::fabs(0.5 * q * step) &&
+	    p > q * (lo - b) && p < q * (hi - b)) {
+	  step = d;
+	  d = p / q;
+	  golden = false;
+	}
+      }
+      if (golden) {
+	step = (b >= mid) ? lo - b : hi - b;
+	d = 0.381966 * step;
+      }
+      const double u = b + (std::fabs(d) >= tol ? d : (d > 0.0 ? tol : -tol));
+      const double fu = eval(u);
+      if (fu <= fb) {
+	if (u >= b) lo = b; else hi = b;
+	v = w;  fv = fw;
+	w = b;  fw = fb;
+	b = u;  fb = fu;
+      }
+      else {
+	if (u < b) lo = u; else hi = u;
+	if (fu <= fw || w == b) {
+	  v = w;  fv = fw;
+	  w = u;  fw = fu;
+	}
+	else if (fu <= fv || v == b || v == w) {
+	  v = u;  fv = fu;
+	}
+      }
+    }
+  }
+
+  if (!(fb < fx))
+    return 0.0;
+  for (int i = 0; i < len; ++i)
+    x[i] += b * dir[i];
+  const double decrease = fx - fb;
+  fx = fb;
+  return decrease;
+}
+
+}  // namespace conjugateDirection
+
+// Minimizes func starting from x (len values, updated in place).
+// steps give the initial search length along each coordinate. fmin
+// receives func at the returned x.
+template <class Function>
+int conjugateDirectionMethod(const Function& func, double* x,
+			     const double* steps, const int len,
+			     const int maxIterations, double& fmin) {
+  const double kTolerance = 1.0e-6;
+
+  std::vector<double> dirs(len * len, 0.0);
+  for (int i = 0; i < len; ++i)
+    dirs[i * len + i] = steps[i];
+  std::vector<double> xt(len), xstart(len), dnew(len);
+
+  fmin = func(x);
+  if (!std::isfinite(fmin))
+    return kConjFailure;
+
+  for (int iteration = 0; iteration < maxIterations; ++iteration) {
+    const double fstart = fmin;
+    std::copy(x, x + len, xstart.begin());
+
+    // Line search along every direction, remember the best one
+    int biggest = 0;
+    double biggestDecrease = 0.0;
+    for (int i = 0; i < len; ++i) {
+      const double decrease =
+	conjugateDirection::lineMinimize(func, x, &dirs[i * len], len, fmin, xt);
+      if (decrease > biggestDecrease) {
+	biggestDecrease = decrease;
+	biggest = i;
+      }
+    }
+
+    if (2.0 * (fstart - fmin) <=
+	kTolerance * (std::fabs(fstart) + std::fabs(fmin)) + 1.0e-20)
+      return kConjSuccess;
+
+    // Powell's update: try the overall displacement as a new direction
+    for (int i = 0; i < len; ++i) {
+      dnew[i] = x[i] - xstart[i];
+      xt[i] = x[i] + dnew[i];
+    }
+    const double fextra = func(&xt[0]);
+    if (fextra < fstart) {
+      const double a = fstart - 2.0 * fmin + fextra;
+      const double b = fstart - fmin - biggestDecrease;
+      const double c = fstart - fextra;
+      if (2.0 * a * b * b < biggestDecrease * c * c) {
+	conjugateDirection::lineMinimize(func, x, &dnew[0], len, fmin, xt);
+	// Replace the direction of the biggest decrease
+	std::copy(dirs.begin() + (len - 1) * len, dirs.end(),
+		  dirs.begin() + biggest * len);
+	std::copy(dnew.begin(), dnew.end(), dirs.begin() + (len - 1) * len);
+      }
+    }
+  }
+  return kConjSuboptimal;
+}
+
+}  // namespace ImageProcess
+
+#endif // IMAGEPROCESS_CONJUGATEDIRECTION_H
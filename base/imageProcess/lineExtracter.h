@@ -1,76 +1,107 @@
-#ifndef IMAGEPROCESS_LINEEXTRACTER_H
-#define IMAGEPROCESS_LINEEXTRACTER_H
-
-#include <image/image.h>
-#include "line.h"
-#include <vector>
-
-namespace ImageProcess {
-class ClineExtracter {
- public:
-  ClineExtracter(void);
-  virtual ~ClineExtracter();
-
-  void extract(Image::Cimage& eImage, const int level, const float minLen);
-
-  void write(const std::string& file) const;
-  
-  std::vector<Cline> m_lines;
-  
- protected:
-  void BDF(void);
-  void smooth(void);
-  void nonMaxSuppress(void);
-
-  void extractLines(Image::Cimage& eImage);
-  void extractLine(Image::Cimage& eImage, Cline& line);
-
-  void getInOut(Image::Cimage& eImage, const Cline& line,
-                std::vector<int>& inout) const;
-
-  void fillIn(const int scanwhich, std::vector<int>& inout) const;
-  
-  void removeEdge(Image::Cimage& eImage, const Cline& line);
-  
-  int theta2cell(const float theta) const;
-  float cell2theta(const int cell) const;
-  int rho2cell(const float rho) const;
-  float cell2rho(const int cell) const;
-  
-  // Votes
-  std::vector<std::vector<float> > m_votes;
-  // temporary
-  std::vector<std::vector<float> > m_tmp;
-
-  // Removed pixel map
-  std::vector<std::vector<std::vector<Vec3f> > > m_removed;
-  
-  // Units for the voting space
-  float m_thetaUnit;
-  float m_rhoUnit;
-  // Width and height of the voting space (theta, rho)
-  int m_thetaWidth;
-  int m_rhoHeight;
-  int m_rhoOffset;
-  
-  // level
-  int m_level;
-  // Width and height of the image
-  int m_width;
-  int m_height;
-  Vec2f m_center;
-
-  // Thresholds
-  // Gap allowed in a line segment
-  int m_gap;
-  // Minimum length of a line segment allowed
-  float m_minLen;
-
-
-
-  //void squareFilter(Image::Cimage& eImage);
-  void boxFilter(Image::Cimage& eImage);
-  void gaussFilter(Image::Cimage& eImage);
-};
-};
-#endif // IMAGEPROCESS_LINEEXTRACTER_H
+#ifndef IMAGEPROCESS_LINEEXTRACTER_H
+#define IMAGEPROCESS_LINEEXTRACTER_H
+
+#include <image/image.h>
+#include "line.h"
+#include <vector>
+
+namespace ImageProcess {
+class ClineExtracter {
+ public:
+  ClineExtracter(void);
+  virtual ~ClineExtracter();
+
+  // Votes and NMS are split over numThreads workers (all cores if
+  // <= 0), each with its own accumulator. With one worker the votes
+  // are the same as a serial transform; more workers sum them in
+  // another order (float rounding).
+  //
+  // If orientationMargin (degrees) is positive, an edge pixel with a
+  // clear direction votes only within that margin of its normal, and
+  // lines whose edges were taken by stronger ones are skipped early.
+  // This is faster but changes which lines are found. By default,
+  // every edge pixel votes for every theta.
+  void extract(Image::Cimage& eImage, const int level, const float minLen,
+               const int numThreads = 0, const float orientationMargin = 0.0f);
+
+  void write(const std::string& file) const;
+  
+  std::vector<Cline> m_lines;
+  
+ protected:
+  void estimateOrientations(Image::Cimage& eImage);
+  void vote(Image::Cimage& eImage);
+  // Adds weight to the cells of the lines through an edge pixel.
+  void castVotes(const int x, const int y, const float weight,
+                 std::vector<float>& votes) const;
+  // Raw votes remaining around a cell.
+  float support(const int rcell, const int tcell) const;
+
+  void BDF(void);
+  void smooth(void);
+  void nonMaxSuppress(void);
+
+  void extractLines(Image::Cimage& eImage);
+  void extractLine(Image::Cimage& eImage, Cline& line);
+
+  void getInOut(Image::Cimage& eImage, const Cline& line,
+                std::vector<int>& inout) const;
+
+  void fillIn(const int scanwhich, std::vector<int>& inout) const;
+  
+  void removeEdge(Image::Cimage& eImage, const Cline& line);
+  
+  int theta2cell(const float theta) const;
+  float cell2theta(const int cell) const;
+  int rho2cell(const float rho) const;
+  float cell2rho(const int cell) const;
+  
+  // Votes
+  std::vector<std::vector<float> > m_votes;
+  // Raw votes of the edge pixels with an orientation (rho major),
+  // decremented as edges are taken by lines
+  std::vector<float> m_raw;
+  // Normal direction (theta cell) of each edge pixel, or -1 if unknown
+  std::vector<int> m_orientations;
+  // Theta cells voted on each side of a known normal (0: no
+  // restriction)
+  int m_orientationMargin;
+  std::vector<float> m_cos;
+  std::vector<float> m_sin;
+  // temporary
+  std::vector<std::vector<float> > m_tmp;
+
+  // Removed pixel map
+  std::vector<std::vector<std::vector<Vec3f> > > m_removed;
+  
+  // Units for the voting space
+  float m_thetaUnit;
+  float m_rhoUnit;
+  // Width and height of the voting space (theta, rho)
+  int m_thetaWidth;
+  int m_rhoHeight;
+  int m_rhoOffset;
+  
+  // level
+  int m_level;
+  // Width and height of the image
+  int m_width;
+  int m_height;
+  Vec2f m_center;
+
+  // Thresholds
+  // Gap allowed in a line segment
+  int m_gap;
+  // Minimum length of a line segment allowed
+  float m_minLen;
+
+  int m_numThreads;
+
+
+
+  //void squareFilter(Image::Cimage& eImage);
+  void boxFilter(Image::Cimage& eImage);
+  void gaussFilter(Image::Cimage& eImage);
+};
+};
+#endif // IMAGEPROCESS_LINEEXTRACTER_H
@@ -1,19 +1,9 @@
 #include <vector>
 #include <iostream>
 #include "patch2dOptimizer.h"
-#include "../image/photo.h"
-
-extern "C" {
-#include <acc/wnconj.h>
-#include <acc2/wnconj.h>  
-#include <acc3/wnconj.h>  
-#include <acc4/wnconj.h>
-    
-#include <acc/wnconjd.h>
-#include <acc2/wnconjd.h>  
-#include <acc3/wnconjd.h>  
-#include <acc4/wnconjd.h>
-};
+#include "conjugateDirection.h"
+#include <image/photo.h>
+#include "../parallel.h"
 
 #include <minpack/cminpak.h>
 #include <minpack/dpmpar.h>
@@ -22,42 +12,31 @@ using namespace std;
 using namespace Image;
 using namespace ImageProcess;
 
-Cpatch2dOptimizer* Cpatch2dOptimizer::m_one = NULL;
-
-Cpatch2dOptimizer::Cpatch2dOptimizer(void) {
-  m_CPU = 4;
-
-  m_ppatches0T.resize(m_CPU);
-  m_ppatches1T.resize(m_CPU);
-  m_patches1OrgT.resize(m_CPU);
-
-  m_pimages0T.resize(m_CPU);
-  m_pimages1T.resize(m_CPU);
-  
-  m_halfsizesT.resize(m_CPU);
-  m_levelsT.resize(m_CPU);
-
-  m_ssdsT.resize(m_CPU);
-
-  m_one = this;
+namespace {
+// lmdif0 does not pass a user pointer to the cost function, so the
+// track being optimized is handed to sfunc per thread.
+thread_local const Cpatch2dOptimizer* tOptimizer = NULL;
+thread_local const void* tTrackContext = NULL;
+}
 
+Cpatch2dOptimizer::Cpatch2dOptimizer(const int numThreads) {
   // ????? critical parameter
   m_maxMoves[0] = 2.0f;  m_maxMoves[1] = 2.0f;
   m_maxMoves[2] = 1.0f;  m_maxMoves[3] = 1.0f;
   m_maxMoves[4] = 1.0f;  m_maxMoves[5] = 1.0f;
 
-  // Initialize stats
-  m_stats.resize(5);
-  for (int i = 0; i < 5; ++i)
-    m_stats[i] = 0;
-
-  for (int id = 0; id < m_CPU; ++id)
-    m_ssdsT[id] = 0;
+  setCPU(numThreads);
 }
 
 Cpatch2dOptimizer::~Cpatch2dOptimizer() {
 }
 
+void Cpatch2dOptimizer::setCPU(const int numThreads) {
+  m_CPU = structured_indoor_modeling::GetNumThreads(numThreads);
+  m_stats.resize(m_CPU);
+  initStats();
+}
+
 //----------------------------------------------------------------------
 // 6 param optimization
 // optimize, patch2d's location and shapes
@@ -67,323 +46,17 @@ double Cpatch2dOptimizer::optimize(const Cpatch2d& lhs, Cpatch2d& rhs,
 				   const Image::Cimage& rhsimage,
 				   const int halfsize, const int level,
 				   const int id) {
-  if (isInvalidAxes(lhs.m_xaxis, lhs.m_yaxis) ||
-      isInvalidAxes(rhs.m_xaxis, rhs.m_yaxis)) {
-    cerr << "Invalid axes at inputs." << endl;
-    return 2.0f;
-  }
-  
-  m_ppatches0T[id] = &lhs;      m_ppatches1T[id] = &rhs;
-  m_pimages0T[id] = &lhsimage;  m_pimages1T[id] = &rhsimage;
-  m_halfsizesT[id] = halfsize;  m_levelsT[id] = level;
-
-  m_patches1OrgT[id] = rhs;
-
-  int code;  double pval_min;  double vect[6];  int len = 6;
-  const int max_iterations = 20;
-  for (int i = 0; i < 6; ++i)
-    vect[i] = 0.0;
-
-  // Position, xaxis, yaxis
-  double initial_coord_x0s[6];
-  initial_coord_x0s[0] = 1.0f;  initial_coord_x0s[1] = 1.0f;
-  initial_coord_x0s[2] = 0.5f;  initial_coord_x0s[3] = 0.5f;
-  initial_coord_x0s[4] = 0.5f;  initial_coord_x0s[5] = 0.5f;
-  
-  if (id == 0)
-    wn_conj_direction_method(&code, &pval_min, vect, initial_coord_x0s,
-			     len, eval0, max_iterations);
-  else if (id == 1)
-    wn2_conj_direction_method(&code, &pval_min, vect, initial_coord_x0s,
-			      len, eval1, max_iterations);
-  else if (id == 2)
-    wn3_conj_direction_method(&code, &pval_min, vect, initial_coord_x0s,
-			      len, eval2, max_iterations);
-  else if (id == 3)
-    wn4_conj_direction_method(&code, &pval_min, vect, initial_coord_x0s,
-			      len, eval3, max_iterations);
-  else {
-    cerr << "No way in refinePatch" << endl;
-    exit (1);
-  }
-
-  double score;
-  if (m_ssdsT[id] == 0)
-    score = pval_min;
-  else {
-    m_ssdsT[id] = 0;
-    score = eval(vect, id);
-    m_ssdsT[id] = 1;
-  }    
-  
-  if (score != 2.0f && (code == WN_SUCCESS || code == WN_SUBOPTIMAL)) {
-    if (isTooMuchMove(vect, 1, id) == 0) {
-      encode(vect, id);
-      m_stats[0]++;
-      return score;
-    }
-    else {
-      m_stats[1]++;
-      *m_ppatches1T[id] = m_patches1OrgT[id];
-      return 2.0f;
-    }
-  }
-  else {
-    m_stats[2]++;
-    *m_ppatches1T[id] = m_patches1OrgT[id];
-    return 2.0f;
-  }
-}
-
-double Cpatch2dOptimizer::eval0(double* xs) {
-  return m_one->eval(xs, 0);
-}
-
-double Cpatch2dOptimizer::eval1(double* xs) {
-  return m_one->eval(xs, 1);
-}
-
-double Cpatch2dOptimizer::eval2(double* xs) {
-  return m_one->eval(xs, 2);
-}
-
-double Cpatch2dOptimizer::eval3(double* xs) {
-  return m_one->eval(xs, 3);
-}
-
-void Cpatch2dOptimizer::encode(const double* const vect, const int id) {
-  const int level = m_levelsT[id];
-  const float scale = (float)(0x0001 << level);    
-  
-  m_ppatches1T[id]->m_center[0] = m_patches1OrgT[id].m_center[0]
-    + vect[0] * scale;
-  m_ppatches1T[id]->m_center[1] = m_patches1OrgT[id].m_center[1]
-    + vect[1] * scale;
-  m_ppatches1T[id]->m_xaxis[0] = m_patches1OrgT[id].m_xaxis[0] + vect[2];
-  m_ppatches1T[id]->m_xaxis[1] = m_patches1OrgT[id].m_xaxis[1] + vect[3];
-  m_ppatches1T[id]->m_yaxis[0] = m_patches1OrgT[id].m_yaxis[0] + vect[4];
-  m_ppatches1T[id]->m_yaxis[1] = m_patches1OrgT[id].m_yaxis[1] + vect[5];
-}
-
-double Cpatch2dOptimizer::eval(const double* const vect, const int id) {
-  if (isTooMuchMove(vect, 0, id))
-    return 2.0f;
-  
-  encode(vect, id);
-
-  if (isInvalidAxes(m_ppatches1T[id]->m_xaxis, m_ppatches1T[id]->m_yaxis))
-    return 2.0f;
-
-  const int level = m_levelsT[id];
-  const int halfsize = m_halfsizesT[id];
-
-  const float scale = (float)(0x0001 << level);  
-  const Vec2f center0 = m_ppatches0T[id]->m_center / scale;
-  const Vec2f center1 = m_ppatches1T[id]->m_center / scale;
-  const Vec2f& xaxis0 = m_ppatches0T[id]->m_xaxis;
-  const Vec2f& yaxis0 = m_ppatches0T[id]->m_yaxis;
-  const Vec2f& xaxis1 = m_ppatches1T[id]->m_xaxis;
-  const Vec2f& yaxis1 = m_ppatches1T[id]->m_yaxis;
-
-  if (isOutside(center0, xaxis0, yaxis0, halfsize,
-		m_pimages0T[id]->getWidth(level), m_pimages0T[id]->getHeight(level)) ||
-      isOutside(center1, xaxis1, yaxis1, halfsize,
-		m_pimages1T[id]->getWidth(level), m_pimages1T[id]->getHeight(level)))
-    return 2.0;
-
-  const int size = (2 * halfsize + 1) * (2 * halfsize + 1);
-  vector<Vec3f> lhscolors, rhscolors;
-  lhscolors.resize(size);       rhscolors.resize(size);
-  int count = -1;
-  for (int y = -halfsize; y <= halfsize; ++y) {
-    Vec2f lpos = center0 + y * yaxis0 - halfsize * xaxis0;
-    Vec2f rpos = center1 + y * yaxis1 - halfsize * xaxis1;
-    for (int x = -halfsize; x <= halfsize; ++x) {
-      count++;
-
-      lhscolors[count] = m_pimages0T[id]->getColor(lpos[0], lpos[1], level);
-      rhscolors[count] = m_pimages1T[id]->getColor(rpos[0], rpos[1], level);
-      lpos += xaxis0;
-      rpos += xaxis1;
-    }
-  }
-
-  if (m_ssdsT[id] == 0) {
-    Cphoto::normalize(lhscolors);
-    Cphoto::normalize(rhscolors);
-    return Cphoto::idot(lhscolors, rhscolors);
-  }
-  else
-    return Cphoto::ssd(lhscolors, rhscolors);    
-}
-
-int Cpatch2dOptimizer::isTooMuchMove(const double* const vect, const int final, const int id) const {
-  const float scale = (final ? 1.0f : 1.5) * (0x0001 << m_levelsT[id]);
-  
-  if (scale * m_maxMoves[0] < fabs(vect[0]) || scale * m_maxMoves[1] < fabs(vect[1]) ||
-      scale * m_maxMoves[2] < fabs(vect[2]) || scale * m_maxMoves[3] < fabs(vect[3]) ||
-      scale * m_maxMoves[4] < fabs(vect[4]) || scale * m_maxMoves[5] < fabs(vect[5]))
-    return 1;
-  else
-    return 0;
+  return optimizeSub(ALL, lhs, rhs, lhsimage, rhsimage, halfsize, level, id);
 }
 
 //----------------------------------------------------------------------
 // Position optimization
 //----------------------------------------------------------------------
-// optimize, patch2d's location and shapes
 double Cpatch2dOptimizer::optimizePos(const Cpatch2d& lhs, Cpatch2d& rhs,
 				      const Image::Cimage& lhsimage, const Image::Cimage& rhsimage,
 				      const int halfsize, const int level,
 				      const int id) {
-  if (isInvalidAxes(lhs.m_xaxis, lhs.m_yaxis) ||
-      isInvalidAxes(rhs.m_xaxis, rhs.m_yaxis)) {
-    cerr << "Invalid axes at inputs." << endl;
-    return 2.0f;
-  }
-  
-  m_ppatches0T[id] = &lhs;      m_ppatches1T[id] = &rhs;
-  m_pimages0T[id] = &lhsimage;  m_pimages1T[id] = &rhsimage;
-  m_halfsizesT[id] = halfsize;  m_levelsT[id] = level;
-
-  m_patches1OrgT[id] = rhs;
-
-  int code;  double pval_min;  double vect[2];  int len = 2;
-  const int max_iterations = 8;
-
-  // Position, xaxis, yaxis
-  double initial_coord_x0s[2];
-  initial_coord_x0s[0] = 1.0f;  initial_coord_x0s[1] = 1.0f;
-  
-  for (int i = 0; i < 2; ++i)
-    vect[i] = 0.0;
-  
-  if (id == 0)
-    wn_conj_direction_method(&code, &pval_min, vect, initial_coord_x0s,
-			     len, evalPos0, max_iterations);
-  else if (id == 1)
-    wn2_conj_direction_method(&code, &pval_min, vect, initial_coord_x0s,
-			      len, evalPos1, max_iterations);
-  else if (id == 2)
-    wn3_conj_direction_method(&code, &pval_min, vect, initial_coord_x0s,
-			      len, evalPos2, max_iterations);
-  else if (id == 3)
-    wn4_conj_direction_method(&code, &pval_min, vect, initial_coord_x0s,
-			      len, evalPos3, max_iterations);
-  else {
-    cerr << "No way in refinePatch" << endl;
-    exit (1);
-  }
-
-  double score;
-  if (m_ssdsT[id] == 0)
-    score = pval_min;
-  else {
-    m_ssdsT[id] = 0;
-    score = evalPos(vect, id);
-    m_ssdsT[id] = 1;
-  }    
-  
-  if (score != 2.0f && (code == WN_SUCCESS || code == WN_SUBOPTIMAL)) {
-    if (isTooMuchMovePos(vect, 1, id) == 0) {
-      encodePos(vect, id);
-      m_stats[0]++;
-      return score;
-    }
-    else {
-      m_stats[1]++;
-      *m_ppatches1T[id] = m_patches1OrgT[id];
-      return 2.0f;
-    }
-  }
-  else {
-    m_stats[2]++;
-    *m_ppatches1T[id] = m_patches1OrgT[id];
-    return 2.0f;
-  }
-}
-
-double Cpatch2dOptimizer::evalPos0(double* xs) {
-  return m_one->evalPos(xs, 0);
-}
-
-double Cpatch2dOptimizer::evalPos1(double* xs) {
-  return m_one->evalPos(xs, 1);
-}
-
-double Cpatch2dOptimizer::evalPos2(double* xs) {
-  return m_one->evalPos(xs, 2);
-}
-
-double Cpatch2dOptimizer::evalPos3(double* xs) {
-  return m_one->evalPos(xs, 3);
-}
-
-void Cpatch2dOptimizer::encodePos(const double* const vect, const int id) {
-  const int level = m_levelsT[id];
-  const float scale = (float)(0x0001 << level);    
-  
-  m_ppatches1T[id]->m_center[0] = m_patches1OrgT[id].m_center[0]
-    + vect[0] * scale;
-  m_ppatches1T[id]->m_center[1] = m_patches1OrgT[id].m_center[1]
-    + vect[1] * scale;
-}
-
-double Cpatch2dOptimizer::evalPos(const double* const vect, const int id) {
-  if (isTooMuchMovePos(vect, 0, id))
-    return 2.0f;
-  
-  encodePos(vect, id);
-
-  const int level = m_levelsT[id];
-  const int halfsize = m_halfsizesT[id];
-  
-  const float scale = (float)(0x0001 << level);  
-  const Vec2f center0 = m_ppatches0T[id]->m_center / scale;
-  const Vec2f center1 = m_ppatches1T[id]->m_center / scale;
-  const Vec2f& xaxis0 = m_ppatches0T[id]->m_xaxis;
-  const Vec2f& yaxis0 = m_ppatches0T[id]->m_yaxis;
-  const Vec2f& xaxis1 = m_ppatches1T[id]->m_xaxis;
-  const Vec2f& yaxis1 = m_ppatches1T[id]->m_yaxis;
-
-  if (isOutside(center0, xaxis0, yaxis0, halfsize,
-		m_pimages0T[id]->getWidth(level), m_pimages0T[id]->getHeight(level)) ||
-      isOutside(center1, xaxis1, yaxis1, halfsize,
-		m_pimages1T[id]->getWidth(level), m_pimages1T[id]->getHeight(level)))
-    return 2.0;
-
-  const int size = (2 * halfsize + 1) * (2 * halfsize + 1);
-  vector<Vec3f> lhscolors, rhscolors;
-  lhscolors.resize(size);       rhscolors.resize(size);
-  int count = -1;
-  for (int y = -halfsize; y <= halfsize; ++y) {
-    Vec2f lpos = center0 + y * yaxis0 - halfsize * xaxis0;
-    Vec2f rpos = center1 + y * yaxis1 - halfsize * xaxis1;
-    for (int x = -halfsize; x <= halfsize; ++x) {
-      count++;
-      lhscolors[count] = m_pimages0T[id]->getColor(lpos[0], lpos[1], level);
-      rhscolors[count] = m_pimages1T[id]->getColor(rpos[0], rpos[1], level);
-      lpos += xaxis0;
-      rpos += xaxis1;
-    }
-  }
-
-  if (m_ssdsT[id] == 0) {
-    Cphoto::normalize(lhscolors);
-    Cphoto::normalize(rhscolors);
-    return Cphoto::idot(lhscolors, rhscolors);
-  }
-  else
-    return Cphoto::ssd(lhscolors, rhscolors);    
-}
-
-int Cpatch2dOptimizer::isTooMuchMovePos(const double* const vect, const int final, const int id) const {
-  const float scale = (final ? 1.0f : 1.5) * (0x0001 << m_levelsT[id]);
-  
-  if (scale * m_maxMoves[0] < fabs(vect[0]) || scale * m_maxMoves[1] < fabs(vect[1]))
-    return 1;
-  else
-    return 0;
+  return optimizeSub(POS, lhs, rhs, lhsimage, rhsimage, halfsize, level, id);
 }
 
 //----------------------------------------------------------------------
@@ -394,156 +67,193 @@ double Cpatch2dOptimizer::optimizeAxes(const Cpatch2d& lhs, Cpatch2d& rhs,
 				       const Image::Cimage& rhsimage,
 				       const int halfsize, const int level,
 				       const int id) {
+  return optimizeSub(AXES, lhs, rhs, lhsimage, rhsimage, halfsize, level, id);
+}
+
+void Cpatch2dOptimizer::optimize(std::vector<Cpair>& pairs, const int halfsize) {
+  structured_indoor_modeling::ParallelForWithThreadId
+    (0, (int)pairs.size(), [&](const int p, const int id) {
+      Cpair& pair = pairs[p];
+      pair.m_score = optimize(*pair.m_plhs, *pair.m_prhs,
+			      *pair.m_plhsimage, *pair.m_prhsimage,
+			      halfsize, pair.m_level, id);
+    }, m_CPU);
+}
+
+double Cpatch2dOptimizer::optimizeSub(const EMode mode,
+				      const Cpatch2d& lhs, Cpatch2d& rhs,
+				      const Image::Cimage& lhsimage,
+				      const Image::Cimage& rhsimage,
+				      const int halfsize, const int level,
+				      const int id) {
+  if (id < 0 || (int)m_stats.size() <= id) {
+    cerr << "Thread id out of range in optimize: " << id << endl;
+    exit (1);
+  }
   if (isInvalidAxes(lhs.m_xaxis, lhs.m_yaxis) ||
       isInvalidAxes(rhs.m_xaxis, rhs.m_yaxis)) {
     cerr << "Invalid axes at inputs." << endl;
     return 2.0f;
   }
-  
-  m_ppatches0T[id] = &lhs;      m_ppatches1T[id] = &rhs;
-  m_pimages0T[id] = &lhsimage;  m_pimages1T[id] = &rhsimage;
-  m_halfsizesT[id] = halfsize;  m_levelsT[id] = level;
 
-  m_patches1OrgT[id] = rhs;
-
-  int code;  double pval_min;  double vect[4];  int len = 4;
-  const int max_iterations = 15;
+  Ccontext context;
+  context.m_mode = mode;
+  context.m_ppatch0 = &lhs;      context.m_ppatch1 = &rhs;
+  context.m_pimage0 = &lhsimage;  context.m_pimage1 = &rhsimage;
+  context.m_halfsize = halfsize;  context.m_level = level;
+  context.m_ssd = 0;
+  context.m_patch1Org = rhs;
+  const int size = (2 * halfsize + 1) * (2 * halfsize + 1);
+  context.m_lhscolors.resize(size);
+  context.m_rhscolors.resize(size);
 
+  double pval_min;  double vect[6];
   // Position, xaxis, yaxis
-  double initial_coord_x0s[4];
-  initial_coord_x0s[0] = 0.5f;  initial_coord_x0s[1] = 0.5f;
-  initial_coord_x0s[2] = 0.5f;  initial_coord_x0s[2] = 0.5f;
-
-  for (int i = 0; i < 4; ++i)
-    vect[i] = 0.0;
-  
-  if (id == 0)
-    wn_conj_direction_method(&code, &pval_min, vect, initial_coord_x0s,
-			     len, evalAxes0, max_iterations);
-  else if (id == 1)
-    wn2_conj_direction_method(&code, &pval_min, vect, initial_coord_x0s,
-			      len, evalAxes1, max_iterations);
-  else if (id == 2)
-    wn3_conj_direction_method(&code, &pval_min, vect, initial_coord_x0s,
-			      len, evalAxes2, max_iterations);
-  else if (id == 3)
-    wn4_conj_direction_method(&code, &pval_min, vect, initial_coord_x0s,
-			      len, evalAxes3, max_iterations);
+  double initial_coord_x0s[6];
+  int len, max_iterations;
+  if (mode == ALL) {
+    len = 6;  max_iterations = 20;
+    initial_coord_x0s[0] = 1.0f;  initial_coord_x0s[1] = 1.0f;
+    initial_coord_x0s[2] = 0.5f;  initial_coord_x0s[3] = 0.5f;
+    initial_coord_x0s[4] = 0.5f;  initial_coord_x0s[5] = 0.5f;
+  }
+  else if (mode == POS) {
+    len = 2;  max_iterations = 8;
+    initial_coord_x0s[0] = 1.0f;  initial_coord_x0s[1] = 1.0f;
+  }
   else {
-    cerr << "No way in refinePatch" << endl;
-    exit (1);
+    len = 4;  max_iterations = 15;
+    initial_coord_x0s[0] = 0.5f;  initial_coord_x0s[1] = 0.5f;
+    initial_coord_x0s[2] = 0.5f;  initial_coord_x0s[3] = 0.5f;
   }
+  for (int i = 0; i < len; ++i)
+    vect[i] = 0.0;
+
+  const int code =
+    conjugateDirectionMethod([&](const double* const v) { return eval(v, context); },
+			     vect, initial_coord_x0s, len, max_iterations, pval_min);
 
   double score;
-  if (m_ssdsT[id] == 0)
+  if (context.m_ssd == 0)
     score = pval_min;
   else {
-    m_ssdsT[id] = 0;
-    score = evalAxes(vect, id);
-    m_ssdsT[id] = 1;
+    context.m_ssd = 0;
+    score = eval(vect, context);
+    context.m_ssd = 1;
   }    
-
-  if (score != 2.0f && (code == WN_SUCCESS || code == WN_SUBOPTIMAL)) {
-    if (isTooMuchMoveAxes(vect, 1, id) == 0) {
-      m_stats[0]++;
-      encodeAxes(vect, id);
+  
+  Cstats& stats = m_stats[id];
+  if (score != 2.0f && (code == kConjSuccess || code == kConjSuboptimal)) {
+    if (isTooMuchMove(vect, 1, context) == 0) {
+      encode(vect, context);
+      stats.m_success++;
       return score;
     }
     else {
-      m_stats[1]++;
-      *m_ppatches1T[id] = m_patches1OrgT[id];
+      stats.m_tooMuchMove++;
+      rhs = context.m_patch1Org;
       return 2.0f;
     }
   }
   else {
-    m_stats[2]++;
-    *m_ppatches1T[id] = m_patches1OrgT[id];
+    stats.m_optimFail++;
+    rhs = context.m_patch1Org;
     return 2.0f;
   }
 }
 
-double Cpatch2dOptimizer::evalAxes0(double* xs) {
-  return m_one->evalAxes(xs, 0);
-}
-
-double Cpatch2dOptimizer::evalAxes1(double* xs) {
-  return m_one->evalAxes(xs, 1);
-}
-
-double Cpatch2dOptimizer::evalAxes2(double* xs) {
-  return m_one->evalAxes(xs, 2);
-}
-
-double Cpatch2dOptimizer::evalAxes3(double* xs) {
-  return m_one->evalAxes(xs, 3);
-}
+void Cpatch2dOptimizer::encode(const double* const vect, Ccontext& context) const {
+  const float scale = (float)(0x0001 << context.m_level);    
+  const Cpatch2d& org = context.m_patch1Org;
+  Cpatch2d& patch = *context.m_ppatch1;
 
-void Cpatch2dOptimizer::encodeAxes(const double* const vect, const int id) {
-  m_ppatches1T[id]->m_xaxis[0] = m_patches1OrgT[id].m_xaxis[0] + vect[0];
-  m_ppatches1T[id]->m_xaxis[1] = m_patches1OrgT[id].m_xaxis[1] + vect[1];
-  m_ppatches1T[id]->m_yaxis[0] = m_patches1OrgT[id].m_yaxis[0] + vect[2];
-  m_ppatches1T[id]->m_yaxis[1] = m_patches1OrgT[id].m_yaxis[1] + vect[3];
+  if (context.m_mode == ALL || context.m_mode == POS) {
+    patch.m_center[0] = org.m_center[0] + vect[0] * scale;
+    patch.m_center[1] = org.m_center[1] + vect[1] * scale;
+  }
+  if (context.m_mode == ALL || context.m_mode == AXES) {
+    const double* const axes = context.m_mode == ALL ? vect + 2 : vect;
+    patch.m_xaxis[0] = org.m_xaxis[0] + axes[0];
+    patch.m_xaxis[1] = org.m_xaxis[1] + axes[1];
+    patch.m_yaxis[0] = org.m_yaxis[0] + axes[2];
+    patch.m_yaxis[1] = org.m_yaxis[1] + axes[3];
+  }
 }
 
-double Cpatch2dOptimizer::evalAxes(const double* const vect, const int id) {
-  if (isTooMuchMoveAxes(vect, 0, id))
+double Cpatch2dOptimizer::eval(const double* const vect, Ccontext& context) const {
+  if (isTooMuchMove(vect, 0, context))
     return 2.0f;
   
-  encodeAxes(vect, id);
+  encode(vect, context);
 
-  if (isInvalidAxes(m_ppatches1T[id]->m_xaxis, m_ppatches1T[id]->m_yaxis))
+  if (context.m_mode != POS &&
+      isInvalidAxes(context.m_ppatch1->m_xaxis, context.m_ppatch1->m_yaxis))
     return 2.0f;
 
-  const int level = m_levelsT[id];
-  const int halfsize = m_halfsizesT[id];
+  const int level = context.m_level;
+  const int halfsize = context.m_halfsize;
+  const Image::Cimage& image0 = *context.m_pimage0;
+  const Image::Cimage& image1 = *context.m_pimage1;
 
   const float scale = (float)(0x0001 << level);  
-  const Vec2f center0 = m_ppatches0T[id]->m_center / scale;
-  const Vec2f center1 = m_ppatches1T[id]->m_center / scale;
-  const Vec2f& xaxis0 = m_ppatches0T[id]->m_xaxis;
-  const Vec2f& yaxis0 = m_ppatches0T[id]->m_yaxis;
-  const Vec2f& xaxis1 = m_ppatches1T[id]->m_xaxis;
-  const Vec2f& yaxis1 = m_ppatches1T[id]->m_yaxis;
+  const Vec2f center0 = context.m_ppatch0->m_center / scale;
+  const Vec2f center1 = context.m_ppatch1->m_center / scale;
+  const Vec2f& xaxis0 = context.m_ppatch0->m_xaxis;
+  const Vec2f& yaxis0 = context.m_ppatch0->m_yaxis;
+  const Vec2f& xaxis1 = context.m_ppatch1->m_xaxis;
+  const Vec2f& yaxis1 = context.m_ppatch1->m_yaxis;
 
   if (isOutside(center0, xaxis0, yaxis0, halfsize,
-		m_pimages0T[id]->getWidth(level), m_pimages0T[id]->getHeight(level)) ||
+		image0.getWidth(level), image0.getHeight(level)) ||
       isOutside(center1, xaxis1, yaxis1, halfsize,
-		m_pimages1T[id]->getWidth(level), m_pimages1T[id]->getHeight(level)))
+		image1.getWidth(level), image1.getHeight(level)))
     return 2.0;
 
-  const int size = (2 * halfsize + 1) * (2 * halfsize + 1);
-  vector<Vec3f> lhscolors, rhscolors;
-  lhscolors.resize(size);       rhscolors.resize(size);
+  vector<Vec3f>& lhscolors = context.m_lhscolors;
+  vector<Vec3f>& rhscolors = context.m_rhscolors;
   int count = -1;
   for (int y = -halfsize; y <= halfsize; ++y) {
     Vec2f lpos = center0 + y * yaxis0 - halfsize * xaxis0;
     Vec2f rpos = center1 + y * yaxis1 - halfsize * xaxis1;
     for (int x = -halfsize; x <= halfsize; ++x) {
       count++;
-      lhscolors[count] = m_pimages0T[id]->getColor(lpos[0], lpos[1], level);
-      rhscolors[count] = m_pimages1T[id]->getColor(rpos[0], rpos[1], level);
+
+      lhscolors[count] = image0.getColor(lpos[0], lpos[1], level);
+      rhscolors[count] = image1.getColor(rpos[0], rpos[1], level);
       lpos += xaxis0;
       rpos += xaxis1;
     }
   }
 
-  if (m_ssdsT[id] == 0) {
+  if (context.m_ssd == 0) {
     Cphoto::normalize(lhscolors);
     Cphoto::normalize(rhscolors);
     return Cphoto::idot(lhscolors, rhscolors);
   }
   else
-    return Cphoto::ssd(lhscolors, rhscolors);
+    return Cphoto::ssd(lhscolors, rhscolors);    
 }
 
-int Cpatch2dOptimizer::isTooMuchMoveAxes(const double* const vect, const int final, const int id) const {
-  const float scale = (final ? 1.0f : 1.5) * (0x0001 << m_levelsT[id]);
+int Cpatch2dOptimizer::isTooMuchMove(const double* const vect, const int final,
+				     const Ccontext& context) const {
+  const float scale = (final ? 1.0f : 1.5) * (0x0001 << context.m_level);
+
+  // m_maxMoves index of vect[0]
+  int offset;  int len;
+  if (context.m_mode == ALL) {
+    offset = 0;  len = 6;
+  }
+  else if (context.m_mode == POS) {
+    offset = 0;  len = 2;
+  }
+  else {
+    offset = 2;  len = 4;
+  }
   
-  if (scale * m_maxMoves[2] < fabs(vect[0]) || scale * m_maxMoves[3] < fabs(vect[1]) ||
-      scale * m_maxMoves[4] < fabs(vect[2]) || scale * m_maxMoves[5] < fabs(vect[3]))
-    return 1;
-  else
-    return 0;
+  for (int i = 0; i < len; ++i)
+    if (scale * m_maxMoves[offset + i] < fabs(vect[i]))
+      return 1;
+  return 0;
 }
 
 //----------------------------------------------------------------------
@@ -599,13 +309,23 @@ int Cpatch2dOptimizer::isInvalidAxes(const Vec2f& xaxis,
 }
 
 void Cpatch2dOptimizer::showStats(void) const {
-  cerr << m_stats[0] << ' ' << m_stats[1] << ' ' << m_stats[2]
+  Cstats total;
+  total.m_success = total.m_tooMuchMove = total.m_optimFail = 0;
+  for (int i = 0; i < (int)m_stats.size(); ++i) {
+    total.m_success += m_stats[i].m_success;
+    total.m_tooMuchMove += m_stats[i].m_tooMuchMove;
+    total.m_optimFail += m_stats[i].m_optimFail;
+  }
+  cerr << total.m_success << ' ' << total.m_tooMuchMove << ' ' << total.m_optimFail
        << "  success too-much-move optim-fail" << endl;
 }
 
 void Cpatch2dOptimizer::initStats(void) {
-  for (int i = 0; i < (int)m_stats.size(); ++i)
-    m_stats[i] = 0;
+  for (int i = 0; i < (int)m_stats.size(); ++i) {
+    m_stats[i].m_success = 0;
+    m_stats[i].m_tooMuchMove = 0;
+    m_stats[i].m_optimFail = 0;
+  }
 }
 
 //----------------------------------------------------------------------
@@ -619,28 +339,28 @@ void Cpatch2dOptimizer::optimize(Cpatch2dTrack& patch2dTrack,
     exit (1);
   }
   
-  m_one = this;
-  m_ppatch2dTrack = &patch2dTrack;
-  m_pimages = &images;
-  m_firstFrame = firstFrame;
-  m_lastFrame = lastFrame;
-  m_refFrame = refFrame;
-  m_halfsize = halfsize;
-  m_level = level;
+  CtrackContext context;
+  context.m_ppatch2dTrack = &patch2dTrack;
+  context.m_pimages = &images;
+  context.m_firstFrame = firstFrame;
+  context.m_lastFrame = lastFrame;
+  context.m_refFrame = refFrame;
+  context.m_halfsize = halfsize;
+  context.m_level = level;
   
   // Fix only the reference frame and optimize other m_center, m_xaxis, m_yaxis
   const int n = (lastFrame - firstFrame) * 6;
   const int m = (lastFrame - firstFrame + 1) * (lastFrame - firstFrame) / 2;
 
-  m_orgx.resize(n);
+  context.m_orgx.resize(n);
   int count = 0;
   for (int f = firstFrame; f < lastFrame; ++f) {
-    m_orgx[count++] = patch2dTrack.m_patch2ds[f].m_center[0];
-    m_orgx[count++] = patch2dTrack.m_patch2ds[f].m_center[1];
-    m_orgx[count++] = patch2dTrack.m_patch2ds[f].m_xaxis[0];
-    m_orgx[count++] = patch2dTrack.m_patch2ds[f].m_xaxis[1];
-    m_orgx[count++] = patch2dTrack.m_patch2ds[f].m_yaxis[0];
-    m_orgx[count++] = patch2dTrack.m_patch2ds[f].m_yaxis[1];
+    context.m_orgx[count++] = patch2dTrack.m_patch2ds[f].m_center[0];
+    context.m_orgx[count++] = patch2dTrack.m_patch2ds[f].m_center[1];
+    context.m_orgx[count++] = patch2dTrack.m_patch2ds[f].m_xaxis[0];
+    context.m_orgx[count++] = patch2dTrack.m_patch2ds[f].m_xaxis[1];
+    context.m_orgx[count++] = patch2dTrack.m_patch2ds[f].m_yaxis[0];
+    context.m_orgx[count++] = patch2dTrack.m_patch2ds[f].m_yaxis[1];
   }
   
   double x[n];  double fvec[m];
@@ -653,8 +373,7 @@ void Cpatch2dOptimizer::optimize(Cpatch2dTrack& patch2dTrack,
     x[i] = 0.0;
   
   // when showing initial error
-  int iflag;
-  func(m, n, x, fvec, &iflag, NULL);
+  func(m, n, x, fvec, context);
   double fnorm = enorm(m, fvec);
   cerr << "Error " << fnorm << " -> " << flush;
 
@@ -665,7 +384,11 @@ void Cpatch2dOptimizer::optimize(Cpatch2dTrack& patch2dTrack,
 
   //----------------------------------------------------------------------
   // Compute energy functions first
+  tOptimizer = this;
+  tTrackContext = &context;
   lmdif0(sfunc, m, n, x, msk, fvec, tol, &info, &nfev, maxfev, 0.25);
+  tOptimizer = NULL;
+  tTrackContext = NULL;
 
   //cerr << endl
   //<< "----------------------------------------------------------------------" << endl
@@ -700,55 +423,56 @@ c
 c         info = 8  gtol is too small. fvec is orthogonal to the
 c                   columns of the jacobian to machine precision.
    */
-  setFromX(x);
+  setFromX(x, context);
 }
 
 void Cpatch2dOptimizer::setValid(const double* const x,
-				 std::vector<unsigned char>& valid) {
-  const int scale = 0x0001 << m_level;
-  valid.resize(m_lastFrame - m_firstFrame);
+				 const CtrackContext& context,
+				 std::vector<unsigned char>& valid) const {
+  const int scale = 0x0001 << context.m_level;
+  valid.resize(context.m_lastFrame - context.m_firstFrame);
   
   int count = 0;
-  for (int f = m_firstFrame; f < m_lastFrame; ++f) {
-    valid[f - m_firstFrame] = 1;
+  for (int f = context.m_firstFrame; f < context.m_lastFrame; ++f) {
+    valid[f - context.m_firstFrame] = 1;
     
     // Check the amount of movements
     if (m_maxMoves[0] < fabs(x[count++]) || m_maxMoves[1] < fabs(x[count++]) ||
 	m_maxMoves[2] < fabs(x[count++]) || m_maxMoves[3] < fabs(x[count++]) ||
 	m_maxMoves[4] < fabs(x[count++]) || m_maxMoves[5] < fabs(x[count++])) {
-      valid[f - m_firstFrame] = 0;
+      valid[f - context.m_firstFrame] = 0;
       continue;
     }
 
     // Check the axes
-    if (isInvalidAxes(m_ppatch2dTrack->m_patch2ds[f].m_xaxis,
-		      m_ppatch2dTrack->m_patch2ds[f].m_yaxis)) {
-      valid[f - m_firstFrame] = 0;
+    if (isInvalidAxes(context.m_ppatch2dTrack->m_patch2ds[f].m_xaxis,
+		      context.m_ppatch2dTrack->m_patch2ds[f].m_yaxis)) {
+      valid[f - context.m_firstFrame] = 0;
       continue;
     }
 
     // Check outside
-    const Vec2f center = m_ppatch2dTrack->m_patch2ds[f].m_center / scale;
-    const Vec2f& xaxis = m_ppatch2dTrack->m_patch2ds[f].m_xaxis;
-    const Vec2f& yaxis = m_ppatch2dTrack->m_patch2ds[f].m_yaxis;
-
-    if (isOutside(center, xaxis, yaxis, m_halfsize,
-		  (*m_pimages)[f].getWidth(m_level),
-		  (*m_pimages)[f].getHeight(m_level))) {
-      valid[f - m_firstFrame] = 0;
+    const Vec2f center = context.m_ppatch2dTrack->m_patch2ds[f].m_center / scale;
+    const Vec2f& xaxis = context.m_ppatch2dTrack->m_patch2ds[f].m_xaxis;
+    const Vec2f& yaxis = context.m_ppatch2dTrack->m_patch2ds[f].m_yaxis;
+
+    if (isOutside(center, xaxis, yaxis, context.m_halfsize,
+		  (*context.m_pimages)[f].getWidth(context.m_level),
+		  (*context.m_pimages)[f].getHeight(context.m_level))) {
+      valid[f - context.m_firstFrame] = 0;
       continue;
     }
   }
 
   // for the reference frame
   // Check outside
-  const Vec2f center = m_ppatch2dTrack->m_patch2ds[m_refFrame].m_center / scale;
-  const Vec2f& xaxis = m_ppatch2dTrack->m_patch2ds[m_refFrame].m_xaxis;
-  const Vec2f& yaxis = m_ppatch2dTrack->m_patch2ds[m_refFrame].m_yaxis;
+  const Vec2f center = context.m_ppatch2dTrack->m_patch2ds[context.m_refFrame].m_center / scale;
+  const Vec2f& xaxis = context.m_ppatch2dTrack->m_patch2ds[context.m_refFrame].m_xaxis;
+  const Vec2f& yaxis = context.m_ppatch2dTrack->m_patch2ds[context.m_refFrame].m_yaxis;
   
-  if (isOutside(center, xaxis, yaxis, m_halfsize,
-		(*m_pimages)[m_refFrame].getWidth(m_level),
-		(*m_pimages)[m_refFrame].getHeight(m_level)))
+  if (isOutside(center, xaxis, yaxis, context.m_halfsize,
+		(*context.m_pimages)[context.m_refFrame].getWidth(context.m_level),
+		(*context.m_pimages)[context.m_refFrame].getHeight(context.m_level)))
     valid.push_back(0);
   else
     valid.push_back(1);
@@ -756,43 +480,43 @@ void Cpatch2dOptimizer::setValid(const double* const x,
 
 void Cpatch2dOptimizer::sfunc(int m, int n, double* x, double* fvec, int* iflag,
 			      void* arg) {
-  m_one->func(m, n, x, fvec, iflag, arg);
+  tOptimizer->func(m, n, x, fvec, *(const CtrackContext*)tTrackContext);
 }
 
-void Cpatch2dOptimizer::func(int m, int n, double* x, double* fvec, int* iflag,
-			     void* arg) {
-  setFromX(x);
+void Cpatch2dOptimizer::func(int m, int n, double* x, double* fvec,
+			     const CtrackContext& context) const {
+  setFromX(x, context);
 
   // check if each frame is valid or invalid
   vector<unsigned char> valid;
-  setValid(x, valid);
+  setValid(x, context, valid);
   
   vector<vector<Vec3f> > colors;
-  colors.resize(m_lastFrame - m_firstFrame + 1);
+  colors.resize(context.m_lastFrame - context.m_firstFrame + 1);
   vector<int> frameids;
-  for (int f = m_firstFrame; f < m_lastFrame; ++f)
+  for (int f = context.m_firstFrame; f < context.m_lastFrame; ++f)
     frameids.push_back(f);
-  frameids.push_back(m_refFrame);
+  frameids.push_back(context.m_refFrame);
 
-  const int size = (2 * m_halfsize + 1) * (2 * m_halfsize + 1);
-  const float scale = 0x0001 << m_level;
+  const int size = (2 * context.m_halfsize + 1) * (2 * context.m_halfsize + 1);
+  const float scale = 0x0001 << context.m_level;
   for (int i = 0; i < (int)frameids.size(); ++i) {
     if (valid[i] == 0)
       continue;
     
     const int f = frameids[i];
-    const Vec2f center = m_ppatch2dTrack->m_patch2ds[f].m_center / scale;
-    const Vec2f& xaxis = m_ppatch2dTrack->m_patch2ds[f].m_xaxis;
-    const Vec2f& yaxis = m_ppatch2dTrack->m_patch2ds[f].m_yaxis;
+    const Vec2f center = context.m_ppatch2dTrack->m_patch2ds[f].m_center / scale;
+    const Vec2f& xaxis = context.m_ppatch2dTrack->m_patch2ds[f].m_xaxis;
+    const Vec2f& yaxis = context.m_ppatch2dTrack->m_patch2ds[f].m_yaxis;
     
     colors[i].resize(size);
     int count = -1;
-    for (int y = -m_halfsize; y <= m_halfsize; ++y) {
-      Vec2f pos = center + y * yaxis - m_halfsize * xaxis;
-      for (int x = -m_halfsize; x <= m_halfsize; ++x) {
+    for (int y = -context.m_halfsize; y <= context.m_halfsize; ++y) {
+      Vec2f pos = center + y * yaxis - context.m_halfsize * xaxis;
+      for (int x = -context.m_halfsize; x <= context.m_halfsize; ++x) {
 	count++;
 	colors[i][count] =
-	  (*m_pimages)[f].getColor(pos[0], pos[1], m_level);
+	  (*context.m_pimages)[f].getColor(pos[0], pos[1], context.m_level);
       }
     }
     
@@ -811,21 +535,22 @@ void Cpatch2dOptimizer::func(int m, int n, double* x, double* fvec, int* iflag,
   }
 }
 
-void Cpatch2dOptimizer::setFromX(const double* const x) {
-  const int scale = 0x0001 << m_level;
+void Cpatch2dOptimizer::setFromX(const double* const x,
+				 const CtrackContext& context) const {
+  const int scale = 0x0001 << context.m_level;
   int count = 0;
-  for (int f = m_firstFrame; f < m_lastFrame; ++f) {
-    m_ppatch2dTrack->m_patch2ds[f].m_center[0] = m_orgx[count] + x[count] * scale;
+  for (int f = context.m_firstFrame; f < context.m_lastFrame; ++f) {
+    context.m_ppatch2dTrack->m_patch2ds[f].m_center[0] = context.m_orgx[count] + x[count] * scale;
     count++;
-    m_ppatch2dTrack->m_patch2ds[f].m_center[1] = m_orgx[count] + x[count] * scale;
+    context.m_ppatch2dTrack->m_patch2ds[f].m_center[1] = context.m_orgx[count] + x[count] * scale;
     count++;
-    m_ppatch2dTrack->m_patch2ds[f].m_xaxis[0] = m_orgx[count] + x[count];
+    context.m_ppatch2dTrack->m_patch2ds[f].m_xaxis[0] = context.m_orgx[count] + x[count];
     count++;
-    m_ppatch2dTrack->m_patch2ds[f].m_xaxis[1] = m_orgx[count] + x[count];
+    context.m_ppatch2dTrack->m_patch2ds[f].m_xaxis[1] = context.m_orgx[count] + x[count];
     count++;
-    m_ppatch2dTrack->m_patch2ds[f].m_yaxis[0] = m_orgx[count] + x[count];
+    context.m_ppatch2dTrack->m_patch2ds[f].m_yaxis[0] = context.m_orgx[count] + x[count];
     count++;
-    m_ppatch2dTrack->m_patch2ds[f].m_yaxis[1] = m_orgx[count] + x[count];
+    context.m_ppatch2dTrack->m_patch2ds[f].m_yaxis[1] = context.m_orgx[count] + x[count];
     count++;
   }
 }
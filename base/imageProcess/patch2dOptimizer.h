@@ -1,14 +1,19 @@
 #ifndef IMAGEPROCESS_PATCH2DOPTIMIZER_H
 #define IMAGEPROCESS_PATCH2DOPTIMIZER_H
 
-#include "../image/image.h"
+#include <image/image.h>
 #include "patch2d.h"
 #include "patch2dTrack.h"
 
 namespace ImageProcess {
+// Affine patch alignment. Optimizations share no state but the
+// movement limits, so any number of them may run at the same time. id
+// selects the statistics slot of the caller (a worker id in
+// [0, m_CPU)), and the slots are merged by showStats.
 class Cpatch2dOptimizer {  
  public:
-  Cpatch2dOptimizer(void);
+  // numThreads <= 0 uses all cores
+  Cpatch2dOptimizer(const int numThreads = 0);
   virtual ~Cpatch2dOptimizer();
 
   void optimize(Cpatch2dTrack& patch2dTrack,
@@ -31,6 +36,22 @@ class Cpatch2dOptimizer {
 		      const int halfsize, const int level = 0,
 		      const int id = 0);
 
+  // One patch pair of a batch. m_score receives the result of the 6
+  // parameter optimize() (2.0 means failure).
+  struct Cpair {
+    const Cpatch2d* m_plhs;
+    Cpatch2d* m_prhs;
+    const Image::Cimage* m_plhsimage;
+    const Image::Cimage* m_prhsimage;
+    int m_level;
+    double m_score;
+  };
+  // Optimizes every pair over m_CPU threads.
+  void optimize(std::vector<Cpair>& pairs, const int halfsize);
+
+  // Changes the number of threads (and statistics slots).
+  void setCPU(const int numThreads);
+
   void showStats(void) const;
   void initStats(void);
   
@@ -38,48 +59,49 @@ class Cpatch2dOptimizer {
   int m_CPU;
 
  protected:
-  //----------------------------------------------------------------------
-  // 6 parameter optimization
-  //----------------------------------------------------------------------
-  // Evaluate a correlation score given 6 parameters
-  double eval(const double* const vect, const int id);
-  static double eval0(double* xs);
-  static double eval1(double* xs);
-  static double eval2(double* xs);
-  static double eval3(double* xs);
-
-  void encode(const double* const vect, const int id);
+  // Which parameters are optimized
+  enum EMode {
+    // center, xaxis, yaxis
+    ALL,
+    // center
+    POS,
+    // xaxis, yaxis
+    AXES
+  };
   
-  // Check if optimizer moves too much or not
-  int isTooMuchMove(const double* const vect, const int final, const int id) const;
-
-  //----------------------------------------------------------------------
-  // Position (2 params) optimization
-  //----------------------------------------------------------------------
-  double evalPos(const double* const vect, const int id);
-  static double evalPos0(double* xs);
-  static double evalPos1(double* xs);
-  static double evalPos2(double* xs);
-  static double evalPos3(double* xs);
-
-  void encodePos(const double* const vect, const int id);
+  // Everything one optimization reads and writes
+  struct Ccontext {
+    EMode m_mode;
+    // Left patch, right patch
+    const Cpatch2d* m_ppatch0;
+    Cpatch2d* m_ppatch1;
+    // original right patch
+    Cpatch2d m_patch1Org;
+    // Left image, right image
+    const Image::Cimage* m_pimage0;
+    const Image::Cimage* m_pimage1;
+    // which consistency function. (ncc, ssd)
+    int m_ssd;
+    int m_halfsize;
+    int m_level;
+    // Sampled colors, reused by every evaluation
+    std::vector<Vec3f> m_lhscolors;
+    std::vector<Vec3f> m_rhscolors;
+  };
+
+  double optimizeSub(const EMode mode,
+		     const Cpatch2d& lhs, Cpatch2d& rhs,
+		     const Image::Cimage& lhsimage, const Image::Cimage& rhsimage,
+		     const int halfsize, const int level, const int id);
   
-  // Check if optimizer moves too much or not
-  int isTooMuchMovePos(const double* const vect, const int final, const int id) const;
+  // Evaluate a correlation score given the parameters of the mode
+  double eval(const double* const vect, Ccontext& context) const;
 
-  //----------------------------------------------------------------------
-  // Axes (4 params) optimization
-  //----------------------------------------------------------------------
-  double evalAxes(const double* const vect, const int id);
-  static double evalAxes0(double* xs);
-  static double evalAxes1(double* xs);
-  static double evalAxes2(double* xs);
-  static double evalAxes3(double* xs);
-
-  void encodeAxes(const double* const vect, const int id);
+  void encode(const double* const vect, Ccontext& context) const;
   
   // Check if optimizer moves too much or not
-  int isTooMuchMoveAxes(const double* const vect, const int final, const int id) const;
+  int isTooMuchMove(const double* const vect, const int final,
+		    const Ccontext& context) const;
 
   //----------------------------------------------------------------------
   int isOutside(const Vec2f& center,
@@ -89,53 +111,38 @@ class Cpatch2dOptimizer {
 
   static int isInvalidAxes(const Vec2f& xaxis, const Vec2f& yaxis);
   
-  static Cpatch2dOptimizer* m_one;
-  
-  // Left patch, right patch
-  std::vector<const Cpatch2d*> m_ppatches0T;
-  std::vector<Cpatch2d*> m_ppatches1T;
-  // original right patch
-  std::vector<Cpatch2d> m_patches1OrgT;
-  
-  // Left image, right image
-  std::vector<const Image::Cimage*> m_pimages0T;
-  std::vector<const Image::Cimage*> m_pimages1T;
-
-  // which consistency function. (ncc, ssd)
-  std::vector<int> m_ssdsT;
-  
-  // halfsize
-  std::vector<int> m_halfsizesT;
-  // level
-  std::vector<int> m_levelsT;
-
   // How much movement is allowed for each parameter
   float m_maxMoves[6];
   
   //----------------------------------------------------------------------
   // Statistics
   //----------------------------------------------------------------------
-  // 0: success
-  // 1: too much move
-  // 2: optim fail
-  std::vector<int> m_stats;
+  struct Cstats {
+    int m_success;
+    int m_tooMuchMove;
+    int m_optimFail;
+  };
+  // One slot per thread id
+  std::vector<Cstats> m_stats;
 
   //----------------------------------------------------------------------
   // For final optimization
-  ImageProcess::Cpatch2dTrack* m_ppatch2dTrack;
-  std::vector<Image::Cimage>* m_pimages;
-  int m_firstFrame;
-  int m_lastFrame;
-  int m_refFrame;
-  int m_halfsize;
-  int m_level;
-  std::vector<double> m_orgx;
-
-  void setValid(const double* const x, std::vector<unsigned char>& valid);
+  struct CtrackContext {
+    ImageProcess::Cpatch2dTrack* m_ppatch2dTrack;
+    std::vector<Image::Cimage>* m_pimages;
+    int m_firstFrame;
+    int m_lastFrame;
+    int m_refFrame;
+    int m_halfsize;
+    int m_level;
+    std::vector<double> m_orgx;
+  };
+
+  void setValid(const double* const x, const CtrackContext& context,
+		std::vector<unsigned char>& valid) const;
   static void sfunc(int m, int n, double* x, double* fvec, int* iflag, void* arg);
-  void func(int m, int n, double* x, double* fvec, int* iflag, void* arg);
-  void setFromX(const double* const x);
-  void setToX(double* const x) const;
+  void func(int m, int n, double* x, double* fvec, const CtrackContext& context) const;
+  void setFromX(const double* const x, const CtrackContext& context) const;
 };
 };
 
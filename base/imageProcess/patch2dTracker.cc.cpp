@@ -1,16 +1,15 @@
 #include <fstream>
 #include "patch2dTracker.h"
+#include "../parallel.h"
 
 using namespace ImageProcess;
 using namespace Image;
 using namespace std;
 
 Cpatch2dTracker::Cpatch2dTracker(void) {
-  pthread_rwlock_init(&m_rwlock, NULL);    
 }
 
 Cpatch2dTracker::~Cpatch2dTracker() {
-  pthread_rwlock_destroy(&m_rwlock);    
 }
 
 void Cpatch2dTracker::init(const std::string prefix,
@@ -166,12 +165,10 @@ void Cpatch2dTracker::run(void) {
     m_movie.alloc(m_fnum);
     cerr << m_fnum << endl;
 
-    m_count = 0;
-    pthread_t threads[m_patch2dOptimizer.m_CPU];
-    for (int i = 0; i < m_patch2dOptimizer.m_CPU; ++i)
-      pthread_create(&threads[i], NULL, runThreadTmp, (void*)this);
-    for (int i = 0; i < m_patch2dOptimizer.m_CPU; ++i)
-      pthread_join(threads[i], NULL);     
+    structured_indoor_modeling::ParallelForWithThreadId
+      (0, (int)m_patch2dTracks.size(), [&](const int i, const int id) {
+	track(i, id);
+      }, m_patch2dOptimizer.m_CPU);
 
     int success = 0;    int total = 0;
     for (int i = 0; i < (int)m_patch2dTracks.size(); ++i) {
@@ -204,87 +201,35 @@ void Cpatch2dTracker::filter(const float passratio) {
   vc.swap(m_patch2dTracks);
 }
 
-void* Cpatch2dTracker::runThreadTmp(void* arg) {
-  Cpatch2dTracker* patch2dTracker = (Cpatch2dTracker*)arg;  
-  patch2dTracker->runThread();
-  return NULL;
-}
-
-void Cpatch2dTracker::runThread(void) {
-  pthread_rwlock_wrlock(&m_rwlock);
-  const int id = m_count++;
-  pthread_rwlock_unlock(&m_rwlock);
-
-  const int itmp = (int)ceil((int)m_patch2dTracks.size()
-			     / (float)m_patch2dOptimizer.m_CPU);
-  const int begin = id * itmp;
-  const int end = min((int)m_patch2dTracks.size(), (id + 1) * itmp);
-
-  for (int i = begin; i < end; ++i) {
-    const Cpatch2d& ref = getPatch2d(i, m_refFrame);
-    const Cpatch2d& pre = getPatch2d(i, m_fnum - 1);
-    Cpatch2d& cur = getPatch2d(i, m_fnum);
-    cur.m_score = 2.0;
+void Cpatch2dTracker::track(const int index, const int id) {
+  const Cpatch2d& ref = getPatch2d(index, m_refFrame);
+  const Cpatch2d& pre = getPatch2d(index, m_fnum - 1);
+  Cpatch2d& cur = getPatch2d(index, m_fnum);
+  cur.m_score = 2.0;
     
-    const float step = 0x0001 << (m_maxLevel - 1);
+  const float step = 0x0001 << (m_maxLevel - 1);
       
-    for (int y = -m_margin; y <= m_margin; ++y) {
-      for (int x = -m_margin; x <= m_margin; ++x) {
-	Cpatch2d curtmp = pre;
-	curtmp.m_center[0] += x * step;
-	curtmp.m_center[1] += y * step;
-
-	optimize(id, pre, curtmp,
-		 m_movie.m_images[m_fnum - 1],
-		 m_movie.m_images[m_fnum]);
-
-	// We should use thresholds
-	//????? if enforce threshold, put something here
-	if (curtmp.m_score < m_inccThreshold && curtmp.m_score < cur.m_score)
-	  cur = curtmp;
-      }
+  for (int y = -m_margin; y <= m_margin; ++y) {
+    for (int x = -m_margin; x <= m_margin; ++x) {
+      Cpatch2d curtmp = pre;
+      curtmp.m_center[0] += x * step;
+      curtmp.m_center[1] += y * step;
+
+      optimize(id, pre, curtmp,
+	       m_movie.m_images[m_fnum - 1],
+	       m_movie.m_images[m_fnum]);
+
+      // We should use thresholds
+      //????? if enforce threshold, put something here
+      if (curtmp.m_score < m_inccThreshold && curtmp.m_score < cur.m_score)
+	cur = curtmp;
     }
+  }
 
-    if (cur.m_score == 2.0)
-      continue;
+  if (cur.m_score == 2.0)
+    return;
 
-    optimize(id, ref, cur, m_movie.m_images[m_refFrame], m_movie.m_images[m_fnum]);
-  }
-  
-  /*
-  pthread_rwlock_wrlock(&m_rwlock);
-  const int id = m_count++;
-  pthread_rwlock_unlock(&m_rwlock);
-
-  const int itmp = (int)ceil((int)m_patch2dTracks.size()
-			     / (float)m_patch2dOptimizer.m_CPU);
-  const int begin = id * itmp;
-  const int end = min((int)m_patch2dTracks.size(), (id + 1) * itmp);
-
-  for (int i = begin; i < end; ++i) {
-    const Cpatch2d& pre = getPatch2d(i, m_refFrame);
-    Cpatch2d& cur = getPatch2d(i, m_fnum);
-    cur.m_score = 2.0;
-    
-    const float step = 0x0001 << (m_maxLevel - 1);
-      
-    for (int y = -m_margin; y <= m_margin; ++y) {
-      for (int x = -m_margin; x <= m_margin; ++x) {
-	Cpatch2d curtmp = getPatch2d(i, m_fnum - 1);	  
-	curtmp.m_center[0] += x * step;
-	curtmp.m_center[1] += y * step;
-
-	optimize(id, pre, curtmp,
-		 m_movie.m_images[m_refFrame],
-		 m_movie.m_images[m_fnum]);
-
-	//???????? if enforce threshold, put something here
-	if (curtmp.m_score < cur.m_score)
-	  cur = curtmp;
-      }
-    }
-  }
-  */
+  optimize(id, ref, cur, m_movie.m_images[m_refFrame], m_movie.m_images[m_fnum]);
 }
 
 void Cpatch2dTracker::tighten(void) {
@@ -5,7 +5,7 @@
 #include <string>
 #include "patch2dTrack.h"
 #include "patch2dOptimizer.h"
-#include "../image/movie.h"
+#include <image/movie.h>
 
 namespace ImageProcess {
 
@@ -72,12 +72,9 @@ class Cpatch2dTracker {
   // half size
   int m_halfsize;
 
-  // Threads
-  pthread_rwlock_t m_rwlock;
-  int m_count;
-  
-  void runThread(void);
-  static void* runThreadTmp(void*arg);  
+  // Tracks one patch into m_fnum. id is the worker id in
+  // [0, m_patch2dOptimizer.m_CPU).
+  void track(const int index, const int id);
 
   friend std::istream& operator>>(std::istream& istr, Cpatch2dTracker& rhs);
   friend std::ostream& operator<<(std::ostream& ostr, Cpatch2dTracker& rhs); 
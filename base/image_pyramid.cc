@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <iostream>
+
+#include "image_pyramid.h"
+#include "parallel.h"
+
+using namespace std;
+
+namespace structured_indoor_modeling {
+
+namespace {
+
+// Levels start on cache line boundaries.
+const size_t kAlignment = 64;
+
+template <typename T> struct Accumulator { typedef T Type; };
+template <> struct Accumulator<unsigned char> { typedef int Type; };
+
+template <typename T>
+T Average(const typename Accumulator<T>::Type sum, const int count) {
+  return static_cast<T>(sum / count);
+}
+
+template <>
+unsigned char Average<unsigned char>(const int sum, const int count) {
+  return static_cast<unsigned char>((2 * sum + count) / (2 * count));
+}
+
+template <typename T, int kChannels, ImagePyramid::HoleRule kRule>
+int IsValid(const T* pixel, const T hole_value) {
+  if (kRule == ImagePyramid::kNoHole)
+    return 1;
+  if (kRule == ImagePyramid::kValueHole)
+    return pixel[0] != hole_value;
+  int valid = 0;
+  for (int c = 0; c < kChannels; ++c)
+    valid |= (pixel[c] != 0);
+  return valid;
+}
+
+// Reduces two rows into one. Written without branches on holes, so
+// that the compiler vectorizes the loop.
+template <typename T, int kChannels, ImagePyramid::HoleRule kRule>
+void ReduceRow(const T* row0,
+               const T* row1,
+               const int half_width,
+               const T hole_value,
+               T* output) {
+  typedef typename Accumulator<T>::Type Acc;
+  const T hole = (kRule == ImagePyramid::kValueHole) ? hole_value : T(0);
+  for (int x = 0; x < half_width; ++x) {
+    const T* children[4] = { row0 + 2 * x * kChannels,
+                             row0 + (2 * x + 1) * kChannels,
+                             row1 + 2 * x * kChannels,
+                             row1 + (2 * x + 1) * kChannels };
+    Acc sum[kChannels] = {};
+    int count = 0;
+    for (int i = 0; i < 4; ++i) {
+      const int valid = IsValid<T, kChannels, kRule>(children[i], hole_value);
+      count += valid;
+      for (int c = 0; c < kChannels; ++c)
+        sum[c] += static_cast<Acc>(children[i][c]) * valid;
+    }
+    T* pixel = output + x * kChannels;
+    for (int c = 0; c < kChannels; ++c)
+      pixel[c] = (count == 0) ? hole : Average<T>(sum[c], count);
+  }
+}
+
+template <typename T, int kChannels, ImagePyramid::HoleRule kRule>
+void ReduceLevel(const cv::Mat& source,
+                 const double hole_value,
+                 const int num_threads,
+                 cv::Mat* target) {
+  ParallelFor(0, target->rows, [&](const int y) {
+      ReduceRow<T, kChannels, kRule>(source.ptr<T>(2 * y),
+                                     source.ptr<T>(2 * y + 1),
+                                     target->cols,
+                                     static_cast<T>(hole_value),
+                                     target->ptr<T>(y));
+    }, num_threads);
+}
+
+template <typename T, int kChannels>
+void ReduceLevel(const cv::Mat& source,
+                 const ImagePyramid::HoleRule hole_rule,
+                 const double hole_value,
+                 const int num_threads,
+                 cv::Mat* target) {
+  switch (hole_rule) {
+  case ImagePyramid::kNoHole:
+    ReduceLevel<T, kChannels, ImagePyramid::kNoHole>(source, hole_value, num_threads, target);
+    break;
+  case ImagePyramid::kBlackHole:
+    ReduceLevel<T, kChannels, ImagePyramid::kBlackHole>(source, hole_value, num_threads, target);
+    break;
+  case ImagePyramid::kValueHole:
+    ReduceLevel<T, kChannels, ImagePyramid::kValueHole>(source, hole_value, num_threads, target);
+    break;
+  }
+}
+
+void ReduceLevel(const cv::Mat& source,
+                 const ImagePyramid::HoleRule hole_rule,
+                 const double hole_value,
+                 const int num_threads,
+                 cv::Mat* target) {
+  switch (source.type()) {
+  case CV_8UC1:
+    ReduceLevel<unsigned char, 1>(source, hole_rule, hole_value, num_threads, target);
+    break;
+  case CV_8UC3:
+    ReduceLevel<unsigned char, 3>(source, hole_rule, hole_value, num_threads, target);
+    break;
+  case CV_32FC1:
+    ReduceLevel<float, 1>(source, hole_rule, hole_value, num_threads, target);
+    break;
+  case CV_32FC3:
+    ReduceLevel<float, 3>(source, hole_rule, hole_value, num_threads, target);
+    break;
+  case CV_64FC1:
+    ReduceLevel<double, 1>(source, hole_rule, hole_value, num_threads, target);
+    break;
+  case CV_64FC3:
+    ReduceLevel<double, 3>(source, hole_rule, hole_value, num_threads, target);
+    break;
+  default:
+    cerr << "Unsupported pyramid type: " << source.type() << endl;
+    exit (1);
+  }
+}
+
+void SetGradientRows(const cv::Mat& rgb_image,
+                     const int y,
+                     cv::Mat* dx_image,
+                     cv::Mat* dy_image) {
+  const int width = rgb_image.cols;
+  const int height = rgb_image.rows;
+  const unsigned char* row = rgb_image.ptr<unsigned char>(y);
+  float* dx = dx_image->ptr<float>(y);
+  float* dy = dy_image->ptr<float>(y);
+  const float kScale = 1.0f / 3.0f / 2.0f;
+
+  dx[0] = 0.0f;
+  dx[width - 1] = 0.0f;
+  for (int x = 1; x < width - 1; ++x) {
+    const unsigned char* left = row + 3 * (x - 1);
+    const unsigned char* right = row + 3 * (x + 1);
+    dx[x] = (static_cast<int>(right[0]) + right[1] + right[2] -
+             left[0] - left[1] - left[2]) * kScale;
+  }
+
+  if (y == 0 || y == height - 1) {
+    for (int x = 0; x < width; ++x)
+      dy[x] = 0.0f;
+    return;
+  }
+  const unsigned char* up = rgb_image.ptr<unsigned char>(y - 1);
+  const unsigned char* down = rgb_image.ptr<unsigned char>(y + 1);
+  for (int x = 0; x < width; ++x) {
+    dy[x] = (static_cast<int>(down[3 * x]) + down[3 * x + 1] + down[3 * x + 2] -
+             up[3 * x] - up[3 * x + 1] - up[3 * x + 2]) * kScale;
+  }
+}
+
+}  // namespace
+
+ImagePyramid::ImagePyramid() : width(0), height(0), type(CV_8UC3) {
+}
+
+void ImagePyramid::Allocate(const int width,
+                            const int height,
+                            const int type,
+                            const int num_levels) {
+  this->width = width;
+  this->height = height;
+  this->type = type;
+
+  // Offsets count elements of one channel, the unit of arena.
+  const size_t element_size = CV_ELEM_SIZE1(type);
+  const size_t alignment = kAlignment / element_size;
+  offsets.resize(num_levels);
+  size_t total = 0;
+  for (int level = 0; level < num_levels; ++level) {
+    if (GetWidth(level) == 0 || GetHeight(level) == 0) {
+      cerr << "Too many pyramid levels for " << width << 'x' << height << endl;
+      exit (1);
+    }
+    offsets[level] = total;
+    const size_t elements = CV_MAT_CN(type) * GetWidth(level) * GetHeight(level);
+    total += (elements + alignment - 1) / alignment * alignment;
+  }
+  // Always a new buffer: views of the previous one may still be in use.
+  arena = cv::Mat(1, static_cast<int>(total), CV_MAT_DEPTH(type));
+}
+
+void ImagePyramid::Build(const cv::Mat& image,
+                         const int num_levels,
+                         const HoleRule hole_rule,
+                         const double hole_value,
+                         const int num_threads) {
+  Allocate(image.cols, image.rows, image.type(), num_levels);
+  cv::Mat level0 = GetLevel(0);
+  image.copyTo(level0);
+  for (int level = 1; level < num_levels; ++level) {
+    cv::Mat target = GetLevel(level);
+    ReduceLevel(GetLevel(level - 1), hole_rule, hole_value, num_threads, &target);
+  }
+}
+
+cv::Mat ImagePyramid::GetLevel(const int level) const {
+  if (level < 0 || GetNumLevels() <= level) {
+    cerr << "Pyramid level out of range: " << level << endl;
+    exit (1);
+  }
+  // A range of the single row arena is continuous, so it can be
+  // reshaped into the level. The view shares the arena's reference
+  // count.
+  const int elements = CV_MAT_CN(type) * GetWidth(level) * GetHeight(level);
+  const int begin = static_cast<int>(offsets[level]);
+  return arena.colRange(begin, begin + elements).reshape(CV_MAT_CN(type), GetHeight(level));
+}
+
+void BuildGradientPyramids(const ImagePyramid& rgb_pyramid,
+                           ImagePyramid* dx_pyramid,
+                           ImagePyramid* dy_pyramid,
+                           const int num_threads) {
+  if (rgb_pyramid.GetType() != CV_8UC3) {
+    cerr << "Gradients need an 8 bit RGB pyramid." << endl;
+    exit (1);
+  }
+  const int num_levels = rgb_pyramid.GetNumLevels();
+  dx_pyramid->Allocate(rgb_pyramid.GetWidth(0), rgb_pyramid.GetHeight(0), CV_32FC1, num_levels);
+  dy_pyramid->Allocate(rgb_pyramid.GetWidth(0), rgb_pyramid.GetHeight(0), CV_32FC1, num_levels);
+
+  // Levels are independent: one parallel loop over the rows of all.
+  vector<int> first_rows(num_levels + 1, 0);
+  for (int level = 0; level < num_levels; ++level)
+    first_rows[level + 1] = first_rows[level] + rgb_pyramid.GetHeight(level);
+
+  ParallelFor(0, first_rows[num_levels], [&](const int row) {
+      const int level =
+        static_cast<int>(upper_bound(first_rows.begin(), first_rows.end(), row) - first_rows.begin()) - 1;
+      cv::Mat dx_image = dx_pyramid->GetLevel(level);
+      cv::Mat dy_image = dy_pyramid->GetLevel(level);
+      SetGradientRows(rgb_pyramid.GetLevel(level), row - first_rows[level], &dx_image, &dy_image);
+    }, num_threads);
+}
+
+}  // namespace structured_indoor_modeling
@@ -0,0 +1,89 @@
+/*
+  Image pyramid whose levels live in one allocation. Level l is
+  (width >> l) x (height >> l), and every level is reduced from the
+  previous one by 2x2 averaging. Levels are handed out as cv::Mat
+  headers into the shared buffer (no copy), and the buffer stays alive
+  as long as any of those headers does.
+
+  Hole pixels are skipped by the reduction, so that black backgrounds
+  or invalid depths do not bleed into valid pixels. A pixel whose four
+  children are all holes becomes a hole. The rules:
+
+    kNoHole      every pixel is valid (raw images)
+    kBlackHole   all channels are 0 (panoramas after MakeOnlyBackgroundBlack)
+    kValueHole   the first channel equals hole_value (depth maps, -1)
+
+  Supported types: CV_8UC1/3, CV_32FC1/3, CV_64FC1/3. 8 bit levels are
+  rounded to the nearest integer.
+
+  < Example >
+
+  ImagePyramid pyramid;
+  pyramid.Build(panorama.GetRGBImage(), 4, ImagePyramid::kBlackHole);
+  cv::Mat half = pyramid.GetLevel(1);
+
+  ImagePyramid dx, dy;
+  BuildGradientPyramids(pyramid, &dx, &dy);
+*/
+
+#ifndef BASE_IMAGE_PYRAMID_H_
+#define BASE_IMAGE_PYRAMID_H_
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+namespace structured_indoor_modeling {
+
+class ImagePyramid {
+ public:
+  enum HoleRule {
+    kNoHole,
+    kBlackHole,
+    kValueHole
+  };
+
+  ImagePyramid();
+
+  // Allocates all the levels. Contents are undefined.
+  void Allocate(const int width,
+                const int height,
+                const int type,
+                const int num_levels);
+
+  // Copies image to level 0 and reduces the other levels. Rows of a
+  // level are reduced over num_threads workers (all cores if <= 0).
+  void Build(const cv::Mat& image,
+             const int num_levels,
+             const HoleRule hole_rule,
+             const double hole_value = -1.0,
+             const int num_threads = 0);
+
+  int GetNumLevels() const { return static_cast<int>(offsets.size()); }
+  int GetWidth(const int level) const { return width >> level; }
+  int GetHeight(const int level) const { return height >> level; }
+  int GetType() const { return type; }
+
+  // Zero-copy view of a level.
+  cv::Mat GetLevel(const int level) const;
+
+ private:
+  int width;
+  int height;
+  int type;
+  // Offset of each level in arena, in elements.
+  std::vector<size_t> offsets;
+  // Every level, one after another in a single row (cv::Mat buffers
+  // are 64 byte aligned).
+  cv::Mat arena;
+};
+
+// Central difference gradients of an 8 bit RGB pyramid, averaged over
+// the channels and halved (CV_32FC1 levels, 0 on the image border).
+void BuildGradientPyramids(const ImagePyramid& rgb_pyramid,
+                           ImagePyramid* dx_pyramid,
+                           ImagePyramid* dy_pyramid,
+                           const int num_threads = 0);
+
+}  // namespace structured_indoor_modeling
+
+#endif  // BASE_IMAGE_PYRAMID_H_
@@ -11,12 +11,15 @@ a given point, or to a ray).
 
 #include <cstring>
 #include <cmath>
+#include <limits>
 #include <vector>
 #include <utility>
 #include <algorithm>
 #include "KDtree.h"
-#include "mempool.h"
+#include "../parallel.h"
 using namespace std;
+using structured_indoor_modeling::GetNumThreads;
+using structured_indoor_modeling::ParallelFor;
 
 
 // Small utility fcns
@@ -38,91 +41,47 @@ static inline float dist2ray2(const float *x, const float *p, const float *d)
 }
 
 
-// A point together with a distance - default comparison is by "first",
-// i.e., distance
-typedef pair<float, const float *> pt_with_d;
-
-
-// Class for nodes in the K-D tree
-class KDtree::Node {
-private:
-  static PoolAlloc memPool;
-  
-public:
-  // A place to put all the stuff required while traversing the K-D
-  // tree, so we don't have to pass tons of variables at each fcn call
-  struct Traversal_Info {
-    const float *p, *dir;
-    const float *closest;
-    float closest_d, closest_d2;
-    const KDtree::CompatFunc *iscompat;
-    size_t k;
-    vector<pt_with_d> knn;
-  };
-  
-  enum { MAX_PTS_PER_NODE = 7 };
-  
-  
-  // The node itself
-  
-  int npts; // If this is 0, intermediate node.  If nonzero, leaf.
-  
-  union {
-    struct {
-      float center[3];
-      float r;
-      int splitaxis;
-      Node *child1, *child2;
-    } node;
-    struct {
-      const float *p[MAX_PTS_PER_NODE];
-    } leaf;
-  };
-  
-  Node(const float **pts, int n);
-  ~Node();
-  
-  void find_closest_to_pt(Traversal_Info &ti) const;
-  void find_k_closest_to_pt(Traversal_Info &ti) const;
-  void find_closest_to_ray(Traversal_Info &ti) const;
-  
-  void *operator new(size_t n) { return memPool.alloc(n); }
-  void operator delete(void *p, size_t n) { memPool.free(p,n); }
-};
+// A point index together with a squared distance - default comparison
+// is by "first", i.e., distance
+typedef pair<float, int> pt_with_d;
 
 
-// Class static variable
-PoolAlloc KDtree::Node::memPool(sizeof(KDtree::Node));
+// A place to put all the stuff required while traversing the K-D
+// tree, so we don't have to pass tons of variables at each fcn call
+struct KDtree::Traversal_Info {
+  const float *p, *dir;
+  int closest;
+  float closest_d, closest_d2;
+  const KDtree::CompatFunc *iscompat;
+  size_t k;
+  vector<pt_with_d> *knn;
+};
 
 
-// Create a KD tree from the points pointed to by the array pts
-KDtree::Node::Node(const float **pts, int n)
+// Create a KD tree node from the points order[begin .. begin+n)
+int KDtree::build_node(int begin, int n)
 {
-  // Leaf nodes
-  if (n <= MAX_PTS_PER_NODE) {
-    npts = n;
-    memcpy(leaf.p, pts, n * sizeof(float *));
-    return;
-  }
-  
-  
-  // Else, interior nodes
-  npts = 0;
-  
+  const int index = nodes.size();
+  nodes.push_back(Node());
+  int *ids = &order[begin];
+
   // Find bbox
-  float xmin = pts[0][0], xmax = pts[0][0];
-  float ymin = pts[0][1], ymax = pts[0][1];
-  float zmin = pts[0][2], zmax = pts[0][2];
+  const float *p0 = ptlist + 3 * ids[0];
+  float xmin = p0[0], xmax = p0[0];
+  float ymin = p0[1], ymax = p0[1];
+  float zmin = p0[2], zmax = p0[2];
   for (int i = 1; i < n; i++) {
-    if (pts[i][0] < xmin)  xmin = pts[i][0];
-    if (pts[i][0] > xmax)  xmax = pts[i][0];
-    if (pts[i][1] < ymin)  ymin = pts[i][1];
-    if (pts[i][1] > ymax)  ymax = pts[i][1];
-    if (pts[i][2] < zmin)  zmin = pts[i][2];
-    if (pts[i][2] > zmax)  zmax = pts[i][2];
+    const float *p = ptlist + 3 * ids[i];
+    if (p[0] < xmin)  xmin = p[0];
+    if (p[0] > xmax)  xmax = p[0];
+    if (p[1] < ymin)  ymin = p[1];
+    if (p[1] > ymax)  ymax = p[1];
+    if (p[2] < zmin)  zmin = p[2];
+    if (p[2] > zmax)  zmax = p[2];
   }
-  
+
   // Find node center and size
+  Node node;
   node.center[0] = 0.5f * (xmin+xmax);
   node.center[1] = 0.5f * (ymin+ymax);
   node.center[2] = 0.5f * (zmin+zmax);
@@ -130,7 +89,10 @@ KDtree::Node::Node(const float **pts, int n)
   float dy = ymax-ymin;
   float dz = zmax-zmin;
   node.r = 0.5f * sqrt(sqr(dx) + sqr(dy) + sqr(dz));
-  
+  node.begin = begin;
+  node.npts = n;
+  node.child2 = -1;
+
   // Find longest axis
   node.splitaxis = 2;
   if (dx > dy) {
@@ -140,250 +102,479 @@ KDtree::Node::Node(const float **pts, int n)
     if (dy > dz)
       node.splitaxis = 1;
   }
-  
+
+  // Leaf nodes
+  if (n <= Node::MAX_PTS_PER_NODE) {
+    nodes[index] = node;
+    return index;
+  }
+
   // Partition
-  const float splitval = node.center[node.splitaxis];
-  const float **left = pts, **right = pts + n - 1;
+  const int axis = node.splitaxis;
+  const float splitval = node.center[axis];
+  int *left = ids, *right = ids + n - 1;
   while (1) {
-    while ((*left)[node.splitaxis] < splitval)
+    while (ptlist[3 * (*left) + axis] < splitval)
       left++;
-    while ((*right)[node.splitaxis] >= splitval)
+    while (ptlist[3 * (*right) + axis] >= splitval)
       right--;
     if (right < left)
       break;
     swap(*left, *right);
     left++; right--;
   }
-  
-  // Check for bad cases of clustered points
-  if (left-pts == 0 || left-pts == n)
-    left = pts + n/2;
-  
-  // Build subtrees
-  node.child1 = new Node(pts, left-pts);
-  node.child2 = new Node(left, n-(left-pts));
-}
 
-
-// Destroy a KD tree node
-KDtree::Node::~Node()
-{
-  if (!npts) {
-    delete node.child1;
-    delete node.child2;
-  }
+  // Check for bad cases of clustered points
+  if (left-ids == 0 || left-ids == n)
+    left = ids + n/2;
+  const int nleft = left - ids;
+
+  // Build subtrees. The first child directly follows this node.
+  nodes[index] = node;
+  build_node(begin, nleft);
+  const int child2 = build_node(begin + nleft, n - nleft);
+  nodes[index].child2 = child2;
+  return index;
 }
 
 
 // Crawl the KD tree
-void KDtree::Node::find_closest_to_pt(KDtree::Node::Traversal_Info &ti) const
+void KDtree::find_closest_to_pt(int n, Traversal_Info &ti) const
 {
+  const Node &node = nodes[n];
+
   // Leaf nodes
-  if (npts) {
-    for (int i = 0; i < npts; i++) {
-      float myd2 = dist2(leaf.p[i], ti.p);
+  if (node.is_leaf()) {
+    const float *p = &pts[3 * node.begin];
+    for (int i = 0; i < node.npts; i++, p += 3) {
+      float myd2 = dist2(p, ti.p);
+      const int id = order[node.begin + i];
       if ((myd2 < ti.closest_d2) &&
-          (!ti.iscompat || (*ti.iscompat)(leaf.p[i]))) {
+          (!ti.iscompat || (*ti.iscompat)(ptlist + 3 * id))) {
         ti.closest_d2 = myd2;
         ti.closest_d = sqrt(ti.closest_d2);
-        ti.closest = leaf.p[i];
+        ti.closest = id;
       }
     }
     return;
   }
-  
-  
+
+
   // Check whether to abort
   if (dist2(node.center, ti.p) >= sqr(node.r + ti.closest_d))
     return;
-  
+
   // Recursive case
   float myd = node.center[node.splitaxis] - ti.p[node.splitaxis];
   if (myd >= 0.0f) {
-    node.child1->find_closest_to_pt(ti);
+    find_closest_to_pt(n + 1, ti);
     if (myd < ti.closest_d)
-      node.child2->find_closest_to_pt(ti);
+      find_closest_to_pt(node.child2, ti);
   } else {
-    node.child2->find_closest_to_pt(ti);
+    find_closest_to_pt(node.child2, ti);
     if (-myd < ti.closest_d)
-      node.child1->find_closest_to_pt(ti);
+      find_closest_to_pt(n + 1, ti);
   }
 }
 
 
 // Crawl the KD tree, retaining k closest points
-void KDtree::Node::find_k_closest_to_pt(KDtree::Node::Traversal_Info &ti) const
+void KDtree::find_k_closest_to_pt(int n, Traversal_Info &ti) const
 {
+  const Node &node = nodes[n];
+  vector<pt_with_d> &knn = *ti.knn;
+
   // Leaf nodes
-  if (npts) {
-    for (int i = 0; i < npts; i++) {
-      float myd2 = dist2(leaf.p[i], ti.p);
-      if ((myd2 < ti.closest_d2 || ti.knn.size() < ti.k) &&
-          (!ti.iscompat || (*ti.iscompat)(leaf.p[i]))) {
-        float myd = sqrt(myd2);
-        ti.knn.push_back(make_pair(myd, leaf.p[i]));
-        push_heap(ti.knn.begin(), ti.knn.end());
-        if (ti.knn.size() > ti.k) {
-          pop_heap(ti.knn.begin(), ti.knn.end());
-          ti.knn.pop_back();
+  if (node.is_leaf()) {
+    const float *p = &pts[3 * node.begin];
+    for (int i = 0; i < node.npts; i++, p += 3) {
+      float myd2 = dist2(p, ti.p);
+      const int id = order[node.begin + i];
+      if ((myd2 < ti.closest_d2 || knn.size() < ti.k) &&
+          (!ti.iscompat || (*ti.iscompat)(ptlist + 3 * id))) {
+        knn.push_back(make_pair(myd2, id));
+        push_heap(knn.begin(), knn.end());
+        if (knn.size() > ti.k) {
+          pop_heap(knn.begin(), knn.end());
+          knn.pop_back();
         }
         // Keep track of distance to k-th closest
-        ti.closest_d = ti.knn[0].first;
-        ti.closest_d2 = sqr(ti.closest_d);
+        ti.closest_d2 = knn[0].first;
+        ti.closest_d = sqrt(ti.closest_d2);
       }
     }
     return;
   }
-  
-  
+
+
   // Check whether to abort
   if (dist2(node.center, ti.p) >= sqr(node.r + ti.closest_d) &&
-      ti.knn.size() == ti.k)
+      knn.size() == ti.k)
     return;
-  
+
   // Recursive case
   float myd = node.center[node.splitaxis] - ti.p[node.splitaxis];
   if (myd >= 0.0f) {
-    node.child1->find_k_closest_to_pt(ti);
-    if (myd < ti.closest_d || ti.knn.size() != ti.k)
-      node.child2->find_k_closest_to_pt(ti);
+    find_k_closest_to_pt(n + 1, ti);
+    if (myd < ti.closest_d || knn.size() != ti.k)
+      find_k_closest_to_pt(node.child2, ti);
   } else {
-    node.child2->find_k_closest_to_pt(ti);
-    if (-myd < ti.closest_d || ti.knn.size() != ti.k)
-      node.child1->find_k_closest_to_pt(ti);
+    find_k_closest_to_pt(node.child2, ti);
+    if (-myd < ti.closest_d || knn.size() != ti.k)
+      find_k_closest_to_pt(n + 1, ti);
+  }
+}
+
+
+// Crawl the KD tree, retaining every point within ti.closest_d
+void KDtree::find_within_radius(int n, Traversal_Info &ti) const
+{
+  const Node &node = nodes[n];
+
+  // Leaf nodes
+  if (node.is_leaf()) {
+    const float *p = &pts[3 * node.begin];
+    for (int i = 0; i < node.npts; i++, p += 3) {
+      float myd2 = dist2(p, ti.p);
+      if (myd2 <= ti.closest_d2)
+        ti.knn->push_back(make_pair(myd2, order[node.begin + i]));
+    }
+    return;
+  }
+
+
+  // Check whether to abort
+  if (dist2(node.center, ti.p) > sqr(node.r + ti.closest_d))
+    return;
+
+  // Recursive case
+  float myd = node.center[node.splitaxis] - ti.p[node.splitaxis];
+  if (myd >= 0.0f) {
+    find_within_radius(n + 1, ti);
+    if (myd <= ti.closest_d)
+      find_within_radius(node.child2, ti);
+  } else {
+    find_within_radius(node.child2, ti);
+    if (-myd <= ti.closest_d)
+      find_within_radius(n + 1, ti);
   }
 }
 
 
 // Crawl the KD tree to look for the closest point to
 // the line going through ti.p in the direction ti.dir
-void KDtree::Node::find_closest_to_ray(KDtree::Node::Traversal_Info &ti) const
+void KDtree::find_closest_to_ray(int n, Traversal_Info &ti) const
 {
+  const Node &node = nodes[n];
+
   // Leaf nodes
-  if (npts) {
-    for (int i = 0; i < npts; i++) {
-      float myd2 = dist2ray2(leaf.p[i], ti.p, ti.dir);
+  if (node.is_leaf()) {
+    const float *p = &pts[3 * node.begin];
+    for (int i = 0; i < node.npts; i++, p += 3) {
+      float myd2 = dist2ray2(p, ti.p, ti.dir);
+      const int id = order[node.begin + i];
       if ((myd2 < ti.closest_d2) &&
-          (!ti.iscompat || (*ti.iscompat)(leaf.p[i]))) {
+          (!ti.iscompat || (*ti.iscompat)(ptlist + 3 * id))) {
         ti.closest_d2 = myd2;
         ti.closest_d = sqrt(ti.closest_d2);
-        ti.closest = leaf.p[i];
+        ti.closest = id;
       }
     }
     return;
   }
-  
-  
+
+
   // Check whether to abort
   if (dist2ray2(node.center, ti.p, ti.dir) >= sqr(node.r + ti.closest_d))
     return;
-  
+
   // Recursive case
   if (ti.p[node.splitaxis] < node.center[node.splitaxis] ) {
-    node.child1->find_closest_to_ray(ti);
-    node.child2->find_closest_to_ray(ti);
+    find_closest_to_ray(n + 1, ti);
+    find_closest_to_ray(node.child2, ti);
   } else {
-    node.child2->find_closest_to_ray(ti);
-    node.child1->find_closest_to_ray(ti);
+    find_closest_to_ray(node.child2, ti);
+    find_closest_to_ray(n + 1, ti);
   }
 }
 
 
 // Create a KDtree from a list of points (i.e., ptlist is a list of 3*n floats)
-void KDtree::build(const float *ptlist, int n)
+void KDtree::build(const float *ptlist_, int n)
 {
-  vector<const float *> pts(n);
+  ptlist = ptlist_;
+  if (n <= 0)
+    return;
+
+  order.resize(n);
   for (int i = 0; i < n; i++)
-    pts[i] = ptlist + i * 3;
-  
-  root = new Node(&(pts[0]), n);
+    order[i] = i;
+
+  // A tree with leaves of at least half capacity has fewer than
+  // 4n/MAX_PTS_PER_NODE nodes.
+  nodes.reserve(4 * n / Node::MAX_PTS_PER_NODE + 1);
+  build_node(0, n);
+
+  pts.resize(3 * n);
+  for (int i = 0; i < n; i++)
+    memcpy(&pts[3 * i], ptlist + 3 * order[i], 3 * sizeof(float));
 }
 
 
 // Delete a KDtree
 KDtree::~KDtree()
 {
-  delete root;
 }
 
 
-// Return the closest point in the KD tree to p
-const float *KDtree::closest_to_pt(const float *p, float maxdist2 /* = 0.0f */,
-				   const CompatFunc *iscompat /* = NULL */) const
+float KDtree::default_maxdist2(float maxdist2) const
 {
-  Node::Traversal_Info ti;
-  
+  if (maxdist2 <= 0.0f)
+    maxdist2 = sqr(nodes[0].r);
+  return maxdist2;
+}
+
+
+// Return the index of the closest point in the KD tree to p
+int KDtree::closest_index(const float *p, float maxdist2 /* = 0.0f */,
+                          float *dist2 /* = NULL */,
+                          const CompatFunc *iscompat /* = NULL */) const
+{
+  if (nodes.empty())
+    return -1;
+
+  Traversal_Info ti;
+
   ti.p = p;
   ti.iscompat = iscompat;
-  ti.closest = NULL;
-  if (maxdist2 <= 0.0f)
-    maxdist2 = sqr(root->node.r);
-  ti.closest_d2 = maxdist2;
+  ti.closest = -1;
+  ti.closest_d2 = default_maxdist2(maxdist2);
   ti.closest_d = sqrt(ti.closest_d2);
-  
-  root->find_closest_to_pt(ti);
-  
+
+  find_closest_to_pt(0, ti);
+
+  if (dist2)
+    *dist2 = ti.closest_d2;
   return ti.closest;
 }
 
 
+// Find the k nearest neighbors, as indices and squared distances
+void KDtree::find_k_closest(const float *p,
+                            int k,
+                            std::vector<int> &indices,
+                            std::vector<float> &dist2s,
+                            float maxdist2 /* = 0.0f */,
+                            Scratch *scratch /* = NULL */,
+                            const CompatFunc *iscompat /* = NULL */) const
+{
+  indices.clear();
+  dist2s.clear();
+  if (nodes.empty() || k <= 0)
+    return;
+
+  Scratch local_scratch;
+  if (!scratch)
+    scratch = &local_scratch;
+
+  Traversal_Info ti;
+
+  ti.p = p;
+  ti.iscompat = iscompat;
+  ti.closest = -1;
+  ti.closest_d2 = default_maxdist2(maxdist2);
+  ti.closest_d = sqrt(ti.closest_d2);
+  ti.k = k;
+  ti.knn = &scratch->heap;
+  ti.knn->clear();
+  ti.knn->reserve(k+1);
+
+  find_k_closest_to_pt(0, ti);
+
+  sort_heap(ti.knn->begin(), ti.knn->end());
+  const size_t found = ti.knn->size();
+  indices.resize(found);
+  dist2s.resize(found);
+  for (size_t i = 0; i < found; i++) {
+    dist2s[i] = (*ti.knn)[i].first;
+    indices[i] = (*ti.knn)[i].second;
+  }
+}
+
+
+// Find every point within sqrt(radius2)
+void KDtree::find_within_radius(const float *p,
+                                float radius2,
+                                std::vector<int> &indices,
+                                std::vector<float> &dist2s,
+                                Scratch *scratch /* = NULL */) const
+{
+  indices.clear();
+  dist2s.clear();
+  if (nodes.empty() || radius2 < 0.0f)
+    return;
+
+  Scratch local_scratch;
+  if (!scratch)
+    scratch = &local_scratch;
+
+  Traversal_Info ti;
+
+  ti.p = p;
+  ti.iscompat = NULL;
+  ti.closest = -1;
+  ti.closest_d2 = radius2;
+  ti.closest_d = sqrt(radius2);
+  ti.knn = &scratch->heap;
+  ti.knn->clear();
+
+  find_within_radius(0, ti);
+
+  sort(ti.knn->begin(), ti.knn->end());
+  const size_t found = ti.knn->size();
+  indices.resize(found);
+  dist2s.resize(found);
+  for (size_t i = 0; i < found; i++) {
+    dist2s[i] = (*ti.knn)[i].first;
+    indices[i] = (*ti.knn)[i].second;
+  }
+}
+
+
+// Batch kNN, one scratch buffer per worker
+void KDtree::find_k_closest_batch(const float *queries,
+                                  int nqueries,
+                                  int k,
+                                  std::vector<int> &indices,
+                                  std::vector<float> &dist2s,
+                                  float maxdist2 /* = 0.0f */,
+                                  int num_threads /* = 0 */) const
+{
+  indices.assign((size_t) max(0, nqueries) * max(0, k), -1);
+  dist2s.assign(indices.size(), numeric_limits<float>::max());
+  if (nqueries <= 0 || k <= 0)
+    return;
+
+  // Queries are split into contiguous chunks so that each chunk owns
+  // its scratch and result vectors.
+  const int num_chunks = min(nqueries, GetNumThreads(num_threads));
+  const int chunk = (nqueries + num_chunks - 1) / num_chunks;
+  ParallelFor(0, num_chunks, [&](const int c) {
+      Scratch scratch;
+      vector<int> knn_indices;
+      vector<float> knn_dist2s;
+      const int end = min(nqueries, (c + 1) * chunk);
+      for (int q = c * chunk; q < end; ++q) {
+        find_k_closest(queries + 3 * q, k, knn_indices, knn_dist2s,
+                       maxdist2, &scratch);
+        copy(knn_indices.begin(), knn_indices.end(),
+             indices.begin() + (size_t) q * k);
+        copy(knn_dist2s.begin(), knn_dist2s.end(),
+             dist2s.begin() + (size_t) q * k);
+      }
+    }, num_chunks);
+}
+
+
+// Batch radius search. Each worker fills a local CSR block, and the
+// blocks are concatenated in query order.
+void KDtree::find_within_radius_batch(const float *queries,
+                                      int nqueries,
+                                      float radius2,
+                                      std::vector<int> &offsets,
+                                      std::vector<int> &indices,
+                                      std::vector<float> &dist2s,
+                                      int num_threads /* = 0 */) const
+{
+  offsets.assign(max(0, nqueries) + 1, 0);
+  indices.clear();
+  dist2s.clear();
+  if (nqueries <= 0)
+    return;
+
+  const int num_chunks = min(nqueries, GetNumThreads(num_threads));
+  const int chunk = (nqueries + num_chunks - 1) / num_chunks;
+  vector<vector<int> > chunk_indices(num_chunks);
+  vector<vector<float> > chunk_dist2s(num_chunks);
+  ParallelFor(0, num_chunks, [&](const int c) {
+      Scratch scratch;
+      vector<int> found_indices;
+      vector<float> found_dist2s;
+      const int end = min(nqueries, (c + 1) * chunk);
+      for (int q = c * chunk; q < end; ++q) {
+        find_within_radius(queries + 3 * q, radius2,
+                           found_indices, found_dist2s, &scratch);
+        // Store the count for now; turned into offsets below.
+        offsets[q + 1] = found_indices.size();
+        chunk_indices[c].insert(chunk_indices[c].end(),
+                                found_indices.begin(), found_indices.end());
+        chunk_dist2s[c].insert(chunk_dist2s[c].end(),
+                               found_dist2s.begin(), found_dist2s.end());
+      }
+    }, num_chunks);
+
+  for (int q = 0; q < nqueries; ++q)
+    offsets[q + 1] += offsets[q];
+  indices.reserve(offsets[nqueries]);
+  dist2s.reserve(offsets[nqueries]);
+  for (int c = 0; c < num_chunks; ++c) {
+    indices.insert(indices.end(),
+                   chunk_indices[c].begin(), chunk_indices[c].end());
+    dist2s.insert(dist2s.end(),
+                  chunk_dist2s[c].begin(), chunk_dist2s[c].end());
+  }
+}
+
+
+// Return the closest point in the KD tree to p
+const float *KDtree::closest_to_pt(const float *p, float maxdist2 /* = 0.0f */,
+                                   const CompatFunc *iscompat /* = NULL */) const
+{
+  const int index = closest_index(p, maxdist2, NULL, iscompat);
+  return index < 0 ? NULL : ptlist + 3 * index;
+}
+
+
 // Return the closest point in the KD tree to the line
 // going through p in the direction dir
 const float *KDtree::closest_to_ray(const float *p, const float *dir,
-				    float maxdist2 /* = 0.0f */,
-				    const CompatFunc *iscompat /* = NULL */) const
+                                    float maxdist2 /* = 0.0f */,
+                                    const CompatFunc *iscompat /* = NULL */) const
 {
-  Node::Traversal_Info ti;
-  
+  if (nodes.empty())
+    return NULL;
+
+  Traversal_Info ti;
+
   float one_over_dir_len = 1.0f / sqrt(sqr(dir[0])+sqr(dir[1])+sqr(dir[2]));
-  float normalized_dir[3] = { dir[0] * one_over_dir_len, 
-                              dir[1] * one_over_dir_len, 
+  float normalized_dir[3] = { dir[0] * one_over_dir_len,
+                              dir[1] * one_over_dir_len,
                               dir[2] * one_over_dir_len };
   ti.dir = normalized_dir;
   ti.p = p;
   ti.iscompat = iscompat;
-  ti.closest = NULL;
-  if (maxdist2 <= 0.0f)
-    maxdist2 = sqr(root->node.r);
-  ti.closest_d2 = maxdist2;
+  ti.closest = -1;
+  ti.closest_d2 = default_maxdist2(maxdist2);
   ti.closest_d = sqrt(ti.closest_d2);
-  
-  root->find_closest_to_ray(ti);
-  
-  return ti.closest;
+
+  find_closest_to_ray(0, ti);
+
+  return ti.closest < 0 ? NULL : ptlist + 3 * ti.closest;
 }
 
 
 // Find the k nearest neighbors
 void KDtree::find_k_closest_to_pt(std::vector<const float *> &knn,
-				  int k,
-				  const float *p,
-				  float maxdist2 /* = 0.0f */,
-				  const CompatFunc *iscompat /* = NULL */) const
+                                  int k,
+                                  const float *p,
+                                  float maxdist2 /* = 0.0f */,
+                                  const CompatFunc *iscompat /* = NULL */) const
 {
-  Node::Traversal_Info ti;
-  
-  ti.p = p;
-  ti.iscompat = iscompat;
-  ti.closest = NULL;
-  if (maxdist2 <= 0.0f)
-    maxdist2 = sqr(root->node.r);
-  ti.closest_d2 = maxdist2;
-  ti.closest_d = sqrt(ti.closest_d2);
-  ti.k = k;
-  ti.knn.reserve(k+1);
-  
-  root->find_k_closest_to_pt(ti);
-  
-  size_t found = ti.knn.size();
-  if (!found) {
-    knn.clear();
-    return;
-  }
-  
-  knn.resize(found);
-  sort_heap(ti.knn.begin(), ti.knn.end());
-  for (size_t i = 0; i < found; i++)
-    knn[i] = ti.knn[i].second;
-}
+  vector<int> indices;
+  vector<float> dist2s;
+  find_k_closest(p, k, indices, dist2s, maxdist2, NULL, iscompat);
 
+  knn.resize(indices.size());
+  for (size_t i = 0; i < indices.size(); i++)
+    knn[i] = ptlist + 3 * indices[i];
+}
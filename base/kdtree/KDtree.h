@@ -5,19 +5,68 @@ Szymon Rusinkiewicz
 Princeton University
 
 KDtree.h
-A K-D tree for points, with limited capabilities (find nearest point to 
-a given point, or to a ray). 
+A K-D tree for points, with limited capabilities (find nearest point to
+a given point, or to a ray).
 
 Note that in order to be generic, this *doesn't* use Vecs and the like...
+
+Nodes live in a flat per-instance array (no class-static pool), and
+queries never touch shared mutable state, so several trees can be
+built in parallel and one tree can be queried from many threads.
+The index-based queries return the position of a point in the input
+array (i.e., the point is ptlist[3 * index .. 3 * index + 2]) and its
+squared distance. The pointer-returning queries are kept for old code.
+
+< Example >
+
+KDtree kdtree(point_data);   // point_data holds 3 * n floats.
+vector<int> indices;
+vector<float> dist2s;
+kdtree.find_k_closest(&query[0], 10, indices, dist2s);
+
+// All queries at once, 10 results per query, -1 padded.
+kdtree.find_k_closest_batch(&point_data[0], n, 10, indices, dist2s);
 */
 
+#include <utility>
 #include <vector>
 
 class KDtree {
 private:
-	class Node;
-	Node *root;
+	// Nodes are stored by value in a flat array.
+	struct Node {
+		enum { MAX_PTS_PER_NODE = 7 };
+
+		float center[3];
+		float r;
+		int splitaxis;
+		// Interior nodes: index of the second child (the first
+		// child is the next node). Leaves: -1.
+		int child2;
+		// Range in pts / order.
+		int begin, npts;
+
+		bool is_leaf() const { return child2 < 0; }
+	};
+	struct Traversal_Info;
+
+	// Caller-owned point array (3 floats per point).
+	const float *ptlist;
+	// Points copied in leaf order for locality. pts[3*i..3*i+2] is
+	// the point ptlist[3*order[i]..].
+	std::vector<float> pts;
+	std::vector<int> order;
+	// nodes[0] is the root. An interior node's first child directly
+	// follows it.
+	std::vector<Node> nodes;
+
 	void build(const float *ptlist, int n);
+	int build_node(int begin, int n);
+	void find_closest_to_pt(int node, Traversal_Info &ti) const;
+	void find_k_closest_to_pt(int node, Traversal_Info &ti) const;
+	void find_within_radius(int node, Traversal_Info &ti) const;
+	void find_closest_to_ray(int node, Traversal_Info &ti) const;
+	float default_maxdist2(float maxdist2) const;
 
 public:
 	// Compatibility function for closest-compatible-point searches
@@ -27,32 +76,84 @@ public:
 		virtual ~CompatFunc() {}  // To make the compiler shut up
 	};
 
+	// Buffers reused across queries. Keep one per thread to make
+	// repeated single queries allocation free.
+	struct Scratch
+	{
+		std::vector<std::pair<float, int> > heap;
+	};
+
 	// Constructor from an array of points
 	KDtree(const float *ptlist, int n)
 		{ build(ptlist, n); }
 
 	// Constructor from a vector of points
 	template <class T> KDtree(const std::vector<T> &v)
-		{ build((const float *) &v[0], v.size() / 3); }
+		{ build(v.empty() ? (const float *) 0 : (const float *) &v[0],
+		        v.size() / 3); }
 
-	// Destructor - recursively frees the tree
 	~KDtree();
 
-	// The queries: returns closest point to a point or a ray,
+	int size() const { return (int) order.size(); }
+
+	// The index queries. Return -1 or nothing when no point lies
+	// within sqrt(maxdist2) (the whole tree if maxdist2 <= 0).
+	int closest_index(const float *p,
+			  float maxdist2 = 0.0f,
+			  float *dist2 = 0,
+			  const CompatFunc *iscompat = 0) const;
+
+	// k nearest neighbors sorted by increasing distance.
+	void find_k_closest(const float *p,
+			    int k,
+			    std::vector<int> &indices,
+			    std::vector<float> &dist2s,
+			    float maxdist2 = 0.0f,
+			    Scratch *scratch = 0,
+			    const CompatFunc *iscompat = 0) const;
+
+	// All points within sqrt(radius2), sorted by increasing distance.
+	void find_within_radius(const float *p,
+				float radius2,
+				std::vector<int> &indices,
+				std::vector<float> &dist2s,
+				Scratch *scratch = 0) const;
+
+	// Batch queries over 3 * nqueries floats, split over num_threads
+	// workers (all cores if <= 0).
+	// kNN output is nqueries x k, row-major, padded with index -1.
+	void find_k_closest_batch(const float *queries,
+				  int nqueries,
+				  int k,
+				  std::vector<int> &indices,
+				  std::vector<float> &dist2s,
+				  float maxdist2 = 0.0f,
+				  int num_threads = 0) const;
+	// Radius output is CSR: the results of query q are
+	// indices[offsets[q] .. offsets[q + 1]).
+	void find_within_radius_batch(const float *queries,
+				      int nqueries,
+				      float radius2,
+				      std::vector<int> &offsets,
+				      std::vector<int> &indices,
+				      std::vector<float> &dist2s,
+				      int num_threads = 0) const;
+
+	// The pointer queries: returns closest point to a point or a ray,
 	// provided it's within sqrt(maxdist2) and is compatible
 	const float *closest_to_pt(const float *p,
 				   float maxdist2 = 0.0f,
-				   const CompatFunc *iscompat = NULL) const;
+				   const CompatFunc *iscompat = 0) const;
 	const float *closest_to_ray(const float *p, const float *dir,
 				    float maxdist2 = 0.0f,
-				    const CompatFunc *iscompat = NULL) const;
+				    const CompatFunc *iscompat = 0) const;
 
 	// Find the k nearest neighbors
 	void find_k_closest_to_pt(std::vector<const float *> &knn,
 				  int k,
 				  const float *p,
 				  float maxdist2 = 0.0f,
-				  const CompatFunc *iscompat = NULL) const;
+				  const CompatFunc *iscompat = 0) const;
 };
 
 #endif
@@ -6,6 +6,7 @@
 #include <algorithm>
 #include "vec.h"
 #include "mat.h"
+#include "sparseMatKernels.h"
 
 template <class T> class CcooMat;
 template <class T> class CdenseMat;
@@ -41,6 +42,9 @@ class CsparseMat: public Cmat {
   // get and set functions
   //----------------------------------------------------------------------
   T get(const int i, const int j) const;
+
+  // CSR arrays without a copy, for the kernels in sparseMatKernels.h.
+  CcsrView<T> view(void) const;
   
   //----------------------------------------------------------------------
   // print out matrix in a full format (you'll see lots of zeros)
@@ -73,6 +77,9 @@ class CsparseMat: public Cmat {
   
   // mat vec
   Cvec<T> operator*(const Cvec<T>& vec) const;
+  // ans = this * vec without a temporary. ans must have getRow()
+  // elements. Rows are split over num_threads workers.
+  void multiply(const Cvec<T>& vec, Cvec<T>& ans, const int num_threads = 1) const;
   // mat mat
   CsparseMat& operator*=(const CsparseMat& rhs);
   CsparseMat operator*(const CsparseMat& rhs) const;
@@ -291,6 +298,17 @@ T CsparseMat<T>::get(const int i, const int j) const {
     return m_val[pos - m_colind.begin()];  
 };
 
+template <class T>
+CcsrView<T> CsparseMat<T>::view(void) const {
+  CcsrView<T> ans;
+  ans.m_row = m_row;
+  ans.m_col = m_col;
+  ans.m_rowind = m_rowind.data();
+  ans.m_colind = m_colind.data();
+  ans.m_val = m_val.data();
+  return ans;
+};
+
 #include "sparseMatSolve.h"
 #include "sparseMatAlgebra.h"
 
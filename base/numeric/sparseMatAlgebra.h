@@ -190,18 +190,20 @@ Cvec<T> CsparseMat<T>::operator*(const Cvec<T>& vec) const{
   Cvec<T> ans;
   // resize ans vector
   ans.resize(getRow());
+  spmv(view(), vec.data(), ans.data());
+  return ans;
+};
 
-  for (int r = 0; r < ans.size(); ++r) {
-    ans[r] = 0.0;
-
-    const int beg = m_rowind[r];
-    const int end = m_rowind[r+1];
-    for (int i = beg; i < end; ++i) {
-      const int col = m_colind[i];
-      ans[r] += vec[col] * m_val[i];
-    }
+template <class T>
+void CsparseMat<T>::multiply(const Cvec<T>& vec, Cvec<T>& ans, const int num_threads) const {
+#ifdef FURUKAWA_DEBUG
+  if (getCol() != vec.size() || getRow() != ans.size()) {
+    std::cerr << "Invalid matrix vector sizes: " << getRow() << ' ' << getCol()
+	      << ' ' << vec.size() << ' ' << ans.size() << std::endl;
+    exit (1);
   }
-  return ans;
+#endif
+  spmv(view(), vec.data(), ans.data(), num_threads);
 };
 
 template <class T>
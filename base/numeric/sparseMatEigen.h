@@ -0,0 +1,80 @@
+#ifndef NUMERIC_SPARSEMATEIGEN_H
+#define NUMERIC_SPARSEMATEIGEN_H
+
+#include <cstdlib>
+#include <iostream>
+#include <Eigen/Sparse>
+#include "sparseMat.h"
+
+//======================================================================
+// Adapters between the numeric module and Eigen
+//
+// Matrices and vectors are viewed in place: no data is copied, and a
+// view is valid as long as the viewed object is alive and not
+// resized. This lets the pipeline assemble systems with Eigen
+// (setFromTriplets) and solve them with the parallel kernels, or hand
+// a CsparseMat to an Eigen direct solver.
+//
+// < Example >
+//
+// Eigen::SparseMatrix<double, Eigen::RowMajor> A(n, n);
+// A.setFromTriplets(triplets.begin(), triplets.end());
+// CsolverWorkspace<double> workspace;
+// PCG(makeCsrView(A), b.data(), x.data(), 1e-6, 1000, workspace, 0);
+//
+// CsparseMat<double> B;
+// ...
+// Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > ldlt(toEigen(B));
+//======================================================================
+
+template <class T>
+Eigen::Map<const Eigen::SparseMatrix<T, Eigen::RowMajor, int> >
+toEigen(const CsparseMat<T>& A) {
+  return Eigen::Map<const Eigen::SparseMatrix<T, Eigen::RowMajor, int> >
+    (A.getRow(), A.getCol(), (int)A.m_val.size(),
+     A.m_rowind.data(), A.m_colind.data(), A.m_val.data());
+};
+
+template <class T>
+Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, 1> > toEigen(Cvec<T>& v) {
+  return Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, 1> >(v.data(), v.size());
+};
+
+template <class T>
+Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, 1> > toEigen(const Cvec<T>& v) {
+  return Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, 1> >(v.data(), v.size());
+};
+
+// A row major Eigen matrix is CSR already. It must be compressed
+// (call makeCompressed() after insert()/coeffRef()).
+template <class T>
+CcsrView<T> makeCsrView(const Eigen::SparseMatrix<T, Eigen::RowMajor, int>& A) {
+  if (!A.isCompressed()) {
+    std::cerr << "makeCsrView needs a compressed matrix" << std::endl;    exit (1);
+  }
+  CcsrView<T> ans;
+  ans.m_row = (int)A.rows();
+  ans.m_col = (int)A.cols();
+  ans.m_rowind = A.outerIndexPtr();
+  ans.m_colind = A.innerIndexPtr();
+  ans.m_val = A.valuePtr();
+  return ans;
+};
+
+// A column major matrix read as CSR is its transpose. For symmetric
+// matrices (normal equations, Laplacians), that is the matrix itself.
+template <class T>
+CcsrView<T> makeCsrViewOfTranspose(const Eigen::SparseMatrix<T, Eigen::ColMajor, int>& A) {
+  if (!A.isCompressed()) {
+    std::cerr << "makeCsrViewOfTranspose needs a compressed matrix" << std::endl;    exit (1);
+  }
+  CcsrView<T> ans;
+  ans.m_row = (int)A.cols();
+  ans.m_col = (int)A.rows();
+  ans.m_rowind = A.outerIndexPtr();
+  ans.m_colind = A.innerIndexPtr();
+  ans.m_val = A.valuePtr();
+  return ans;
+};
+
+#endif // SPARSEMATEIGEN_H
@@ -0,0 +1,100 @@
+#ifndef NUMERIC_SPARSEMATKERNELS_H
+#define NUMERIC_SPARSEMATKERNELS_H
+
+#include <algorithm>
+#include <vector>
+#include "../parallel.h"
+
+//======================================================================
+// Row-parallel kernels on CSR arrays
+//
+// They work on raw pointers, so that CsparseMat, Cvec and Eigen
+// storage (see sparseMatEigen.h) share them without copies. Rows are
+// split into fixed blocks, and reductions are summed block by block in
+// order, so results do not depend on the number of threads.
+//
+// num_threads follows base/parallel.h (<= 0 means all cores). Systems
+// of a single block always run on the calling thread.
+//======================================================================
+
+// Read-only CSR matrix. Does not own the arrays.
+template <class T>
+struct CcsrView {
+  int m_row;
+  int m_col;
+  const int* m_rowind;
+  const int* m_colind;
+  const T* m_val;
+};
+
+const int kCsrBlockSize = 4096;
+
+inline int csrNumBlocks(const int n) {
+  return (n + kCsrBlockSize - 1) / kCsrBlockSize;
+}
+
+// Calls func(begin, end, block) for the row blocks of [0, n).
+template <class Function>
+void csrForEachBlock(const int n, const Function& func, const int num_threads) {
+  const int num_blocks = csrNumBlocks(n);
+  structured_indoor_modeling::ParallelFor(0, num_blocks, [&](const int block) {
+      const int begin = block * kCsrBlockSize;
+      func(begin, std::min(n, begin + kCsrBlockSize), block);
+    }, num_blocks < 2 ? 1 : num_threads);
+}
+
+// Sum of the per block partial results.
+template <class T>
+T csrSumBlocks(const std::vector<T>& partial, const int n) {
+  T sum = 0.0;
+  for (int b = 0; b < csrNumBlocks(n); ++b)
+    sum += partial[b];
+  return sum;
+}
+
+// y = A x
+template <class T>
+void spmv(const CcsrView<T>& A, const T* x, T* y, const int num_threads = 1) {
+  csrForEachBlock(A.m_row, [&](const int begin, const int end, const int) {
+      for (int r = begin; r < end; ++r) {
+	T ans = 0.0;
+	for (int i = A.m_rowind[r]; i < A.m_rowind[r+1]; ++i)
+	  ans += A.m_val[i] * x[A.m_colind[i]];
+	y[r] = ans;
+      }
+    }, num_threads);
+};
+
+// y = A x, and returns x * y. partial needs csrNumBlocks(A.m_row)
+// elements.
+template <class T>
+T spmvDot(const CcsrView<T>& A, const T* x, T* y, std::vector<T>& partial,
+	  const int num_threads = 1) {
+  csrForEachBlock(A.m_row, [&](const int begin, const int end, const int block) {
+      T sum = 0.0;
+      for (int r = begin; r < end; ++r) {
+	T ans = 0.0;
+	for (int i = A.m_rowind[r]; i < A.m_rowind[r+1]; ++i)
+	  ans += A.m_val[i] * x[A.m_colind[i]];
+	y[r] = ans;
+	sum += ans * x[r];
+      }
+      partial[block] = sum;
+    }, num_threads);
+  return csrSumBlocks(partial, A.m_row);
+};
+
+// Returns x * y. partial needs csrNumBlocks(n) elements.
+template <class T>
+T dot(const int n, const T* x, const T* y, std::vector<T>& partial,
+      const int num_threads = 1) {
+  csrForEachBlock(n, [&](const int begin, const int end, const int block) {
+      T sum = 0.0;
+      for (int i = begin; i < end; ++i)
+	sum += x[i] * y[i];
+      partial[block] = sum;
+    }, num_threads);
+  return csrSumBlocks(partial, n);
+};
+
+#endif // SPARSEMATKERNELS_H
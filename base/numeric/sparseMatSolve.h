@@ -1,7 +1,9 @@
 #ifndef NUMERIC_SPARSEMATSOLVE_H
 #define NUMERIC_SPARSEMATSOLVE_H
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 template <class T>
 void wJacobi(const CsparseMat<T>& A, const Cvec<T>& b, Cvec<T>& x,
@@ -38,6 +40,47 @@ void CG(const CsparseMat<T>& A, const Cvec<T>& b, Cvec<T>& x,
 	const T rtol, const int maxit, int& iter,
 	std::vector<T>& res);
 
+// Preallocated temporaries of the allocation-free solvers below. Keep
+// one workspace around and reuse it for repeated solves (e.g., one
+// per color channel); nothing is allocated once it has grown to the
+// system size.
+template <class T>
+class CsolverWorkspace {
+ public:
+  void reserve(const int n);
+
+  std::vector<T> m_r;
+  std::vector<T> m_z;
+  std::vector<T> m_p;
+  std::vector<T> m_ap;
+  std::vector<T> m_invdiag;
+  // per block partial sums (two reductions at a time)
+  std::vector<T> m_partial;
+};
+
+// Conjugate gradient for a symmetric positive definite A. x holds the
+// initial guess on input. Stops when |b - Ax| < rtol |b| or after
+// maxit iterations, and returns the number of iterations. Residual
+// norms are appended to res if given. Rows are split over num_threads
+// workers (see sparseMatKernels.h).
+template <class T>
+int CG(const CcsrView<T>& A, const T* b, T* x, const T rtol, const int maxit,
+       CsolverWorkspace<T>& workspace, const int num_threads = 1,
+       std::vector<T>* res = NULL);
+
+// Same with a Jacobi (diagonal) preconditioner. It costs one pass to
+// set up and helps when the diagonal varies, e.g., with data terms.
+template <class T>
+int PCG(const CcsrView<T>& A, const T* b, T* x, const T rtol, const int maxit,
+	CsolverWorkspace<T>& workspace, const int num_threads = 1,
+	std::vector<T>* res = NULL);
+
+// Weighted Jacobi: x <- x + omega D^{-1} (b - Ax). Unlike GaussSeidel,
+// rows are independent and updated in parallel.
+template <class T>
+void Jacobi(const CcsrView<T>& A, const T* b, T* x, const int iter, const T omega,
+	    CsolverWorkspace<T>& workspace, const int num_threads = 1);
+
 template <class T>
 void extractD(const CsparseMat<T>& A, CsparseMat<T>& D);
 
@@ -496,54 +539,148 @@ template <class T>
 void CG(const CsparseMat<T>& A, const Cvec<T>& b, Cvec<T>& x,
 	const T rtol, const int maxit, int& iter,
 	std::vector<T>& res) {
-  Cvec<T> r = b - A * x;
-  Cvec<T> p = r;
-  Cvec<T> ap;
+  CsolverWorkspace<T> workspace;
+  iter = CG(A.view(), b.data(), x.data(), rtol, maxit, workspace, 1, &res);
+};
 
-  const T normb = b.norm();
-  const T threshold = rtol * normb;
-  T oldrr = r * r;
-  
+template <class T>
+void CsolverWorkspace<T>::reserve(const int n) {
+  m_r.resize(n);
+  m_z.resize(n);
+  m_p.resize(n);
+  m_ap.resize(n);
+  m_invdiag.resize(n);
+  m_partial.resize(2 * csrNumBlocks(n));
+};
+
+// Inverse of the diagonal, 1 where it is missing or zero.
+template <class T>
+void extractInvDiag(const CcsrView<T>& A, std::vector<T>& invdiag,
+		    const int num_threads) {
+  csrForEachBlock(A.m_row, [&](const int begin, const int end, const int) {
+      for (int r = begin; r < end; ++r) {
+	invdiag[r] = 1.0;
+	for (int i = A.m_rowind[r]; i < A.m_rowind[r+1]; ++i) {
+	  if (A.m_colind[i] == r && A.m_val[i] != 0.0)
+	    invdiag[r] = 1.0 / A.m_val[i];
+	}
+      }
+    }, num_threads);
+};
+
+template <class T>
+int CGSub(const CcsrView<T>& A, const T* b, T* x, const T rtol, const int maxit,
+	  const bool precondition, CsolverWorkspace<T>& workspace,
+	  const int num_threads, std::vector<T>* res) {
+  const int n = A.m_row;
+  workspace.reserve(n);
+  T* r = workspace.m_r.data();
+  T* z = workspace.m_z.data();
+  T* p = workspace.m_p.data();
+  T* ap = workspace.m_ap.data();
+  T* invdiag = workspace.m_invdiag.data();
+  std::vector<T>& partial = workspace.m_partial;
+  const int num_blocks = csrNumBlocks(n);
+
+  if (precondition)
+    extractInvDiag(A, workspace.m_invdiag, num_threads);
+  else
+    std::fill(workspace.m_invdiag.begin(), workspace.m_invdiag.end(), 1.0);
+
+  // r = b - Ax, z = D^{-1} r, p = z
+  spmv(A, x, ap, num_threads);
+  csrForEachBlock(n, [&](const int begin, const int end, const int block) {
+      T rz = 0.0, rr = 0.0;
+      for (int i = begin; i < end; ++i) {
+	r[i] = b[i] - ap[i];
+	z[i] = invdiag[i] * r[i];
+	p[i] = z[i];
+	rz += r[i] * z[i];
+	rr += r[i] * r[i];
+      }
+      partial[block] = rz;
+      partial[num_blocks + block] = rr;
+    }, num_threads);
+  T rz = 0.0, rr = 0.0;
+  for (int block = 0; block < num_blocks; ++block) {
+    rz += partial[block];
+    rr += partial[num_blocks + block];
+  }
+  const T threshold = rtol * sqrt(dot(n, b, b, partial, num_threads));
+
+  int iter;
   for (iter = 0; iter < maxit; ++iter) {
-    //???? Outputting A norm
-    Cvec<T> ans;
-    ans.resize(x.size);
-    for (int i = 0; i < x.size(); ++i)
-      ans[i] = 1.0 / A.get(i, i);    
-    ans -= x;
-    std::cerr << sqrt((A * ans) * ans) << ' ';
-    //????
-    
-    const T residual = sqrt(oldrr);
-    res.push_back(residual);
-    if (residual < threshold)
-      break;
-    
-    ap = A * p;
-    const T app = ap * p;
-    if (app == 0.0 || oldrr == 0.0)
+    const T residual = sqrt(rr);
+    if (res != NULL)
+      res->push_back(residual);
+    if (residual <= threshold)
       break;
-    
-    const T alpha = oldrr / app;
 
-    x += alpha * p;
-    r -= alpha * ap;
+    const T pap = spmvDot(A, p, ap, partial, num_threads);
+    if (pap <= 0.0 || rz == 0.0)
+      break;
+    const T alpha = rz / pap;
+
+    // x += alpha p, r -= alpha Ap, z = D^{-1} r in one pass.
+    csrForEachBlock(n, [&](const int begin, const int end, const int block) {
+	T rz = 0.0, rr = 0.0;
+	for (int i = begin; i < end; ++i) {
+	  x[i] += alpha * p[i];
+	  r[i] -= alpha * ap[i];
+	  z[i] = invdiag[i] * r[i];
+	  rz += r[i] * z[i];
+	  rr += r[i] * r[i];
+	}
+	partial[block] = rz;
+	partial[num_blocks + block] = rr;
+      }, num_threads);
+    T newrz = 0.0;
+    rr = 0.0;
+    for (int block = 0; block < num_blocks; ++block) {
+      newrz += partial[block];
+      rr += partial[num_blocks + block];
+    }
 
-    const T newrr = r * r;
-    const T beta = newrr / oldrr;
-    p = r + beta * p;
-    oldrr = newrr;
+    const T beta = newrz / rz;
+    csrForEachBlock(n, [&](const int begin, const int end, const int) {
+	for (int i = begin; i < end; ++i)
+	  p[i] = z[i] + beta * p[i];
+      }, num_threads);
+    rz = newrz;
   }
+  return iter;
+};
 
+template <class T>
+int CG(const CcsrView<T>& A, const T* b, T* x, const T rtol, const int maxit,
+       CsolverWorkspace<T>& workspace, const int num_threads,
+       std::vector<T>* res) {
+  return CGSub(A, b, x, rtol, maxit, false, workspace, num_threads, res);
+};
+
+template <class T>
+int PCG(const CcsrView<T>& A, const T* b, T* x, const T rtol, const int maxit,
+	CsolverWorkspace<T>& workspace, const int num_threads,
+	std::vector<T>* res) {
+  return CGSub(A, b, x, rtol, maxit, true, workspace, num_threads, res);
+};
 
-  //???? Outputting A norm  
-  Cvec<T> ans;
-  ans.resize(x.size());
-  for (int i = 0; i < x.size(); ++i)
-    ans[i] = 1.0 / A.get(i, i);    
-  ans -= x;
-  std::cerr << sqrt((A * ans) * ans) << std::endl;
-  //????
+template <class T>
+void Jacobi(const CcsrView<T>& A, const T* b, T* x, const int iter, const T omega,
+	    CsolverWorkspace<T>& workspace, const int num_threads) {
+  const int n = A.m_row;
+  workspace.reserve(n);
+  extractInvDiag(A, workspace.m_invdiag, num_threads);
+  const T* invdiag = workspace.m_invdiag.data();
+  T* ax = workspace.m_ap.data();
+
+  for (int t = 0; t < iter; ++t) {
+    spmv(A, x, ax, num_threads);
+    csrForEachBlock(n, [&](const int begin, const int end, const int) {
+	for (int i = begin; i < end; ++i)
+	  x[i] += omega * invdiag[i] * (b[i] - ax[i]);
+      }, num_threads);
+  }
 };
 
 //======================================================================
@@ -668,7 +805,7 @@ void ILU0(const CsparseMat<T>& A, CsparseMat<T>& LDU) {
 	break;
       LDU.m_val[k] /= LDU.get(ktmp, ktmp);
       
-      for (int j = k+1; k < end; ++k) {
+      for (int j = k+1; j < end; ++j) {
 	const int jtmp = LDU.m_colind[j];
 	LDU.m_val[j] -= LDU.m_val[k] * LDU.get(ktmp, jtmp);
       }
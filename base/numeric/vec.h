@@ -1,6 +1,8 @@
 #ifndef NUMERIC_VEC_H
 #define NUMERIC_VEC_H
 
+#include <cmath>
+#include <cstddef>
 #include <iostream>
 #include <vector>
 
@@ -64,6 +66,9 @@ class Cvec {
   inline T& operator[](const int index);
   inline const T& operator[](const int index) const;
   inline int size(void) const;
+  // contiguous storage, e.g., for the sparse kernels or Eigen::Map
+  inline T* data(void);
+  inline const T* data(void) const;
   
   //----------------------------------------------------------------------
   // protected member variables
@@ -97,6 +102,16 @@ inline int Cvec<T>::size(void) const {
   return m_n;
 };
 
+template <class T>
+inline T* Cvec<T>::data(void) {
+  return m_val.empty() ? NULL : &m_val[0];
+};
+
+template <class T>
+inline const T* Cvec<T>::data(void) const {
+  return m_val.empty() ? NULL : &m_val[0];
+};
+
 template <class T>
 inline Cvec<T>& Cvec<T>::operator+=(const Cvec<T>& lhs) {
   for (int i = 0; i < m_n; ++i)
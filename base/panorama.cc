@@ -2,6 +2,7 @@
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "panorama.h"
+#include "tracing.h"
 
 using namespace Eigen;
 using namespace std;
@@ -333,6 +334,39 @@ void Panorama::Resize(const Eigen::Vector2i& size) {
   phi_per_depth_pixel = phi_range / depth_height;
 }
 
+void Panorama::BuildPyramids(const int num_levels,
+                             ImagePyramid* rgb_pyramid,
+                             ImagePyramid* depth_pyramid,
+                             const int num_threads) const {
+  rgb_pyramid->Build(rgb_image, num_levels,
+                     only_background_black ? ImagePyramid::kBlackHole : ImagePyramid::kNoHole,
+                     0.0, num_threads);
+  if (!depth_image.empty()) {
+    const double kInvalid = -1.0;
+    const cv::Mat depth(depth_height, depth_width, CV_64FC1,
+                        const_cast<double*>(&depth_image[0]));
+    depth_pyramid->Build(depth, num_levels, ImagePyramid::kValueHole, kInvalid, num_threads);
+  }
+}
+
+void Panorama::ResizeToLevel(const ImagePyramid& rgb_pyramid,
+                             const ImagePyramid& depth_pyramid,
+                             const int level) {
+  rgb_image = rgb_pyramid.GetLevel(level);
+  width  = rgb_image.cols;
+  height = rgb_image.rows;
+  phi_per_pixel = phi_range / height;
+
+  depth_width  = depth_width >> level;
+  depth_height = depth_height >> level;
+  if (level < depth_pyramid.GetNumLevels()) {
+    const cv::Mat depth = depth_pyramid.GetLevel(level);
+    const double* const data = depth.ptr<double>(0);
+    depth_image.assign(data, data + depth_width * depth_height);
+  }
+  phi_per_depth_pixel = phi_range / depth_height;
+}
+
 void Panorama::AdjustCenter(const Eigen::Vector3d& new_center) {
   const Vector3d translation = new_center - center;
   Matrix4d adjustment;
@@ -460,6 +494,7 @@ void Panorama::MakeOnlyBackgroundBlack() {
 // Utility functions.  
 void ReadPanoramas(const FileIO& file_io,
                    vector<Panorama>* panoramas) {
+  const ScopedTrace trace("ReadPanoramas");
   const int num_panoramas = GetNumPanoramas(file_io);
   panoramas->clear();
   panoramas->resize(num_panoramas);
@@ -487,6 +522,7 @@ void ReadPanoramasWithoutDepths(const FileIO& file_io,
 void ReadPanoramaPyramids(const FileIO& file_io,
                           const int num_levels,
                           std::vector<std::vector<Panorama> >* panorama_pyramids) {
+  const ScopedTrace trace("ReadPanoramaPyramids");
   const int num_panoramas = GetNumPanoramas(file_io);
 
   panorama_pyramids->clear();
@@ -494,16 +530,16 @@ void ReadPanoramaPyramids(const FileIO& file_io,
   cout << "Reading panorama_pyramids" << flush;
   for (int p = 0; p < num_panoramas; ++p) {
     cout << '.' << flush;
-    panorama_pyramids->at(p).resize(num_levels);
-    for (int level = 0; level < num_levels; ++level) {
-      panorama_pyramids->at(p)[level].Init(file_io, p);
-      panorama_pyramids->at(p)[level].MakeOnlyBackgroundBlack();
-      if (level != 0) {
-        const int new_width  = panorama_pyramids->at(p)[level].Width()  / (0x01 << level);
-        const int new_height = panorama_pyramids->at(p)[level].Height() / (0x01 << level);
-        panorama_pyramids->at(p)[level].Resize(Vector2i(new_width, new_height));
-      }
-    }
+    // Load once. All the levels of the RGB images share one buffer.
+    Panorama panorama;
+    panorama.Init(file_io, p);
+    panorama.MakeOnlyBackgroundBlack();
+    ImagePyramid rgb_pyramid, depth_pyramid;
+    panorama.BuildPyramids(num_levels, &rgb_pyramid, &depth_pyramid);
+
+    panorama_pyramids->at(p).resize(num_levels, panorama);
+    for (int level = 0; level < num_levels; ++level)
+      panorama_pyramids->at(p)[level].ResizeToLevel(rgb_pyramid, depth_pyramid, level);
   }
   cout << " done." << endl;
 }
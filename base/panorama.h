@@ -49,6 +49,7 @@
 #include <vector>
 
 #include "file_io.h"
+#include "image_pyramid.h"
 
 namespace structured_indoor_modeling {
 
@@ -96,6 +97,19 @@ public:
   // Shrink only and suggested for integer shrink ratio (e.g., making a width half or 1/3).
   void Resize(const Eigen::Vector2i& size);
 
+  // Pyramids of the RGB and depth images (holes are black pixels if
+  // MakeOnlyBackgroundBlack was called, and invalid depths).
+  void BuildPyramids(const int num_levels,
+                     ImagePyramid* rgb_pyramid,
+                     ImagePyramid* depth_pyramid,
+                     const int num_threads = 0) const;
+  // Same as Resize to 1 / 2^level of the size, with the images taken
+  // from the pyramids of this (full size) panorama. The RGB image is a
+  // view of the pyramid, not a copy.
+  void ResizeToLevel(const ImagePyramid& rgb_pyramid,
+                     const ImagePyramid& depth_pyramid,
+                     const int level);
+
   // void ReleaseMemory();
 
   // This function needs to be used very carefully. Adjust the center
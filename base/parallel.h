@@ -0,0 +1,86 @@
+/*
+  Minimal thread helpers shared by the pipeline. Work is split into
+  contiguous chunks and dispatched over std::thread, so no extra
+  dependency is needed.
+
+  < Example >
+
+  vector<double> values(num_points);
+  ParallelFor(0, num_points, [&](const int p) {
+    values[p] = Compute(p);
+  });
+
+  // Per-thread state: the second argument is the worker id in
+  // [0, GetNumThreads(num_threads)).
+  vector<Workspace> workspaces(GetNumThreads());
+  ParallelForWithThreadId(0, num_points, [&](const int p, const int thread) {
+    Compute(p, &workspaces[thread]);
+  });
+*/
+
+#ifndef BASE_PARALLEL_H_
+#define BASE_PARALLEL_H_
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace structured_indoor_modeling {
+
+// Returns the number of workers to use. A non-positive request means
+// "as many as the hardware has".
+inline int GetNumThreads(const int num_threads = 0) {
+  if (num_threads > 0)
+    return num_threads;
+  const int hardware = static_cast<int>(std::thread::hardware_concurrency());
+  return std::max(1, hardware);
+}
+
+// Calls func(index, thread) for every index in [begin, end). Each
+// worker gets one contiguous range, so per-thread buffers can be
+// indexed by "thread" without locking.
+template <typename Function>
+void ParallelForWithThreadId(const int begin,
+                             const int end,
+                             const Function& func,
+                             const int num_threads = 0) {
+  if (end <= begin)
+    return;
+  const int num_workers = std::min(GetNumThreads(num_threads), end - begin);
+  if (num_workers == 1) {
+    for (int i = begin; i < end; ++i)
+      func(i, 0);
+    return;
+  }
+
+  const int chunk = (end - begin + num_workers - 1) / num_workers;
+  std::vector<std::thread> threads;
+  threads.reserve(num_workers);
+  for (int t = 0; t < num_workers; ++t) {
+    const int chunk_begin = begin + t * chunk;
+    const int chunk_end = std::min(end, chunk_begin + chunk);
+    if (chunk_end <= chunk_begin)
+      break;
+    threads.push_back(std::thread([&func, chunk_begin, chunk_end, t]() {
+          for (int i = chunk_begin; i < chunk_end; ++i)
+            func(i, t);
+        }));
+  }
+  for (auto& thread : threads)
+    thread.join();
+}
+
+// Same as above without the worker id.
+template <typename Function>
+void ParallelFor(const int begin,
+                 const int end,
+                 const Function& func,
+                 const int num_threads = 0) {
+  ParallelForWithThreadId(begin, end,
+                          [&func](const int i, const int) { func(i); },
+                          num_threads);
+}
+
+}  // namespace structured_indoor_modeling
+
+#endif  // BASE_PARALLEL_H_
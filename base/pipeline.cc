@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+#include "parallel.h"
+#include "pipeline.h"
+#include "tracing.h"
+
+using namespace std;
+
+namespace structured_indoor_modeling {
+
+namespace {
+
+// Interval of the resident memory samples of the function stages.
+const int kRSSIntervalMs = 10;
+
+long ToKilobytes(const long max_rss) {
+#ifdef __APPLE__
+  // Bytes on OS X, kilobytes on Linux.
+  return max_rss / 1024;
+#else
+  return max_rss;
+#endif
+}
+
+// Runs command with /bin/sh and waits. posix_spawn does not copy the
+// page tables of this (large) process as fork would.
+bool RunCommand(const string& command, long* peak_rss_kb) {
+#ifdef _WIN32
+  *peak_rss_kb = -1;
+  return system(command.c_str()) == 0;
+#else
+  *peak_rss_kb = -1;
+  char* argv[] = { const_cast<char*>("sh"),
+                   const_cast<char*>("-c"),
+                   const_cast<char*>(command.c_str()),
+                   NULL };
+  pid_t pid;
+  if (posix_spawn(&pid, "/bin/sh", NULL, NULL, argv, environ) != 0) {
+    cerr << "Cannot run: " << command << endl;
+    return false;
+  }
+  int status;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) != pid)
+    return false;
+  *peak_rss_kb = ToKilobytes(usage.ru_maxrss);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
+}  // namespace
+
+void Pipeline::AddStage(const string& name,
+                        const vector<string>& dependencies,
+                        const function<bool()>& run) {
+  Stage stage;
+  stage.name = name;
+  stage.dependencies = dependencies;
+  stage.run = run;
+  stages.push_back(stage);
+}
+
+void Pipeline::AddCommandStage(const string& name,
+                               const vector<string>& dependencies,
+                               const string& command) {
+  Stage stage;
+  stage.name = name;
+  stage.dependencies = dependencies;
+  stage.command = command;
+  stages.push_back(stage);
+}
+
+bool Pipeline::Run(const int max_concurrent_stages, vector<StageReport>* reports) const {
+  const int num_stages = static_cast<int>(stages.size());
+  map<string, int> stage_ids;
+  for (int s = 0; s < num_stages; ++s) {
+    if (!stage_ids.insert(make_pair(stages[s].name, s)).second) {
+      cerr << "Duplicated stage: " << stages[s].name << endl;
+      exit (1);
+    }
+  }
+  vector<vector<int> > dependencies(num_stages);
+  for (int s = 0; s < num_stages; ++s) {
+    for (const auto& name : stages[s].dependencies) {
+      const auto ite = stage_ids.find(name);
+      if (ite == stage_ids.end()) {
+        cerr << "Unknown dependency of " << stages[s].name << ": " << name << endl;
+        exit (1);
+      }
+      dependencies[s].push_back(ite->second);
+    }
+  }
+
+  reports->resize(num_stages);
+  for (int s = 0; s < num_stages; ++s) {
+    reports->at(s).name = stages[s].name;
+    reports->at(s).status = StageReport::kSkipped;
+    reports->at(s).seconds = 0.0;
+    reports->at(s).peak_rss_kb = -1;
+  }
+
+  enum State { kPending, kRunning, kDone };
+  vector<State> states(num_stages, kPending);
+  const int max_running = GetNumThreads(max_concurrent_stages);
+  int num_running = 0;
+  mutex state_mutex;
+  condition_variable state_changed;
+  vector<thread> threads;
+
+  // The resident memory of the process when a function stage started
+  // and its maximum since, sampled by one thread (-1 if unknown).
+  vector<long> rss_starts(num_stages, -1);
+  vector<long> rss_peaks(num_stages, -1);
+  bool finished = false;
+  condition_variable sampler_wakeup;
+  thread sampler([&]() {
+      unique_lock<mutex> lock(state_mutex);
+      while (!finished) {
+        lock.unlock();
+        const long rss = GetCurrentRSSKilobytes();
+        lock.lock();
+        for (int s = 0; s < num_stages; ++s) {
+          if (states[s] == kRunning && rss_starts[s] >= 0)
+            rss_peaks[s] = max(rss_peaks[s], rss);
+        }
+        sampler_wakeup.wait_for(lock, chrono::milliseconds(kRSSIntervalMs));
+      }
+    });
+
+  unique_lock<mutex> lock(state_mutex);
+  while (true) {
+    // Skip or start every pending stage whose dependencies are done.
+    int num_pending = 0;
+    bool changed = false;
+    for (int s = 0; s < num_stages; ++s) {
+      if (states[s] != kPending)
+        continue;
+      bool ready = true;
+      bool skip = false;
+      for (const int d : dependencies[s]) {
+        if (states[d] != kDone)
+          ready = false;
+        else if (reports->at(d).status != StageReport::kSucceeded)
+          skip = true;
+      }
+      if (skip) {
+        states[s] = kDone;
+        changed = true;
+        continue;
+      }
+      if (!ready || num_running == max_running) {
+        ++num_pending;
+        continue;
+      }
+
+      states[s] = kRunning;
+      ++num_running;
+      threads.push_back(thread([&, s]() {
+            const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            long peak_rss_kb;
+            bool success;
+            if (stages[s].run) {
+              const long rss_start = GetCurrentRSSKilobytes();
+              {
+                lock_guard<mutex> lock(state_mutex);
+                rss_starts[s] = rss_peaks[s] = rss_start;
+              }
+              success = stages[s].run();
+              const long rss_end = GetCurrentRSSKilobytes();
+              lock_guard<mutex> lock(state_mutex);
+              peak_rss_kb =
+                rss_start < 0 ? -1 : max(rss_peaks[s], rss_end) - rss_start;
+            } else {
+              success = RunCommand(stages[s].command, &peak_rss_kb);
+            }
+            const double seconds =
+              chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            lock_guard<mutex> lock(state_mutex);
+            StageReport& report = reports->at(s);
+            report.status = success ? StageReport::kSucceeded : StageReport::kFailed;
+            report.seconds = seconds;
+            report.peak_rss_kb = peak_rss_kb;
+            states[s] = kDone;
+            --num_running;
+            state_changed.notify_one();
+          }));
+    }
+    if (changed)
+      continue;
+    if (num_running == 0) {
+      if (num_pending != 0) {
+        cerr << "Cyclic stage dependencies." << endl;
+        exit (1);
+      }
+      break;
+    }
+    state_changed.wait(lock);
+  }
+  finished = true;
+  sampler_wakeup.notify_one();
+  lock.unlock();
+  sampler.join();
+  for (auto& thread : threads)
+    thread.join();
+
+  for (const auto& report : *reports) {
+    if (report.status != StageReport::kSucceeded)
+      return false;
+  }
+  return true;
+}
+
+void PrintStageReports(const vector<StageReport>& reports, ostream& ostr) {
+  const char* const kStatus[] = { "ok", "failed", "skipped" };
+  ostr << setw(28) << left << "stage" << right << setw(10) << "status"
+       << setw(10) << "sec" << setw(14) << "peak_rss_mb" << endl;
+  for (const auto& report : reports) {
+    ostr << setw(28) << left << report.name << right << setw(10) << kStatus[report.status]
+         << setw(10) << fixed << setprecision(2) << report.seconds << setw(14);
+    if (report.peak_rss_kb < 0)
+      ostr << '-';
+    else
+      ostr << setprecision(1) << report.peak_rss_kb / 1024.0;
+    ostr << endl;
+  }
+}
+
+}  // namespace structured_indoor_modeling
@@ -0,0 +1,87 @@
+/*
+  Runs the stages of the reconstruction pipeline in one process as a
+  DAG. A stage starts as soon as all its dependencies succeeded, and
+  at most max_concurrent_stages stages run at the same time. A stage
+  whose dependency failed is skipped.
+
+  A stage is either a function (in process, typically reading a shared
+  DatasetCache) or a command line run as a child process (tools that
+  are not linked in).
+
+  Every stage reports its wall time and peak resident set size. For a
+  function, the peak is how far the resident memory of the process
+  rose above its size at the start of the stage (sampled every 10 ms
+  while the stage runs), so it excludes what was loaded before (e.g.
+  the shared cache) but includes the stages that ran concurrently. For
+  a command, it is the peak of the child (on Linux, never below the
+  size of this process at the spawn, which exec accounts to the
+  child).
+
+  < Example >
+
+  Pipeline pipeline;
+  pipeline.AddStage("floorplan_texture", {}, [&]() { return Run(dataset); });
+  pipeline.AddCommandStage("object_refinement", {"object_segmentation"},
+                           "./Object_refinement data_directory");
+  vector<StageReport> reports;
+  const bool success = pipeline.Run(2, &reports);
+  PrintStageReports(reports, cout);
+*/
+
+#ifndef BASE_PIPELINE_H_
+#define BASE_PIPELINE_H_
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace structured_indoor_modeling {
+
+struct StageReport {
+  enum Status {
+    kSucceeded,
+    kFailed,
+    kSkipped
+  };
+
+  std::string name;
+  Status status;
+  double seconds;
+  // -1 if unknown.
+  long peak_rss_kb;
+};
+
+class Pipeline {
+ public:
+  // A function stage returns false on failure.
+  void AddStage(const std::string& name,
+                const std::vector<std::string>& dependencies,
+                const std::function<bool()>& run);
+  // A command stage fails on a non-zero exit status.
+  void AddCommandStage(const std::string& name,
+                       const std::vector<std::string>& dependencies,
+                       const std::string& command);
+
+  // Runs every stage once (all cores if max_concurrent_stages <= 0).
+  // reports follow the order of the Add calls. Returns true if every
+  // stage succeeded.
+  bool Run(const int max_concurrent_stages, std::vector<StageReport>* reports) const;
+
+ private:
+  struct Stage {
+    std::string name;
+    std::vector<std::string> dependencies;
+    std::function<bool()> run;
+    // Used if run is empty.
+    std::string command;
+  };
+
+  std::vector<Stage> stages;
+};
+
+void PrintStageReports(const std::vector<StageReport>& reports, std::ostream& ostr);
+
+}  // namespace structured_indoor_modeling
+
+#endif  // BASE_PIPELINE_H_
@@ -1,16 +1,67 @@
 #include <Eigen/Dense>
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <limits>
 #include "file_io.h"
+#include "parallel.h"
 #include "point_cloud.h"
+#include "tracing.h"
 
 using namespace Eigen;
 using namespace std;
 
 namespace structured_indoor_modeling {
 
+namespace {
+
+// Counting sort of the point indices by object_id: one pass to count,
+// one to scatter, so indices of an object stay in increasing order.
+// Boxes and centers are accumulated in the scatter pass.
+std::shared_ptr<const ObjectIndex> BuildObjectIndex(const vector<Point>& points) {
+  std::shared_ptr<ObjectIndex> object_index(new ObjectIndex);
+  int num_objects = 0;
+  for (const auto& point : points)
+    num_objects = max(num_objects, point.object_id + 1);
+
+  vector<int>& offsets = object_index->offsets;
+  offsets.assign(num_objects + 1, 0);
+  for (const auto& point : points) {
+    if (point.object_id >= 0)
+      ++offsets[point.object_id + 1];
+  }
+  for (int o = 0; o < num_objects; ++o)
+    offsets[o + 1] += offsets[o];
+
+  object_index->indices.resize(offsets[num_objects]);
+  object_index->min_xyz.assign(num_objects, Vector3d(numeric_limits<double>::max(),
+                                                     numeric_limits<double>::max(),
+                                                     numeric_limits<double>::max()));
+  object_index->max_xyz.assign(num_objects, -object_index->min_xyz[0]);
+  object_index->centers.assign(num_objects, Vector3d(0, 0, 0));
+  vector<int> next(offsets.begin(), offsets.end() - 1);
+  for (int p = 0; p < (int)points.size(); ++p) {
+    const int o = points[p].object_id;
+    if (o < 0)
+      continue;
+    object_index->indices[next[o]++] = p;
+    const Vector3d& position = points[p].position;
+    object_index->min_xyz[o] = object_index->min_xyz[o].cwiseMin(position);
+    object_index->max_xyz[o] = object_index->max_xyz[o].cwiseMax(position);
+    object_index->centers[o] += position;
+  }
+  for (int o = 0; o < num_objects; ++o) {
+    if (offsets[o + 1] > offsets[o])
+      object_index->centers[o] /= offsets[o + 1] - offsets[o];
+  }
+  return object_index;
+}
+
+}  // namespace
+
 const int PointCloud::kDepthPositionOffset = 1;
 
 PointCloud::PointCloud() {
@@ -18,6 +69,8 @@ PointCloud::PointCloud() {
 }
 
 void PointCloud::InitializeMembers() {
+  InvalidateObjectIndex();
+
   center.resize(3);
   center[0] = 0;
   center[1] = 0;
@@ -97,6 +150,7 @@ bool PointCloud::Init(const std::string& filename) {
 }
   
 void PointCloud::Write(const std::string& filename) {
+  const ScopedTrace trace("PointCloud::Write");
   ofstream ofstr;
   ofstr.open(filename.c_str());
   if (!ofstr.is_open()) {
@@ -122,20 +176,35 @@ void PointCloud::Write(const std::string& filename) {
 	<< "property uchar object_id" << endl
 	<< "end_header" << endl;
 
-  for (const auto& point : points) {
-    ofstr << point.depth_position[1] + kDepthPositionOffset << ' '
-          << point.depth_position[0] + kDepthPositionOffset << ' '
-          << point.position[0] << ' '
-          << point.position[1] << ' '
-          << point.position[2] << ' '
-          << (int)point.color[0] << ' '
-          << (int)point.color[1] << ' '
-          << (int)point.color[2] << ' '
-          << point.normal[0] << ' '
-          << point.normal[1] << ' '
-          << point.normal[2] << ' '
-          << point.intensity << ' '
-	  << point.object_id << endl;
+  // Blocks of points are formatted in parallel and written in order.
+  // "%g" is the default formatting of ostream, so the file is the
+  // same as with operator<<.
+  const int kBlockSize = 4096;
+  const int num_blocks = ((int)points.size() + kBlockSize - 1) / kBlockSize;
+  const int num_threads = GetNumThreads();
+  for (int first_block = 0; first_block < num_blocks; first_block += num_threads) {
+    const int last_block = min(num_blocks, first_block + num_threads);
+    vector<string> texts(last_block - first_block);
+    ParallelFor(first_block, last_block, [&](const int block) {
+      string& text = texts[block - first_block];
+      char buffer[512];
+      const int begin = block * kBlockSize;
+      const int end = min((int)points.size(), begin + kBlockSize);
+      for (int p = begin; p < end; ++p) {
+        const Point& point = points[p];
+        const int length =
+          snprintf(buffer, sizeof(buffer), "%d %d %g %g %g %d %d %d %g %g %g %d %d\n",
+                   point.depth_position[1] + kDepthPositionOffset,
+                   point.depth_position[0] + kDepthPositionOffset,
+                   point.position[0], point.position[1], point.position[2],
+                   (int)point.color[0], (int)point.color[1], (int)point.color[2],
+                   point.normal[0], point.normal[1], point.normal[2],
+                   point.intensity, point.object_id);
+        text.append(buffer, min(length, (int)sizeof(buffer) - 1));
+      }
+    }, num_threads);
+    for (const auto& text : texts)
+      ofstr.write(text.data(), text.size());
   }
 
   ofstr.close();
@@ -143,10 +212,7 @@ void PointCloud::Write(const std::string& filename) {
 
 void PointCloud::WriteObject(const string& filename, const int objectid){
     vector<Point>object_points;
-    for(const auto&pt: points){
-	if(pt.object_id == objectid)
-	    object_points.push_back(pt);
-    }
+    GetObjectPoints(objectid, object_points);
     
     PointCloud objectcloud;
     objectcloud.AddPoints(object_points);
@@ -231,43 +297,70 @@ void PointCloud::RemovePoints(const std::vector<int>& indexes) {
   Update();
 }
 
-void PointCloud::GetObjectIndice(int objectid, vector<int>&indices) const{
-  for(int i=0; i<GetNumPoints(); i++){
-    const Point& curpt = GetPoint(i);
-    if(curpt.object_id == objectid)
-      indices.push_back(i);
+std::shared_ptr<const ObjectIndex> PointCloud::GetObjectIndex() const {
+  std::shared_ptr<const ObjectIndex> index = std::atomic_load(&object_index);
+  if (!index) {
+    // Concurrent first queries may both build, the results are equal.
+    index = BuildObjectIndex(points);
+    std::atomic_store(&object_index, index);
   }
+  return index;
+}
+
+ObjectPointSpan PointCloud::GetObjectPointSpan(const int objectid) const {
+  const std::shared_ptr<const ObjectIndex> index = GetObjectIndex();
+  if (objectid < 0 || objectid >= index->GetNumObjects())
+    return ObjectPointSpan();
+  const int* indices = index->indices.data();
+  return ObjectPointSpan(index, &points,
+                         indices + index->offsets[objectid],
+                         indices + index->offsets[objectid + 1]);
+}
+
+int PointCloud::GetNumObjectPoints(const int objectid) const {
+  const std::shared_ptr<const ObjectIndex> index = GetObjectIndex();
+  if (objectid < 0 || objectid >= index->GetNumObjects())
+    return 0;
+  return index->offsets[objectid + 1] - index->offsets[objectid];
+}
+
+void PointCloud::GetObjectIndice(int objectid, vector<int>&indices) const{
+  const ObjectPointSpan span = GetObjectPointSpan(objectid);
+  for (int i = 0; i < span.size(); ++i)
+    indices.push_back(span.GetIndex(i));
 }
 
 void PointCloud::GetObjectPoints(int objectid, vector<Point>&object_points) const{
-    object_points.clear();
-    for(const auto& pt: points){
-	if(pt.object_id == objectid)
-	    object_points.push_back(pt);
-    }
+    const ObjectPointSpan span = GetObjectPointSpan(objectid);
+    object_points.assign(span.begin(), span.end());
 }
 
 void PointCloud::GetObjectBoundingbox(int objectid, vector<double>&bbox) const{
+    // The max used to start from numeric_limits<double>::min(), the
+    // smallest positive double, which clamped negative coordinates.
     bbox.clear();
     bbox.resize(6);
     bbox[0] = numeric_limits<double>::max();
-    bbox[1] = numeric_limits<double>::min();
+    bbox[1] = -numeric_limits<double>::max();
     bbox[2] = numeric_limits<double>::max();
-    bbox[3] = numeric_limits<double>::min();
+    bbox[3] = -numeric_limits<double>::max();
     bbox[4] = numeric_limits<double>::max();
-    bbox[5] = numeric_limits<double>::min();
-    for(int ptid=0; ptid<GetNumPoints(); ptid++){
-	Point curpt = GetPoint(ptid);
-	if(curpt.object_id == objectid){
-	    bbox[0] = std::min(bbox[0], curpt.position[0]);
-	    bbox[1] = std::max(bbox[1], curpt.position[0]);
-	    bbox[2] = std::min(bbox[2], curpt.position[1]);
-	    bbox[3] = std::max(bbox[3], curpt.position[1]);
-	    bbox[4] = std::min(bbox[4], curpt.position[2]);
-	    bbox[5] = std::max(bbox[5], curpt.position[2]);
-	}
+    bbox[5] = -numeric_limits<double>::max();
+    const std::shared_ptr<const ObjectIndex> index = GetObjectIndex();
+    if (objectid < 0 || objectid >= index->GetNumObjects())
+	return;
+    for (int a = 0; a < 3; ++a) {
+	bbox[2 * a] = index->min_xyz[objectid][a];
+	bbox[2 * a + 1] = index->max_xyz[objectid][a];
     }
 }
+
+Eigen::Vector3d PointCloud::GetObjectCenter(const int objectid) const {
+  const std::shared_ptr<const ObjectIndex> index = GetObjectIndex();
+  if (objectid < 0 || objectid >= index->GetNumObjects())
+    return Vector3d(0, 0, 0);
+  return index->centers[objectid];
+}
     
 void PointCloud::SetAllColor(float r,float g,float b){
   for(auto &v: points){
@@ -350,17 +443,20 @@ void PointCloud::RandomSampleScale(const double scale) {
   const int target_size = static_cast<int>(scale * points.size());
   random_shuffle(points.begin(), points.end());
   points.resize(target_size);
+  InvalidateObjectIndex();
 }
 
 void PointCloud::RandomSampleCount(const int max_count) {
   if (max_count < (int)points.size()) {
     random_shuffle(points.begin(), points.end());
     points.resize(max_count);
+    InvalidateObjectIndex();
   }
 }
   
 //----------------------------------------------------------------------
 void ReadPointClouds(const FileIO& file_io, std::vector<PointCloud>* point_clouds) {
+  const ScopedTrace trace("ReadPointClouds");
   cout << "Reading pointclouds" << flush;
   const int num_panoramas = GetNumPanoramas(file_io);
 
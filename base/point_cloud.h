@@ -34,6 +34,8 @@
 #define BASE_POINT_CLOUD_H_
 
 #include <Eigen/Dense>
+#include <iterator>
+#include <memory>
 #include <vector>
 
 namespace structured_indoor_modeling {
@@ -51,6 +53,68 @@ struct Point {
   Point(){object_id = 0;}
 };
 
+// Points grouped by object_id (counting sort). The point indices of
+// object o are indices[offsets[o]] ... indices[offsets[o + 1] - 1], in
+// increasing order. Points with a negative object_id are left out.
+struct ObjectIndex {
+  std::vector<int> offsets;
+  std::vector<int> indices;
+  // Per object bounding box and centroid of the positions.
+  std::vector<Eigen::Vector3d> min_xyz;
+  std::vector<Eigen::Vector3d> max_xyz;
+  std::vector<Eigen::Vector3d> centers;
+
+  int GetNumObjects() const { return (int)offsets.size() - 1; }
+};
+
+// Points of one object, read through the object index without
+// copies. The span shares the index, so it stays valid after the
+// cloud is modified, as long as no point is added or removed.
+class ObjectPointSpan {
+ public:
+  class const_iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Point value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Point* pointer;
+    typedef const Point& reference;
+
+    const_iterator(const std::vector<Point>* points, const int* index)
+      : points(points), index(index) {}
+    const Point& operator*() const { return (*points)[*index]; }
+    const Point* operator->() const { return &(*points)[*index]; }
+    const_iterator& operator++() { ++index; return *this; }
+    const_iterator operator++(int) { const_iterator tmp(*this); ++index; return tmp; }
+    bool operator!=(const const_iterator& rhs) const { return index != rhs.index; }
+    bool operator==(const const_iterator& rhs) const { return index == rhs.index; }
+  private:
+    const std::vector<Point>* points;
+    const int* index;
+  };
+
+  ObjectPointSpan() : points(NULL), first(NULL), last(NULL) {}
+  ObjectPointSpan(const std::shared_ptr<const ObjectIndex>& object_index,
+                  const std::vector<Point>* points,
+                  const int* first,
+                  const int* last)
+    : object_index(object_index), points(points), first(first), last(last) {}
+
+  int size() const { return (int)(last - first); }
+  bool empty() const { return first == last; }
+  const Point& operator[](const int i) const { return (*points)[first[i]]; }
+  // Index of the i-th point in the cloud.
+  int GetIndex(const int i) const { return first[i]; }
+  const_iterator begin() const { return const_iterator(points, first); }
+  const_iterator end() const { return const_iterator(points, last); }
+
+ private:
+  std::shared_ptr<const ObjectIndex> object_index;
+  const std::vector<Point>* points;
+  const int* first;
+  const int* last;
+};
+
 class PointCloud {
  public:
   PointCloud();
@@ -77,18 +141,29 @@ class PointCloud {
   inline int GetDepthWidth() const { return depth_width; }
   inline int GetDepthHeight() const { return depth_height; }
   inline const std::vector<Point>& GetPointData() const {return points;}
-  inline std::vector<Point> &GetPointData() {return points;}
+  // Non-const access may change the points, so it drops the object index.
+  inline std::vector<Point> &GetPointData() { InvalidateObjectIndex(); return points; }
   // yasu This should return const reference to speed-up.
   inline const std::vector<double>& GetBoundingbox() const { return bounding_box; }
   inline int GetNumObjects() const { return num_objects; }
   // yasu This should return const reference to speed-up.
   inline const Eigen::Vector3d& GetCenter() const { return center; }
   inline const Point& GetPoint(const int p) const { return points[p]; }
-  inline Point& GetPoint(const int p) { return points[p]; }
+  inline Point& GetPoint(const int p) { InvalidateObjectIndex(); return points[p]; }
   inline bool isempty() const {return (int)points.size() == 0;}
+
+  // Per object queries. They read an index of the points by object_id
+  // that is built at the first query after a modification, so each
+  // query costs the size of the object, not of the cloud.
+  // Appends the indices of the object's points.
   void GetObjectIndice(int objectid, std::vector<int>&indices) const;
   void GetObjectPoints(int objectid, std::vector<structured_indoor_modeling::Point>& object_points) const;
+  ObjectPointSpan GetObjectPointSpan(const int objectid) const;
+  int GetNumObjectPoints(const int objectid) const;
+  // xmin,xmax,ymin,ymax,zmin,zmax. min > max if the object is empty.
   void GetObjectBoundingbox(int objectid, std::vector<double>&bbox)const;
+  // Centroid of the positions, (0, 0, 0) if the object is empty.
+  Eigen::Vector3d GetObjectCenter(const int objectid) const;
   double GetBoundingboxVolume();
   double GetObjectBoundingboxVolume(const int objectid);
   // Setters.
@@ -111,7 +186,15 @@ class PointCloud {
   void Update();  
  private:
   void InitializeMembers();
+  std::shared_ptr<const ObjectIndex> GetObjectIndex() const;
+  inline void InvalidateObjectIndex() {
+    if (object_index)
+      object_index.reset();
+  }
   std::vector<Point> points;
+  // Built lazily by the const queries (std::atomic_load/store, so
+  // concurrent readers are fine), shared by copies of the cloud.
+  mutable std::shared_ptr<const ObjectIndex> object_index;
 
   Eigen::Vector3d center;
   int depth_width;
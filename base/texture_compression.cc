@@ -0,0 +1,286 @@
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include "parallel.h"
+#include "texture_compression.h"
+
+using namespace std;
+
+namespace structured_indoor_modeling {
+
+namespace {
+
+const int kBlockSize = 4;
+const int kBytesPerBlock = 8;
+
+uint16_t ToRGB565(const float rgb[3]) {
+  const int r = min(31, max(0, static_cast<int>(round(rgb[0] * 31.0f / 255.0f))));
+  const int g = min(63, max(0, static_cast<int>(round(rgb[1] * 63.0f / 255.0f))));
+  const int b = min(31, max(0, static_cast<int>(round(rgb[2] * 31.0f / 255.0f))));
+  return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void FromRGB565(const uint16_t color, float rgb[3]) {
+  const int r = (color >> 11) & 31;
+  const int g = (color >> 5) & 63;
+  const int b = color & 31;
+  rgb[0] = static_cast<float>((r << 3) | (r >> 2));
+  rgb[1] = static_cast<float>((g << 2) | (g >> 4));
+  rgb[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+// Endpoints are the extremes of the block along its principal color
+// axis. Indices pick the closest of the four palette colors.
+void CompressBlock(const float pixels[16][3], unsigned char* block) {
+  float mean[3] = {0, 0, 0};
+  for (int p = 0; p < 16; ++p)
+    for (int c = 0; c < 3; ++c)
+      mean[c] += pixels[p][c] / 16.0f;
+
+  float covariance[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+  for (int p = 0; p < 16; ++p) {
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+        covariance[i][j] += (pixels[p][i] - mean[i]) * (pixels[p][j] - mean[j]);
+  }
+  // Power iteration.
+  float axis[3] = {1, 1, 1};
+  for (int iteration = 0; iteration < 8; ++iteration) {
+    float next[3];
+    for (int i = 0; i < 3; ++i)
+      next[i] = covariance[i][0] * axis[0] + covariance[i][1] * axis[1] + covariance[i][2] * axis[2];
+    const float norm = sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+    if (norm < 1e-6f)
+      break;
+    for (int i = 0; i < 3; ++i)
+      axis[i] = next[i] / norm;
+  }
+
+  float min_t = 0.0f, max_t = 0.0f;
+  for (int p = 0; p < 16; ++p) {
+    const float t = (pixels[p][0] - mean[0]) * axis[0] + (pixels[p][1] - mean[1]) * axis[1] +
+      (pixels[p][2] - mean[2]) * axis[2];
+    min_t = min(min_t, t);
+    max_t = max(max_t, t);
+  }
+  float endpoint0[3], endpoint1[3];
+  for (int c = 0; c < 3; ++c) {
+    endpoint0[c] = min(255.0f, max(0.0f, mean[c] + max_t * axis[c]));
+    endpoint1[c] = min(255.0f, max(0.0f, mean[c] + min_t * axis[c]));
+  }
+
+  uint16_t color0 = ToRGB565(endpoint0);
+  uint16_t color1 = ToRGB565(endpoint1);
+  // color0 > color1 selects the four color mode.
+  if (color0 < color1)
+    swap(color0, color1);
+
+  uint32_t indices = 0;
+  if (color0 != color1) {
+    float palette[4][3];
+    FromRGB565(color0, palette[0]);
+    FromRGB565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+      palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+      palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+    for (int p = 0; p < 16; ++p) {
+      int best_index = 0;
+      float best_distance = 0.0f;
+      for (int i = 0; i < 4; ++i) {
+        float distance = 0.0f;
+        for (int c = 0; c < 3; ++c)
+          distance += (pixels[p][c] - palette[i][c]) * (pixels[p][c] - palette[i][c]);
+        if (i == 0 || distance < best_distance) {
+          best_index = i;
+          best_distance = distance;
+        }
+      }
+      indices |= static_cast<uint32_t>(best_index) << (2 * p);
+    }
+  }
+
+  block[0] = color0 & 0xff;
+  block[1] = color0 >> 8;
+  block[2] = color1 & 0xff;
+  block[3] = color1 >> 8;
+  for (int i = 0; i < 4; ++i)
+    block[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+void Downsample(const std::vector<unsigned char>& image,
+                const int width,
+                const int height,
+                std::vector<unsigned char>* half,
+                const int num_threads) {
+  const int half_width = max(1, width / 2);
+  const int half_height = max(1, height / 2);
+  half->resize(3 * half_width * half_height);
+  ParallelFor(0, half_height, [&](const int y) {
+      const int y0 = min(2 * y, height - 1);
+      const int y1 = min(2 * y + 1, height - 1);
+      for (int x = 0; x < half_width; ++x) {
+        const int x0 = min(2 * x, width - 1);
+        const int x1 = min(2 * x + 1, width - 1);
+        for (int c = 0; c < 3; ++c) {
+          const int sum =
+            image[3 * (y0 * width + x0) + c] + image[3 * (y0 * width + x1) + c] +
+            image[3 * (y1 * width + x0) + c] + image[3 * (y1 * width + x1) + c];
+          half->at(3 * (y * half_width + x) + c) = static_cast<unsigned char>((sum + 2) / 4);
+        }
+      }
+    }, num_threads);
+}
+
+void WriteUint32(const uint32_t value, ofstream* ofstr) {
+  for (int i = 0; i < 4; ++i)
+    ofstr->put(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+uint32_t ReadUint32(const unsigned char* data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+// DDS layout constants (see the DDS_HEADER documentation).
+const int kDDSHeaderSize = 124;
+const uint32_t kDDSFlags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+const uint32_t kDDPFFourCC = 0x4;
+const uint32_t kDDSCaps = 0x8 | 0x1000 | 0x400000;
+const uint32_t kFourCCDXT1 = 'D' | ('X' << 8) | ('T' << 16) | ('1' << 24);
+// In the first reserved field: the rows are stored bottom first.
+const uint32_t kBottomUpMarker = 'B' | ('T' << 8) | ('U' << 16) | ('P' << 24);
+
+}  // namespace
+
+void CompressBC1(const std::vector<unsigned char>& image,
+                 const int width,
+                 const int height,
+                 std::vector<unsigned char>* blocks,
+                 const int num_threads) {
+  const int blocks_x = (width + kBlockSize - 1) / kBlockSize;
+  const int blocks_y = (height + kBlockSize - 1) / kBlockSize;
+  blocks->resize(kBytesPerBlock * blocks_x * blocks_y);
+  ParallelFor(0, blocks_y, [&](const int by) {
+      float pixels[16][3];
+      for (int bx = 0; bx < blocks_x; ++bx) {
+        // Blocks over the image border repeat the last row / column.
+        for (int j = 0; j < kBlockSize; ++j) {
+          const int y = min(by * kBlockSize + j, height - 1);
+          for (int i = 0; i < kBlockSize; ++i) {
+            const int x = min(bx * kBlockSize + i, width - 1);
+            const unsigned char* bgr = &image[3 * (y * width + x)];
+            pixels[j * kBlockSize + i][0] = bgr[2];
+            pixels[j * kBlockSize + i][1] = bgr[1];
+            pixels[j * kBlockSize + i][2] = bgr[0];
+          }
+        }
+        CompressBlock(pixels, &blocks->at(kBytesPerBlock * (by * blocks_x + bx)));
+      }
+    }, num_threads);
+}
+
+void CompressTextureImage(const std::vector<unsigned char>& image,
+                          const int width,
+                          const int height,
+                          CompressedImage* compressed_image,
+                          const int num_threads) {
+  compressed_image->width = width;
+  compressed_image->height = height;
+  compressed_image->levels.clear();
+
+  // Bottom row first, for glCompressedTexImage2D.
+  vector<unsigned char> level_image(image.size());
+  const int row_size = 3 * width;
+  for (int y = 0; y < height; ++y)
+    copy(image.begin() + y * row_size, image.begin() + (y + 1) * row_size,
+         level_image.begin() + (height - 1 - y) * row_size);
+  int level_width = width;
+  int level_height = height;
+  while (true) {
+    compressed_image->levels.push_back(vector<unsigned char>());
+    CompressBC1(level_image, level_width, level_height,
+                &compressed_image->levels.back(), num_threads);
+    if (level_width == 1 && level_height == 1)
+      break;
+    vector<unsigned char> half;
+    Downsample(level_image, level_width, level_height, &half, num_threads);
+    level_image.swap(half);
+    level_width = max(1, level_width / 2);
+    level_height = max(1, level_height / 2);
+  }
+}
+
+bool WriteDDS(const std::string& filename, const CompressedImage& compressed_image) {
+  ofstream ofstr;
+  ofstr.open(filename.c_str(), ios::binary);
+  if (!ofstr.is_open()) {
+    cerr << "Cannot open " << filename << endl;
+    return false;
+  }
+
+  ofstr.write("DDS ", 4);
+  WriteUint32(kDDSHeaderSize, &ofstr);
+  WriteUint32(kDDSFlags, &ofstr);
+  WriteUint32(compressed_image.height, &ofstr);
+  WriteUint32(compressed_image.width, &ofstr);
+  WriteUint32(compressed_image.levels.empty() ? 0 : compressed_image.levels[0].size(), &ofstr);
+  WriteUint32(0, &ofstr);  // Depth.
+  WriteUint32(compressed_image.GetNumLevels(), &ofstr);
+  WriteUint32(kBottomUpMarker, &ofstr);
+  for (int i = 1; i < 11; ++i)
+    WriteUint32(0, &ofstr);
+  // Pixel format.
+  WriteUint32(32, &ofstr);
+  WriteUint32(kDDPFFourCC, &ofstr);
+  WriteUint32(kFourCCDXT1, &ofstr);
+  for (int i = 0; i < 5; ++i)
+    WriteUint32(0, &ofstr);
+  WriteUint32(kDDSCaps, &ofstr);
+  for (int i = 0; i < 4; ++i)
+    WriteUint32(0, &ofstr);
+
+  for (const auto& level : compressed_image.levels)
+    ofstr.write(reinterpret_cast<const char*>(&level[0]), level.size());
+  ofstr.close();
+  return true;
+}
+
+bool ReadDDS(const std::string& filename, CompressedImage* compressed_image) {
+  ifstream ifstr;
+  ifstr.open(filename.c_str(), ios::binary);
+  if (!ifstr.is_open())
+    return false;
+
+  unsigned char header[4 + kDDSHeaderSize];
+  if (!ifstr.read(reinterpret_cast<char*>(header), sizeof(header)))
+    return false;
+  if (header[0] != 'D' || header[1] != 'D' || header[2] != 'S' || header[3] != ' ' ||
+      ReadUint32(header + 4) != kDDSHeaderSize ||
+      ReadUint32(header + 4 + 80) != kFourCCDXT1) {
+    cerr << "Unsupported DDS file: " << filename << endl;
+    return false;
+  }
+  if (ReadUint32(header + 4 + 28) != kBottomUpMarker) {
+    cerr << "DDS file in the old row order, regenerate it: " << filename << endl;
+    return false;
+  }
+  compressed_image->height = ReadUint32(header + 4 + 8);
+  compressed_image->width = ReadUint32(header + 4 + 12);
+  const int num_levels = max(1, static_cast<int>(ReadUint32(header + 4 + 24)));
+
+  compressed_image->levels.resize(num_levels);
+  for (int level = 0; level < num_levels; ++level) {
+    const int blocks_x = (compressed_image->GetWidth(level) + kBlockSize - 1) / kBlockSize;
+    const int blocks_y = (compressed_image->GetHeight(level) + kBlockSize - 1) / kBlockSize;
+    vector<unsigned char>& data = compressed_image->levels[level];
+    data.resize(kBytesPerBlock * blocks_x * blocks_y);
+    if (!ifstr.read(reinterpret_cast<char*>(&data[0]), data.size())) {
+      cerr << "Truncated DDS file: " << filename << endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace structured_indoor_modeling
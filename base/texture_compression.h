@@ -0,0 +1,75 @@
+/*
+  Block compressed texture images with a precomputed mip chain, for
+  fast loading by the viewer. Images are BC1 (DXT1) compressed and
+  stored in a DDS file, which OpenGL can upload level by level with
+  glCompressedTexImage2D and no decoding.
+
+  Input images are 3 channel, row major, in OpenCV (BGR) order, i.e.,
+  the texture image buffers written by the texture generators.
+
+  The compressed levels store the bottom row first, the OpenGL row
+  order (QGLWidget::bindTexture flips the PNG images the same way), so
+  both are sampled with the same texture coordinates. DDS files written
+  in the top row first order (without the marker of WriteDDS) are
+  rejected by ReadDDS.
+
+  < Example >
+
+  CompressedImage image;
+  CompressTextureImage(texture_image, 2048, 2048, &image);
+  WriteDDS(file_io.GetTextureImageDDS(0), image);
+
+  CompressedImage loaded;
+  if (ReadDDS(file_io.GetTextureImageDDS(0), &loaded)) {
+    for (int level = 0; level < loaded.GetNumLevels(); ++level)
+      glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+                             loaded.GetWidth(level), loaded.GetHeight(level), 0,
+                             loaded.levels[level].size(), &loaded.levels[level][0]);
+  }
+*/
+
+#ifndef BASE_TEXTURE_COMPRESSION_H_
+#define BASE_TEXTURE_COMPRESSION_H_
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace structured_indoor_modeling {
+
+struct CompressedImage {
+  // Size of level 0.
+  int width;
+  int height;
+  // BC1 blocks of each mip level, level 0 first. Each 4x4 block takes
+  // 8 bytes, blocks are in row major order.
+  std::vector<std::vector<unsigned char> > levels;
+
+  int GetNumLevels() const { return static_cast<int>(levels.size()); }
+  int GetWidth(const int level) const { return std::max(1, width >> level); }
+  int GetHeight(const int level) const { return std::max(1, height >> level); }
+};
+
+// Compresses one image (BGR) to BC1. Block rows are encoded in
+// parallel over num_threads workers (all cores if <= 0).
+void CompressBC1(const std::vector<unsigned char>& image,
+                 const int width,
+                 const int height,
+                 std::vector<unsigned char>* blocks,
+                 const int num_threads = 0);
+
+// Builds the full mip chain (2x2 box filter) down to 1x1 and
+// compresses every level, bottom row first.
+void CompressTextureImage(const std::vector<unsigned char>& image,
+                          const int width,
+                          const int height,
+                          CompressedImage* compressed_image,
+                          const int num_threads = 0);
+
+bool WriteDDS(const std::string& filename, const CompressedImage& compressed_image);
+// Reads DXT1 files written by WriteDDS. Returns false on other formats.
+bool ReadDDS(const std::string& filename, CompressedImage* compressed_image);
+
+}  // namespace structured_indoor_modeling
+
+#endif  // BASE_TEXTURE_COMPRESSION_H_
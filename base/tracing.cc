@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "tracing.h"
+
+using namespace std;
+
+namespace structured_indoor_modeling {
+
+namespace {
+
+struct TraceEvent {
+  const char* name;
+  // 'X' (complete slice) or 'C' (counter).
+  char phase;
+  int thread;
+  int64_t timestamp_us;
+  int64_t duration_us;
+  double value;
+};
+
+class Tracer {
+ public:
+  // Never destroyed, so that the scopes of other static objects and
+  // the atexit handler can still use it.
+  static Tracer& Get() {
+    static Tracer* tracer = new Tracer();
+    return *tracer;
+  }
+
+  bool IsEnabled() const { return enabled.load(memory_order_relaxed); }
+
+  int64_t GetMicroseconds() const {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - origin).count();
+  }
+
+  void Start(const string& new_filename, const int memory_interval_ms) {
+    lock_guard<std::mutex> lock(mutex);
+    if (IsEnabled())
+      return;
+    filename = new_filename;
+    events.clear();
+    stopping = false;
+    enabled.store(true);
+    if (memory_interval_ms > 0)
+      sampler = thread(&Tracer::SampleMemory, this, memory_interval_ms);
+  }
+
+  void Stop() {
+    {
+      lock_guard<std::mutex> lock(mutex);
+      if (!IsEnabled())
+        return;
+      stopping = true;
+    }
+    stopped.notify_all();
+    if (sampler.joinable())
+      sampler.join();
+    AddCounter("rss_mb", GetCurrentRSSKilobytes() / 1024.0);
+
+    lock_guard<std::mutex> lock(mutex);
+    enabled.store(false);
+    Write();
+    WriteSummary();
+  }
+
+  void AddSlice(const char* name, const int64_t start_us, const int64_t end_us) {
+    TraceEvent event;
+    event.name = name;
+    event.phase = 'X';
+    event.timestamp_us = start_us;
+    event.duration_us = end_us - start_us;
+    event.value = 0.0;
+    Add(&event);
+  }
+
+  void AddCounter(const char* name, const double value) {
+    TraceEvent event;
+    event.name = name;
+    event.phase = 'C';
+    event.timestamp_us = GetMicroseconds();
+    event.duration_us = 0;
+    event.value = value;
+    Add(&event);
+  }
+
+ private:
+  Tracer() : enabled(false), origin(chrono::steady_clock::now()), stopping(false) {}
+
+  void Add(TraceEvent* event) {
+    lock_guard<std::mutex> lock(mutex);
+    const thread::id id = this_thread::get_id();
+    auto ite = thread_ids.find(id);
+    if (ite == thread_ids.end())
+      ite = thread_ids.insert(make_pair(id, static_cast<int>(thread_ids.size()))).first;
+    event->thread = ite->second;
+    events.push_back(*event);
+  }
+
+  void SampleMemory(const int memory_interval_ms) {
+    while (true) {
+      AddCounter("rss_mb", GetCurrentRSSKilobytes() / 1024.0);
+      unique_lock<std::mutex> lock(mutex);
+      if (stopped.wait_for(lock, chrono::milliseconds(memory_interval_ms),
+                           [this]() { return stopping; }))
+        break;
+    }
+  }
+
+  // Requires mutex.
+  void Write() const {
+    ofstream ofstr;
+    ofstr.open(filename.c_str());
+    if (!ofstr.is_open()) {
+      cerr << "Cannot open a file: " << filename << endl;
+      return;
+    }
+    ofstr << "{\"traceEvents\":[" << endl;
+    for (int e = 0; e < (int)events.size(); ++e) {
+      const TraceEvent& event = events[e];
+      ofstr << "{\"name\":\"" << event.name << "\",\"ph\":\"" << event.phase
+            << "\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":" << event.timestamp_us;
+      if (event.phase == 'X')
+        ofstr << ",\"dur\":" << event.duration_us;
+      else
+        ofstr << ",\"args\":{\"value\":" << event.value << "}";
+      ofstr << "}" << (e + 1 < (int)events.size() ? "," : "") << endl;
+    }
+    ofstr << "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"peak_rss_mb\":"
+          << GetPeakRSSKilobytes() / 1024.0 << "}}" << endl;
+    ofstr.close();
+  }
+
+  // Requires mutex. Total time per scope, the longest first.
+  void WriteSummary() const {
+    map<string, pair<int, int64_t> > totals;
+    for (const auto& event : events) {
+      if (event.phase != 'X')
+        continue;
+      pair<int, int64_t>& total = totals[event.name];
+      ++total.first;
+      total.second += event.duration_us;
+    }
+    vector<pair<int64_t, string> > sorted;
+    for (const auto& total : totals)
+      sorted.push_back(make_pair(total.second.second, total.first));
+    sort(sorted.rbegin(), sorted.rend());
+
+    ostringstream ostr;
+    ostr << "Trace: " << filename << endl
+         << setw(32) << left << "scope" << right << setw(8) << "count" << setw(12) << "sec" << endl;
+    for (const auto& entry : sorted) {
+      ostr << setw(32) << left << entry.second << right
+           << setw(8) << totals[entry.second].first
+           << setw(12) << fixed << setprecision(3) << entry.first / 1000000.0 << endl;
+    }
+    ostr << "Peak RSS: " << GetPeakRSSKilobytes() / 1024 << " MB" << endl;
+    cerr << ostr.str();
+  }
+
+  atomic<bool> enabled;
+  const chrono::steady_clock::time_point origin;
+
+  mutable std::mutex mutex;
+  string filename;
+  vector<TraceEvent> events;
+  map<thread::id, int> thread_ids;
+
+  thread sampler;
+  condition_variable stopped;
+  bool stopping;
+};
+
+void StopTracingAtExit() {
+  StopTracing();
+}
+
+}  // namespace
+
+void StartTracing(const string& filename, const int memory_interval_ms) {
+  static once_flag registered;
+  call_once(registered, []() { atexit(StopTracingAtExit); });
+  Tracer::Get().Start(filename, memory_interval_ms);
+}
+
+void StopTracing() {
+  Tracer::Get().Stop();
+}
+
+bool IsTracing() {
+  return Tracer::Get().IsEnabled();
+}
+
+ScopedTrace::ScopedTrace(const char* name) : name(name), start_us(-1) {
+  Tracer& tracer = Tracer::Get();
+  if (tracer.IsEnabled())
+    start_us = tracer.GetMicroseconds();
+}
+
+ScopedTrace::~ScopedTrace() {
+  if (start_us < 0)
+    return;
+  Tracer& tracer = Tracer::Get();
+  if (tracer.IsEnabled())
+    tracer.AddSlice(name, start_us, tracer.GetMicroseconds());
+}
+
+void TraceCounter(const char* name, const double value) {
+  Tracer& tracer = Tracer::Get();
+  if (tracer.IsEnabled())
+    tracer.AddCounter(name, value);
+}
+
+long GetCurrentRSSKilobytes() {
+#if defined(_WIN32)
+  return -1;
+#elif defined(__linux__)
+  // Resident pages are the second field.
+  FILE* file = fopen("/proc/self/statm", "r");
+  if (file == NULL)
+    return -1;
+  long pages, resident_pages;
+  const int num_read = fscanf(file, "%ld %ld", &pages, &resident_pages);
+  fclose(file);
+  if (num_read != 2)
+    return -1;
+  return resident_pages * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+  // No cheap current value elsewhere: the peak is an upper bound.
+  return GetPeakRSSKilobytes();
+#endif
+}
+
+long GetPeakRSSKilobytes() {
+#ifdef _WIN32
+  return -1;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return -1;
+#ifdef __APPLE__
+  // Bytes on OS X, kilobytes on Linux.
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+#endif
+}
+
+}  // namespace structured_indoor_modeling
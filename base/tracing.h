@@ -0,0 +1,58 @@
+#ifndef BASE_TRACING_H_
+#define BASE_TRACING_H_
+
+/*
+  Process-wide tracing: scoped timers, counters and a resident memory
+  sampler, written as a Chrome trace (load the file in chrome://tracing
+  or https://ui.perfetto.dev). Tracing is off until StartTracing() is
+  called (CLIs call InitTracingFromFlags, see tracing_flags.h), and a
+  disabled ScopedTrace costs one atomic load.
+
+  The trace is written at exit (or by StopTracing), with a summary of
+  the total time per scope on cerr.
+
+  < Example >
+
+  void ReadPanoramas(...) {
+    const ScopedTrace trace("ReadPanoramas");
+    ...
+    TraceCounter("panoramas", num_panoramas);
+  }
+*/
+
+#include <cstdint>
+#include <string>
+
+namespace structured_indoor_modeling {
+
+// Starts recording. The resident memory is sampled every
+// memory_interval_ms (never if <= 0).
+void StartTracing(const std::string& filename, const int memory_interval_ms);
+// Writes the trace. Also called at exit.
+void StopTracing();
+
+bool IsTracing();
+
+// Records the time between the construction and the destruction as a
+// slice on the calling thread. name must outlive the tracing (a
+// string literal).
+class ScopedTrace {
+ public:
+  explicit ScopedTrace(const char* name);
+  ~ScopedTrace();
+
+ private:
+  const char* name;
+  int64_t start_us;
+};
+
+// A value over time (e.g. a number of points), shown as a track.
+void TraceCounter(const char* name, const double value);
+
+// In kilobytes, -1 if unknown.
+long GetCurrentRSSKilobytes();
+long GetPeakRSSKilobytes();
+
+}  // namespace structured_indoor_modeling
+
+#endif  // BASE_TRACING_H_
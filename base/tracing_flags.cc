@@ -0,0 +1,16 @@
+#include <gflags/gflags.h>
+
+#include "tracing.h"
+#include "tracing_flags.h"
+
+DEFINE_string(trace_file, "", "Chrome trace (JSON) of the run, for chrome://tracing. Off if empty.");
+DEFINE_int32(trace_memory_interval_ms, 100, "Resident memory sampling period of the trace (0: off).");
+
+namespace structured_indoor_modeling {
+
+void InitTracingFromFlags() {
+  if (!FLAGS_trace_file.empty())
+    StartTracing(FLAGS_trace_file, FLAGS_trace_memory_interval_ms);
+}
+
+}  // namespace structured_indoor_modeling
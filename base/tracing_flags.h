@@ -0,0 +1,20 @@
+#ifndef BASE_TRACING_FLAGS_H_
+#define BASE_TRACING_FLAGS_H_
+
+/*
+  The flags shared by the CLIs to enable tracing (tracing.h). Link
+  tracing_flags.cc and call InitTracingFromFlags() after parsing the
+  flags.
+
+  < Example >
+  ./object_segmentation_cli data_directory --trace_file=segmentation.json
+*/
+
+namespace structured_indoor_modeling {
+
+// Starts tracing if --trace_file is given.
+void InitTracingFromFlags();
+
+}  // namespace structured_indoor_modeling
+
+#endif  // BASE_TRACING_FLAGS_H_
@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+
+#include "floorplan.h"
+#include "panorama.h"
+#include "parallel.h"
+#include "tracing.h"
+#include "visibility.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace structured_indoor_modeling {
+
+namespace {
+
+// Points tested together by ComputeVisibility.
+const int kBlockSize = 64;
+
+// Floats that do not make the bounds tighter than the doubles.
+float RoundDown(const double value) {
+  float rounded = static_cast<float>(value);
+  if (rounded > value)
+    rounded = nextafterf(rounded, -numeric_limits<float>::infinity());
+  return rounded;
+}
+
+float RoundUp(const double value) {
+  float rounded = static_cast<float>(value);
+  if (rounded < value)
+    rounded = nextafterf(rounded, numeric_limits<float>::infinity());
+  return rounded;
+}
+
+bool IsInsidePolygon(const vector<Vector2d>& polygon, const Vector2d& point) {
+  bool inside = false;
+  for (int i = 0, j = (int)polygon.size() - 1; i < (int)polygon.size(); j = i++) {
+    if ((polygon[i][1] > point[1]) != (polygon[j][1] > point[1]) &&
+        point[0] < (polygon[j][0] - polygon[i][0]) * (point[1] - polygon[i][1]) /
+        (polygon[j][1] - polygon[i][1]) + polygon[i][0])
+      inside = !inside;
+  }
+  return inside;
+}
+
+}  // namespace
+
+VisibilityIndex::VisibilityIndex(const std::vector<Panorama>& panoramas, const int num_threads)
+  : num_threads(num_threads), floorplan(NULL) {
+  for (const auto& panorama : panoramas)
+    this->panoramas.push_back(&panorama);
+  Init();
+}
+
+VisibilityIndex::VisibilityIndex(const std::vector<std::vector<Panorama> >& panoramas,
+                                 const int level,
+                                 const int num_threads)
+  : num_threads(num_threads), floorplan(NULL) {
+  for (const auto& pyramid : panoramas)
+    this->panoramas.push_back(&pyramid[level]);
+  Init();
+}
+
+void VisibilityIndex::Init() {
+  const ScopedTrace trace("VisibilityIndex");
+  depth_pyramids.resize(panoramas.size());
+  ParallelFor(0, panoramas.size(), [&](const int p) {
+      BuildDepthPyramid(*panoramas[p], &depth_pyramids[p]);
+    }, num_threads);
+}
+
+void VisibilityIndex::SetFloorplan(const Floorplan& new_floorplan, const int max_door_hops) {
+  floorplan = &new_floorplan;
+  const int num_rooms = floorplan->GetNumRooms();
+  panorama_rooms.resize(panoramas.size());
+  for (int p = 0; p < (int)panoramas.size(); ++p)
+    panorama_rooms[p] = FindRoom(panoramas[p]->GetCenter());
+
+  vector<vector<int> > neighbors(num_rooms);
+  for (int door = 0; door < floorplan->GetNumDoors(); ++door) {
+    const Vector2i rooms = floorplan->GetDoorRooms(door);
+    neighbors[rooms[0]].push_back(rooms[1]);
+    neighbors[rooms[1]].push_back(rooms[0]);
+  }
+
+  // Panoramas outside every room are kept for all the rooms.
+  room_panoramas.clear();
+  room_panoramas.resize(num_rooms);
+  for (int room = 0; room < num_rooms; ++room) {
+    vector<int> hops(num_rooms, -1);
+    queue<int> rooms;
+    hops[room] = 0;
+    rooms.push(room);
+    while (!rooms.empty()) {
+      const int current = rooms.front();
+      rooms.pop();
+      if (hops[current] == max_door_hops)
+        continue;
+      for (const int neighbor : neighbors[current]) {
+        if (hops[neighbor] == -1) {
+          hops[neighbor] = hops[current] + 1;
+          rooms.push(neighbor);
+        }
+      }
+    }
+    for (int p = 0; p < (int)panoramas.size(); ++p) {
+      if (panorama_rooms[p] == -1 || hops[panorama_rooms[p]] != -1)
+        room_panoramas[room].push_back(p);
+    }
+  }
+}
+
+bool VisibilityIndex::IsVisible(const Eigen::Vector3d& point,
+                                const int panorama,
+                                const double margin) const {
+  const Vector2d depth_pixel = panoramas[panorama]->ProjectToDepth(point);
+  const double distance = (point - panoramas[panorama]->GetCenter()).norm();
+  return distance <= panoramas[panorama]->GetDepth(depth_pixel) + margin;
+}
+
+VisibilityIndex::BoxVisibility VisibilityIndex::TestBox(const Eigen::AlignedBox3d& box,
+                                                        const int panorama,
+                                                        const double margin) const {
+  if (box.isEmpty())
+    return kInvisible;
+  const Panorama& pano = *panoramas[panorama];
+  const int width  = pano.DepthWidth();
+  const int height = pano.DepthHeight();
+
+  // Bounding sphere, slightly inflated against rounding.
+  const double distance = (box.center() - pano.GetCenter()).norm();
+  const double radius = box.diagonal().norm() / 2.0 + 1e-6 * (distance + 1.0);
+  const Vector3d local = pano.GlobalToLocal(box.center());
+  const double local_distance = local.norm();
+  const double horizontal_distance = sqrt(local[0] * local[0] + local[1] * local[1]);
+  if (distance <= radius || local_distance <= radius)
+    return kPartial;
+
+  // Depth pixels of the sphere (as Panorama::Project), plus the
+  // bilinear neighbors and a pixel of padding.
+  int u_begin, u_end;
+  if (horizontal_distance <= radius) {
+    u_begin = 0;
+    u_end = width - 1;
+  } else {
+    double theta = -atan2(local[1], local[0]);
+    if (theta < 0.0)
+      theta += 2 * M_PI;
+    const double u_center = theta / (2 * M_PI) * width;
+    const double u_radius = asin(radius / horizontal_distance) / (2 * M_PI) * width;
+    u_begin = static_cast<int>(floor(u_center - u_radius)) - 1;
+    u_end   = static_cast<int>(floor(u_center + u_radius)) + 2;
+    while (u_begin < 0) {
+      u_begin += width;
+      u_end += width;
+    }
+  }
+  const double phi = atan2(local[2], horizontal_distance);
+  const double phi_radius = asin(radius / local_distance);
+  // Project and RGBToDepth clamp the row of a point below the last
+  // one (a point beyond the vertical field of view reads the top or
+  // the bottom two rows), so the rows of the sphere are clamped alike.
+  const double pixels_per_phi = height / pano.GetPhiRange();
+  const double v_max = min(height - 1.1, (pano.Height() - 1.1) * height / pano.Height());
+  const double v_top    = max(0.0, min(v_max, height / 2.0 - (phi + phi_radius) * pixels_per_phi));
+  const double v_bottom = max(0.0, min(v_max, height / 2.0 - (phi - phi_radius) * pixels_per_phi));
+  const int v_begin = max(0, static_cast<int>(floor(v_top)) - 1);
+  const int v_end   = min(height - 1, static_cast<int>(floor(v_bottom)) + 2);
+
+  double min_depth, max_depth;
+  GetDepthRange(depth_pyramids[panorama], u_begin, u_end, v_begin, v_end, &min_depth, &max_depth);
+
+  if (distance - radius > max_depth + margin)
+    return kInvisible;
+  if (distance + radius <= min_depth + margin)
+    return kVisible;
+  return kPartial;
+}
+
+void VisibilityIndex::ComputeVisibility(const std::vector<Eigen::Vector3d>& points,
+                                        const double margin_ratio,
+                                        std::vector<char>* visible) const {
+  const ScopedTrace trace("ComputeVisibility");
+  const int num_panoramas = panoramas.size();
+  const int num_points = points.size();
+  visible->assign(static_cast<size_t>(num_points) * num_panoramas, 0);
+
+  vector<double> margins(num_panoramas);
+  for (int p = 0; p < num_panoramas; ++p)
+    margins[p] = panoramas[p]->GetAverageDistance() * margin_ratio;
+
+  // room_masks[room][p]: p may see the room.
+  vector<vector<char> > room_masks;
+  if (floorplan != NULL) {
+    room_masks.resize(room_panoramas.size(), vector<char>(num_panoramas, 0));
+    for (int room = 0; room < (int)room_panoramas.size(); ++room) {
+      for (const int p : room_panoramas[room])
+        room_masks[room][p] = 1;
+    }
+  }
+
+  const int num_blocks = (num_points + kBlockSize - 1) / kBlockSize;
+  ParallelFor(0, num_blocks, [&](const int block) {
+      const int begin = block * kBlockSize;
+      const int end = min(num_points, begin + kBlockSize);
+      AlignedBox3d box;
+      for (int q = begin; q < end; ++q)
+        box.extend(points[q]);
+
+      for (int p = 0; p < num_panoramas; ++p) {
+        const BoxVisibility box_visibility = TestBox(box, p, margins[p]);
+        if (box_visibility == kInvisible)
+          continue;
+        for (int q = begin; q < end; ++q) {
+          if (box_visibility == kVisible || IsVisible(points[q], p, margins[p]))
+            (*visible)[static_cast<size_t>(q) * num_panoramas + p] = 1;
+        }
+      }
+
+      if (floorplan == NULL)
+        return;
+      for (int q = begin; q < end; ++q) {
+        const int room = FindRoom(points[q]);
+        if (room == -1)
+          continue;
+        for (int p = 0; p < num_panoramas; ++p)
+          (*visible)[static_cast<size_t>(q) * num_panoramas + p] &= room_masks[room][p];
+      }
+    }, num_threads);
+}
+
+int VisibilityIndex::GetPanoramaRoom(const int panorama) const {
+  if (floorplan == NULL)
+    return -1;
+  return panorama_rooms[panorama];
+}
+
+void VisibilityIndex::BuildDepthPyramid(const Panorama& panorama, DepthPyramid* pyramid) const {
+  int width  = panorama.DepthWidth();
+  int height = panorama.DepthHeight();
+  pyramid->widths.push_back(width);
+  pyramid->heights.push_back(height);
+  pyramid->min_depths.push_back(vector<float>(width * height));
+  pyramid->max_depths.push_back(vector<float>(width * height));
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const double depth = panorama.GetDepth(Vector2d(x, y));
+      pyramid->min_depths[0][y * width + x] = RoundDown(depth);
+      pyramid->max_depths[0][y * width + x] = RoundUp(depth);
+    }
+  }
+
+  while (width > 1 || height > 1) {
+    const int new_width  = (width + 1) / 2;
+    const int new_height = (height + 1) / 2;
+    const vector<float>& mins = pyramid->min_depths.back();
+    const vector<float>& maxs = pyramid->max_depths.back();
+    vector<float> new_mins(new_width * new_height), new_maxs(new_width * new_height);
+    for (int y = 0; y < new_height; ++y) {
+      for (int x = 0; x < new_width; ++x) {
+        float min_depth = numeric_limits<float>::max();
+        float max_depth = -numeric_limits<float>::max();
+        for (int j = 2 * y; j < min(height, 2 * y + 2); ++j) {
+          for (int i = 2 * x; i < min(width, 2 * x + 2); ++i) {
+            min_depth = min(min_depth, mins[j * width + i]);
+            max_depth = max(max_depth, maxs[j * width + i]);
+          }
+        }
+        new_mins[y * new_width + x] = min_depth;
+        new_maxs[y * new_width + x] = max_depth;
+      }
+    }
+    width = new_width;
+    height = new_height;
+    pyramid->widths.push_back(width);
+    pyramid->heights.push_back(height);
+    pyramid->min_depths.push_back(new_mins);
+    pyramid->max_depths.push_back(new_maxs);
+  }
+}
+
+void VisibilityIndex::GetDepthRange(const DepthPyramid& pyramid,
+                                    const int u_begin, const int u_end,
+                                    const int v_begin, const int v_end,
+                                    double* min_depth, double* max_depth) const {
+  const int width = pyramid.widths[0];
+  // Column segments without wrapping around.
+  vector<pair<int, int> > segments;
+  if (u_end - u_begin + 1 >= width) {
+    segments.push_back(make_pair(0, width - 1));
+  } else if (u_end >= width) {
+    segments.push_back(make_pair(u_begin, width - 1));
+    segments.push_back(make_pair(0, u_end - width));
+  } else {
+    segments.push_back(make_pair(u_begin, u_end));
+  }
+
+  // The finest level with a few cells over the range.
+  const int span = max(min(u_end - u_begin + 1, width), v_end - v_begin + 1);
+  const int kMaxCells = 4;
+  int level = 0;
+  while ((span >> level) > kMaxCells && level + 1 < (int)pyramid.widths.size())
+    ++level;
+  const int level_width = pyramid.widths[level];
+  const vector<float>& mins = pyramid.min_depths[level];
+  const vector<float>& maxs = pyramid.max_depths[level];
+
+  *min_depth = numeric_limits<double>::max();
+  *max_depth = -numeric_limits<double>::max();
+  for (const auto& segment : segments) {
+    for (int y = v_begin >> level; y <= (v_end >> level); ++y) {
+      for (int x = segment.first >> level; x <= (segment.second >> level); ++x) {
+        *min_depth = min(*min_depth, static_cast<double>(mins[y * level_width + x]));
+        *max_depth = max(*max_depth, static_cast<double>(maxs[y * level_width + x]));
+      }
+    }
+  }
+}
+
+int VisibilityIndex::FindRoom(const Eigen::Vector3d& point) const {
+  const Vector3d local = floorplan->GetFloorplanToGlobal().transpose() * point;
+  const Vector2d local2(local[0], local[1]);
+  for (int room = 0; room < floorplan->GetNumRooms(); ++room) {
+    vector<Vector2d> polygon(floorplan->GetNumRoomVertices(room));
+    for (int v = 0; v < (int)polygon.size(); ++v)
+      polygon[v] = floorplan->GetRoomVertexLocal(room, v);
+    if (IsInsidePolygon(polygon, local2))
+      return room;
+  }
+  return -1;
+}
+
+}  // namespace structured_indoor_modeling
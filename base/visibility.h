@@ -0,0 +1,129 @@
+#ifndef BASE_VISIBILITY_H_
+#define BASE_VISIBILITY_H_
+
+/*
+  Visibility of 3D points from the depth panoramas, shared by the
+  stages that used to test every point against every panorama. A
+  point is visible from a panorama if it is not farther than the depth
+  image where it projects plus a margin:
+
+    distance <= panorama.GetDepth(panorama.ProjectToDepth(point)) + margin
+
+  which is the test of RasterizeObjectIds and getObjectColor.
+
+  Two accelerations on top of the per point test:
+
+  - A min/max depth pyramid per panorama. TestBox bounds the depth
+    pixels a box can project to (and their bilinear neighbors), and
+    decides the whole box at once when it is entirely behind
+    (kInvisible) or entirely in front of (kVisible) the depths there.
+    The answers are conservative: kPartial means "test each point".
+
+  - Optionally (SetFloorplan), the room of each panorama center and
+    the door adjacency of the rooms. A point in a room is then only
+    tested against the panoramas at most max_door_hops doors away.
+    This is a heuristic (a panorama may see further through aligned
+    doors), so it is off unless asked.
+
+  RasterizeObjectIds and getObjectColor cull whole objects with
+  TestBox, the indoor polygon texturing culls patches with it, and
+  color_point_cloud picks the panorama of each point among the visible
+  ones from ComputeVisibility. FindBestPanorama and
+  FindVisiblePanoramas of the texture stages do not use the index:
+  they rank every panorama by a score (holes, normal, how far a sample
+  is behind the depths), not by a visible or hidden answer.
+
+  < Example >
+
+  VisibilityIndex visibility(panoramas);
+  // One entry per point and panorama, computed in parallel.
+  vector<char> visible;
+  visibility.ComputeVisibility(points, 0.05, &visible);
+  if (visible[q * panoramas.size() + p])
+    ...
+
+  // Whole objects.
+  const double margin = panoramas[p].GetAverageDistance() * 0.05;
+  if (visibility.TestBox(object_box, p, margin) == VisibilityIndex::kInvisible)
+    continue;
+*/
+
+#include <Eigen/Dense>
+#include <vector>
+
+namespace structured_indoor_modeling {
+
+class Floorplan;
+class Panorama;
+
+class VisibilityIndex {
+ public:
+  enum BoxVisibility {
+    kInvisible,
+    kVisible,
+    kPartial
+  };
+
+  // panoramas must outlive this. Builds the depth pyramids.
+  VisibilityIndex(const std::vector<Panorama>& panoramas, const int num_threads = 0);
+  // Same with the given level of panorama pyramids.
+  VisibilityIndex(const std::vector<std::vector<Panorama> >& panoramas,
+                  const int level,
+                  const int num_threads = 0);
+
+  // Enables the room prefilter of ComputeVisibility (max_door_hops >= 0).
+  void SetFloorplan(const Floorplan& floorplan, const int max_door_hops);
+
+  // The exact per point test.
+  bool IsVisible(const Eigen::Vector3d& point, const int panorama, const double margin) const;
+
+  // Whether all, none or some of the points inside box may be visible.
+  BoxVisibility TestBox(const Eigen::AlignedBox3d& box,
+                        const int panorama,
+                        const double margin) const;
+
+  // visible[q * num_panoramas + p] for each point q and panorama p.
+  // The margin of a panorama is its average distance times
+  // margin_ratio. Consecutive points are tested in blocks, so points
+  // in a spatial order (an object, a scan) are cheaper.
+  void ComputeVisibility(const std::vector<Eigen::Vector3d>& points,
+                         const double margin_ratio,
+                         std::vector<char>* visible) const;
+
+  // -1 if outside every room, or without floorplan.
+  int GetPanoramaRoom(const int panorama) const;
+
+ private:
+  // Min and max of the depths of a panorama, every level half the
+  // size of the previous one (rounded up). Level 0 is the depth image.
+  struct DepthPyramid {
+    std::vector<int> widths;
+    std::vector<int> heights;
+    std::vector<std::vector<float> > min_depths;
+    std::vector<std::vector<float> > max_depths;
+  };
+
+  void Init();
+  void BuildDepthPyramid(const Panorama& panorama, DepthPyramid* pyramid) const;
+  // Range of the depths over the columns [u_begin, u_end] (wrapping
+  // around) and the rows [v_begin, v_end] of the depth image.
+  void GetDepthRange(const DepthPyramid& pyramid,
+                     const int u_begin, const int u_end,
+                     const int v_begin, const int v_end,
+                     double* min_depth, double* max_depth) const;
+  int FindRoom(const Eigen::Vector3d& point) const;
+
+  std::vector<const Panorama*> panoramas;
+  const int num_threads;
+  std::vector<DepthPyramid> depth_pyramids;
+
+  // Room prefilter.
+  const Floorplan* floorplan;
+  std::vector<int> panorama_rooms;
+  // room_panoramas[room]: panoramas that may see the room.
+  std::vector<std::vector<int> > room_panoramas;
+};
+
+}  // namespace structured_indoor_modeling
+
+#endif  // BASE_VISIBILITY_H_
@@ -1,6 +1,9 @@
 #include <fstream>
 #include <iostream>
 #include "../../base/indoor_polygon.h"
+#include "../../base/parallel.h"
+#include "../../base/tracing.h"
+#include "../../base/visibility.h"
 #include "polygon_triangulation2.h"
 #include "generate_object_icons.h"
 #include <opencv2/opencv.hpp>
@@ -71,8 +74,26 @@ void RasterizeObjectIds(const std::vector<Panorama>& panoramas,
   object_id_maps->clear();
   object_id_maps->resize(num_panoramas);
 
+  // Objects entirely behind (or in front of) the depths of a panorama
+  // are decided at once.
+  vector<vector<AlignedBox3d> > object_boxes(num_rooms);
+  for (int room = 0; room < num_rooms; ++room) {
+    const PointCloud& point_cloud = object_point_clouds[room];
+    for (int q = 0; q < point_cloud.GetNumPoints(); ++q) {
+      const Point& point = point_cloud.GetPoint(q);
+      if (point.object_id == -1) {
+        cerr << "No object id assigned to a point." << endl;
+        exit (1);
+      }
+      if (point.object_id >= (int)object_boxes[room].size())
+        object_boxes[room].resize(point.object_id + 1);
+      object_boxes[room][point.object_id].extend(point.position);
+    }
+  }
+  const VisibilityIndex visibility(panoramas);
+
   cerr << "RasterizeObjectIds:" << flush;
-  for (int p = 0; p < num_panoramas; ++p) {
+  ParallelFor(0, num_panoramas, [&](const int p) {
     cerr << "." << flush;
     const Panorama& panorama = panoramas[p];
     const double visibility_threshold = panorama.GetAverageDistance() * kThresholdRatio;
@@ -83,22 +104,27 @@ void RasterizeObjectIds(const std::vector<Panorama>& panoramas,
 
     for (int room = 0; room < num_rooms; ++room) {
       const PointCloud& point_cloud = object_point_clouds[room];
+      vector<VisibilityIndex::BoxVisibility> object_visibilities(object_boxes[room].size());
+      for (int object = 0; object < (int)object_boxes[room].size(); ++object)
+        object_visibilities[object] =
+          visibility.TestBox(object_boxes[room][object], p, visibility_threshold);
 
       for (int q = 0; q < point_cloud.GetNumPoints(); ++q) {
         const Point& point = point_cloud.GetPoint(q);
-        if (point.object_id == -1) {
-          cerr << "No object id assigned to a point." << endl;
-          exit (1);
-        }
         const ObjectId object_id = pair<int, int>(room, point.object_id);
+        const VisibilityIndex::BoxVisibility object_visibility = object_visibilities[point.object_id];
+        if (object_visibility == VisibilityIndex::kInvisible)
+          continue;
 
         const Vector2d depth_pixel = panorama.ProjectToDepth(point.position);
-        const double depth = panorama.GetDepth(depth_pixel);
-        const double distance = (point.position - panorama.GetCenter()).norm();
+        if (object_visibility == VisibilityIndex::kPartial) {
+          const double depth = panorama.GetDepth(depth_pixel);
+          const double distance = (point.position - panorama.GetCenter()).norm();
 
-        // Invisible.
-        if (distance > depth + visibility_threshold)
-          continue;
+          // Invisible.
+          if (distance > depth + visibility_threshold)
+            continue;
+        }
 
         const int u = static_cast<int>(round(depth_pixel[0]));
         const int v = static_cast<int>(round(depth_pixel[1]));
@@ -141,7 +167,7 @@ void RasterizeObjectIds(const std::vector<Panorama>& panoramas,
     }
     */
 
-  }
+  });
   cerr << endl;
 }
 
@@ -193,107 +219,135 @@ void AssociateObjectId(const std::vector<Panorama>& panoramas,
   }
 }
 
+void ObjectGrid::Reset(const int new_width, const int new_height) {
+  width = new_width;
+  height = new_height;
+  values.assign(width * height, 0.0);
+}
+
+namespace {
+
+// Per worker buffers of AddIconInformationToDetections.
+struct IconWorkspace {
+  vector<Vector3d> manhattan_points;
+  vector<double> histograms[3];
+  ObjectGrid grid;
+};
+
+// Points in the Manhattan coordinate system and their 5 and 95
+// percentiles along each axis. Returns false for an empty object.
+bool ComputeObjectRanges(const IndoorPolygon& indoor_polygon,
+                         const PointCloud& point_cloud,
+                         const int object,
+                         IconWorkspace* workspace,
+                         Detection* detection) {
+  const ObjectPointSpan points = point_cloud.GetObjectPointSpan(object);
+  vector<Vector3d>& manhattan_points = workspace->manhattan_points;
+  manhattan_points.clear();
+  for (int a = 0; a < 3; ++a)
+    workspace->histograms[a].clear();
+  for (const auto& point : points) {
+    const Vector3d& manhattan = indoor_polygon.GlobalToManhattan(point.position);
+    manhattan_points.push_back(manhattan);
+    for (int a = 0; a < 3; ++a) {
+      workspace->histograms[a].push_back(manhattan[a]);
+    }
+  }
+  if (manhattan_points.empty())
+    return false;
+
+  // 5 percentile and 95 percentile.
+  for (int a = 0; a < 3; ++a) {
+    vector<double>& histogram = workspace->histograms[a];
+    const int lower = min(static_cast<int>(round(histogram.size() * 0.05)),
+                          static_cast<int>(histogram.size()) - 1);
+    const int upper = min(static_cast<int>(round(histogram.size() * 0.95)),
+                          static_cast<int>(histogram.size()) - 1);
+    nth_element(histogram.begin(), histogram.begin() + lower, histogram.end());
+    detection->ranges[a][0] = histogram[lower];
+    nth_element(histogram.begin(), histogram.begin() + upper, histogram.end());
+    detection->ranges[a][1] = histogram[upper];
+  }
+  return true;
+}
+
+}  // namespace
+
 void AddIconInformationToDetections(const IndoorPolygon& indoor_polygon,
                                     const std::vector<PointCloud>& object_point_clouds,
                                     const std::map<ObjectId, int>& object_to_detection,
+                                    const IconOptions& options,
                                     std::vector<Detection>* detections) {
-    const int num_room = object_point_clouds.size();
-    vector<vector<bool> >isAdded(num_room);
-    for(int roomid=0; roomid<isAdded.size(); roomid++){
-	isAdded[roomid].resize(object_point_clouds[roomid].GetNumObjects());
-	for(int objid=0; objid<isAdded[roomid].size(); objid++)
-	    isAdded[roomid][objid] = false;
-    }
-    
+  const int num_room = object_point_clouds.size();
+  vector<vector<bool> > is_added(num_room);
+  for (int room = 0; room < num_room; ++room)
+    is_added[room].resize(object_point_clouds[room].GetNumObjects(), false);
+
+  // Associated objects first (in the map order), then the others. Each
+  // job works on its own copy, merged back serially in the job order.
+  vector<ObjectId> objects;
+  vector<Detection> results;
   for (const auto& item : object_to_detection) {
-    const ObjectId& object_id = item.first;
-    Detection& detection = detections->at(item.second);
-    detection.room = object_id.first;
-    detection.object = object_id.second;
-
-    isAdded[detection.room][detection.object] = true;
-
-    vector<Point> points;
-    vector<Vector3d>manhattanpoints;
-    object_point_clouds[detection.room].GetObjectPoints(detection.object, points);
-
-    vector<double> histograms[3];
-    for (const auto& point : points) {
-      const Vector3d& manhattan = indoor_polygon.GlobalToManhattan(point.position);
-      manhattanpoints.push_back(manhattan);
-      for (int a = 0; a < 3; ++a) {
-        histograms[a].push_back(manhattan[a]);
-      }
-    }
-
-    // 5 percentile and 95 percentile.
-    for (int a = 0; a < 3; ++a) {
-      vector<double>::iterator lower_ite =
-        histograms[a].begin() + static_cast<int>(round(histograms[a].size() * 0.05));
-      vector<double>::iterator upper_ite =
-        histograms[a].begin() + static_cast<int>(round(histograms[a].size() * 0.95));
-      
-      nth_element(histograms[a].begin(), lower_ite, histograms[a].end());
-      detection.ranges[a][0] = *lower_ite;
-      nth_element(histograms[a].begin(), upper_ite, histograms[a].end());
-      detection.ranges[a][1] = *upper_ite;
+    objects.push_back(item.first);
+    results.push_back(detections->at(item.second));
+    is_added[item.first.first][item.first.second] = true;
+  }
+  const int num_associated = objects.size();
+  for (int room = 0; room < num_room; ++room) {
+    for (int object = 0; object < object_point_clouds[room].GetNumObjects(); ++object) {
+      if (is_added[room][object])
+        continue;
+      objects.push_back(ObjectId(room, object));
+      results.push_back(Detection());
+      results.back().names.resize(1);
+      results.back().names[0] = "unknown";
     }
-    //compute polygon
-    ComputeObjectPolygon(manhattanpoints, detection);
   }
 
-  //Add non-detected objects
+  // Non-detected objects smaller than this on the floorplan are dropped.
   const double min_area = 1e5;
-  for(int roomid=0; roomid<num_room; ++roomid){
-      const PointCloud& room_cloud = object_point_clouds[roomid];
-      for(int objid=0; objid<room_cloud.GetNumObjects(); ++objid){
-	  if(isAdded[roomid][objid])
-	      continue;
-
-	  Detection detection;
-	  detection.room = roomid;
-	  detection.object = objid;
-	  detection.names.resize(1);
-	  detection.names[0] = "unknown";
-
-	  vector<Point>objpt;
-	  vector<Vector3d>manhattanpoints;
-	  room_cloud.GetObjectPoints(objid, objpt);
-	  
-	  vector<double> histograms[3];
-	  for (const auto& point : objpt) {
-	      Vector3d manhattan = indoor_polygon.GlobalToManhattan(point.position);
-	      manhattanpoints.push_back(manhattan);
-	      for (int a = 0; a < 3; ++a) {
-		  histograms[a].push_back(manhattan[a]);
-	      }
-	  }
-	  // 5 percentile and 95 percentile.
-	  for (int a = 0; a < 3; ++a) {
-	      vector<double>::iterator lower_ite =
-		  histograms[a].begin() + static_cast<int>(round(histograms[a].size() * 0.05));
-	      vector<double>::iterator upper_ite =
-		  histograms[a].begin() + static_cast<int>(round(histograms[a].size() * 0.95));
-      
-	      nth_element(histograms[a].begin(), lower_ite, histograms[a].end());
-	      detection.ranges[a][0] = *lower_ite;
-	      nth_element(histograms[a].begin(), upper_ite, histograms[a].end());
-	      detection.ranges[a][1] = *upper_ite;
-	  }
-	  
-	  const double area_on_floorplan = (detection.ranges[0][1] - detection.ranges[0][0]) * (detection.ranges[1][1] - detection.ranges[1][0]);
-	  if(area_on_floorplan >= min_area){
-	       ComputeObjectPolygon(manhattanpoints, detection);
-	       detections->push_back(detection);
-	  }
-
+  vector<char> keep(objects.size(), 0);
+  vector<IconWorkspace> workspaces(GetNumThreads(options.num_threads));
+  ParallelForWithThreadId(0, objects.size(), [&](const int j, const int thread) {
+      const ScopedTrace trace("ComputeObjectIcon");
+      IconWorkspace& workspace = workspaces[thread];
+      Detection& detection = results[j];
+      detection.room = objects[j].first;
+      detection.object = objects[j].second;
+      if (!ComputeObjectRanges(indoor_polygon,
+                               object_point_clouds[detection.room],
+                               detection.object,
+                               &workspace,
+                               &detection))
+        return;
+
+      if (j >= num_associated) {
+        const double area_on_floorplan =
+          (detection.ranges[0][1] - detection.ranges[0][0]) *
+          (detection.ranges[1][1] - detection.ranges[1][0]);
+        if (area_on_floorplan < min_area)
+          return;
       }
+      ComputeObjectPolygon(workspace.manhattan_points,
+                           options.write_debug_images,
+                           &workspace.grid,
+                           detection);
+      keep[j] = 1;
+    }, options.num_threads);
+
+  int j = 0;
+  for (const auto& item : object_to_detection)
+    detections->at(item.second) = results[j++];
+  for (; j < (int)objects.size(); ++j) {
+    if (keep[j])
+      detections->push_back(results[j]);
   }
-  
 }
 
 
     void ComputeObjectPolygon(const vector<Vector3d>& manhattan,
+			      const bool write_debug_images,
+			      ObjectGrid* object_grid,
 			      Detection &detection){
 	static const double grid_size = 40.0;
 	vector<double>bbox(4);
@@ -304,67 +358,58 @@ void AddIconInformationToDetections(const IndoorPolygon& indoor_polygon,
 	    bbox[2] = std::min(bbox[2], v[1]);
 	    bbox[3] = std::max(bbox[3], v[1]);
 	}
-//	bbox[0] = detection.ranges[0][0]; bbox[1] = detection.ranges[0][1];
-//	bbox[2] = detection.ranges[1][0]; bbox[3] = detection.ranges[1][1];
-	//asslocate grid
+	//allocate grid
 	const int size_x = ceil((bbox[1] - bbox[0])/(grid_size));
 	const int size_y = ceil((bbox[3] - bbox[2])/(grid_size));
 	const int margin_begin = 5;
 	const int margin_end = 5;
-	double maxv = -1;
-	double minv = 99999;
-	vector<vector<double> >grid(size_y+margin_end+margin_begin);
-	for(auto& v:grid){
-	    v.resize(size_x+margin_end+margin_begin);
-	    for(auto& vv:v)
-		vv = 0.0;
-	}
+	ObjectGrid& grid = *object_grid;
+	grid.Reset(size_x+margin_end+margin_begin, size_y+margin_end+margin_begin);
 	for(const auto&point: manhattan){
 	    const double curx = (point[0] - bbox[0]) / grid_size;
 	    const double cury = (point[1] - bbox[2]) / grid_size;
 	    if(curx >=0 && floor(curx)<size_x &&
 	       cury >=0 && floor(cury)<size_y){
-		grid[static_cast<int>(cury+margin_begin)][static_cast<int>(curx+margin_begin)] += 1.0;
+		grid.At(static_cast<int>(curx+margin_begin), static_cast<int>(cury+margin_begin)) += 1.0;
 	    }
 	}
 	
 	const double isovalue = 0.5;
 	const int dialate_iter = 2;
-	
-	cv::Mat cmap(grid.size(), grid[0].size(), CV_8UC3);
-	cv::Mat binary(grid.size(), grid[0].size(), CV_8UC3);
-	for(int y=0; y<grid.size(); ++y){
-	    for(int x=0; x<grid[0].size(); ++x){
-		uchar curpix = static_cast<uchar>(grid[y][x] * 10);
-		cmap.at<cv::Vec3b>(y,x) = cv::Vec3b(curpix,curpix,curpix);
-		if(grid[y][x] > isovalue)
-		    binary.at<cv::Vec3b>(y,x) = cv::Vec3b(255,255,255);
-		else
-		    binary.at<cv::Vec3b>(y,x) = cv::Vec3b(0,0,0);
+
+	cv::Mat cmap;
+	if(write_debug_images){
+	    cmap = cv::Mat(grid.height, grid.width, CV_8UC3);
+	    cv::Mat binary(grid.height, grid.width, CV_8UC3);
+	    for(int y=0; y<grid.height; ++y){
+		for(int x=0; x<grid.width; ++x){
+		    uchar curpix = static_cast<uchar>(grid.At(x, y) * 10);
+		    cmap.at<cv::Vec3b>(y,x) = cv::Vec3b(curpix,curpix,curpix);
+		    if(grid.At(x, y) > isovalue)
+			binary.at<cv::Vec3b>(y,x) = cv::Vec3b(255,255,255);
+		    else
+			binary.at<cv::Vec3b>(y,x) = cv::Vec3b(0,0,0);
+		}
 	    }
+	    char buffer[100];
+	    sprintf(buffer,"cmap_room%03d_obj%03d.png",detection.room,detection.object);
+	    cv::imwrite(buffer, cmap);
+	    sprintf(buffer,"binary_room%03d_obj%03d.png",detection.room,detection.object);
+	    cv::imwrite(buffer, binary);
 	}
-	char buffer[100];
-	sprintf(buffer,"cmap_room%03d_obj%03d.png",detection.room,detection.object);
-	cv::imwrite(buffer, cmap);
-	cv::waitKey(10);
-	sprintf(buffer,"binary_room%03d_obj%03d.png",detection.room,detection.object);
-	cv::imwrite(buffer, binary);
-	cv::waitKey(10);
 
 	//close
 	for(int iter=0; iter<dialate_iter; ++iter){
-	     vector<vector<double> >grid_copy = grid;
+	     grid.previous_values = grid.values;
+	     const double* grid_copy = grid.previous_values.data();
 	     for(int y=margin_begin; y<size_y+margin_begin; ++y){
 		  for(int x=margin_begin; x<size_x+margin_begin; ++x){
 		       for(int dy=-1; dy<=1; ++dy){
 			    for(int dx=-1; dx<=1; ++dx){
 				 if(dx==0 && dy==0)
 				      continue;
-				 // if(y+dy < margin_begin || y+dy>=size_y+margin_begin ||
-				 //    x+dx < margin_begin || x+dx>=size_x+margin_begin)
-				 //     continue;
-				 if(grid_copy[y+dy][x+dx] >= isovalue){
-				      grid[y][x] = isovalue + 1.0;
+				 if(grid_copy[(y+dy)*grid.width + x+dx] >= isovalue){
+				      grid.At(x, y) = isovalue + 1.0;
 				      break;
 				 }
 
@@ -372,23 +417,6 @@ void AddIconInformationToDetections(const IndoorPolygon& indoor_polygon,
 		       }
 		  }
 	     }
-	     // for(int y=margin_begin; y<size_y+margin_begin; ++y){
-	     // 	 for(int x=margin_begin; x<size_x+margin_begin; ++x){
-	     // 	     for(int dy=-1; dy<=1; ++dy){
-	     // 		 for(int dx=-1; dx<=1; ++dx){
-	     // 		     if(dx==0 && dy==0)
-	     // 			 continue;
-	     // 		     if(y+dy < margin_begin || y+dy>=size_y+margin_begin ||
-	     // 			x+dx < margin_begin || x+dx>=size_x+margin_begin)
-	     // 			 continue;
-	     // 		     if(grid_copy[y+dy][x+dx] < isovalue){
-	     // 			 grid[y][x] = 0;
-	     // 			 break;
-	     // 		     }
-	     // 		 }
-	     // 	     }
-	     // 	 }
-	     // }
 	}
 
 	vector<Vector2i>linelist;
@@ -398,17 +426,14 @@ void AddIconInformationToDetections(const IndoorPolygon& indoor_polygon,
 //	Smoothing(detection.vlist, 1);
 	Simplification(detection.vlist, 30, 0.01);
 
-	for(int i=0; i<detection.vlist.size()-1; i++){
-	    cv::line(cmap, cv::Point(detection.vlist[i][0],detection.vlist[i][1]), cv::Point(detection.vlist[i+1][0],detection.vlist[i+1][1]), cv::Scalar(0,255,255));
+	if(write_debug_images){
+	    for(int i=0; i<detection.vlist.size()-1; i++){
+		cv::line(cmap, cv::Point(detection.vlist[i][0],detection.vlist[i][1]), cv::Point(detection.vlist[i+1][0],detection.vlist[i+1][1]), cv::Scalar(0,255,255));
+	    }
+	    char buffer[100];
+	    sprintf(buffer,"contour_room%03d_obj%03d.png",detection.room,detection.object);
+	    cv::imwrite(buffer, cmap);
 	}
-	// for(const auto& line: linelist){
-	//     cv::line(cmap, cv::Point(detection.vlist[line[0]][0], detection.vlist[line[0]][1]),
-	// 	     cv::Point(detection.vlist[line[1]][0],detection.vlist[line[1]][1]), cv::Scalar(0,255,255));
-	// }
-	 sprintf(buffer,"contour_room%03d_obj%03d.png",detection.room,detection.object);
-	cv::imwrite(buffer, cmap);
-	cv::waitKey(10);
-	
 
 	for(auto &v :detection.vlist){
 	    v[0] = (v[0]-margin_begin)*grid_size + bbox[0];
@@ -421,28 +446,26 @@ void AddIconInformationToDetections(const IndoorPolygon& indoor_polygon,
 	
     }
 
-     void MarchingCube(std::vector<std::vector<double> >&grid,
+     void MarchingCube(ObjectGrid& object_grid,
 		       std::vector<Vector2d>&vlist,
 		       std::vector<Vector2i>&elist,
 		       const double isovalue){
-	  if(grid.size() == 0)
+	  if(object_grid.width == 0 || object_grid.height == 0)
 	       return;
-//	  cout<<"Marching cube..."<<endl<<flush;
-	  const int size_y = grid.size();
-	  const int size_x = grid[0].size();
-	  vector<vector<Vector2i> >ptindex(size_y);
-	  {
-	       for(auto& v:ptindex){
-		    v.resize(size_x);
-		    for(auto&vv: v)
-			 vv = Vector2i(-1,-1);;
-	       }
-	  }
+	  const int size_y = object_grid.height;
+	  const int size_x = object_grid.width;
+	  object_grid.vertex_ids.assign(size_x * size_y, Vector2i(-1,-1));
+	  auto grid = [&object_grid](const int y, const int x) -> double& {
+	       return object_grid.At(x, y);
+	  };
+	  auto ptindex = [&object_grid](const int y, const int x) -> Vector2i& {
+	       return object_grid.vertex_ids[y * object_grid.width + x];
+	  };
 
 	  for(int y=0;y<size_y; ++y){
 	       for(int x=0;x<size_x;++x){
-		    if(grid[y][x] == isovalue)
-			 grid[y][x] -= 0.01;
+		    if(grid(y,x) == isovalue)
+			 grid(y,x) -= 0.01;
 	       }
 	  }
 
@@ -450,32 +473,32 @@ void AddIconInformationToDetections(const IndoorPolygon& indoor_polygon,
 	  for(int y=0; y<size_y-1; y++){
 	       for(int x=0; x<size_x-1; x++){
 		    unsigned char curshape = 0;
-		    if(grid[y][x] > isovalue)
+		    if(grid(y,x) > isovalue)
 			 curshape = curshape | 8;
-		    if(grid[y][x+1] > isovalue)
+		    if(grid(y,x+1) > isovalue)
 			 curshape = curshape | 4;
-		    if(grid[y+1][x+1] > isovalue)
+		    if(grid(y+1,x+1) > isovalue)
 			 curshape = curshape | 2;
-		    if(grid[y+1][x] > isovalue)
+		    if(grid(y+1,x) > isovalue)
 			 curshape = curshape | 1;
-		    if(grid[y][x]+grid[y][x+1]+grid[y+1][x+1]+grid[y+1][x]!=0)
+		    if(grid(y,x)+grid(y,x+1)+grid(y+1,x+1)+grid(y+1,x)!=0)
 		    if(curshape == 8 || curshape == 7){
 			Vector2i curedge;
-			Vector2d pt1(x+(isovalue-grid[y][x])/(grid[y][x+1]-grid[y][x]),y);
-			Vector2d pt2(x, y+(isovalue-grid[y][x]) / (grid[y+1][x] - grid[y][x]));
-			if(ptindex[y][x][0] != -1)
-			    curedge[0] = ptindex[y][x][0];
+			Vector2d pt1(x+(isovalue-grid(y,x))/(grid(y,x+1)-grid(y,x)),y);
+			Vector2d pt2(x, y+(isovalue-grid(y,x)) / (grid(y+1,x) - grid(y,x)));
+			if(ptindex(y,x)[0] != -1)
+			    curedge[0] = ptindex(y,x)[0];
 			else{
 			    vlist.push_back(pt1);
-			    ptindex[y][x][0] = vlist.size() - 1;
+			    ptindex(y,x)[0] = vlist.size() - 1;
 			    curedge[0] = vlist.size() - 1;
 			}
 
-			if(ptindex[y][x][1] != -1)
-			    curedge[1] = ptindex[y][x][1];
+			if(ptindex(y,x)[1] != -1)
+			    curedge[1] = ptindex(y,x)[1];
 			else{
 			    vlist.push_back(pt2);
-			    ptindex[y][x][1] = vlist.size() - 1;
+			    ptindex(y,x)[1] = vlist.size() - 1;
 			    curedge[1] = vlist.size() - 1;
 			}
 			elist.push_back(curedge);
@@ -483,20 +506,20 @@ void AddIconInformationToDetections(const IndoorPolygon& indoor_polygon,
 		    }
 		    if(curshape == 11 || curshape == 4){
 			Vector2i curedge;
-			Vector2d pt1(x+(isovalue-grid[y][x])/(grid[y][x+1]-grid[y][x]),y);
-			Vector2d pt2(x+1, y+(isovalue-grid[y][x+1]) / (grid[y+1][x+1] - grid[y][x+1]));
-			if(ptindex[y][x][0] != -1)
-			    curedge[0] = ptindex[y][x][0];
+			Vector2d pt1(x+(isovalue-grid(y,x))/(grid(y,x+1)-grid(y,x)),y);
+			Vector2d pt2(x+1, y+(isovalue-grid(y,x+1)) / (grid(y+1,x+1) - grid(y,x+1)));
+			if(ptindex(y,x)[0] != -1)
+			    curedge[0] = ptindex(y,x)[0];
 			else{
 			    vlist.push_back(pt1);
-			    ptindex[y][x][0] = vlist.size() - 1;
+			    ptindex(y,x)[0] = vlist.size() - 1;
 			    curedge[0] = vlist.size() - 1;
 			}
-			if(ptindex[y][x+1][1] != -1)
-			    curedge[1] = ptindex[y][x+1][1];
+			if(ptindex(y,x+1)[1] != -1)
+			    curedge[1] = ptindex(y,x+1)[1];
 			else{
 			    vlist.push_back(pt2);
-			    ptindex[y][x+1][1] = vlist.size() - 1;
+			    ptindex(y,x+1)[1] = vlist.size() - 1;
 			    curedge[1] = vlist.size() - 1;
 			}
 			elist.push_back(curedge);
@@ -505,20 +528,20 @@ void AddIconInformationToDetections(const IndoorPolygon& indoor_polygon,
 		    
 		    if(curshape == 2 || curshape == 13){
 			Vector2i curedge;
-			Vector2d pt1(x+(isovalue-grid[y+1][x])/(grid[y+1][x+1]-grid[y+1][x]),y+1);
-			Vector2d pt2(x+1, y+(isovalue-grid[y][x+1]) / (grid[y+1][x+1] - grid[y][x+1]));
-			if(ptindex[y+1][x][0] != -1)
-			    curedge[0] = ptindex[y+1][x][0];
+			Vector2d pt1(x+(isovalue-grid(y+1,x))/(grid(y+1,x+1)-grid(y+1,x)),y+1);
+			Vector2d pt2(x+1, y+(isovalue-grid(y,x+1)) / (grid(y+1,x+1) - grid(y,x+1)));
+			if(ptindex(y+1,x)[0] != -1)
+			    curedge[0] = ptindex(y+1,x)[0];
 			else{
 			    vlist.push_back(pt1);
-			    ptindex[y+1][x][0] = vlist.size() - 1;
+			    ptindex(y+1,x)[0] = vlist.size() - 1;
 			    curedge[0] = vlist.size() - 1;
 			}
-			if(ptindex[y][x+1][1] != -1)
-			    curedge[1] = ptindex[y][x+1][1];
+			if(ptindex(y,x+1)[1] != -1)
+			    curedge[1] = ptindex(y,x+1)[1];
 			else{
 			    vlist.push_back(pt2);
-			    ptindex[y][x+1][1] = vlist.size() - 1;
+			    ptindex(y,x+1)[1] = vlist.size() - 1;
 			    curedge[1] = vlist.size() - 1;
 			}
 			elist.push_back(curedge);
@@ -527,20 +550,20 @@ void AddIconInformationToDetections(const IndoorPolygon& indoor_polygon,
 		    
 		    if(curshape == 1 || curshape == 14){
 			Vector2i curedge;
-			Vector2d pt1(x+(isovalue-grid[y+1][x])/(grid[y+1][x+1]-grid[y+1][x]),y+1);
-			Vector2d pt2(x, y+(isovalue-grid[y][x]) / (grid[y+1][x] - grid[y][x]));
-			if(ptindex[y+1][x][0] != -1)
-			    curedge[0] = ptindex[y+1][x][0];
+			Vector2d pt1(x+(isovalue-grid(y+1,x))/(grid(y+1,x+1)-grid(y+1,x)),y+1);
+			Vector2d pt2(x, y+(isovalue-grid(y,x)) / (grid(y+1,x) - grid(y,x)));
+			if(ptindex(y+1,x)[0] != -1)
+			    curedge[0] = ptindex(y+1,x)[0];
 			else{
 			    vlist.push_back(pt1);
-			    ptindex[y+1][x][0] = vlist.size() - 1;
+			    ptindex(y+1,x)[0] = vlist.size() - 1;
 			    curedge[0] = vlist.size() - 1;
 			}
-			if(ptindex[y][x][1] != -1)
-			    curedge[1] = ptindex[y][x][1];
+			if(ptindex(y,x)[1] != -1)
+			    curedge[1] = ptindex(y,x)[1];
 			else{
 			    vlist.push_back(pt2);
-			    ptindex[y][x][1] = vlist.size() - 1;
+			    ptindex(y,x)[1] = vlist.size() - 1;
 			    curedge[1] = vlist.size() - 1;
 			}
 			elist.push_back(curedge);
@@ -549,21 +572,21 @@ void AddIconInformationToDetections(const IndoorPolygon& indoor_polygon,
 		    
 		    if(curshape == 9 || curshape == 6){
 			Vector2i curedge;
-			Vector2d pt1(x+(isovalue-grid[y][x])/(grid[y][x+1]-grid[y][x]),y);
-			Vector2d pt2(x+(isovalue-grid[y+1][x])/(grid[y+1][x+1]-grid[y+1][x]),y+1);
-			if(ptindex[y][x][0] != -1)
-			    curedge[0] = ptindex[y][x][0];
+			Vector2d pt1(x+(isovalue-grid(y,x))/(grid(y,x+1)-grid(y,x)),y);
+			Vector2d pt2(x+(isovalue-grid(y+1,x))/(grid(y+1,x+1)-grid(y+1,x)),y+1);
+			if(ptindex(y,x)[0] != -1)
+			    curedge[0] = ptindex(y,x)[0];
 			else{
 			    vlist.push_back(pt1);
-			    ptindex[y][x][0] = vlist.size() - 1;
+			    ptindex(y,x)[0] = vlist.size() - 1;
 			    curedge[0] = vlist.size() - 1;
 			}
-			if(ptindex[y+1][x][0] != -1)
-			    curedge[1] = ptindex[y+1][x][0];
+			if(ptindex(y+1,x)[0] != -1)
+			    curedge[1] = ptindex(y+1,x)[0];
 			else{
 
 			    vlist.push_back(pt2);
-			    ptindex[y+1][x][0] = vlist.size() - 1;
+			    ptindex(y+1,x)[0] = vlist.size() - 1;
 			    curedge[1] = vlist.size() - 1;
 			}
 			elist.push_back(curedge);
@@ -572,22 +595,22 @@ void AddIconInformationToDetections(const IndoorPolygon& indoor_polygon,
 		    
 		    if(curshape == 3 || curshape == 12){
 			Vector2i curedge;
-			Vector2d pt1(x, y+(isovalue-grid[y][x]) / (grid[y+1][x] - grid[y][x]));
-			Vector2d pt2(x+1, y+(isovalue-grid[y][x+1]) / (grid[y+1][x+1] - grid[y][x+1]));
-			if(ptindex[y][x][1] != -1)
-			    curedge[0] = ptindex[y][x][1];
+			Vector2d pt1(x, y+(isovalue-grid(y,x)) / (grid(y+1,x) - grid(y,x)));
+			Vector2d pt2(x+1, y+(isovalue-grid(y,x+1)) / (grid(y+1,x+1) - grid(y,x+1)));
+			if(ptindex(y,x)[1] != -1)
+			    curedge[0] = ptindex(y,x)[1];
 			else{
 
 			    vlist.push_back(pt1);
-			    ptindex[y][x][1] = vlist.size() - 1;
+			    ptindex(y,x)[1] = vlist.size() - 1;
 			    curedge[0] = vlist.size() - 1;
 			}
-			if(ptindex[y][x+1][1] != -1)
-			    curedge[1] = ptindex[y][x+1][1];
+			if(ptindex(y,x+1)[1] != -1)
+			    curedge[1] = ptindex(y,x+1)[1];
 			else{
 
 			    vlist.push_back(pt2);
-			    ptindex[y][x+1][1] = vlist.size() - 1;
+			    ptindex(y,x+1)[1] = vlist.size() - 1;
 			    curedge[1] = vlist.size() - 1;
 			}
 			elist.push_back(curedge);
@@ -597,72 +620,72 @@ void AddIconInformationToDetections(const IndoorPolygon& indoor_polygon,
 		    
 		    if(curshape == 10 || curshape == 5){
 			Vector2i curedge1, curedge2;
-			 Vector2d pt1(x+(isovalue-grid[y][x])/(grid[y][x+1]-grid[y][x]),y);
-			 Vector2d pt2(x+1, y+(isovalue-grid[y][x+1]) / (grid[y+1][x+1] - grid[y][x+1]));
-			 Vector2d pt3(x+(isovalue-grid[y+1][x])/(grid[y+1][x+1]-grid[y+1][x]),y+1);
-			 Vector2d pt4(x, y+(isovalue-grid[y][x]) / (grid[y+1][x] - grid[y][x]));
+			 Vector2d pt1(x+(isovalue-grid(y,x))/(grid(y,x+1)-grid(y,x)),y);
+			 Vector2d pt2(x+1, y+(isovalue-grid(y,x+1)) / (grid(y+1,x+1) - grid(y,x+1)));
+			 Vector2d pt3(x+(isovalue-grid(y+1,x))/(grid(y+1,x+1)-grid(y+1,x)),y+1);
+			 Vector2d pt4(x, y+(isovalue-grid(y,x)) / (grid(y+1,x) - grid(y,x)));
 			 if(curshape == 5){
-			     if(ptindex[y][x][0] != -1)
-				 curedge1[0] = ptindex[y][x][0];
+			     if(ptindex(y,x)[0] != -1)
+				 curedge1[0] = ptindex(y,x)[0];
 			     else
 			     {
 				 vlist.push_back(pt1);
 				 curedge1[0] = vlist.size() - 1;
-				 ptindex[y][x][0] = curedge1[0];
+				 ptindex(y,x)[0] = curedge1[0];
 			     }
-			     if(ptindex[y][x][1] != -1)
-				 curedge1[1] = ptindex[y][x][1];
+			     if(ptindex(y,x)[1] != -1)
+				 curedge1[1] = ptindex(y,x)[1];
 			     else{
 				 vlist.push_back(pt4);
 				 curedge1[1] = vlist.size() - 1;
-				 ptindex[y][x][1] = curedge1[1];
+				 ptindex(y,x)[1] = curedge1[1];
 			     }
 			     
-			     if(ptindex[y][x+1][1] != -1)
-				 curedge2[0] = ptindex[y][x+1][1];
+			     if(ptindex(y,x+1)[1] != -1)
+				 curedge2[0] = ptindex(y,x+1)[1];
 			     else{
 				 vlist.push_back(pt2);
 				 curedge2[0] = vlist.size() - 1;
-				 ptindex[y][x+1][1] = curedge2[0];
+				 ptindex(y,x+1)[1] = curedge2[0];
 			     }
-			     if(ptindex[y+1][x][0] != -1)
-				 curedge2[1] = ptindex[y+1][x][0];
+			     if(ptindex(y+1,x)[0] != -1)
+				 curedge2[1] = ptindex(y+1,x)[0];
 			     else{
 				 vlist.push_back(pt3);
 				 curedge2[1] = vlist.size() - 1;
-				 ptindex[y+1][x][0] = curedge2[1];
+				 ptindex(y+1,x)[0] = curedge2[1];
 			     }
 
 			 }
 			 
 			 if(curshape == 10){
-			     if(ptindex[y][x][0] != -1)
-				 curedge1[0] = ptindex[y][x][0];
+			     if(ptindex(y,x)[0] != -1)
+				 curedge1[0] = ptindex(y,x)[0];
 			     else{
 				 vlist.push_back(pt1);
 				 curedge1[0] = vlist.size() - 1;
-				 ptindex[y][x][0] = curedge1[0];
+				 ptindex(y,x)[0] = curedge1[0];
 			     }
-			     if(ptindex[y][x+1][1] != -1)
-				 curedge1[1] = ptindex[y][x+1][1];
+			     if(ptindex(y,x+1)[1] != -1)
+				 curedge1[1] = ptindex(y,x+1)[1];
 			     else{
 				 vlist.push_back(pt2);
 				 curedge1[1] = vlist.size() - 1;
-				 ptindex[y][x+1][1] = curedge1[1];
+				 ptindex(y,x+1)[1] = curedge1[1];
 			     }
-			     if(ptindex[y][x][1] != -1)
-				 curedge2[0] = ptindex[y][x][1];
+			     if(ptindex(y,x)[1] != -1)
+				 curedge2[0] = ptindex(y,x)[1];
 			     else{
 				 vlist.push_back(pt4);
 				 curedge2[0] = vlist.size() - 1;
-				 ptindex[y][x][1] = curedge2[0];
+				 ptindex(y,x)[1] = curedge2[0];
 			     }
-			     if(ptindex[y+1][x][0] != -1)
-				 curedge2[1] = ptindex[y+1][x][0];
+			     if(ptindex(y+1,x)[0] != -1)
+				 curedge2[1] = ptindex(y+1,x)[0];
 			     else{
 				 vlist.push_back(pt3);
 				 curedge2[1] = vlist.size() - 1;
-				 ptindex[y+1][x][0] = curedge2[1];
+				 ptindex(y+1,x)[0] = curedge2[1];
 			     }
 			 }
 			 elist.push_back(curedge1);
@@ -25,15 +25,52 @@ void AssociateObjectId(const std::vector<Panorama>& panoramas,
                        const double area_threshold,
                        std::map<ObjectId, int>* object_id_to_detection);
 
+struct IconOptions {
+  IconOptions() : num_threads(0), write_debug_images(false) {}
+  // Objects processed in parallel (all cores if <= 0).
+  int num_threads;
+  // Writes the density grid, the binary grid and the contour of each
+  // object (cmap_, binary_ and contour_roomXXX_objXXX.png) to the
+  // working directory.
+  bool write_debug_images;
+};
+
+// Flat row-major density grid of an object on the floor. Keep one per
+// worker: the buffers only grow, so consecutive objects do not allocate.
+struct ObjectGrid {
+  ObjectGrid() : width(0), height(0) {}
+  // Zero filled.
+  void Reset(const int new_width, const int new_height);
+  double& At(const int x, const int y) { return values[y * width + x]; }
+  const double& At(const int x, const int y) const { return values[y * width + x]; }
+
+  int width;
+  int height;
+  std::vector<double> values;
+  // Scratch buffers: the values before a closing step, and the
+  // marching squares vertex on the two edges of each cell.
+  std::vector<double> previous_values;
+  std::vector<Eigen::Vector2i> vertex_ids;
+};
+
+// Ranges and polygon of each associated object, and a new "unknown"
+// detection for each large enough object without one. The new
+// detections are appended in the room and object order, whatever the
+// number of threads.
 void AddIconInformationToDetections(const IndoorPolygon& indoor_polygon,
                                     const std::vector<PointCloud>& object_point_clouds,
                                     const std::map<ObjectId, int>& object_to_detection,
+                                    const IconOptions& options,
                                     std::vector<Detection>* detections);
 
+// object_points are in the Manhattan coordinate system. grid is a
+// workspace.
 void ComputeObjectPolygon(const std::vector<Eigen::Vector3d>& object_points,
+                          const bool write_debug_images,
+                          ObjectGrid* grid,
 			  Detection &detection);
 
-void MarchingCube(std::vector<std::vector<double> >&grid,
+void MarchingCube(ObjectGrid& grid,
 		  std::vector<Eigen::Vector2d>&vlist,
 		  std::vector<Eigen::Vector2i>&elist,
 		  const double isovalue);
@@ -11,6 +11,7 @@
 #include "../../base/indoor_polygon.h"
 #include "../../base/panorama.h"
 #include "../../base/point_cloud.h"
+#include "../../base/tracing_flags.h"
 #include "generate_object_icons.h"
 
 //#define __INCOMPLETE__
@@ -21,6 +22,8 @@ using namespace structured_indoor_modeling;
 
 DEFINE_double(score_threshold, 0.0, "Ignore detections below this threshold.");
 DEFINE_double(area_threshold, 0.01, "How many pixels in a bounding box must be of the object."); // 0.3
+DEFINE_int32(num_threads, 0, "Objects processed in parallel (0: all cores).");
+DEFINE_bool(write_debug_images, false, "Write the density grid and the contour of each object.");
 
 int main(int argc, char* argv[]) {
 #ifdef __INCOMPLETE__
@@ -36,6 +39,7 @@ int main(int argc, char* argv[]) {
 #else
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 #endif
+  InitTracingFromFlags();
 
   FileIO file_io(argv[1]);
 
@@ -86,9 +90,13 @@ int main(int argc, char* argv[]) {
                     FLAGS_area_threshold,
                     &object_to_detection);
 
+  IconOptions icon_options;
+  icon_options.num_threads        = FLAGS_num_threads;
+  icon_options.write_debug_images = FLAGS_write_debug_images;
   AddIconInformationToDetections(indoor_polygon,
                                  object_point_clouds,
                                  object_to_detection,
+                                 icon_options,
                                  &detections);
 
   ofstream ofstr;
@@ -16,8 +16,11 @@ void GCoptimization::initialize_memory()
 
     m_lookupPixVar = (PixelType *) new PixelType[m_nPixels];
     m_labelTable   = (LabelType *) new LabelType[m_nLabels];
+    m_variables    = (Energy::Var *) new Energy::Var[m_nPixels];
+    m_energy       = new Energy();
+    m_ownEnergy    = 1;
 
-    terminateOnError( !m_lookupPixVar || !m_labelTable ,"Not enough memory");
+    terminateOnError( !m_lookupPixVar || !m_labelTable || !m_variables || !m_energy,"Not enough memory");
 
     for ( int i = 0; i < m_nLabels; i++ )
         m_labelTable[i] = i;
@@ -459,11 +462,23 @@ GCoptimization::~GCoptimization()
     if ( ! m_grid_graph ) delete [] m_neighbors;            
     delete [] m_labelTable;
     delete [] m_lookupPixVar;
+    delete [] m_variables;
+    if (m_ownEnergy) delete m_energy;
     if (m_needToFreeV) delete [] m_smoothcost;
 }
 
 /**************************************************************************************/
 
+void GCoptimization::setGraph(Energy *graph)
+{
+    terminateOnError( !graph ,"Graph must not be NULL");
+    if (m_ownEnergy) delete m_energy;
+    m_energy    = graph;
+    m_ownEnergy = 0;
+}
+
+/**************************************************************************************/
+
 Swap::Swap(PixelType width,PixelType height,int num_labels, EnergyFunction *eng):GCoptimization(width,height,num_labels,eng)
 {
     m_pixels = new PixelType[m_nPixels];
@@ -585,7 +600,7 @@ void Swap::add_t_links_FnPix_swap(Energy *e,Energy::Var *variables,int size,
 void Swap::perform_alpha_beta_swap(LabelType alpha_label, LabelType beta_label)
 {
     PixelType i,size = 0;
-    Energy *e = new Energy();
+    Energy *e = m_energy;
 
 
     for ( i = 0; i < m_nPixels; i++ )
@@ -601,9 +616,8 @@ void Swap::perform_alpha_beta_swap(LabelType alpha_label, LabelType beta_label)
     if ( size == 0 ) return;
 
 
-    Energy::Var *variables = (Energy::Var *) new Energy::Var[size];
-    if (!variables) { fprintf(stderr, "Not enough memory!\n"); exit(1); }
-    
+    Energy::Var *variables = m_variables;
+    e -> reset();
 
     for ( i = 0; i < size; i++ )
         variables[i] = e ->add_variable();
@@ -635,10 +649,6 @@ void Swap::perform_alpha_beta_swap(LabelType alpha_label, LabelType beta_label)
             m_labeling[m_pixels[i]] = alpha_label;
         else m_labeling[m_pixels[i]] = beta_label;
 
-
-    delete [] variables;
-    delete e;
-
 }
 
 /**************************************************************************************/
@@ -996,7 +1006,7 @@ GCoptimization::EnergyType Expansion::alpha_expansion(LabelType label)
 void Expansion::perform_alpha_expansion(LabelType alpha_label)
 {
     PixelType i,size = 0; 
-    Energy *e = new Energy();
+    Energy *e = m_energy;
     
 
     
@@ -1012,8 +1022,8 @@ void Expansion::perform_alpha_expansion(LabelType alpha_label)
         
     if ( size > 0 ) 
     {
-        Energy::Var *variables = (Energy::Var *) new Energy::Var[size];
-        if ( !variables) {printf("\nOut of memory, exiting");exit(1);}
+        Energy::Var *variables = m_variables;
+        e -> reset();
 
         for ( i = 0; i < size; i++ )
             variables[i] = e ->add_variable();
@@ -1050,11 +1060,7 @@ void Expansion::perform_alpha_expansion(LabelType alpha_label)
                 size++;
             }
         }
-
-        delete [] variables;
     }
-
-    delete e;
 }
 
 /**********************************************************************************************/
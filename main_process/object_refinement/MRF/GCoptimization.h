@@ -121,6 +121,13 @@ public:
     /* Returns Smooth Energy of current labeling */
     EnergyType smoothnessEnergy();
 
+    /* Every move is solved on one graph whose storage is reset, not freed,  */
+    /* between moves. By default the graph is owned by this object. Passing  */
+    /* an external graph lets several optimizations (e.g. one per panorama)  */
+    /* share the same node and arc storage. The caller keeps ownership.      */
+    void setGraph(Energy *graph);
+    Energy *getGraph(){return(m_energy);}
+
 protected:
 	void initializeAlg() {};
 
@@ -182,6 +189,10 @@ protected:
 
     LabelType *m_labelTable;
     PixelType *m_lookupPixVar;
+
+    Energy *m_energy;
+    bool m_ownEnergy;
+    Energy::Var *m_variables;
     
 
     EnergyTermType m_weight;
@@ -0,0 +1,397 @@
+#include <algorithm>
+#include <string.h>
+#include <assert.h>
+#include "GridBP.h"
+#include "../../../base/parallel.h"
+
+using structured_indoor_modeling::GetNumThreads;
+using structured_indoor_modeling::ParallelFor;
+using structured_indoor_modeling::ParallelForWithThreadId;
+
+GridBP::GridBP(int width, int height, int nLabels,EnergyFunction *eng):MRF(width,height,nLabels,eng)
+{
+    m_D = NULL;
+    m_V = NULL;
+    m_horizWeights = NULL;
+    m_vertWeights = NULL;
+    m_dataFn = NULL;
+    m_smoothFn = NULL;
+    m_costType = MATRIX;
+    m_pottsCost = 0;
+    m_linearSlope = m_linearMax = 0;
+    m_wrap = false;
+    m_numLevels = 4;
+    m_numThreads = 0;
+    m_iterationsDone = 0;
+    m_answer.resize(m_nPixels, 0);
+}
+
+GridBP::~GridBP()
+{
+}
+
+void GridBP::clearAnswer()
+{
+    std::fill(m_answer.begin(), m_answer.end(), 0);
+}
+
+void GridBP::setData(DataCostFn dcost)
+{
+    m_dataFn = dcost;
+}
+
+void GridBP::setData(CostVal* data)
+{
+    m_D = data;
+}
+
+void GridBP::setSmoothness(SmoothCostGeneralFn cost)
+{
+    m_smoothFn = cost;
+    m_costType = FUNCTION_COST;
+}
+
+void GridBP::setSmoothness(CostVal* V)
+{
+    m_V = V;
+    m_costType = MATRIX;
+    if (m_nLabels < 2)
+        return;
+
+    // Potts matrices get the linear time update.
+    bool potts = true;
+    for (int i = 0; i < m_nLabels && potts; i++)
+        for (int j = 0; j < m_nLabels; j++)
+        {
+            const CostVal expected = (i == j) ? 0 : V[1];
+            if (V[i*m_nLabels + j] != expected) { potts = false; break; }
+        }
+
+    if (potts)
+    {
+        m_costType = POTTS;
+        m_pottsCost = (float) V[1];
+    }
+}
+
+void GridBP::setSmoothness(int smoothExp,CostVal smoothMax, CostVal lambda)
+{
+    m_ownV.resize(m_nLabels*m_nLabels);
+    for (int i=0; i<m_nLabels; i++)
+        for (int j=i; j<m_nLabels; j++)
+        {
+            CostVal cost = (CostVal) ((smoothExp == 1) ? j - i : (j - i)*(j - i));
+            if (cost > smoothMax) cost = smoothMax;
+            m_ownV[i*m_nLabels + j] = m_ownV[j*m_nLabels + i] = cost*lambda;
+        }
+    m_V = &m_ownV[0];
+
+    if (smoothExp == 1)
+    {
+        m_costType = TRUNCATED_LINEAR;
+        m_linearSlope = (float) lambda;
+        m_linearMax = (float) (smoothMax*lambda);
+    }
+    else m_costType = MATRIX;
+}
+
+void GridBP::setCues(CostVal* hCue, CostVal* vCue)
+{
+    m_horizWeights = hCue;
+    m_vertWeights  = vCue;
+}
+
+int GridBP::colorOf(const Level &level, int x, int y) const
+{
+    // With an odd wrapped width, the last column touches two pixels of
+    // the same checkerboard color. It gets two colors of its own,
+    // alternating along the column.
+    if (m_wrap && level.width >= 3 && level.width % 2 == 1 && x == level.width - 1)
+        return 2 + (y & 1);
+    return (x + y) & 1;
+}
+
+MRF::CostVal GridBP::V(int pix1, int pix2, Label l1, Label l2) const
+{
+    if (m_costType == FUNCTION_COST)
+        return m_smoothFn(pix1, pix2, l1, l2);
+    return m_V[l1*m_nLabels + l2];
+}
+
+void GridBP::initializeAlg()
+{
+    if (!m_dataFn && !m_D) { fprintf(stderr, "GridBP: no data cost!\n"); exit(1); }
+    if (m_wrap && m_width < 3) m_wrap = false;
+    m_iterationsDone = 0;
+    buildLevels();
+}
+
+void GridBP::buildLevels()
+{
+    const int L = m_nLabels;
+    m_levels.clear();
+    m_levels.reserve(std::max(1, m_numLevels));
+    m_levels.push_back(Level());
+
+    Level &finest = m_levels[0];
+    finest.width = m_width;
+    finest.height = m_height;
+    finest.data.resize(m_nPixels*L);
+    finest.hWeight.assign(m_nPixels, 0.0f);
+    finest.vWeight.assign(m_nPixels, 0.0f);
+    ParallelFor(0, m_height, [&](const int y) {
+            for (int x = 0; x < m_width; x++)
+            {
+                const int pix = x + y*m_width;
+                for (int l = 0; l < L; l++)
+                    finest.data[pix*L + l] = (float) (m_D ? m_D[pix*L + l] : m_dataFn(pix, l));
+                if (hasRight(finest, x))
+                    finest.hWeight[pix] = m_varWeights ? (float) m_horizWeights[pix] : 1.0f;
+                if (y + 1 < m_height)
+                    finest.vWeight[pix] = m_varWeights ? (float) m_vertWeights[pix] : 1.0f;
+            }
+        }, m_numThreads);
+
+    // A coarse level is the energy restricted to labelings constant on
+    // 2x2 blocks: data costs and crossing edge weights are summed.
+    // General cost functions take pixel indices and cannot be coarsened.
+    const int numLevels = (m_costType == FUNCTION_COST) ? 1 : m_numLevels;
+    while ((int) m_levels.size() < numLevels)
+    {
+        const Level &fine = m_levels.back();
+        const int width = (fine.width + 1) / 2;
+        const int height = (fine.height + 1) / 2;
+        if (width < 3 || height < 2)
+            break;
+
+        Level coarse;
+        coarse.width = width;
+        coarse.height = height;
+        coarse.data.assign(width*height*L, 0.0f);
+        coarse.hWeight.assign(width*height, 0.0f);
+        coarse.vWeight.assign(width*height, 0.0f);
+        for (int y = 0; y < fine.height; y++)
+            for (int x = 0; x < fine.width; x++)
+            {
+                const int pix = x + y*fine.width;
+                const int parent = x/2 + (y/2)*width;
+                for (int l = 0; l < L; l++)
+                    coarse.data[parent*L + l] += fine.data[pix*L + l];
+                if (hasRight(fine, x) && right(fine, x)/2 != x/2)
+                    coarse.hWeight[parent] += fine.hWeight[pix];
+                if (y + 1 < fine.height && (y + 1)/2 != y/2)
+                    coarse.vWeight[parent] += fine.vWeight[pix];
+            }
+        m_levels.push_back(coarse);
+    }
+
+    for (int i = 0; i < (int) m_levels.size(); i++)
+        for (int d = 0; d < 4; d++)
+            m_levels[i].msg[d].assign(m_levels[i].width*m_levels[i].height*L, 0.0f);
+}
+
+// out(l) = min_k (h(k) - incoming(k) + weight * V(k, l)), normalized to
+// a zero minimum. The loops over labels are kept branch free so the
+// compiler can vectorize them.
+void GridBP::sendMessage(const float *h, const float *incoming, float weight,
+                         int pix1, int pix2, float *scratch, float *out) const
+{
+    const int L = m_nLabels;
+    float *s = scratch;
+    for (int l = 0; l < L; l++)
+        s[l] = h[l] - incoming[l];
+    float sMin = s[0];
+    for (int l = 1; l < L; l++)
+        sMin = std::min(sMin, s[l]);
+
+    switch (m_costType)
+    {
+        case POTTS:
+        {
+            const float cap = sMin + weight*m_pottsCost;
+            for (int l = 0; l < L; l++)
+                out[l] = std::min(s[l], cap);
+            break;
+        }
+        case TRUNCATED_LINEAR:
+        {
+            // Distance transform of Felzenszwalb and Huttenlocher.
+            const float slope = weight*m_linearSlope;
+            out[0] = s[0];
+            for (int l = 1; l < L; l++)
+                out[l] = std::min(s[l], out[l-1] + slope);
+            for (int l = L - 2; l >= 0; l--)
+                out[l] = std::min(out[l], out[l+1] + slope);
+            const float cap = sMin + weight*m_linearMax;
+            for (int l = 0; l < L; l++)
+                out[l] = std::min(out[l], cap);
+            break;
+        }
+        case MATRIX:
+        {
+            for (int l = 0; l < L; l++)
+            {
+                float best = s[0] + weight*m_V[l];
+                for (int k = 1; k < L; k++)
+                    best = std::min(best, s[k] + weight*m_V[k*L + l]);
+                out[l] = best;
+            }
+            break;
+        }
+        case FUNCTION_COST:
+        {
+            for (int l = 0; l < L; l++)
+            {
+                float best = s[0] + m_smoothFn(pix1, pix2, 0, l);
+                for (int k = 1; k < L; k++)
+                    best = std::min(best, s[k] + m_smoothFn(pix1, pix2, k, l));
+                out[l] = best;
+            }
+            break;
+        }
+    }
+
+    float outMin = out[0];
+    for (int l = 1; l < L; l++)
+        outMin = std::min(outMin, out[l]);
+    for (int l = 0; l < L; l++)
+        out[l] -= outMin;
+}
+
+// Pixels of one color only write messages into pixels of other colors,
+// so rows are processed in parallel without locks.
+void GridBP::updateColor(Level &level, int color)
+{
+    const int L = m_nLabels;
+    const int width = level.width;
+    std::vector<float> buffers(GetNumThreads(m_numThreads) * 2 * L);
+
+    ParallelForWithThreadId(0, level.height, [&](const int y, const int thread) {
+            float *h = &buffers[thread * 2 * L];
+            float *scratch = h + L;
+            for (int x = 0; x < width; x++)
+            {
+                if (colorOf(level, x, y) != color)
+                    continue;
+                const int pix = x + y*width;
+                const float *data = &level.data[pix*L];
+                const float *fromLeft = &level.msg[LEFT][pix*L];
+                const float *fromRight = &level.msg[RIGHT][pix*L];
+                const float *fromUp = &level.msg[UP][pix*L];
+                const float *fromDown = &level.msg[DOWN][pix*L];
+                for (int l = 0; l < L; l++)
+                    h[l] = data[l] + fromLeft[l] + fromRight[l] + fromUp[l] + fromDown[l];
+
+                if (hasRight(level, x))
+                {
+                    const int q = right(level, x) + y*width;
+                    sendMessage(h, fromRight, level.hWeight[pix], pix, q, scratch, &level.msg[LEFT][q*L]);
+                }
+                if (hasLeft(level, x))
+                {
+                    const int q = left(level, x) + y*width;
+                    sendMessage(h, fromLeft, level.hWeight[q], pix, q, scratch, &level.msg[RIGHT][q*L]);
+                }
+                if (y + 1 < level.height)
+                {
+                    const int q = pix + width;
+                    sendMessage(h, fromDown, level.vWeight[pix], pix, q, scratch, &level.msg[UP][q*L]);
+                }
+                if (y > 0)
+                {
+                    const int q = pix - width;
+                    sendMessage(h, fromUp, level.vWeight[q], pix, q, scratch, &level.msg[DOWN][q*L]);
+                }
+            }
+        }, m_numThreads);
+}
+
+void GridBP::upsample(const Level &coarse, Level &fine) const
+{
+    const int L = m_nLabels;
+    ParallelFor(0, fine.height, [&](const int y) {
+            for (int x = 0; x < fine.width; x++)
+            {
+                const int pix = x + y*fine.width;
+                const int parent = x/2 + (y/2)*coarse.width;
+                for (int d = 0; d < 4; d++)
+                    memcpy(&fine.msg[d][pix*L], &coarse.msg[d][parent*L], L*sizeof(float));
+            }
+        }, m_numThreads);
+}
+
+void GridBP::computeAnswer(const Level &level)
+{
+    const int L = m_nLabels;
+    ParallelFor(0, level.height, [&](const int y) {
+            for (int x = 0; x < level.width; x++)
+            {
+                const int pix = x + y*level.width;
+                Label best = 0;
+                float bestCost = 0;
+                for (int l = 0; l < L; l++)
+                {
+                    const int i = pix*L + l;
+                    const float cost = level.data[i] + level.msg[LEFT][i] + level.msg[RIGHT][i] +
+                        level.msg[UP][i] + level.msg[DOWN][i];
+                    if (l == 0 || cost < bestCost) { best = l; bestCost = cost; }
+                }
+                m_answer[pix] = best;
+            }
+        }, m_numThreads);
+}
+
+void GridBP::optimizeAlg(int nIterations)
+{
+    int first = 0;
+    if (m_iterationsDone == 0)
+        first = (int) m_levels.size() - 1;
+
+    for (int i = first; i >= 0; i--)
+    {
+        Level &level = m_levels[i];
+        const int numColors = (m_wrap && level.width >= 3 && level.width % 2 == 1) ? 4 : 2;
+        for (int iter = 0; iter < nIterations; iter++)
+            for (int color = 0; color < numColors; color++)
+                updateColor(level, color);
+        if (i > 0)
+            upsample(level, m_levels[i - 1]);
+    }
+    m_iterationsDone += nIterations;
+
+    computeAnswer(m_levels[0]);
+}
+
+MRF::EnergyVal GridBP::dataEnergy()
+{
+    EnergyVal eng = (EnergyVal) 0;
+    for (int i = 0; i < m_nPixels; i++)
+        eng = eng + (m_D ? m_D[i*m_nLabels + m_answer[i]] : m_dataFn(i, m_answer[i]));
+    return(eng);
+}
+
+// Includes the seam edges when the grid wraps around.
+MRF::EnergyVal GridBP::smoothnessEnergy()
+{
+    EnergyVal eng = (EnergyVal) 0;
+    const bool function = (m_costType == FUNCTION_COST);
+    const bool wrap = m_wrap && m_width >= 3;
+    for (int y = 0; y < m_height; y++)
+        for (int x = 0; x < m_width; x++)
+        {
+            const int pix = x + y*m_width;
+            if (x + 1 < m_width || wrap)
+            {
+                const int q = (x + 1 < m_width) ? pix + 1 : y*m_width;
+                const CostVal weight = (m_varWeights && !function) ? m_horizWeights[pix] : 1;
+                eng = eng + V(pix, q, m_answer[pix], m_answer[q])*weight;
+            }
+            if (y + 1 < m_height)
+            {
+                const int q = pix + m_width;
+                const CostVal weight = (m_varWeights && !function) ? m_vertWeights[pix] : 1;
+                eng = eng + V(pix, q, m_answer[pix], m_answer[q])*weight;
+            }
+        }
+    return(eng);
+}
@@ -0,0 +1,123 @@
+#ifndef __GRIDBP_H__
+#define __GRIDBP_H__
+
+/*
+  Min-sum belief propagation specialized for 4-connected grids, meant
+  for per-pixel labelings of panoramas.
+
+  - The grid may wrap around horizontally (setWrapAround), so that the
+    first and last columns of a cylindrical panorama are neighbors. The
+    seam edge uses the horizontal cue of the last column, i.e.,
+    hCue(width-1,y) (unused by the other grid solvers).
+  - Messages are updated in a checkerboard order: all pixels of one
+    color only write messages read by the other color, so each half
+    sweep runs rows in parallel.
+  - Potts and truncated linear smoothness use linear time message
+    updates on flat float arrays (written to be vectorized); general
+    arrays and functions fall back to the quadratic update.
+  - Coarse-to-fine: the first optimize() call solves a pyramid of
+    problems over 2x2 blocks and initializes each level from the
+    coarser one. Later calls continue on the finest level.
+
+  < Example >
+
+  GridBP mrf(width, height, numlabels, &energy);
+  mrf.setWrapAround(true);
+  mrf.initialize();
+  float time;
+  mrf.optimize(10, time);
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "mrf.h"
+
+class GridBP : public MRF{
+public:
+    GridBP(int width, int height, int nLabels, EnergyFunction *eng);
+    ~GridBP();
+
+    // Grid only.
+    void setNeighbors(int /*pix1*/, int /*pix2*/, CostVal /*weight*/)
+        {fprintf(stderr, "GridBP supports 2D grids only\n"); exit(1);}
+    Label getLabel(int pixel){return(m_answer[pixel]);};
+    void setLabel(int pixel,Label label){m_answer[pixel] = label;};
+    Label* getAnswerPtr(){return(&m_answer[0]);};
+    void clearAnswer();
+    void setParameters(int /*numParam*/, void * /*param*/){printf("Use the GridBP setters instead"); exit(1);}
+    EnergyVal smoothnessEnergy();
+    EnergyVal dataEnergy();
+
+    // Must be called before initialize(). Wrapping needs width >= 3.
+    void setWrapAround(bool wrap){m_wrap = wrap;};
+    // Number of pyramid levels (1 disables coarse-to-fine). Levels
+    // stop before any side gets shorter than 2. Default 4.
+    void setNumLevels(int numLevels){m_numLevels = numLevels;};
+    // Workers for the message updates (<= 0: all cores).
+    void setNumThreads(int numThreads){m_numThreads = numThreads;};
+
+protected:
+    void setData(DataCostFn dcost);
+    void setData(CostVal* data);
+    void setSmoothness(SmoothCostGeneralFn cost);
+    void setSmoothness(CostVal* V);
+    void setSmoothness(int smoothExp,CostVal smoothMax, CostVal lambda);
+    void setCues(CostVal* hCue, CostVal* vCue);
+    void initializeAlg();
+    void optimizeAlg(int nIterations);
+
+private:
+    enum {LEFT, RIGHT, UP, DOWN};
+    enum {POTTS, TRUNCATED_LINEAR, MATRIX, FUNCTION_COST} m_costType;
+
+    // One level of the pyramid. Edge weights multiply the label cost;
+    // hWeight[p] is the edge from p to its right neighbor (wrapping),
+    // vWeight[p] the edge from p to the pixel below.
+    struct Level {
+        int width, height;
+        std::vector<float> data;        // width*height*nLabels
+        std::vector<float> hWeight;
+        std::vector<float> vWeight;
+        // msg[d][p*nLabels+l]: message p received from its neighbor
+        // in direction d.
+        std::vector<float> msg[4];
+    };
+
+    bool hasRight(const Level &level, int x) const
+        {return x + 1 < level.width || (m_wrap && level.width >= 3);}
+    int right(const Level &level, int x) const
+        {return (x + 1 < level.width) ? x + 1 : 0;}
+    int left(const Level &level, int x) const
+        {return (x > 0) ? x - 1 : level.width - 1;}
+    bool hasLeft(const Level &level, int x) const
+        {return x > 0 || (m_wrap && level.width >= 3);}
+    int colorOf(const Level &level, int x, int y) const;
+
+    void buildLevels();
+    void updateColor(Level &level, int color);
+    void sendMessage(const float *h, const float *incoming, float weight,
+                     int pix1, int pix2, float *scratch, float *out) const;
+    void upsample(const Level &coarse, Level &fine) const;
+    void computeAnswer(const Level &level);
+    CostVal V(int pix1, int pix2, Label l1, Label l2) const;
+
+    std::vector<Label> m_answer;
+    CostVal *m_D;
+    CostVal *m_V;
+    CostVal *m_horizWeights;
+    CostVal *m_vertWeights;
+    DataCostFn m_dataFn;
+    SmoothCostGeneralFn m_smoothFn;
+    std::vector<CostVal> m_ownV;
+    float m_pottsCost;
+    float m_linearSlope, m_linearMax;
+
+    bool m_wrap;
+    int m_numLevels;
+    int m_numThreads;
+    int m_iterationsDone;
+    std::vector<Level> m_levels;    // m_levels[0] is the input grid.
+};
+
+#endif /*  __GRIDBP_H__ */
@@ -137,6 +137,10 @@ public:
     /* Destructor */
     ~Energy();
 
+    /* Removes all variables and terms, keeping the allocated storage
+       so the same object can be reused for the next move */
+    void reset();
+
     /* Adds a new binary variable */
     Var add_variable();
 
@@ -179,8 +183,10 @@ public:
 
     /* After the energy function has been constructed,
        call this function to minimize it.
-       Returns the minimum of the function */
-    TotalValue minimize();
+       Returns the minimum of the function.
+       With reuse_trees, terms added after the previous call are taken
+       into account incrementally (see Graph::maxflow and mark_node) */
+    TotalValue minimize(bool reuse_trees = false);
 
     /* After 'minimize' has been called, this function
        can be used to determine the value of variable 'x'
@@ -227,6 +233,12 @@ inline Energy::Energy(void (*err_function)(const char *)) : Graph(err_function)
 
 inline Energy::~Energy() {}
 
+inline void Energy::reset()
+{
+    Graph::reset();
+    Econst = 0;
+}
+
 inline Energy::Var Energy::add_variable() { return add_node(); }
 
 inline void Energy::add_constant(Value A) { Econst += A; }
@@ -364,7 +376,7 @@ inline void Energy::add_term3(Var x, Var y, Var z,
     }
 }
 
-inline Energy::TotalValue Energy::minimize() { return Econst + maxflow(); }
+inline Energy::TotalValue Energy::minimize(bool reuse_trees) { return Econst + maxflow(reuse_trees); }
 
 inline int Energy::get_var(Var x) { return (int)what_segment(x); }
 
@@ -39,30 +39,25 @@
 /*
     For description, example usage, discussion of graph representation
     and memory usage see README.TXT.
+
+    Nodes and arcs are stored in two growable arrays owned by the graph
+    (the layout of maxflow-v3). reset() empties the graph but keeps the
+    storage, so a Graph/Energy object can be reused across alpha-expansion
+    moves and across MRF instances without touching the heap once it has
+    grown to the largest problem.
+
+    After maxflow() the capacities can be changed (add_tweights(),
+    set_rcap()) and maxflow(true) called again. Nodes whose terminal or
+    incident capacities changed must be passed to mark_node() first; the
+    search trees of the previous run are then reused instead of rebuilt.
 */
 
 #ifndef __GRAPH_H__
 #define __GRAPH_H__
 
-#ifndef	USE_64_BIT_PTR_CAST
-#define PTR_CAST int
-#else
-#define PTR_CAST long
-#endif
-
-
-#include "block.h"
+#include <vector>
 #include "mrf.h"
 
-/*
-    Nodes, arcs and pointers to nodes are
-    added in blocks for memory and time efficiency.
-    Below are numbers of items in blocks
-*/
-#define NODE_BLOCK_SIZE 512
-#define ARC_BLOCK_SIZE 1024
-#define NODEPTR_BLOCK_SIZE 128
-
 class Graph
 {
 public:
@@ -76,8 +71,9 @@ public:
 
     /* Type of total flow */
     typedef MRF::EnergyVal flowtype;
-    
-    typedef void * node_id;
+
+    typedef int node_id;
+    typedef int arc_id;
 
     /* interface functions */
 
@@ -90,12 +86,22 @@ public:
     /* Destructor */
     ~Graph();
 
-    /* Adds a node to the graph */
-    node_id add_node();
+    /* Removes all nodes and arcs. Allocated storage is kept. */
+    void reset();
+
+    /* Grows the storage for the given number of nodes and edges
+       (each edge is two arcs), so that no allocation happens while
+       the graph is built. */
+    void reserve(int node_num, int edge_num);
+
+    /* Adds num nodes to the graph; returns the id of the first one.
+       Node ids are consecutive, starting at 0 after reset(). */
+    node_id add_node(int num = 1);
 
     /* Adds a bidirectional edge between 'from' and 'to'
-       with the weights 'cap' and 'rev_cap' */
-    void add_edge(node_id from, node_id to, captype cap, captype rev_cap);
+       with the weights 'cap' and 'rev_cap'. Returns the id of the
+       arc 'from->to'; the reverse arc is (id ^ 1). */
+    arc_id add_edge(node_id from, node_id to, captype cap, captype rev_cap);
 
     /* Sets the weights of the edges 'SOURCE->i' and 'i->SINK'
        Can be called at most once for each node before any call to 'add_tweights'.
@@ -103,159 +109,120 @@ public:
     void set_tweights(node_id i, captype cap_source, captype cap_sink);
 
     /* Adds new edges 'SOURCE->i' and 'i->SINK' with corresponding weights
-       Can be called multiple times for each node.
+       Can be called multiple times for each node, also after maxflow().
        Weights can be negative */
     void add_tweights(node_id i, captype cap_source, captype cap_sink);
 
+    /* Residual capacity of an arc. Changing it after maxflow() requires
+       mark_node() on both of its end points before maxflow(true). */
+    captype get_rcap(arc_id a) const { return arcs[a].r_cap; }
+    void set_rcap(arc_id a, captype cap) { arcs[a].r_cap = cap; }
+
+    /* Residual terminal capacity of a node (positive: SOURCE->i). */
+    captype get_trcap(node_id i) const { return nodes[i].tr_cap; }
+
+    /* Tells maxflow(true) that the capacities around node i changed. */
+    void mark_node(node_id i);
+
     /* After the maxflow is computed, this function returns to which
-       segment the node 'i' belongs (Graph::SOURCE or Graph::SINK) */
-    termtype what_segment(node_id i);
+       segment the node 'i' belongs (Graph::SOURCE or Graph::SINK).
+       Nodes that can belong to either segment get 'default_segm'. */
+    termtype what_segment(node_id i, termtype default_segm = SINK) const;
+
+    /* Computes the maxflow. With reuse_trees, the search trees of the
+       previous call are kept and only marked nodes are revisited. */
+    flowtype maxflow(bool reuse_trees = false);
 
-    /* Computes the maxflow. Can be called only once. */
-    flowtype maxflow();
+    int get_node_num() const { return (int) nodes.size(); }
+    int get_arc_num() const { return (int) arcs.size(); }
+
+    /* Number of times the node, arc or orphan storage had to grow since
+       construction. Stays constant once the graph is warmed up. */
+    int get_num_allocations() const { return num_allocations; }
 
 /***********************************************************************/
 /***********************************************************************/
 /***********************************************************************/
-    
+
 private:
     /* internal variables and functions */
 
-    struct arc_forward_st;
-    struct arc_reverse_st;
-
-#define IS_ODD(a) ((PTR_CAST)(a) & 1)
-#define MAKE_ODD(a)  ((arc_forward *) ((PTR_CAST)(a) | 1))
-#define MAKE_EVEN(a) ((arc_forward *) ((PTR_CAST)(a) & (~1)))
-#define MAKE_ODD_REV(a)  ((arc_reverse *) ((PTR_CAST)(a) | 1))
-#define MAKE_EVEN_REV(a) ((arc_reverse *) ((PTR_CAST)(a) & (~1)))
+    /* special values of node::parent and "no node"/"no arc" */
+    enum { NONE = -1, TERMINAL = -2, ORPHAN = -3 };
 
     /* node structure */
-    typedef struct node_st
+    struct node
     {
-        /*
-            Usually i->first_out is the first outgoing
-            arc, and (i+1)->first_out-1 is the last outgoing arc.
-            However, it is not always possible, since
-            arcs are allocated in blocks, so arcs corresponding
-            to two consecutive nodes may be in different blocks.
-
-            If outgoing arcs for i are last in the arc block,
-            then a different mechanism is used. i->first_out
-            is odd in this case; the first outgoing arc
-            is (a+1), and the last outgoing arc is
-            ((arc_forward *)(a->shift))-1, where
-            a = (arc_forward *) (((char *)(i->first_out)) + 1);
-
-            Similar mechanism is used for incoming arcs.
-        */
-        arc_forward_st  *first_out; /* first outcoming arc */
-        arc_reverse_st  *first_in;  /* first incoming arc */
-
-        arc_forward_st  *parent;    /* describes node's parent
-                                       if IS_ODD(parent) then MAKE_EVEN(parent) points to 'arc_reverse',
-                                       otherwise parent points to 'arc_forward' */
-
-        node_st         *next;      /* pointer to the next active node
-                                       (or to itself if it is the last node in the list) */
+        arc_id          first;      /* first outcoming arc */
 
+        arc_id          parent;     /* arc to the parent in the search tree,
+                                       TERMINAL, ORPHAN, or NONE for a free node */
+        node_id         next;       /* next active node (or itself if it is
+                                       the last one), NONE if not active */
         int             TS;         /* timestamp showing when DIST was computed */
         int             DIST;       /* distance to the terminal */
-        short           is_sink;    /* flag showing whether the node is in the source or in the sink tree */
+        char            is_sink;    /* flag showing whether the node is in the source or in the sink tree */
+        char            is_marked;  /* set by mark_node() */
 
         captype         tr_cap;     /* if tr_cap > 0 then tr_cap is residual capacity of the arc SOURCE->node
                                        otherwise         -tr_cap is residual capacity of the arc node->SINK */
-    } node;
+    };
 
-    /* arc structures */
-#define NEIGHBOR_NODE(i, shift) ((node *) ((char *)(i) + (shift)))
-#define NEIGHBOR_NODE_REV(i, shift) ((node *) ((char *)(i) - (shift)))
-    typedef struct arc_forward_st
+    /* arc structure. Arcs are added in pairs; the sister of arc a is a ^ 1. */
+    struct arc
     {
-        PTR_CAST        shift;      /* node_to = NEIGHBOR_NODE(node_from, shift) */
+        node_id         head;       /* node the arc points to */
+        arc_id          next;       /* next arc with the same originating node */
         captype         r_cap;      /* residual capacity */
-        captype         r_rev_cap;  /* residual capacity of the reverse arc*/
-    } arc_forward;
-
-    typedef struct arc_reverse_st
-    {
-        arc_forward     *sister;    /* reverse arc */
-    } arc_reverse;
-
-    /* 'pointer to node' structure */
-    typedef struct nodeptr_st
-    {
-        node_st         *ptr;
-        nodeptr_st      *next;
-    } nodeptr;
-
-    typedef struct node_block_st
-    {
-        node                    *current;
-        struct node_block_st    *next;
-        node                    nodes[NODE_BLOCK_SIZE];
-    } node_block;
-
-#define last_node LAST_NODE.LAST_NODE
+    };
 
-    typedef struct arc_for_block_st
-    {
-        char                    *start;     /* the actual start address of this block.
-                                               May be different from 'this' since 'this'
-                                               must be at an even address. */
-        arc_forward             *current;
-        struct arc_for_block_st *next;
-        arc_forward             arcs_for[ARC_BLOCK_SIZE]; /* all arcs must be at even addresses */
-        union
-        {
-            arc_forward         dummy;
-            node                *LAST_NODE; /* used in graph consruction */
-        }                       LAST_NODE;
-    } arc_for_block;
-
-    typedef struct arc_rev_block_st
-    {
-        char                    *start;     /* the actual start address of this block.
-                                               May be different from 'this' since 'this'
-                                               must be at an even address. */
-        arc_reverse             *current;
-        struct arc_rev_block_st *next;
-        arc_reverse             arcs_rev[ARC_BLOCK_SIZE]; /* all arcs must be at even addresses */
-        union
-        {
-            arc_reverse         dummy;
-            node                *LAST_NODE; /* used in graph consruction */
-        }                       LAST_NODE;
-    } arc_rev_block;
-
-    node_block          *node_block_first;
-    arc_for_block       *arc_for_block_first;
-    arc_rev_block       *arc_rev_block_first;
-    DBlock<nodeptr>     *nodeptr_block;
+    std::vector<node>   nodes;
+    std::vector<arc>    arcs;
+    std::vector<node_id> orphans;   /* FIFO of orphan nodes, read from orphan_head */
+    size_t              orphan_head;
 
     void    (*error_function)(const char *);  /* this function is called if a error occurs,
                                            with a corresponding error message
                                            (or exit(1) is called if it's NULL) */
 
     flowtype            flow;       /* total flow */
+    int                 maxflow_iteration; /* number of maxflow() calls since reset() */
+    int                 num_allocations;
 
 /***********************************************************************/
 
-    node                *queue_first[2], *queue_last[2];    /* list of active nodes */
-    nodeptr             *orphan_first, *orphan_last;        /* list of pointers to orphans */
+    node_id             queue_first[2], queue_last[2];      /* list of active nodes */
+    node_id             current_node;
     int                 TIME;                               /* monotonically increasing global counter */
 
 /***********************************************************************/
 
     /* functions for processing active list */
-    void set_active(node *i);
-    node *next_active();
+    void set_active(node_id i);
+    node_id next_active();
+
+    void set_orphan(node_id i);
+    void process_orphans();
 
-    void prepare_graph();
     void maxflow_init();
-    void augment(node *s_start, node *t_start, captype *cap_middle, captype *rev_cap_middle);
-    void process_source_orphan(node *i);
-    void process_sink_orphan(node *i);
+    void maxflow_reuse_trees_init();
+    void augment(arc_id middle_arc);
+    void process_source_orphan(node_id i);
+    void process_sink_orphan(node_id i);
+
+    template <class T> void grow(std::vector<T> &v, size_t size);
 };
 
+/*
+    std::vector growth wrapped so that every reallocation is counted.
+*/
+template <class T> inline void Graph::grow(std::vector<T> &v, size_t size)
+{
+    if (size <= v.capacity()) return;
+    size_t capacity = v.capacity() < 16 ? 16 : v.capacity();
+    while (capacity < size) capacity *= 2;
+    v.reserve(capacity);
+    ++num_allocations;
+}
+
 #endif
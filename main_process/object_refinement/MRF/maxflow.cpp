@@ -21,12 +21,6 @@
 #include <stdio.h>
 #include "graph.h"
 
-/*
-    special constants for node->parent
-*/
-#define TERMINAL ( (arc_forward *) 1 )      /* to terminal */
-#define ORPHAN   ( (arc_forward *) 2 )      /* orphan */
-
 #define INFINITE_D 1000000000       /* infinite distance to the terminal */
 
 /***********************************************************************/
@@ -35,7 +29,7 @@
     Functions for processing active list.
     i->next points to the next node in the list
     (or to i, if i is the last node in the list).
-    If i->next is NULL iff i is not in the list.
+    If i->next is NONE iff i is not in the list.
 
     There are two queues. Active nodes are added
     to the end of the second queue and read from
@@ -44,15 +38,15 @@
     (and the second queue becomes empty).
 */
 
-inline void Graph::set_active(node *i)
+inline void Graph::set_active(node_id i)
 {
-    if (!i->next)
+    if (nodes[i].next == NONE)
     {
         /* it's not in the list yet */
-        if (queue_last[1]) queue_last[1] -> next = i;
-        else               queue_first[1]        = i;
+        if (queue_last[1] != NONE) nodes[queue_last[1]].next = i;
+        else                       queue_first[1]            = i;
         queue_last[1] = i;
-        i -> next = i;
+        nodes[i].next = i;
     }
 }
 
@@ -61,587 +55,376 @@ inline void Graph::set_active(node *i)
     If it is connected to the sink, it stays in the list,
     otherwise it is removed from the list
 */
-inline Graph::node * Graph::next_active()
+inline Graph::node_id Graph::next_active()
 {
-    node *i;
+    node_id i;
 
     while ( 1 )
     {
-        if (!(i=queue_first[0]))
+        if ((i=queue_first[0]) == NONE)
         {
             queue_first[0] = i = queue_first[1];
             queue_last[0]  = queue_last[1];
-            queue_first[1] = NULL;
-            queue_last[1]  = NULL;
-            if (!i) return NULL;
+            queue_first[1] = NONE;
+            queue_last[1]  = NONE;
+            if (i == NONE) return NONE;
         }
 
         /* remove it from the active list */
-        if (i->next == i) queue_first[0] = queue_last[0] = NULL;
-        else              queue_first[0] = i -> next;
-        i -> next = NULL;
+        if (nodes[i].next == i) queue_first[0] = queue_last[0] = NONE;
+        else                    queue_first[0] = nodes[i].next;
+        nodes[i].next = NONE;
 
         /* a node in the list is active iff it has a parent */
-        if (i->parent) return i;
+        if (nodes[i].parent != NONE) return i;
+    }
+}
+
+/***********************************************************************/
+
+inline void Graph::set_orphan(node_id i)
+{
+    nodes[i].parent = ORPHAN;
+    if (orphans.size() == orphans.capacity()) grow(orphans, orphans.size() + 1);
+    orphans.push_back(i);
+}
+
+void Graph::process_orphans()
+{
+    while (orphan_head < orphans.size())
+    {
+        node_id i = orphans[orphan_head ++];
+        if (nodes[i].is_sink) process_sink_orphan(i);
+        else                  process_source_orphan(i);
     }
+    orphans.clear();
+    orphan_head = 0;
+}
+
+/***********************************************************************/
+
+void Graph::mark_node(node_id i)
+{
+    node *n = &nodes[i];
+    if (n->next == NONE)
+    {
+        /* it's not in the list yet */
+        if (queue_last[1] != NONE) nodes[queue_last[1]].next = i;
+        else                       queue_first[1]            = i;
+        queue_last[1] = i;
+        n->next = i;
+    }
+    n->is_marked = 1;
 }
 
 /***********************************************************************/
 
 void Graph::maxflow_init()
 {
-    node *i;
-    node_block *nb;
+    queue_first[0] = queue_last[0] = NONE;
+    queue_first[1] = queue_last[1] = NONE;
+    orphans.clear();
+    orphan_head = 0;
+    current_node = NONE;
 
-    queue_first[0] = queue_last[0] = NULL;
-    queue_first[1] = queue_last[1] = NULL;
-    orphan_first = NULL;
+    TIME = 0;
 
-    for (nb=node_block_first; nb; nb=nb->next)
-    for (i=&nb->nodes[0]; i<nb->current; i++)
+    for (node_id i = 0; i < (node_id) nodes.size(); i++)
     {
-        i -> next = NULL;
-        i -> TS = 0;
-        if (i->tr_cap > 0)
+        node *n = &nodes[i];
+        n -> next = NONE;
+        n -> is_marked = 0;
+        n -> TS = TIME;
+        if (n->tr_cap > 0)
         {
             /* i is connected to the source */
-            i -> is_sink = 0;
-            i -> parent = TERMINAL;
+            n -> is_sink = 0;
+            n -> parent = TERMINAL;
             set_active(i);
-            i -> TS = 0;
-            i -> DIST = 1;
+            n -> DIST = 1;
         }
-        else if (i->tr_cap < 0)
+        else if (n->tr_cap < 0)
         {
             /* i is connected to the sink */
-            i -> is_sink = 1;
-            i -> parent = TERMINAL;
+            n -> is_sink = 1;
+            n -> parent = TERMINAL;
             set_active(i);
-            i -> TS = 0;
-            i -> DIST = 1;
+            n -> DIST = 1;
         }
         else
         {
-            i -> parent = NULL;
+            n -> parent = NONE;
         }
     }
-    TIME = 0;
 }
 
-/***********************************************************************/
-
-void Graph::augment(node *s_start, node *t_start, captype *cap_middle, captype *rev_cap_middle)
+void Graph::maxflow_reuse_trees_init()
 {
-    node *i;
-    arc_forward *a;
-    captype bottleneck;
-    nodeptr *np;
+    node_id i, j, queue = queue_first[1];
+    arc_id a;
 
+    queue_first[0] = queue_last[0] = NONE;
+    queue_first[1] = queue_last[1] = NONE;
+    orphans.clear();
+    orphan_head = 0;
+    current_node = NONE;
 
-    /* 1. Finding bottleneck capacity */
-    /* 1a - the source tree */
-    bottleneck = *cap_middle;
-    for (i=s_start; ; )
-    {
-        a = i -> parent;
-        if (a == TERMINAL) break;
-        if (IS_ODD(a))
-        {
-            a = MAKE_EVEN(a);
-            if (bottleneck > a->r_cap) bottleneck = a -> r_cap;
-            i = NEIGHBOR_NODE_REV(i, a -> shift);
-        }
-        else
-        {
-            if (bottleneck > a->r_rev_cap) bottleneck = a -> r_rev_cap;
-            i = NEIGHBOR_NODE(i, a -> shift);
-        }
-    }
-    if (bottleneck > i->tr_cap) bottleneck = i -> tr_cap;
-    /* 1b - the sink tree */
-    for (i=t_start; ; )
+    TIME ++;
+
+    /* the queue holds exactly the marked nodes at this point */
+    while ((i=queue) != NONE)
     {
-        a = i -> parent;
-        if (a == TERMINAL) break;
-        if (IS_ODD(a))
-        {
-            a = MAKE_EVEN(a);
-            if (bottleneck > a->r_rev_cap) bottleneck = a -> r_rev_cap;
-            i = NEIGHBOR_NODE_REV(i, a -> shift);
-        }
-        else
+        queue = nodes[i].next;
+        if (queue == i) queue = NONE;
+        nodes[i].next = NONE;
+        nodes[i].is_marked = 0;
+        set_active(i);
+
+        if (nodes[i].tr_cap == 0)
         {
-            if (bottleneck > a->r_cap) bottleneck = a -> r_cap;
-            i = NEIGHBOR_NODE(i, a -> shift);
+            if (nodes[i].parent != NONE) set_orphan(i);
+            continue;
         }
-    }
-    if (bottleneck > - i->tr_cap) bottleneck = - i -> tr_cap;
-
 
-    /* 2. Augmenting */
-    /* 2a - the source tree */
-    *rev_cap_middle += bottleneck;
-    *cap_middle -= bottleneck;
-    for (i=s_start; ; )
-    {
-        a = i -> parent;
-        if (a == TERMINAL) break;
-        if (IS_ODD(a))
+        if (nodes[i].tr_cap > 0)
         {
-            a = MAKE_EVEN(a);
-            a -> r_rev_cap += bottleneck;
-            a -> r_cap -= bottleneck;
-            if (!a->r_cap)
+            if (nodes[i].parent == NONE || nodes[i].is_sink)
             {
-                /* add i to the adoption list */
-                i -> parent = ORPHAN;
-                np = nodeptr_block -> New();
-                np -> ptr = i;
-                np -> next = orphan_first;
-                orphan_first = np;
+                nodes[i].is_sink = 0;
+                for (a=nodes[i].first; a!=NONE; a=arcs[a].next)
+                {
+                    j = arcs[a].head;
+                    if (!nodes[j].is_marked)
+                    {
+                        if (nodes[j].parent == (a ^ 1)) set_orphan(j);
+                        if (nodes[j].parent != NONE && nodes[j].is_sink && arcs[a].r_cap > 0) set_active(j);
+                    }
+                }
             }
-            i = NEIGHBOR_NODE_REV(i, a -> shift);
         }
         else
         {
-            a -> r_cap += bottleneck;
-            a -> r_rev_cap -= bottleneck;
-            if (!a->r_rev_cap)
+            if (nodes[i].parent == NONE || !nodes[i].is_sink)
             {
-                /* add i to the adoption list */
-                i -> parent = ORPHAN;
-                np = nodeptr_block -> New();
-                np -> ptr = i;
-                np -> next = orphan_first;
-                orphan_first = np;
+                nodes[i].is_sink = 1;
+                for (a=nodes[i].first; a!=NONE; a=arcs[a].next)
+                {
+                    j = arcs[a].head;
+                    if (!nodes[j].is_marked)
+                    {
+                        if (nodes[j].parent == (a ^ 1)) set_orphan(j);
+                        if (nodes[j].parent != NONE && !nodes[j].is_sink && arcs[a ^ 1].r_cap > 0) set_active(j);
+                    }
+                }
             }
-            i = NEIGHBOR_NODE(i, a -> shift);
         }
+        nodes[i].parent = TERMINAL;
+        nodes[i].TS = TIME;
+        nodes[i].DIST = 1;
     }
-    i -> tr_cap -= bottleneck;
-    if (!i->tr_cap)
+
+    /* adoption */
+    process_orphans();
+}
+
+/***********************************************************************/
+
+void Graph::augment(arc_id middle_arc)
+{
+    node_id i;
+    arc_id a;
+    captype bottleneck;
+
+    /* 1. Finding bottleneck capacity */
+    /* 1a - the source tree */
+    bottleneck = arcs[middle_arc].r_cap;
+    for (i=arcs[middle_arc ^ 1].head; ; i=arcs[a].head)
     {
-        /* add i to the adoption list */
-        i -> parent = ORPHAN;
-        np = nodeptr_block -> New();
-        np -> ptr = i;
-        np -> next = orphan_first;
-        orphan_first = np;
+        a = nodes[i].parent;
+        if (a == TERMINAL) break;
+        if (bottleneck > arcs[a ^ 1].r_cap) bottleneck = arcs[a ^ 1].r_cap;
     }
-    /* 2b - the sink tree */
-    for (i=t_start; ; )
+    if (bottleneck > nodes[i].tr_cap) bottleneck = nodes[i].tr_cap;
+    /* 1b - the sink tree */
+    for (i=arcs[middle_arc].head; ; i=arcs[a].head)
     {
-        a = i -> parent;
+        a = nodes[i].parent;
         if (a == TERMINAL) break;
-        if (IS_ODD(a))
-        {
-            a = MAKE_EVEN(a);
-            a -> r_cap += bottleneck;
-            a -> r_rev_cap -= bottleneck;
-            if (!a->r_rev_cap)
-            {
-                /* add i to the adoption list */
-                i -> parent = ORPHAN;
-                np = nodeptr_block -> New();
-                np -> ptr = i;
-                np -> next = orphan_first;
-                orphan_first = np;
-            }
-            i = NEIGHBOR_NODE_REV(i, a -> shift);
-        }
-        else
-        {
-            a -> r_rev_cap += bottleneck;
-            a -> r_cap -= bottleneck;
-            if (!a->r_cap)
-            {
-                /* add i to the adoption list */
-                i -> parent = ORPHAN;
-                np = nodeptr_block -> New();
-                np -> ptr = i;
-                np -> next = orphan_first;
-                orphan_first = np;
-            }
-            i = NEIGHBOR_NODE(i, a -> shift);
-        }
+        if (bottleneck > arcs[a].r_cap) bottleneck = arcs[a].r_cap;
     }
-    i -> tr_cap += bottleneck;
-    if (!i->tr_cap)
+    if (bottleneck > - nodes[i].tr_cap) bottleneck = - nodes[i].tr_cap;
+
+    /* 2. Augmenting */
+    arcs[middle_arc ^ 1].r_cap += bottleneck;
+    arcs[middle_arc].r_cap -= bottleneck;
+    /* 2a - the source tree */
+    for (i=arcs[middle_arc ^ 1].head; ; i=arcs[a].head)
     {
-        /* add i to the adoption list */
-        i -> parent = ORPHAN;
-        np = nodeptr_block -> New();
-        np -> ptr = i;
-        np -> next = orphan_first;
-        orphan_first = np;
+        a = nodes[i].parent;
+        if (a == TERMINAL) break;
+        arcs[a].r_cap += bottleneck;
+        arcs[a ^ 1].r_cap -= bottleneck;
+        if (!arcs[a ^ 1].r_cap) set_orphan(i);
     }
-
+    nodes[i].tr_cap -= bottleneck;
+    if (!nodes[i].tr_cap) set_orphan(i);
+    /* 2b - the sink tree */
+    for (i=arcs[middle_arc].head; ; i=arcs[a].head)
+    {
+        a = nodes[i].parent;
+        if (a == TERMINAL) break;
+        arcs[a ^ 1].r_cap += bottleneck;
+        arcs[a].r_cap -= bottleneck;
+        if (!arcs[a].r_cap) set_orphan(i);
+    }
+    nodes[i].tr_cap += bottleneck;
+    if (!nodes[i].tr_cap) set_orphan(i);
 
     flow += bottleneck;
 }
 
 /***********************************************************************/
 
-void Graph::process_source_orphan(node *i)
+void Graph::process_source_orphan(node_id i)
 {
-    node *j;
-    arc_forward *a0_for, *a0_for_first, *a0_for_last;
-    arc_reverse *a0_rev, *a0_rev_first, *a0_rev_last;
-    arc_forward *a0_min = NULL, *a;
-    nodeptr *np;
+    node_id j;
+    arc_id a0, a0_min = NONE, a;
     int d, d_min = INFINITE_D;
 
     /* trying to find a new parent */
-    a0_for_first = i -> first_out;
-    if (IS_ODD(a0_for_first))
-    {
-        a0_for_first = (arc_forward *) (((char *)a0_for_first) + 1);
-        a0_for_last = (arc_forward *) ((a0_for_first ++) -> shift);
-    }
-    else a0_for_last = (i + 1) -> first_out;
-    a0_rev_first = i -> first_in;
-    if (IS_ODD(a0_rev_first))
-    {
-        a0_rev_first = (arc_reverse *) (((char *)a0_rev_first) + 1);
-        a0_rev_last  = (arc_reverse *) ((a0_rev_first ++) -> sister);
-    }
-    else a0_rev_last = (i + 1) -> first_in;
-
-
-    for (a0_for=a0_for_first; a0_for<a0_for_last; a0_for++)
-    if (a0_for->r_rev_cap)
+    for (a0=nodes[i].first; a0!=NONE; a0=arcs[a0].next)
+    if (arcs[a0 ^ 1].r_cap)
     {
-        j = NEIGHBOR_NODE(i, a0_for -> shift);
-        if (!j->is_sink && (a=j->parent))
+        j = arcs[a0].head;
+        if (!nodes[j].is_sink && (a=nodes[j].parent) != NONE)
         {
             /* checking the origin of j */
             d = 0;
             while ( 1 )
             {
-                if (j->TS == TIME)
+                if (nodes[j].TS == TIME)
                 {
-                    d += j -> DIST;
+                    d += nodes[j].DIST;
                     break;
                 }
-                a = j -> parent;
+                a = nodes[j].parent;
                 d ++;
                 if (a==TERMINAL)
                 {
-                    j -> TS = TIME;
-                    j -> DIST = 1;
+                    nodes[j].TS = TIME;
+                    nodes[j].DIST = 1;
                     break;
                 }
                 if (a==ORPHAN) { d = INFINITE_D; break; }
-                if (IS_ODD(a))
-                    j = NEIGHBOR_NODE_REV(j, MAKE_EVEN(a) -> shift);
-                else
-                    j = NEIGHBOR_NODE(j, a -> shift);
+                j = arcs[a].head;
             }
             if (d<INFINITE_D) /* j originates from the source - done */
             {
                 if (d<d_min)
                 {
-                    a0_min = a0_for;
+                    a0_min = a0;
                     d_min = d;
                 }
                 /* set marks along the path */
-                for (j=NEIGHBOR_NODE(i, a0_for->shift); j->TS!=TIME; )
+                for (j=arcs[a0].head; nodes[j].TS!=TIME; j=arcs[nodes[j].parent].head)
                 {
-                    j -> TS = TIME;
-                    j -> DIST = d --;
-                    a = j->parent;
-                    if (IS_ODD(a))
-                        j = NEIGHBOR_NODE_REV(j, MAKE_EVEN(a) -> shift);
-                    else
-                        j = NEIGHBOR_NODE(j, a -> shift);
-                }
-            }
-        }
-    }
-    for (a0_rev=a0_rev_first; a0_rev<a0_rev_last; a0_rev++)
-    {
-        a0_for = a0_rev -> sister;
-        if (a0_for->r_cap)
-        {
-            j = NEIGHBOR_NODE_REV(i, a0_for -> shift);
-            if (!j->is_sink && (a=j->parent))
-            {
-                /* checking the origin of j */
-                d = 0;
-                while ( 1 )
-                {
-                    if (j->TS == TIME)
-                    {
-                        d += j -> DIST;
-                        break;
-                    }
-                    a = j -> parent;
-                    d ++;
-                    if (a==TERMINAL)
-                    {
-                        j -> TS = TIME;
-                        j -> DIST = 1;
-                        break;
-                    }
-                    if (a==ORPHAN) { d = INFINITE_D; break; }
-                    if (IS_ODD(a))
-                        j = NEIGHBOR_NODE_REV(j, MAKE_EVEN(a) -> shift);
-                    else
-                        j = NEIGHBOR_NODE(j, a -> shift);
-                }
-                if (d<INFINITE_D) /* j originates from the source - done */
-                {
-                    if (d<d_min)
-                    {
-                        a0_min = MAKE_ODD(a0_for);
-                        d_min = d;
-                    }
-                    /* set marks along the path */
-                    for (j=NEIGHBOR_NODE_REV(i,a0_for->shift); j->TS!=TIME; )
-                    {
-                        j -> TS = TIME;
-                        j -> DIST = d --;
-                        a = j->parent;
-                        if (IS_ODD(a))
-                            j = NEIGHBOR_NODE_REV(j, MAKE_EVEN(a) -> shift);
-                        else
-                            j = NEIGHBOR_NODE(j, a -> shift);
-                    }
+                    nodes[j].TS = TIME;
+                    nodes[j].DIST = d --;
                 }
             }
         }
     }
 
-    if ((i->parent = a0_min))
+    if ((nodes[i].parent = a0_min) != NONE)
     {
-        i -> TS = TIME;
-        i -> DIST = d_min + 1;
+        nodes[i].TS = TIME;
+        nodes[i].DIST = d_min + 1;
     }
     else
     {
-        /* no parent is found */
-        i -> TS = 0;
-
-        /* process neighbors */
-        for (a0_for=a0_for_first; a0_for<a0_for_last; a0_for++)
-        {
-            j = NEIGHBOR_NODE(i, a0_for -> shift);
-            if (!j->is_sink && (a=j->parent))
-            {
-                if (a0_for->r_rev_cap) set_active(j);
-                if (a!=TERMINAL && a!=ORPHAN && IS_ODD(a) && NEIGHBOR_NODE_REV(j, MAKE_EVEN(a)->shift)==i)
-                {
-                    /* add j to the adoption list */
-                    j -> parent = ORPHAN;
-                    np = nodeptr_block -> New();
-                    np -> ptr = j;
-                    if (orphan_last) orphan_last -> next = np;
-                    else             orphan_first        = np;
-                    orphan_last = np;
-                    np -> next = NULL;
-                }
-            }
-        }
-        for (a0_rev=a0_rev_first; a0_rev<a0_rev_last; a0_rev++)
+        /* no parent is found, process neighbors */
+        for (a0=nodes[i].first; a0!=NONE; a0=arcs[a0].next)
         {
-            a0_for = a0_rev -> sister;
-            j = NEIGHBOR_NODE_REV(i, a0_for -> shift);
-            if (!j->is_sink && (a=j->parent))
+            j = arcs[a0].head;
+            if (!nodes[j].is_sink && (a=nodes[j].parent) != NONE)
             {
-                if (a0_for->r_cap) set_active(j);
-                if (a!=TERMINAL && a!=ORPHAN && !IS_ODD(a) && NEIGHBOR_NODE(j, a->shift)==i)
+                if (arcs[a0 ^ 1].r_cap) set_active(j);
+                if (a!=TERMINAL && a!=ORPHAN && arcs[a].head==i)
                 {
-                    /* add j to the adoption list */
-                    j -> parent = ORPHAN;
-                    np = nodeptr_block -> New();
-                    np -> ptr = j;
-                    if (orphan_last) orphan_last -> next = np;
-                    else             orphan_first        = np;
-                    orphan_last = np;
-                    np -> next = NULL;
+                    set_orphan(j);
                 }
             }
         }
     }
 }
 
-void Graph::process_sink_orphan(node *i)
+void Graph::process_sink_orphan(node_id i)
 {
-    node *j;
-    arc_forward *a0_for, *a0_for_first, *a0_for_last;
-    arc_reverse *a0_rev, *a0_rev_first, *a0_rev_last;
-    arc_forward *a0_min = NULL, *a;
-    nodeptr *np;
+    node_id j;
+    arc_id a0, a0_min = NONE, a;
     int d, d_min = INFINITE_D;
 
     /* trying to find a new parent */
-    a0_for_first = i -> first_out;
-    if (IS_ODD(a0_for_first))
-    {
-        a0_for_first = (arc_forward *) (((char *)a0_for_first) + 1);
-        a0_for_last = (arc_forward *) ((a0_for_first ++) -> shift);
-    }
-    else a0_for_last = (i + 1) -> first_out;
-    a0_rev_first = i -> first_in;
-    if (IS_ODD(a0_rev_first))
+    for (a0=nodes[i].first; a0!=NONE; a0=arcs[a0].next)
+    if (arcs[a0].r_cap)
     {
-        a0_rev_first = (arc_reverse *) (((char *)a0_rev_first) + 1);
-        a0_rev_last  = (arc_reverse *) ((a0_rev_first ++) -> sister);
-    }
-    else a0_rev_last = (i + 1) -> first_in;
-
-
-    for (a0_for=a0_for_first; a0_for<a0_for_last; a0_for++)
-    if (a0_for->r_cap)
-    {
-        j = NEIGHBOR_NODE(i, a0_for -> shift);
-        if (j->is_sink && (a=j->parent))
+        j = arcs[a0].head;
+        if (nodes[j].is_sink && (a=nodes[j].parent) != NONE)
         {
             /* checking the origin of j */
             d = 0;
             while ( 1 )
             {
-                if (j->TS == TIME)
+                if (nodes[j].TS == TIME)
                 {
-                    d += j -> DIST;
+                    d += nodes[j].DIST;
                     break;
                 }
-                a = j -> parent;
+                a = nodes[j].parent;
                 d ++;
                 if (a==TERMINAL)
                 {
-                    j -> TS = TIME;
-                    j -> DIST = 1;
+                    nodes[j].TS = TIME;
+                    nodes[j].DIST = 1;
                     break;
                 }
                 if (a==ORPHAN) { d = INFINITE_D; break; }
-                if (IS_ODD(a))
-                    j = NEIGHBOR_NODE_REV(j, MAKE_EVEN(a) -> shift);
-                else
-                    j = NEIGHBOR_NODE(j, a -> shift);
+                j = arcs[a].head;
             }
             if (d<INFINITE_D) /* j originates from the sink - done */
             {
                 if (d<d_min)
                 {
-                    a0_min = a0_for;
+                    a0_min = a0;
                     d_min = d;
                 }
                 /* set marks along the path */
-                for (j=NEIGHBOR_NODE(i, a0_for->shift); j->TS!=TIME; )
-                {
-                    j -> TS = TIME;
-                    j -> DIST = d --;
-                    a = j->parent;
-                    if (IS_ODD(a))
-                        j = NEIGHBOR_NODE_REV(j, MAKE_EVEN(a) -> shift);
-                    else
-                        j = NEIGHBOR_NODE(j, a -> shift);
-                }
-            }
-        }
-    }
-    for (a0_rev=a0_rev_first; a0_rev<a0_rev_last; a0_rev++)
-    {
-        a0_for = a0_rev -> sister;
-        if (a0_for->r_rev_cap)
-        {
-            j = NEIGHBOR_NODE_REV(i, a0_for -> shift);
-            if (j->is_sink && (a=j->parent))
-            {
-                /* checking the origin of j */
-                d = 0;
-                while ( 1 )
-                {
-                    if (j->TS == TIME)
-                    {
-                        d += j -> DIST;
-                        break;
-                    }
-                    a = j -> parent;
-                    d ++;
-                    if (a==TERMINAL)
-                    {
-                        j -> TS = TIME;
-                        j -> DIST = 1;
-                        break;
-                    }
-                    if (a==ORPHAN) { d = INFINITE_D; break; }
-                    if (IS_ODD(a))
-                        j = NEIGHBOR_NODE_REV(j, MAKE_EVEN(a) -> shift);
-                    else
-                        j = NEIGHBOR_NODE(j, a -> shift);
-                }
-                if (d<INFINITE_D) /* j originates from the sink - done */
+                for (j=arcs[a0].head; nodes[j].TS!=TIME; j=arcs[nodes[j].parent].head)
                 {
-                    if (d<d_min)
-                    {
-                        a0_min = MAKE_ODD(a0_for);
-                        d_min = d;
-                    }
-                    /* set marks along the path */
-                    for (j=NEIGHBOR_NODE_REV(i,a0_for->shift); j->TS!=TIME; )
-                    {
-                        j -> TS = TIME;
-                        j -> DIST = d --;
-                        a = j->parent;
-                        if (IS_ODD(a))
-                            j = NEIGHBOR_NODE_REV(j, MAKE_EVEN(a) -> shift);
-                        else
-                            j = NEIGHBOR_NODE(j, a -> shift);
-                    }
+                    nodes[j].TS = TIME;
+                    nodes[j].DIST = d --;
                 }
             }
         }
     }
 
-    if ((i->parent = a0_min))
+    if ((nodes[i].parent = a0_min) != NONE)
     {
-        i -> TS = TIME;
-        i -> DIST = d_min + 1;
+        nodes[i].TS = TIME;
+        nodes[i].DIST = d_min + 1;
     }
     else
     {
-        /* no parent is found */
-        i -> TS = 0;
-
-        /* process neighbors */
-        for (a0_for=a0_for_first; a0_for<a0_for_last; a0_for++)
-        {
-            j = NEIGHBOR_NODE(i, a0_for -> shift);
-            if (j->is_sink && (a=j->parent))
-            {
-                if (a0_for->r_cap) set_active(j);
-                if (a!=TERMINAL && a!=ORPHAN && IS_ODD(a) && NEIGHBOR_NODE_REV(j, MAKE_EVEN(a)->shift)==i)
-                {
-                    /* add j to the adoption list */
-                    j -> parent = ORPHAN;
-                    np = nodeptr_block -> New();
-                    np -> ptr = j;
-                    if (orphan_last) orphan_last -> next = np;
-                    else             orphan_first        = np;
-                    orphan_last = np;
-                    np -> next = NULL;
-                }
-            }
-        }
-        for (a0_rev=a0_rev_first; a0_rev<a0_rev_last; a0_rev++)
+        /* no parent is found, process neighbors */
+        for (a0=nodes[i].first; a0!=NONE; a0=arcs[a0].next)
         {
-            a0_for = a0_rev -> sister;
-            j = NEIGHBOR_NODE_REV(i, a0_for -> shift);
-            if (j->is_sink && (a=j->parent))
+            j = arcs[a0].head;
+            if (nodes[j].is_sink && (a=nodes[j].parent) != NONE)
             {
-                if (a0_for->r_rev_cap) set_active(j);
-                if (a!=TERMINAL && a!=ORPHAN && !IS_ODD(a) && NEIGHBOR_NODE(j, a->shift)==i)
+                if (arcs[a0].r_cap) set_active(j);
+                if (a!=TERMINAL && a!=ORPHAN && arcs[a].head==i)
                 {
-                    /* add j to the adoption list */
-                    j -> parent = ORPHAN;
-                    np = nodeptr_block -> New();
-                    np -> ptr = j;
-                    if (orphan_last) orphan_last -> next = np;
-                    else             orphan_first        = np;
-                    orphan_last = np;
-                    np -> next = NULL;
+                    set_orphan(j);
                 }
             }
         }
@@ -650,224 +433,116 @@ void Graph::process_sink_orphan(node *i)
 
 /***********************************************************************/
 
-Graph::flowtype Graph::maxflow()
+Graph::flowtype Graph::maxflow(bool reuse_trees)
 {
-    node *i, *j, *current_node = NULL, *s_start, *t_start = NULL;
-    captype *cap_middle = NULL, *rev_cap_middle = NULL;
-    arc_forward *a_for, *a_for_first, *a_for_last;
-    arc_reverse *a_rev, *a_rev_first, *a_rev_last;
-    nodeptr *np, *np_next;
+    node_id i, j;
+    arc_id a;
+
+    if (maxflow_iteration == 0) reuse_trees = false;
 
-    prepare_graph();
-    maxflow_init();
-    nodeptr_block = new DBlock<nodeptr>(NODEPTR_BLOCK_SIZE, error_function);
+    if (reuse_trees) maxflow_reuse_trees_init();
+    else             maxflow_init();
 
+    /* main loop */
     while ( 1 )
     {
-        if ((i=current_node))
+        if ((i=current_node) != NONE)
         {
-            i -> next = NULL; /* remove active flag */
-            if (!i->parent) i = NULL;
+            nodes[i].next = NONE; /* remove active flag */
+            if (nodes[i].parent == NONE) i = NONE;
         }
-        if (!i)
+        if (i == NONE)
         {
-            if (!(i = next_active())) break;
+            if ((i = next_active()) == NONE) break;
         }
 
         /* growth */
-        s_start = NULL;
-
-        a_for_first = i -> first_out;
-        if (IS_ODD(a_for_first))
-        {
-            a_for_first = (arc_forward *) (((char *)a_for_first) + 1);
-            a_for_last = (arc_forward *) ((a_for_first ++) -> shift);
-        }
-        else a_for_last = (i + 1) -> first_out;
-        a_rev_first = i -> first_in;
-        if (IS_ODD(a_rev_first))
-        {
-            a_rev_first = (arc_reverse *) (((char *)a_rev_first) + 1);
-            a_rev_last = (arc_reverse *) ((a_rev_first ++) -> sister);
-        }
-        else a_rev_last = (i + 1) -> first_in;
-
-        if (!i->is_sink)
+        a = NONE;
+        if (!nodes[i].is_sink)
         {
             /* grow source tree */
-            for (a_for=a_for_first; a_for<a_for_last; a_for++)
-            if (a_for->r_cap)
+            for (a=nodes[i].first; a!=NONE; a=arcs[a].next)
+            if (arcs[a].r_cap)
             {
-                j = NEIGHBOR_NODE(i, a_for -> shift);
-                if (!j->parent)
+                j = arcs[a].head;
+                if (nodes[j].parent == NONE)
                 {
-                    j -> is_sink = 0;
-                    j -> parent = MAKE_ODD(a_for);
-                    j -> TS = i -> TS;
-                    j -> DIST = i -> DIST + 1;
+                    nodes[j].is_sink = 0;
+                    nodes[j].parent = a ^ 1;
+                    nodes[j].TS = nodes[i].TS;
+                    nodes[j].DIST = nodes[i].DIST + 1;
                     set_active(j);
                 }
-                else if (j->is_sink)
-                {
-                    s_start = i;
-                    t_start = j;
-                    cap_middle     = & ( a_for -> r_cap );
-                    rev_cap_middle = & ( a_for -> r_rev_cap );
-                    break;
-                }
-                else if (j->TS <= i->TS &&
-                         j->DIST > i->DIST)
+                else if (nodes[j].is_sink) break;
+                else if (nodes[j].TS <= nodes[i].TS &&
+                         nodes[j].DIST > nodes[i].DIST)
                 {
                     /* heuristic - trying to make the distance from j to the source shorter */
-                    j -> parent = MAKE_ODD(a_for);
-                    j -> TS = i -> TS;
-                    j -> DIST = i -> DIST + 1;
-                }
-            }
-            if (!s_start)
-            for (a_rev=a_rev_first; a_rev<a_rev_last; a_rev++)
-            {
-                a_for = a_rev -> sister;
-                if (a_for->r_rev_cap)
-                {
-                    j = NEIGHBOR_NODE_REV(i, a_for -> shift);
-                    if (!j->parent)
-                    {
-                        j -> is_sink = 0;
-                        j -> parent = a_for;
-                        j -> TS = i -> TS;
-                        j -> DIST = i -> DIST + 1;
-                        set_active(j);
-                    }
-                    else if (j->is_sink)
-                    {
-                        s_start = i;
-                        t_start = j;
-                        cap_middle     = & ( a_for -> r_rev_cap );
-                        rev_cap_middle = & ( a_for -> r_cap );
-                        break;
-                    }
-                    else if (j->TS <= i->TS &&
-                             j->DIST > i->DIST)
-                    {
-                        /* heuristic - trying to make the distance from j to the source shorter */
-                        j -> parent = a_for;
-                        j -> TS = i -> TS;
-                        j -> DIST = i -> DIST + 1;
-                    }
+                    nodes[j].parent = a ^ 1;
+                    nodes[j].TS = nodes[i].TS;
+                    nodes[j].DIST = nodes[i].DIST + 1;
                 }
             }
         }
         else
         {
             /* grow sink tree */
-            for (a_for=a_for_first; a_for<a_for_last; a_for++)
-            if (a_for->r_rev_cap)
+            for (a=nodes[i].first; a!=NONE; a=arcs[a].next)
+            if (arcs[a ^ 1].r_cap)
             {
-                j = NEIGHBOR_NODE(i, a_for -> shift);
-                if (!j->parent)
+                j = arcs[a].head;
+                if (nodes[j].parent == NONE)
                 {
-                    j -> is_sink = 1;
-                    j -> parent = MAKE_ODD(a_for);
-                    j -> TS = i -> TS;
-                    j -> DIST = i -> DIST + 1;
+                    nodes[j].is_sink = 1;
+                    nodes[j].parent = a ^ 1;
+                    nodes[j].TS = nodes[i].TS;
+                    nodes[j].DIST = nodes[i].DIST + 1;
                     set_active(j);
                 }
-                else if (!j->is_sink)
-                {
-                    s_start = j;
-                    t_start = i;
-                    cap_middle     = & ( a_for -> r_rev_cap );
-                    rev_cap_middle = & ( a_for -> r_cap );
-                    break;
-                }
-                else if (j->TS <= i->TS &&
-                         j->DIST > i->DIST)
+                else if (!nodes[j].is_sink) { a = a ^ 1; break; }
+                else if (nodes[j].TS <= nodes[i].TS &&
+                         nodes[j].DIST > nodes[i].DIST)
                 {
                     /* heuristic - trying to make the distance from j to the sink shorter */
-                    j -> parent = MAKE_ODD(a_for);
-                    j -> TS = i -> TS;
-                    j -> DIST = i -> DIST + 1;
-                }
-            }
-            for (a_rev=a_rev_first; a_rev<a_rev_last; a_rev++)
-            {
-                a_for = a_rev -> sister;
-                if (a_for->r_cap)
-                {
-                    j = NEIGHBOR_NODE_REV(i, a_for -> shift);
-                    if (!j->parent)
-                    {
-                        j -> is_sink = 1;
-                        j -> parent = a_for;
-                        j -> TS = i -> TS;
-                        j -> DIST = i -> DIST + 1;
-                        set_active(j);
-                    }
-                    else if (!j->is_sink)
-                    {
-                        s_start = j;
-                        t_start = i;
-                        cap_middle     = & ( a_for -> r_cap );
-                        rev_cap_middle = & ( a_for -> r_rev_cap );
-                        break;
-                    }
-                    else if (j->TS <= i->TS &&
-                             j->DIST > i->DIST)
-                    {
-                        /* heuristic - trying to make the distance from j to the sink shorter */
-                        j -> parent = a_for;
-                        j -> TS = i -> TS;
-                        j -> DIST = i -> DIST + 1;
-                    }
+                    nodes[j].parent = a ^ 1;
+                    nodes[j].TS = nodes[i].TS;
+                    nodes[j].DIST = nodes[i].DIST + 1;
                 }
             }
         }
 
         TIME ++;
 
-        if (s_start)
+        if (a != NONE)
         {
-            i -> next = i; /* set active flag */
+            nodes[i].next = i; /* set active flag */
             current_node = i;
 
             /* augmentation */
-            augment(s_start, t_start, cap_middle, rev_cap_middle);
+            augment(a);
             /* augmentation end */
 
             /* adoption */
-            while ((np=orphan_first))
-            {
-                np_next = np -> next;
-                np -> next = NULL;
-
-                while ((np=orphan_first))
-                {
-                    orphan_first = np -> next;
-                    i = np -> ptr;
-                    nodeptr_block -> Delete(np);
-                    if (!orphan_first) orphan_last = NULL;
-                    if (i->is_sink) process_sink_orphan(i);
-                    else            process_source_orphan(i);
-                }
-
-                orphan_first = np_next;
-            }
+            process_orphans();
             /* adoption end */
         }
-        else current_node = NULL;
+        else current_node = NONE;
     }
 
-    delete nodeptr_block;
-
+    maxflow_iteration ++;
     return flow;
 }
 
 /***********************************************************************/
 
-Graph::termtype Graph::what_segment(node_id i)
+Graph::termtype Graph::what_segment(node_id i, termtype default_segm) const
 {
-    if (((node*)i)->parent && !((node*)i)->is_sink) return SOURCE;
-    return SINK;
+    if (nodes[i].parent != NONE)
+    {
+        return (nodes[i].is_sink) ? SINK : SOURCE;
+    }
+    else
+    {
+        return default_segm;
+    }
 }
-
@@ -1,7 +1,11 @@
 #include "depth_filling.h"
+#include "projection_cache.h"
 #include "../../base/panorama.h"
 #include "../../base/point_cloud.h"
 #include "../../base/file_io.h"
+#include "../../base/tracing.h"
+#include "../../base/numeric/sparseMat.h"
+#include "../../base/numeric/cooMat.h"
 #include <numeric>
 #include <fstream>
 
@@ -13,38 +17,6 @@ using namespace cv;
 
 namespace structured_indoor_modeling{
 
-    vector<double> JacobiMethod(const vector< vector<double> >& A, const vector<double>& B, int max_iter = 300){
-	vector<double>solution(B.size());
-	for(auto& v:solution) v=0.0;
-	for(int iter=0;iter<max_iter;iter++){
-	    for(int i=0;i<solution.size();i++){
-		double sum = 0.0;
-		for(int j=0;j<solution.size();j++){
-		    if(j!=i)
-			sum += A[i][j] * solution[j];
-		}
-		solution[i] = (B[i] - sum) / A[i][i];
-	    }
-	    //evaluate the result
-	    double ssd = 0;
-	    for(int i=0;i<solution.size();i++){
-		double tempsum = 0.0;
-		for(int j=0;j<solution.size();j++){
-		    tempsum += A[i][j] * solution[j];
-		}
-		tempsum -= B[i];
-		ssd += tempsum * tempsum;
-	    }
-	    ssd = sqrt(ssd);
-#if 0
-	    cout<<"Iteration "<<iter<<", ssd: "<<ssd<<endl;
-#endif
-	    if(ssd < 0.001)
-		break;
-	}
-	return solution;
-    }
-  
     void DepthFilling::Init(const PointCloud& point_cloud, const Panorama &panorama, bool maskv){
 	depthwidth = panorama.DepthWidth();
 	depthheight = panorama.DepthHeight();
@@ -110,6 +82,35 @@ namespace structured_indoor_modeling{
 	}
     }
 
+    void DepthFilling::Init(const ProjectionCache& projection, const Panorama &panorama,const vector<int>&objectgroup, bool maskv){
+	depthwidth = panorama.DepthWidth();
+	depthheight = panorama.DepthHeight();
+	depthmap.clear();
+	depthmap.resize(depthwidth * depthheight);
+	mask.resize(depthmap.size());
+	for(auto &v :depthmap)
+	    v = -1.0;
+	for(auto &v :mask)
+	    v = maskv ? 1 : 0;
+	//the depth pixels and distances of the points are already computed
+	max_depth = -1e100;
+	min_depth = 1e100;
+
+	for(auto ptid: objectgroup){
+	    Vector2d depth_pixel = projection.GetDepthPixel(ptid);
+	    int depthx = round(depth_pixel[0]+0.5);
+	    int depthy = round(depth_pixel[1]+0.5);
+	    if(depthx<0 || depthx>= depthwidth || depthy<0 || depthy>=depthheight)
+		continue;
+	    double depth = projection.GetDistance(ptid);
+	    depthmap[depthy*depthwidth + depthx] = depth;
+	    if(depth < min_depth)
+		min_depth = depth;
+	    if(depth > max_depth)
+		max_depth = depth;
+	}
+    }
+
      void DepthFilling::Init(const Panorama &panorama, bool maskv){
 	  depthwidth = panorama.DepthWidth();
 	  depthheight = panorama.DepthHeight();
@@ -142,7 +143,12 @@ namespace structured_indoor_modeling{
     }
 
     void DepthFilling::fill_hole(const Panorama& panorama){
-	printf("Performing depth impainting...\n");
+	CsolverWorkspace<double> workspace;
+	fill_hole(panorama, workspace, 0);
+    }
+
+    void DepthFilling::fill_hole(const Panorama& panorama, CsolverWorkspace<double>& workspace, const int num_threads){
+	const ScopedTrace trace("fill_hole");
 	int invalidnum= 0;
     
 	//invalidcoord: size of invalidnum
@@ -162,57 +168,41 @@ namespace structured_indoor_modeling{
 		invalidindex[i] = invalidnum - 1;
 	    }
 	}
-	cout<<"Invalid depth num:"<<invalidnum<<endl;
+	TraceCounter("fill_hole_invalid_pixels", invalidnum);
     
-	//construct matrix A and B
-	vector< vector<double> > A(invalidnum);
-	vector <double> B(invalidnum);
-	for(int i=0;i<invalidnum;i++){
-	    A[i].resize(invalidnum);
-	    for(int j=0;j<invalidnum;j++){
-		A[i][j] = 0.0;
-	    }
-	    B[i] = 0.0;
-	}
+	//construct matrix A and B. Each row has at most 5 entries, so A is
+	//kept sparse (a dense A does not fit in memory for large holes).
+	CcooMat<double> coo(invalidnum, invalidnum);
+	vector <double> B(invalidnum, 0.0);
     
 	for(int i=0;i<invalidnum;i++){
 	    //(x,y) is the coordinate of invalid pixel
 	    int x = invalidcoord[i] % depthwidth;
 	    int y = invalidcoord[i] / depthwidth;
 	    int count = 0;
-	    if(insideDepth(x-1,y)){
-		count++;
-		if(depthmap[y*depthwidth + x-1] <0 )
-		    A[i][invalidindex[y*depthwidth+x-1]] = -1;
-		else
-		    B[i] += depthmap[y*depthwidth+x-1];
-	    }
-	    if(insideDepth(x+1,y)){
-		count++;
-		if(depthmap[y*depthwidth + x+1] <0 )
-		    A[i][invalidindex[y*depthwidth+x+1]] = -1;
-		else
-		    B[i] += depthmap[y*depthwidth+x+1];
-	    }
-	    if(insideDepth(x,y-1)){
-		count++;
-		if(depthmap[(y-1)*depthwidth + x] <0 )
-		    A[i][invalidindex[(y-1)*depthwidth+x]] = -1;
-		else
-		    B[i] += depthmap[(y-1)*depthwidth+x];
-	    }
-	    if(insideDepth(x,y+1)){
+	    const int neighbors[4][2] = {{x-1,y}, {x+1,y}, {x,y-1}, {x,y+1}};
+	    for(int n=0;n<4;n++){
+		const int nx = neighbors[n][0];
+		const int ny = neighbors[n][1];
+		if(!insideDepth(nx,ny))
+		    continue;
 		count++;
-		if(depthmap[(y+1)*depthwidth + x] <0 )
-		    A[i][invalidindex[(y+1)*depthwidth+x]] = -1;
+		if(depthmap[ny*depthwidth + nx] <0 )
+		    coo.set(i, invalidindex[ny*depthwidth+nx], -1.0, 1);
 		else
-		    B[i] += depthmap[(y+1)*depthwidth+x];
+		    B[i] += depthmap[ny*depthwidth+nx];
 	    }
-	    A[i][i] = (double)count;
+	    coo.set(i, i, (double)count, 1);
 	}
+	CsparseMat<double> A;
+	coo2csr(coo, A);
+	coo.dealloc();
     
-	//solve the linear problem with Jacobi iterative method
-	vector <double> solution = JacobiMethod(A,B);
+	//solve the linear problem (symmetric, diagonally dominant) with
+	//Jacobi preconditioned CG
+	vector <double> solution(invalidnum, 0.0);
+	const int iterations = PCG(A.view(), B.data(), solution.data(), 1e-6, 2000, workspace, num_threads);
+	TraceCounter("fill_hole_cg_iterations", iterations);
     
 	//copy the result to original depthmap
 	for(int i=0;i<invalidnum;i++){
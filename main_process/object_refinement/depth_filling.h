@@ -4,14 +4,14 @@
 #include <vector>
 #include <opencv2/opencv.hpp>
 
+template <class T> class CsolverWorkspace;
+
 namespace structured_indoor_modeling{
 
   class FileIO;
   class PointCloud;
   class Panorama;
-
-  std::vector <double> JacobiMethod(const std::vector <std::vector<double> >& A, const std::vector<double>& B, int max_iter);
-
+  class ProjectionCache;
 
   class DepthFilling{
   public:
@@ -19,9 +19,13 @@ namespace structured_indoor_modeling{
     void Init(const Panorama& panorama, bool maskv = true);
     void Init(const PointCloud &point_cloud, const Panorama &panorama, bool maskv = true);
     void Init(const PointCloud &point_cloud, const Panorama &panorama, const std::vector<int>&objectgroup, bool maskv = true);
+    //same from the projections of point_cloud into panorama
+    void Init(const ProjectionCache& projection, const Panorama &panorama, const std::vector<int>&objectgroup, bool maskv = true);
     void setMask(int id, bool maskv);
     void setMask(int x, int y, bool maskv);
     void fill_hole(const Panorama& panorama);
+    //reuses the buffers of workspace, for filling many depth maps
+    void fill_hole(const Panorama& panorama, CsolverWorkspace<double>& workspace, const int num_threads);
 
     inline bool insideDepth(int x,int y){
 	return x>=0 && x<depthwidth && y>=0 && y<depthheight && (mask[y*depthwidth + x] == 1);
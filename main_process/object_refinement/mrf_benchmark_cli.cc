@@ -0,0 +1,229 @@
+// Benchmarks alpha-expansion on the superpixel graphs of a dataset.
+//
+// For every panorama, the superpixel adjacency and per-object
+// confidences are computed as in the refinement pipeline, and the
+// multi-label MRF is solved twice: with a graph owned by the MRF
+// (storage reused across moves) and with one graph shared by all
+// panoramas (storage also reused across optimizations). Reports graph
+// allocations per optimization and the time of each expansion cycle.
+//
+// The same labeling is then solved per pixel with the grid BP solver
+// (horizontally wrapping panorama grid, color-weighted Potts edges).
+//
+// ./mrf_benchmark_cli data_directory --room=0
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <gflags/gflags.h>
+#include "../../base/file_io.h"
+#include "../../base/floorplan.h"
+#include "../../base/panorama.h"
+#include "../../base/point_cloud.h"
+#include "MRF/GridBP.h"
+#include "object_refinement.h"
+#include "depth_filling.h"
+#include "superpixel_graph.h"
+
+DEFINE_int32(label_num, 12000, "Number of superpixel");
+DEFINE_double(smoothness_weight, 0.15, "Weight of smoothness term");
+DEFINE_int32(room, 0, "Room whose objects define the labels");
+DEFINE_int32(max_cycles, 100, "Maximum number of expansion cycles");
+DEFINE_int32(bp_iterations, 10, "Grid BP iterations per pyramid level");
+DEFINE_int32(bp_levels, 4, "Grid BP pyramid levels");
+DEFINE_int32(num_threads, 0, "Workers for grid BP (0: all cores)");
+
+using namespace std;
+using namespace Eigen;
+using namespace structured_indoor_modeling;
+
+namespace {
+
+struct RunStats {
+  RunStats() : allocations(0), cycles(0), seconds(0.0), energy(0) {}
+  int allocations;
+  int cycles;
+  double seconds;
+  MRF::EnergyVal energy;
+};
+
+// Same energy as MRFOptimizeLabels_multiLayer. Runs expansion cycles
+// until the energy stops decreasing.
+RunStats Optimize(const vector<vector<double> >& superpixelConfidence,
+                  const SuperpixelGraph& superpixel_graph,
+                  const int numlabels,
+                  Energy* graph) {
+  const int superpixelnum = superpixelConfidence[0].size();
+  const vector<Vector3d>& averageRGB = superpixel_graph.GetMeanRGBs();
+  vector<MRF::CostVal> data(superpixelnum * numlabels);
+  vector<MRF::CostVal> smooth(numlabels * numlabels);
+  for (int i = 0; i < superpixelnum; ++i) {
+    for (int label = 0; label < numlabels; ++label) {
+      if (averageRGB[i].norm() < 0.001 && label < numlabels - 1)
+        data[numlabels * i + label] = 10000;
+      else
+        data[numlabels * i + label] =
+          (MRF::CostVal)(max(gaussianFunc(superpixelConfidence[label][i], 1.0), 0.01) * 1000);
+    }
+  }
+  for (int label1 = 0; label1 < numlabels; ++label1)
+    for (int label2 = 0; label2 < numlabels; ++label2)
+      smooth[label1 * numlabels + label2] = (label1 == label2) ? 0 : 1;
+
+  DataCost dataterm(&data[0]);
+  SmoothnessCost smoothnessterm(&smooth[0]);
+  EnergyFunction energy(&dataterm, &smoothnessterm);
+  Expansion mrf(superpixelnum, numlabels, &energy);
+  if (graph != NULL)
+    mrf.setGraph(graph);
+  mrf.initialize();
+  for (const auto& edge : superpixel_graph.GetEdges()) {
+    const Vector3d diff = averageRGB[edge.superpixel0] - averageRGB[edge.superpixel1];
+    const MRF::CostVal weight = (MRF::CostVal)edge.boundary_length *
+      (MRF::CostVal)(max(gaussianFunc(diff.norm(), 15), 0.1) * 1000 * FLAGS_smoothness_weight);
+    mrf.setNeighbors(edge.superpixel0, edge.superpixel1, weight);
+  }
+  mrf.clearAnswer();
+  mrf.setLabelOrder(false);
+
+  RunStats stats;
+  const int allocations_before = mrf.getGraph()->get_num_allocations();
+  MRF::EnergyVal current = mrf.totalEnergy();
+  for (stats.cycles = 0; stats.cycles < FLAGS_max_cycles; ) {
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    const MRF::EnergyVal next = mrf.oneExpansionIteration();
+    stats.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    ++stats.cycles;
+    if (next >= current)
+      break;
+    current = next;
+  }
+  stats.energy = mrf.totalEnergy();
+  stats.allocations = mrf.getGraph()->get_num_allocations() - allocations_before;
+  return stats;
+}
+
+struct PixelStats {
+  PixelStats() : seconds(0.0), energy(0) {}
+  double seconds;
+  MRF::EnergyVal energy;
+};
+
+// Per-pixel version: a pixel takes the data cost of its superpixel and
+// neighboring pixels are tied by color similarity.
+PixelStats OptimizePixels(const vector<vector<double> >& superpixelConfidence,
+                          const vector<int>& superpixel,
+                          const vector<Vector3d>& averageRGB,
+                          const Panorama& panorama,
+                          const int numlabels) {
+  const int width = panorama.Width();
+  const int height = panorama.Height();
+  vector<MRF::CostVal> data(width * height * numlabels);
+  vector<MRF::CostVal> smooth(numlabels * numlabels);
+  vector<MRF::CostVal> hcue(width * height), vcue(width * height);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const int pix = y * width + x;
+      const int sp = superpixel[pix];
+      for (int label = 0; label < numlabels; ++label) {
+        if (averageRGB[sp].norm() < 0.001 && label < numlabels - 1)
+          data[numlabels * pix + label] = 10000;
+        else
+          data[numlabels * pix + label] =
+            (MRF::CostVal)(max(gaussianFunc(superpixelConfidence[label][sp], 1.0), 0.01) * 1000);
+      }
+      const Vector3f color = panorama.GetRGB(Vector2d(x, y));
+      const Vector3f right_color = panorama.GetRGB(Vector2d((x + 1) % width, y));
+      const Vector3f down_color = panorama.GetRGB(Vector2d(x, min(y + 1, height - 1)));
+      hcue[pix] = (MRF::CostVal)(max(gaussianFunc((color - right_color).norm(), 15), 0.1) * 1000 * FLAGS_smoothness_weight);
+      vcue[pix] = (MRF::CostVal)(max(gaussianFunc((color - down_color).norm(), 15), 0.1) * 1000 * FLAGS_smoothness_weight);
+    }
+  }
+  for (int label1 = 0; label1 < numlabels; ++label1)
+    for (int label2 = 0; label2 < numlabels; ++label2)
+      smooth[label1 * numlabels + label2] = (label1 == label2) ? 0 : 1;
+
+  DataCost dataterm(&data[0]);
+  SmoothnessCost smoothnessterm(&smooth[0], &hcue[0], &vcue[0]);
+  EnergyFunction energy(&dataterm, &smoothnessterm);
+  GridBP mrf(width, height, numlabels, &energy);
+  mrf.setWrapAround(true);
+  mrf.setNumLevels(FLAGS_bp_levels);
+  mrf.setNumThreads(FLAGS_num_threads);
+  mrf.initialize();
+
+  PixelStats stats;
+  const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  float time;
+  mrf.optimize(FLAGS_bp_iterations, time);
+  stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  stats.energy = mrf.totalEnergy();
+  return stats;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+#ifdef __APPLE__
+  google::ParseCommandLineFlags(&argc, &argv, true);
+#else
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+#endif
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0] << " data_directory" << endl;
+    return 1;
+  }
+
+  FileIO file_io(argv[1]);
+  const int startid = 0;
+  const int endid = GetNumPanoramas(file_io) - 1;
+
+  vector<Panorama> panorama;
+  vector<vector<int> > labels;
+  vector<int> numlabels;
+  vector<DepthFilling> depth(endid - startid + 1);
+  int imgwidth, imgheight;
+  initPanorama(file_io, panorama, labels, FLAGS_label_num, numlabels, depth,
+               imgwidth, imgheight, startid, endid);
+
+  Floorplan floorplan(file_io.GetFloorplan());
+  vector<PointCloud> objectcloud;
+  vector<vector<vector<int> > > objectgroup;
+  ReadObjectCloud(file_io, floorplan, objectcloud, objectgroup);
+  if (FLAGS_room < 0 || FLAGS_room >= (int)objectcloud.size() ||
+      objectgroup[FLAGS_room].size() < 2) {
+    cerr << "Room " << FLAGS_room << " has no objects to label." << endl;
+    return 1;
+  }
+  const int numobjects = objectgroup[FLAGS_room].size();
+
+  Energy shared_graph;
+  cout << "panorama superpixels edges | own: allocs cycles sec/cycle | shared: allocs cycles sec/cycle | energy | grid_bp: sec energy" << endl;
+  for (int panid = startid; panid <= endid; ++panid) {
+    const int curid = panid - startid;
+    SuperpixelGraph superpixel_graph;
+    superpixel_graph.Init(panorama[curid], labels[curid], numlabels[curid]);
+
+    vector<vector<double> > superpixelConfidence(numobjects);
+    for (int groupid = 0; groupid < numobjects; ++groupid) {
+      getSuperpixelConfidence(objectcloud[FLAGS_room], objectgroup[FLAGS_room][groupid],
+                              panorama[curid], superpixel_graph, superpixelConfidence[groupid], 1);
+    }
+
+    const RunStats own = Optimize(superpixelConfidence, superpixel_graph, numobjects, NULL);
+    const RunStats shared = Optimize(superpixelConfidence, superpixel_graph, numobjects, &shared_graph);
+    const PixelStats pixels = OptimizePixels(superpixelConfidence, labels[curid],
+                                             superpixel_graph.GetMeanRGBs(),
+                                             panorama[curid], numobjects);
+    if (own.energy != shared.energy)
+      cerr << "Energy mismatch on panorama " << panid << endl;
+
+    cout << panid << ' ' << numlabels[curid] << ' ' << superpixel_graph.GetEdges().size() << " | "
+         << own.allocations << ' ' << own.cycles << ' ' << own.seconds / max(1, own.cycles) << " | "
+         << shared.allocations << ' ' << shared.cycles << ' ' << shared.seconds / max(1, shared.cycles) << " | "
+         << shared.energy << " | " << pixels.seconds << ' ' << pixels.energy << endl;
+  }
+
+  return 0;
+}
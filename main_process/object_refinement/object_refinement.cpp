@@ -1,5 +1,9 @@
 #include "object_refinement.h"
 #include "SLIC/SLIC.h"
+#include "../../base/numeric/sparseMat.h"
+#include "../../base/parallel.h"
+#include "../../base/tracing.h"
+#include "../../base/visibility.h"
 #include <numeric>
 #include <iostream>
 #include <iterator>
@@ -98,12 +102,31 @@ void AllRange(vector<int>&array, vector<vector<int> >&result, int k, int m){
 }
 
 
-void getObjectColor(PointCloud &objectcloud,const vector<Panorama>&panorama,const vector<vector<int> >&objectgroup, const int roomid){
+//depth margin of the visibility test of getObjectColor, relative to the average distance of a panorama
+static const double kDepthMarginRatio = 0.03;
+
+void initProjections(const PointCloud &objectcloud, const vector<Panorama>&panorama, const vector<vector<int> >&labels, const vector<string>&cachefiles, const vector<uint64_t>&cachekeys, vector<ProjectionCache>&projections, const bool recompute){
+    const ScopedTrace trace("initProjections");
+    const vector<int> nolabels;
+    projections.resize(panorama.size());
+    for(int panid=0; panid<panorama.size(); panid++){
+	const double depth_margin = panorama[panid].GetAverageDistance() * kDepthMarginRatio;
+	const bool cached = panid < cachefiles.size();
+	if(cached && !recompute && projections[panid].Read(cachefiles[panid], cachekeys[panid]) &&
+	   projections[panid].GetNumPoints() == objectcloud.GetNumPoints() &&
+	   projections[panid].GetDepthMargin() == depth_margin)
+	    continue;
+	projections[panid].Compute(objectcloud, panorama[panid], panid < labels.size() ? labels[panid] : nolabels, depth_margin);
+	if(cached)
+	    projections[panid].Write(cachefiles[panid], cachekeys[panid]);
+    }
+}
+
+void getObjectColor(PointCloud &objectcloud,const vector<Panorama>&panorama,const VisibilityIndex& visibility,const vector<ProjectionCache>&projections,const vector<vector<int> >&objectgroup, const int roomid){
      if(panorama.size() == 0 || objectgroup.size() == 0 || objectcloud.GetNumPoints() == 0)
 	  return;
      const int depthwidth = panorama[0].DepthWidth();
      const int depthheight = panorama[0].DepthHeight();
-    const double kDepthMarginRatio = 0.03;
     const int min_overlap_points = 10;
     const int pansize = panorama.size();
     const double min_assigned_ratio = 0.98;
@@ -124,28 +147,29 @@ void getObjectColor(PointCloud &objectcloud,const vector<Panorama>&panorama,cons
 	for(auto &v: averagedis)
 	    v = 0.0;
 	vector<vector<int> >point_list(pansize);
+	AlignedBox3d object_box;
+	for(const auto& ptid: objectgroup[objid])
+	    object_box.extend(objectcloud.GetPoint(ptid).position);
 	//Get list of visible points of each panorama
-	for(int panid=0; panid<pansize; panid++){
+	ParallelFor(0, pansize, [&](const int panid){
 	    const double depth_margin = panorama[panid].GetAverageDistance() * kDepthMarginRatio;
-	    for(const auto& ptid: objectgroup[objid]){
-		Vector3d curpt = objectcloud.GetPoint(ptid).position;
-		double ptdepth = (curpt - panorama[panid].GetCenter()).norm();
-		Vector2d RGB_pix = panorama[panid].Project(curpt);
-		if(!panorama[panid].IsInsideRGB(RGB_pix))
-		    continue;
-		if(panorama[panid].GetRGB(RGB_pix).norm() == 0)
-		    continue;
-		Vector2d depth_pix = panorama[panid].RGBToDepth(RGB_pix);
-		if(ptdepth < panorama[panid].GetDepth(depth_pix) + depth_margin){
-		    point_list[panid].push_back(ptid);
-		    averagedis[panid] += ptdepth;
+	    //Objects behind the depths of the panorama are skipped at once
+	    const VisibilityIndex::BoxVisibility object_visibility =
+		visibility.TestBox(object_box, panid, depth_margin);
+	    if(object_visibility != VisibilityIndex::kInvisible){
+		const ProjectionCache& projection = projections[panid];
+		for(const auto& ptid: objectgroup[objid]){
+		    if(projection.IsVisible(ptid)){
+			point_list[panid].push_back(ptid);
+			averagedis[panid] += projection.GetDistance(ptid);
+		    }
 		}
 	    }
 	    if(point_list[panid].size() != 0)
 		averagedis[panid] /= (double)point_list[panid].size();
 	    else
 		averagedis[panid] = -1;
-	}
+	});
 	//Geeadily search for smallest set of panorama
 	vector<int>pan_selected;
 	for(int i=0; i<pansize; i++)
@@ -177,9 +201,7 @@ void getObjectColor(PointCloud &objectcloud,const vector<Panorama>&panorama,cons
 		for(const auto &ptid: point_list[panid]){
 		    if(!assigned[ptid])
 			curcoveragegain += 1.0;
-		    structured_indoor_modeling::Point curpt = objectcloud.GetPoint(ptid);
-		    Vector2d RGB_pix = panorama[panid].Project(curpt.position);
-		    Vector2d depth_pixel = panorama[panid].RGBToDepth(RGB_pix);
+		    Vector2d depth_pixel = projections[panid].GetDepthPixel(ptid);
 		    if(panorama[panid].IsInsideDepth(depth_pixel) == false)
 			 continue;
 		    if(depth_occupicy[floor(depth_pixel[0])][floor(depth_pixel[1])] == false)
@@ -214,8 +236,7 @@ void getObjectColor(PointCloud &objectcloud,const vector<Panorama>&panorama,cons
 	    vector<Vector3f>color_src;
 	    vector<Vector3f>color_tgt;
 	    for(const auto& ptid: point_list[panid]){
-		Vector3d curpt = objectcloud.GetPoint(ptid).position;
-		Vector2d RGB_pix = panorama[panid].Project(curpt);
+		Vector2d RGB_pix = projections[panid].GetRGBPixel(ptid);
 		
 		panout.at<Vec3b>((int)RGB_pix[1], (int)RGB_pix[0])[0] = 255;
 		panout.at<Vec3b>((int)RGB_pix[1], (int)RGB_pix[0])[1] = 0;
@@ -239,8 +260,7 @@ void getObjectColor(PointCloud &objectcloud,const vector<Panorama>&panorama,cons
 	    for(const auto& ptid: point_list[panid]){
 		if(assigned[ptid])
 		    continue;
-		Vector3d curpt = objectcloud.GetPoint(ptid).position;
-		Vector2d RGB_pix = panorama[panid].Project(curpt);
+		Vector2d RGB_pix = projections[panid].GetRGBPixel(ptid);
 		Vector3f curColor = panorama[panid].GetRGB(RGB_pix);
 		swap(curColor[0], curColor[2]);
 		Vector3f color_to_assigned =  colorTransform*curColor;
@@ -703,6 +723,14 @@ void getSuperpixelConfidence(const PointCloud &point_cloud,const vector<int> &ob
     }
 }
 
+void getSuperpixelConfidence(const PointCloud &point_cloud, const vector<int> &objectgroup, const Panorama &panorama, const SuperpixelGraph &superpixelgraph, vector <double> &superpixelConfidence, const int erodeiter){
+    superpixelgraph.ComputeConfidence(point_cloud, objectgroup, panorama, erodeiter, &superpixelConfidence);
+}
+
+void getSuperpixelConfidence(const ProjectionCache &projection, const vector<int> &objectgroup, const SuperpixelGraph &superpixelgraph, vector <double> &superpixelConfidence, const int erodeiter){
+    superpixelgraph.ComputeConfidence(projection, objectgroup, erodeiter, &superpixelConfidence);
+}
+
 void pairSuperpixel(const vector <int> &labels, int width, int height, map<pair<int,int>, int> &pairmap){
     //four connectivities
     for(int y=0;y<height-1;y++){
@@ -811,23 +839,19 @@ void SetNeighbors(const std::vector<structured_indoor_modeling::Point>& points,
 	  }
      }
      KDtree kdtree(point_data);
-     vector<const float*> knn;
-     vector<float> neighbor_distances(points.size());
+     vector<int> knn_indices;
+     vector<float> knn_dist2s;
+     kdtree.find_k_closest_batch(&point_data[0], points.size(), num_neighbors,
+				 knn_indices, knn_dist2s);
 
      neighbors->clear();
      neighbors->resize(points.size());
 
      for (int p = 0; p < points.size(); ++p) {
-	  knn.clear();
-	  const Vector3f ref_point(points[p].position[0],
-				   points[p].position[1],
-				   points[p].position[2]);
-                      
-	  kdtree.find_k_closest_to_pt(knn, num_neighbors, &ref_point[0]);
-
-	  for (int i = 0; i < (int)knn.size(); ++i) {
-	       const int index = (knn[i] - &point_data[0]) / 3;
-	       neighbors->at(p).push_back(index);
+	  for (int i = p * num_neighbors; i < (p + 1) * num_neighbors; ++i) {
+	       if (knn_indices[i] == -1)
+		    break;
+	       neighbors->at(p).push_back(knn_indices[i]);
 	  }
      }
 }
@@ -893,7 +917,7 @@ double colorDiffFunc(int pix1,int pix2, const vector <Vector3d>&averageRGB){
 }
 
 
-void MRFOptimizeLabels(const vector<int>&superpixelConfidence,  const map<pair<int,int>,int> &pairmap, const vector<Vector3d>&averageRGB, float smoothnessweight, vector <int> &superpixelLabel){
+void MRFOptimizeLabels(const vector<int>&superpixelConfidence,  const map<pair<int,int>,int> &pairmap, const vector<Vector3d>&averageRGB, float smoothnessweight, vector <int> &superpixelLabel, Energy *graph){
     int superpixelnum = superpixelConfidence.size();
     vector<MRF::CostVal>data(superpixelnum * 2);
     vector<MRF::CostVal>smooth(4);
@@ -910,8 +934,10 @@ void MRFOptimizeLabels(const vector<int>&superpixelConfidence,  const map<pair<i
     SmoothnessCost *smoothnessterm = new SmoothnessCost(&smooth[0]);
     EnergyFunction *energy = new EnergyFunction(dataterm,smoothnessterm);
 
-    MRF *mrf;
+    Expansion *mrf;
     mrf = new Expansion(superpixelnum, 2, energy);
+    if(graph != NULL)
+	mrf->setGraph(graph);
 
     //solve
     mrf->initialize();
@@ -951,7 +977,24 @@ void MRFOptimizeLabels(const vector<int>&superpixelConfidence,  const map<pair<i
 }
 
 
-void MRFOptimizeLabels_multiLayer(const vector< vector<double> >&superpixelConfidence, const map<pair<int,int>,int> &pairmap, const vector< Vector3d > &averageRGB, float smoothweight, int numlabels, vector <int>& superpixelLabel){
+void MRFOptimizeLabels_multiLayer(const vector< vector<double> >&superpixelConfidence, const map<pair<int,int>,int> &pairmap, const vector< Vector3d > &averageRGB, float smoothweight, int numlabels, vector <int>& superpixelLabel, Energy *graph){
+    vector<SuperpixelGraph::Edge>edges;
+    edges.reserve(pairmap.size());
+    for(const auto &mapiter:pairmap){
+	SuperpixelGraph::Edge edge;
+	edge.superpixel0 = mapiter.first.first;
+	edge.superpixel1 = mapiter.first.second;
+	edge.boundary_length = mapiter.second;
+	edges.push_back(edge);
+    }
+    MRFOptimizeLabels_multiLayer(superpixelConfidence, edges, averageRGB, smoothweight, numlabels, superpixelLabel, graph);
+}
+
+void MRFOptimizeLabels_multiLayer(const vector< vector<double> >&superpixelConfidence, const SuperpixelGraph &superpixelgraph, float smoothweight, int numlabels, vector <int>& superpixelLabel, Energy *graph){
+    MRFOptimizeLabels_multiLayer(superpixelConfidence, superpixelgraph.GetEdges(), superpixelgraph.GetMeanRGBs(), smoothweight, numlabels, superpixelLabel, graph);
+}
+
+void MRFOptimizeLabels_multiLayer(const vector< vector<double> >&superpixelConfidence, const vector<SuperpixelGraph::Edge> &edges, const vector< Vector3d > &averageRGB, float smoothweight, int numlabels, vector <int>& superpixelLabel, Energy *graph){
 
     int superpixelnum = superpixelConfidence[0].size();
 
@@ -985,17 +1028,18 @@ void MRFOptimizeLabels_multiLayer(const vector< vector<double> >&superpixelConfi
     SmoothnessCost *smoothnessterm = new SmoothnessCost(&smooth[0]);
     EnergyFunction *energy = new EnergyFunction(dataterm,smoothnessterm);
 
-    MRF *mrf;
+    Expansion *mrf;
     mrf = new Expansion(superpixelnum, numlabels, energy);
+    if(graph != NULL)
+	mrf->setGraph(graph);
 
     //solve
     mrf->initialize();
 
  
-    for(const auto &mapiter:pairmap){
-	pair<int,int> curpair = mapiter.first;
-	MRF::CostVal weight = (MRF::CostVal)mapiter.second * (MRF::CostVal)(colorDiffFunc(curpair.first,curpair.second,averageRGB) * 1000 * smoothweight);
-	mrf->setNeighbors(curpair.first,curpair.second, weight);
+    for(const auto &edge:edges){
+	MRF::CostVal weight = (MRF::CostVal)edge.boundary_length * (MRF::CostVal)(colorDiffFunc(edge.superpixel0,edge.superpixel1,averageRGB) * 1000 * smoothweight);
+	mrf->setNeighbors(edge.superpixel0,edge.superpixel1, weight);
     }
   
     mrf->clearAnswer();
@@ -1024,7 +1068,8 @@ void MRFOptimizeLabels_multiLayer(const vector< vector<double> >&superpixelConfi
     delete dataterm;
 }
 
-void backProjectObject(const Panorama &panorama,const PointCloud& objectcloud, const vector< vector<int> >&objectgroup, const vector<int>&segmentation, const vector< vector<int> >&labelgroup, vector<list<PointCloud> >&objectlist, const int panoramaid, const int roomid){
+void backProjectObject(const Panorama &panorama,const PointCloud& objectcloud, const vector< vector<int> >&objectgroup, const vector<int>&segmentation, const vector< vector<int> >&labelgroup, vector<list<PointCloud> >&objectlist, const int panoramaid, const int roomid, const bool write_debug_images, const int num_threads, const ProjectionCache *projection){
+    const ScopedTrace trace("backProjectObject");
     const int backgroundlabel = *max_element(segmentation.begin(),segmentation.end());
     const int imgwidth = panorama.Width();
     const int imgheight = panorama.Height();
@@ -1037,60 +1082,65 @@ void backProjectObject(const Panorama &panorama,const PointCloud& objectcloud, c
 
     vector< vector<structured_indoor_modeling::Point> >point_to_add(backgroundlabel);
     vector<PointCloud>pointcloud_to_merge(backgroundlabel);
-    
-    //get depth map for each object
-    vector <DepthFilling> objectdepth(backgroundlabel);
     objectlist.resize(backgroundlabel);
-    
-    for(int objectid=0; objectid<backgroundlabel; objectid++){
-    	objectdepth[objectid].Init(objectcloud, panorama, objectgroup[objectid], false);
-	char buffer[100];
-	sprintf(buffer, "depth/depth_object_pan%03d_object%03d.png", panoramaid, objectid);
-	objectdepth[objectid].SaveDepthmap(string(buffer));
-    	//mask for current object
-    	for(int spix=0; spix<segmentation.size(); spix++){
-    	    if(segmentation[spix] != objectid)
-    		continue;
-    	    for(int pixid=0; pixid<labelgroup[spix].size(); pixid++){
-    		int pix = labelgroup[spix][pixid];
-    		Vector2d RGBpixel((double)(pix%panorama.Width()), (double)(pix/panorama.Width()));
-    		Vector2d depthpixel = panorama.RGBToDepth(RGBpixel);
-    		objectdepth[segmentation[spix]].setMask((int)depthpixel[0],(int)depthpixel[1], true);
-    	    }
-    	}
-    	objectdepth[objectid].fill_hole(panorama);
-    }
-  
+
+    //pixels of each object, in the order of the superpixels
+    vector< vector<int> >objectpixels(backgroundlabel);
     for(int superpixelid=0; superpixelid<segmentation.size(); superpixelid++){
-    	if(segmentation[superpixelid] < backgroundlabel){   //object
-    	    for(int pixelid=0; pixelid<labelgroup[superpixelid].size(); pixelid++){
-    		int pix = labelgroup[superpixelid][pixelid];
-    		Vector2d pixloc((double)(pix % imgwidth), (double)(pix / imgwidth));
-    		Vector2d depthloc = panorama.RGBToDepth(pixloc);
-    		Vector3f curcolor = panorama.GetRGB(pixloc);
-    		float temp = curcolor[2];
-    		curcolor[2] = curcolor[0];
-    		curcolor[0] = temp;
-    		double depthv = objectdepth[segmentation[superpixelid]].GetDepth(depthloc[0],depthloc[1]);
-    		if(curcolor.norm() == 0 || depthv < 0)
-    		    continue;
-
-    		Vector3d worldcoord = panorama.Unproject(pixloc, depthv);
-    		if(worldcoord[2] >= max_z)
-    		    continue;
-		
-    		structured_indoor_modeling::Point curpt;
-    		curpt.position = worldcoord;
-    		curpt.color = curcolor;
-    		curpt.depth_position = Vector2i(0,0);
-    		curpt.normal = Vector3d(0,0,0);
-    		curpt.intensity = 0.0;
-    		curpt.object_id = segmentation[superpixelid];
-    		point_to_add[segmentation[superpixelid]].push_back(curpt);
-    	    }
-    	}
+	if(segmentation[superpixelid] < backgroundlabel)
+	    objectpixels[segmentation[superpixelid]].insert(objectpixels[segmentation[superpixelid]].end(), labelgroup[superpixelid].begin(), labelgroup[superpixelid].end());
     }
 
+    //get depth map for each object, objects in parallel. The depth
+    //map and the solver buffers are reused by the objects of a thread.
+    const int threadnum = GetNumThreads(num_threads);
+    vector <DepthFilling> objectdepth(threadnum);
+    vector <CsolverWorkspace<double> > workspaces(threadnum);
+    ParallelForWithThreadId(0, backgroundlabel, [&](const int objectid, const int thread){
+	DepthFilling &depth = objectdepth[thread];
+	if(projection != NULL)
+	    depth.Init(*projection, panorama, objectgroup[objectid], false);
+	else
+	    depth.Init(objectcloud, panorama, objectgroup[objectid], false);
+	if(write_debug_images){
+	    char buffer[100];
+	    sprintf(buffer, "depth/depth_object_pan%03d_object%03d.png", panoramaid, objectid);
+	    depth.SaveDepthmap(string(buffer));
+	}
+	//mask for current object
+	for(const auto pix: objectpixels[objectid]){
+	    Vector2d RGBpixel((double)(pix%panorama.Width()), (double)(pix/panorama.Width()));
+	    Vector2d depthpixel = panorama.RGBToDepth(RGBpixel);
+	    depth.setMask((int)depthpixel[0],(int)depthpixel[1], true);
+	}
+	depth.fill_hole(panorama, workspaces[thread], 1);
+
+	for(const auto pix: objectpixels[objectid]){
+	    Vector2d pixloc((double)(pix % imgwidth), (double)(pix / imgwidth));
+	    Vector2d depthloc = panorama.RGBToDepth(pixloc);
+	    Vector3f curcolor = panorama.GetRGB(pixloc);
+	    float temp = curcolor[2];
+	    curcolor[2] = curcolor[0];
+	    curcolor[0] = temp;
+	    double depthv = depth.GetDepth(depthloc[0],depthloc[1]);
+	    if(curcolor.norm() == 0 || depthv < 0)
+		continue;
+
+	    Vector3d worldcoord = panorama.Unproject(pixloc, depthv);
+	    if(worldcoord[2] >= max_z)
+		continue;
+
+	    structured_indoor_modeling::Point curpt;
+	    curpt.position = worldcoord;
+	    curpt.color = curcolor;
+	    curpt.depth_position = Vector2i(0,0);
+	    curpt.normal = Vector3d(0,0,0);
+	    curpt.intensity = 0.0;
+	    curpt.object_id = objectid;
+	    point_to_add[objectid].push_back(curpt);
+	}
+    }, threadnum);
+
     for(int objid=0; objid<pointcloud_to_merge.size(); objid++){
 	pointcloud_to_merge[objid].AddPoints(point_to_add[objid]);
 	//ignore small object
@@ -7,12 +7,15 @@
 #include "../../base/floorplan.h"
 #include "../../base/kdtree/KDtree.h"
 #include "../../base/indoor_polygon.h"
+#include "../../base/visibility.h"
 #include <iostream>
 #include <opencv2/opencv.hpp>
 #include <algorithm>
 #include "MRF/mrf.h"
 #include "MRF/GCoptimization.h"
 #include "depth_filling.h"
+#include "superpixel_graph.h"
+#include "projection_cache.h"
 
 
 void initPanorama(const structured_indoor_modeling::FileIO &file_io, std::vector<structured_indoor_modeling::Panorama>&panorama, std::vector<std::vector<int> >&labels, const int expected_num, std::vector<int>&numlabels,std::vector<structured_indoor_modeling::DepthFilling>&depth, int &imgwidth, int &imgheight, const int startid, const int endid, const bool recompute = false);
@@ -20,7 +23,13 @@ void initPanorama(const structured_indoor_modeling::FileIO &file_io, std::vector
 void AllRange(std::vector<int>&array, std::vector<std::vector<int> >&result, int k, int m);
 
 
-void getObjectColor(structured_indoor_modeling::PointCloud &objectcloud, const std::vector<structured_indoor_modeling::Panorama>&panorama, const std::vector<std::vector<int> >&objectgroup, const int roomid);
+//Projections of all the points of objectcloud into every panorama, with the depth margin of getObjectColor.
+//cachefiles and cachekeys (one per panorama, or empty) keep them across runs: a file is read unless recompute is set
+//or it was written with another key. A key must cover the points, the panorama and its superpixel labels.
+void initProjections(const structured_indoor_modeling::PointCloud &objectcloud, const std::vector<structured_indoor_modeling::Panorama>&panorama, const std::vector<std::vector<int> >&labels, const std::vector<std::string>&cachefiles, const std::vector<uint64_t>&cachekeys, std::vector<structured_indoor_modeling::ProjectionCache>&projections, const bool recompute = false);
+
+//projections: from initProjections on objectcloud
+void getObjectColor(structured_indoor_modeling::PointCloud &objectcloud, const std::vector<structured_indoor_modeling::Panorama>&panorama, const structured_indoor_modeling::VisibilityIndex& visibility, const std::vector<structured_indoor_modeling::ProjectionCache>&projections, const std::vector<std::vector<int> >&objectgroup, const int roomid);
 
 
 void removeNearWallObjects(const structured_indoor_modeling::IndoorPolygon& indoor_polygon,
@@ -70,11 +79,20 @@ int groupObject(const structured_indoor_modeling::PointCloud &point_cloud, std::
 void getSuperpixelConfidence(const structured_indoor_modeling::PointCloud &point_cloud, const std::vector<int>&objectgroup, const structured_indoor_modeling::Panorama &panorama, const std::vector<int>& superpixel,const std::vector< std::vector<int> >&labelgroup,const std::map<std::pair<int,int>,int>& pairmap, const structured_indoor_modeling::DepthFilling& depthmap, std::vector<double> &superpixelConfidence, const int superpixelnum, const int erodeiter = 0);
 
 
+//Same as above, reading the superpixels from the graph (no scan of the label map)
+void getSuperpixelConfidence(const structured_indoor_modeling::PointCloud &point_cloud, const std::vector<int>&objectgroup, const structured_indoor_modeling::Panorama &panorama, const structured_indoor_modeling::SuperpixelGraph &superpixelgraph, std::vector<double> &superpixelConfidence, const int erodeiter = 0);
+
+//Same as above, from the projections of point_cloud into the panorama of the graph
+void getSuperpixelConfidence(const structured_indoor_modeling::ProjectionCache &projection, const std::vector<int>&objectgroup, const structured_indoor_modeling::SuperpixelGraph &superpixelgraph, std::vector<double> &superpixelConfidence, const int erodeiter = 0);
+
 void pairSuperpixel(const std::vector <int> &labels, int width, int height, std::map<std::pair<int,int>, int> &pairmap);
 
-void MRFOptimizeLabels(const std::vector<int>&superpixelConfidence,  const std::map<std::pair<int,int>,int> &pairmap,const std::vector< Eigen::Vector3d >&averageRGB, float smoothweight, std::vector<int>&superpixelLabel);
+//graph: optional max-flow graph shared across calls, so that its node and arc storage is reused
+void MRFOptimizeLabels(const std::vector<int>&superpixelConfidence,  const std::map<std::pair<int,int>,int> &pairmap,const std::vector< Eigen::Vector3d >&averageRGB, float smoothweight, std::vector<int>&superpixelLabel, Energy *graph = NULL);
 
-void MRFOptimizeLabels_multiLayer(const std::vector< std::vector<double> >&superpixelConfidence, const std::map<std::pair<int,int>,int> &pairmap, const std::vector< Eigen::Vector3d> &averageRGB,  float smoothweight, int numlabels, std::vector <int> &superpixelLabel);
+void MRFOptimizeLabels_multiLayer(const std::vector< std::vector<double> >&superpixelConfidence, const std::map<std::pair<int,int>,int> &pairmap, const std::vector< Eigen::Vector3d> &averageRGB,  float smoothweight, int numlabels, std::vector <int> &superpixelLabel, Energy *graph = NULL);
+void MRFOptimizeLabels_multiLayer(const std::vector< std::vector<double> >&superpixelConfidence, const structured_indoor_modeling::SuperpixelGraph &superpixelgraph,  float smoothweight, int numlabels, std::vector <int> &superpixelLabel, Energy *graph = NULL);
+void MRFOptimizeLabels_multiLayer(const std::vector< std::vector<double> >&superpixelConfidence, const std::vector<structured_indoor_modeling::SuperpixelGraph::Edge> &edges, const std::vector< Eigen::Vector3d> &averageRGB,  float smoothweight, int numlabels, std::vector <int> &superpixelLabel, Energy *graph = NULL);
 
 void colorTransform_RANSAC(std::vector<Eigen::Vector3f>&src, std::vector<Eigen::Vector3f>&dst, Eigen::Matrix3f& transform, const int maxiter = 1000);
     
@@ -82,7 +100,8 @@ void computeColorTransform(std::vector<Eigen::Vector3f>&src, std::vector<Eigen::
 
 void mergeObject(std::vector<std::vector<std::list<structured_indoor_modeling::PointCloud> > >&objectlist , const std::vector<structured_indoor_modeling::PointCloud> &objectcloud, std::vector<structured_indoor_modeling::PointCloud> &resultcloud);
 
-void backProjectObject(const structured_indoor_modeling::Panorama &panorama, const structured_indoor_modeling::PointCloud &objectcloud, const std::vector< std::vector<int> >&objectgroup,  const std::vector<int>&segmentation, const std::vector< std::vector<int> >&labelgroup, std::vector <std::list< structured_indoor_modeling::PointCloud> > &objectlist, const int panoramaid, const int roomid);
+//projection: optional projections of objectcloud into panorama, to build the object depth maps without reprojecting
+void backProjectObject(const structured_indoor_modeling::Panorama &panorama, const structured_indoor_modeling::PointCloud &objectcloud, const std::vector< std::vector<int> >&objectgroup,  const std::vector<int>&segmentation, const std::vector< std::vector<int> >&labelgroup, std::vector <std::list< structured_indoor_modeling::PointCloud> > &objectlist, const int panoramaid, const int roomid, const bool write_debug_images = false, const int num_threads = 0, const structured_indoor_modeling::ProjectionCache *projection = NULL);
 
 
 void cleanObjects(structured_indoor_modeling::PointCloud &pc, std::vector<std::vector<int> >&objectgroup);
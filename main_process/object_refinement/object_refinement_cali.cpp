@@ -4,9 +4,11 @@
 #include <Eigen/Eigen>
 #include <string>
 #include <gflags/gflags.h>
+#include "../../base/build_cache.h"
 #include "../../base/file_io.h"
 #include "../../base/point_cloud.h"
 #include "../../base/panorama.h"
+#include "../../base/tracing_flags.h"
 #include <vector>
 #include <typeinfo>
 #include "object_refinement.h"
@@ -28,6 +30,7 @@ DEFINE_int32(start_id, 0,"Start id");
 DEFINE_int32(end_id,-1, "End id");
 DEFINE_int32(nsmooth, 3, "Iterations of smoothing");
 DEFINE_bool(recompute, false, "Recompute superpixel");
+DEFINE_bool(incremental, true, "Skip the rooms whose inputs did not change since the last run");
 
 bool compare_by_z(const structured_indoor_modeling::Point &pt1, const structured_indoor_modeling::Point &pt2){
      return pt1.position[2] < pt2.position[2];
@@ -46,6 +49,7 @@ int main(int argc, char **argv){
 #else
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 #endif
+  InitTracingFromFlags();
 
     if (argc < 2) {
 	cerr << "Usage: " << argv[0] << " data_directory" << endl;
@@ -80,36 +84,100 @@ int main(int argc, char **argv){
     IndoorPolygon indoor_polygon(file_io.GetIndoorPolygon());
     Floorplan floorplan(file_io.GetFloorplan());
 
+    //A room is refined again only if its segmented objects, its
+    //geometry, the panoramas or the flags changed. Panoramas are not
+    //loaded if no room has to be refined.
+    BuildCache build_cache(file_io, "object_refinement", FLAGS_incremental);
+    vector<BuildKey> room_keys(floorplan.GetNumRooms());
+    vector<bool> refine_room(floorplan.GetNumRooms(), false);
+    bool refine_any = false;
+    {
+	BuildKey common_key;
+	common_key.Add("start_id", FLAGS_start_id);
+	common_key.Add("nsmooth", FLAGS_nsmooth);
+	common_key.AddHash(build_cache.HashPanoramaFiles(endid + 1));
+	common_key.AddHash(build_cache.HashFile(file_io.GetIndoorPolygon()));
+	common_key.AddBytes(floorplan.GetFloorplanToGlobal().data(), 9 * sizeof(double));
+	for(int roomid=0; roomid<floorplan.GetNumRooms(); roomid++){
+	    BuildKey& key = room_keys[roomid];
+	    key.AddHash(common_key.GetHash());
+	    key.AddHash(build_cache.HashFile(file_io.GetObjectPointClouds(roomid)));
+	    key.AddHash(build_cache.HashFile(file_io.GetFloorWallPointClouds(roomid)));
+	    for(int v=0; v<floorplan.GetNumRoomVertices(roomid); v++)
+		key.AddBytes(floorplan.GetRoomVertexLocal(roomid, v).data(), 2 * sizeof(double));
+	    key.Add("floor_height", floorplan.GetFloorHeight(roomid));
+	    key.Add("ceiling_height", floorplan.GetCeilingHeight(roomid));
+	    const vector<string> outputs(1, file_io.GetRefinedObjectClouds(roomid));
+	    refine_room[roomid] = !build_cache.IsUpToDate(BuildCache::GetUnitName("room", roomid), key, outputs);
+	    refine_any = refine_any || refine_room[roomid];
+	}
+    }
+    if(!refine_any){
+	cout<<"Object refinement is up to date."<<endl;
+	return 0;
+    }
+
 
 //    cout<<"Init..."<<endl;
     int imgheight, imgwidth;
     initPanorama(file_io, panorama, labels, FLAGS_label_num, numlabels,depth, imgwidth, imgheight, startid, endid, FLAGS_recompute);
     ReadObjectCloud(file_io, floorplan, objectcloud, objectgroup);
+    const VisibilityIndex visibility(panorama);
 
     start = clock();    
 
     for(int roomid=0; roomid<objectcloud.size(); roomid++){
+	if(roomid < refine_room.size() && !refine_room[roomid])
+	    continue;
     	 // for(int objid=0; objid<objectgroup[roomid].size(); objid++){
     	 //      sprintf(buffer,"temp/object_room%03d_obj%03d.ply",roomid,objid);
     	 //      objectcloud[roomid].WriteObject(string(buffer), objid);
     	 // }
 //    	cout<<"---------------------"<<endl;
 //  	cout<<"Room "<<roomid<<endl;
-    	getObjectColor(objectcloud[roomid], panorama, objectgroup[roomid] ,roomid);
+	//Projections of the points into the panoramas, shared by the
+	//refinement steps of the room and kept in the build cache
+	//directory for the next run (recomputed with --recompute).
+	vector<ProjectionCache> projections;
+	{
+	    vector<string> cachefiles;
+	    vector<uint64_t> cachekeys;
+	    if(roomid < room_keys.size()){
+		cachefiles.resize(panorama.size());
+		cachekeys.resize(panorama.size());
+	    }
+	    for(int panid=0; panid<cachefiles.size(); panid++){
+		const string unit = BuildCache::GetUnitName("projection_room", roomid) + "_" +
+		    BuildCache::GetUnitName("panorama", startid + panid);
+		cachefiles[panid] = build_cache.GetBlob(unit);
+		BuildKey key;
+		key.AddHash(room_keys[roomid].GetHash());
+		key.Add("panorama", startid + panid);
+		key.AddHash(build_cache.HashFile(file_io.GetSuperPixelFile(startid + panid)));
+		cachekeys[panid] = key.GetHash();
+	    }
+	    initProjections(objectcloud[roomid], panorama, labels, cachefiles, cachekeys, projections, FLAGS_recompute);
+	}
+    	getObjectColor(objectcloud[roomid], panorama, visibility, projections, objectgroup[roomid] ,roomid);
 	removeNearWallObjects(indoor_polygon,
 			      floorplan,
 			      roomid,
 			      objectcloud[roomid]);
 	cleanObjects(objectcloud[roomid], objectgroup[roomid]);
-	//sort point according to z
-	for(int objid=0; objid<objectgroup[roomid].size(); objid++){
-	     vector<structured_indoor_modeling::Point>sort_array;
-	     vector<int>objind;
-	     objectcloud[roomid].GetObjectPoints(objid, sort_array);
-	     objectcloud[roomid].GetObjectIndice(objid, objind);
-	     sort(sort_array.begin(), sort_array.end(), compare_by_z);
-	     for(int i=0; i<objind.size(); ++i)
-		  objectcloud[roomid].GetPoint(objind[i]) = sort_array[i];
+	//sort point according to z. Spans are taken before writing, as
+	//non-const access to the points drops the object index.
+	{
+	     const PointCloud& cloud = objectcloud[roomid];
+	     vector<ObjectPointSpan>spans(objectgroup[roomid].size());
+	     for(int objid=0; objid<spans.size(); objid++)
+		  spans[objid] = cloud.GetObjectPointSpan(objid);
+	     vector<structured_indoor_modeling::Point>&points = objectcloud[roomid].GetPointData();
+	     for(int objid=0; objid<spans.size(); objid++){
+		  vector<structured_indoor_modeling::Point>sort_array(spans[objid].begin(), spans[objid].end());
+		  sort(sort_array.begin(), sort_array.end(), compare_by_z);
+		  for(int i=0; i<spans[objid].size(); ++i)
+		       points[spans[objid].GetIndex(i)] = sort_array[i];
+	     }
 	}
 
 	//Smoothing
@@ -135,6 +203,9 @@ int main(int argc, char **argv){
 	}
 	
     	objectcloud[roomid].Write(file_io.GetRefinedObjectClouds(roomid));
+	if(roomid < room_keys.size())
+	    build_cache.Record(BuildCache::GetUnitName("room", roomid), room_keys[roomid],
+			       vector<string>(1, file_io.GetRefinedObjectClouds(roomid)));
     }
 
     
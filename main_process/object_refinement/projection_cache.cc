@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "../../base/panorama.h"
+#include "../../base/parallel.h"
+#include "../../base/point_cloud.h"
+#include "../../base/tracing.h"
+#include "projection_cache.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace structured_indoor_modeling {
+
+namespace {
+
+const char kMagic[4] = { 'P', 'R', 'J', 'C' };
+const int kVersion = 2;
+
+template <typename T>
+void WriteArray(const vector<T>& array, ofstream* ofstr) {
+  if (!array.empty())
+    ofstr->write((const char*)array.data(), array.size() * sizeof(T));
+}
+
+template <typename T>
+bool ReadArray(const int size, ifstream* ifstr, vector<T>* array) {
+  array->resize(size);
+  if (size != 0)
+    ifstr->read((char*)array->data(), size * sizeof(T));
+  return !ifstr->fail();
+}
+
+}  // namespace
+
+ProjectionCache::ProjectionCache() : depth_margin(0.0) {
+}
+
+void ProjectionCache::Compute(const PointCloud& point_cloud,
+                              const Panorama& panorama,
+                              const std::vector<int>& labels,
+                              const double new_depth_margin,
+                              const int num_threads) {
+  const ScopedTrace trace("ProjectionCache::Compute");
+  depth_margin = new_depth_margin;
+  const int num_points = point_cloud.GetNumPoints();
+  rgb_pixels.resize(2 * num_points);
+  depth_pixels.resize(2 * num_points);
+  distances.resize(num_points);
+  depths.resize(num_points);
+  flags.resize(num_points);
+  superpixels.resize(num_points);
+
+  const bool has_labels = !labels.empty();
+  const int width = panorama.Width();
+  const Vector3d center = panorama.GetCenter();
+  ParallelFor(0, num_points, [&](const int point) {
+    const Vector3d& position = point_cloud.GetPoint(point).position;
+    const Vector2d rgb_pixel = panorama.Project(position);
+    const Vector2d depth_pixel = panorama.RGBToDepth(rgb_pixel);
+    const double distance = (position - center).norm();
+    rgb_pixels[2 * point] = rgb_pixel[0];
+    rgb_pixels[2 * point + 1] = rgb_pixel[1];
+    depth_pixels[2 * point] = depth_pixel[0];
+    depth_pixels[2 * point + 1] = depth_pixel[1];
+    distances[point] = distance;
+    depths[point] = 0.0f;
+    flags[point] = 0;
+    superpixels[point] = -1;
+    if (!panorama.IsInsideRGB(rgb_pixel))
+      return;
+
+    unsigned char flag = kInsideRGB;
+    if (has_labels)
+      superpixels[point] = labels[(int)rgb_pixel[1] * width + (int)rgb_pixel[0]];
+    const double depth = panorama.GetDepth(depth_pixel);
+    depths[point] = depth;
+    if (panorama.GetRGB(rgb_pixel).norm() != 0) {
+      flag |= kHasColor;
+      if (distance < depth + depth_margin)
+        flag |= kVisible;
+    }
+    flags[point] = flag;
+  }, num_threads);
+
+  TraceCounter("projection_cache_points", num_points);
+}
+
+bool ProjectionCache::Read(const std::string& filename, const uint64_t key) {
+  ifstream ifstr;
+  ifstr.open(filename.c_str(), ios::binary);
+  if (!ifstr.is_open())
+    return false;
+
+  char magic[4];
+  int version;
+  uint64_t file_key;
+  int num_points;
+  ifstr.read(magic, sizeof(magic));
+  ifstr.read((char*)&version, sizeof(version));
+  ifstr.read((char*)&file_key, sizeof(file_key));
+  ifstr.read((char*)&depth_margin, sizeof(depth_margin));
+  ifstr.read((char*)&num_points, sizeof(num_points));
+  if (ifstr.fail() || !equal(magic, magic + 4, kMagic) || version != kVersion ||
+      file_key != key || num_points < 0)
+    return false;
+
+  if (!ReadArray(2 * num_points, &ifstr, &rgb_pixels) ||
+      !ReadArray(2 * num_points, &ifstr, &depth_pixels) ||
+      !ReadArray(num_points, &ifstr, &distances) ||
+      !ReadArray(num_points, &ifstr, &depths) ||
+      !ReadArray(num_points, &ifstr, &flags) ||
+      !ReadArray(num_points, &ifstr, &superpixels)) {
+    cerr << "Broken projection cache: " << filename << endl;
+    flags.clear();
+    return false;
+  }
+  return true;
+}
+
+void ProjectionCache::Write(const std::string& filename, const uint64_t key) const {
+  // Written aside and renamed, so that a killed run leaves no broken
+  // file with a valid key.
+  const string temporary = filename + ".tmp";
+  ofstream ofstr;
+  ofstr.open(temporary.c_str(), ios::binary);
+  if (!ofstr.is_open()) {
+    cerr << "Cannot open a file: " << temporary << endl;
+    return;
+  }
+  const int num_points = GetNumPoints();
+  ofstr.write(kMagic, sizeof(kMagic));
+  ofstr.write((const char*)&kVersion, sizeof(kVersion));
+  ofstr.write((const char*)&key, sizeof(key));
+  ofstr.write((const char*)&depth_margin, sizeof(depth_margin));
+  ofstr.write((const char*)&num_points, sizeof(num_points));
+  WriteArray(rgb_pixels, &ofstr);
+  WriteArray(depth_pixels, &ofstr);
+  WriteArray(distances, &ofstr);
+  WriteArray(depths, &ofstr);
+  WriteArray(flags, &ofstr);
+  WriteArray(superpixels, &ofstr);
+  ofstr.close();
+#ifdef _WIN32
+  remove(filename.c_str());
+#endif
+  rename(temporary.c_str(), filename.c_str());
+}
+
+}  // namespace structured_indoor_modeling
@@ -0,0 +1,96 @@
+#pragma once
+
+/*
+  The projections of the points of a room into one panorama, which the
+  refinement used to recompute in every step (confidences, coloring,
+  back-projection). Per point, as compact arrays:
+
+  - the RGB and depth pixels (double, exactly as Project and
+    RGBToDepth give them: a float may round u up to the width),
+  - the distance to the panorama center and the depth image there,
+  - flags (inside the image, non-black color, visible), and
+  - the superpixel at the RGB pixel (-1 without a label map).
+
+  A point is visible if it has a color and its distance is at most the
+  depth plus the depth margin given to Compute (the test of
+  getObjectColor). Other margins can be tested with GetDistance and
+  GetDepth.
+
+  Compute runs in parallel over the points. The arrays are saved with
+  a key of the inputs (e.g. a BuildKey hash), and Read fails on a
+  different key, so a rerun only recomputes stale caches.
+
+  < Example >
+
+  ProjectionCache projection;
+  if (!projection.Read(filename, key.GetHash())) {
+    projection.Compute(point_cloud, panorama, labels, depth_margin);
+    projection.Write(filename, key.GetHash());
+  }
+  for (const auto point : object_points)
+    if (projection.IsVisible(point))
+      ... projection.GetRGBPixel(point), projection.GetSuperpixel(point)
+*/
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace structured_indoor_modeling {
+
+class Panorama;
+class PointCloud;
+
+class ProjectionCache {
+ public:
+  enum Flag {
+    kInsideRGB = 1,
+    kHasColor = 2,
+    kVisible = 4
+  };
+
+  ProjectionCache();
+
+  // labels[y * width + x] is the superpixel of a pixel of panorama, or
+  // empty.
+  void Compute(const PointCloud& point_cloud,
+               const Panorama& panorama,
+               const std::vector<int>& labels,
+               const double depth_margin,
+               const int num_threads = 0);
+
+  // False if the file is missing, broken or was written with another key.
+  bool Read(const std::string& filename, const uint64_t key);
+  void Write(const std::string& filename, const uint64_t key) const;
+
+  int GetNumPoints() const { return (int)flags.size(); }
+  double GetDepthMargin() const { return depth_margin; }
+
+  Eigen::Vector2d GetRGBPixel(const int point) const {
+    return Eigen::Vector2d(rgb_pixels[2 * point], rgb_pixels[2 * point + 1]);
+  }
+  Eigen::Vector2d GetDepthPixel(const int point) const {
+    return Eigen::Vector2d(depth_pixels[2 * point], depth_pixels[2 * point + 1]);
+  }
+  double GetDistance(const int point) const { return distances[point]; }
+  // Depth image at the depth pixel. Zero outside the image.
+  double GetDepth(const int point) const { return depths[point]; }
+
+  bool IsInsideRGB(const int point) const { return (flags[point] & kInsideRGB) != 0; }
+  bool HasColor(const int point) const { return (flags[point] & kHasColor) != 0; }
+  bool IsVisible(const int point) const { return (flags[point] & kVisible) != 0; }
+  int GetSuperpixel(const int point) const { return superpixels[point]; }
+
+ private:
+  double depth_margin;
+
+  std::vector<double> rgb_pixels;
+  std::vector<double> depth_pixels;
+  std::vector<float> distances;
+  std::vector<float> depths;
+  std::vector<unsigned char> flags;
+  std::vector<int> superpixels;
+};
+
+}  // namespace structured_indoor_modeling
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+
+#include "../../base/panorama.h"
+#include "../../base/point_cloud.h"
+#include "../../base/tracing.h"
+#include "projection_cache.h"
+#include "superpixel_graph.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace structured_indoor_modeling {
+
+namespace {
+
+// Same threshold as the erosion of getSuperpixelConfidence.
+const double kErodeThreshold = 1.0;
+
+// CIE Lab (D65) of an 8 bit sRGB color. srgb_to_linear is a table of
+// the 256 values of a channel.
+Vector3d RGBToLab(const vector<double>& srgb_to_linear,
+                  const int red, const int green, const int blue) {
+  const double r = srgb_to_linear[red];
+  const double g = srgb_to_linear[green];
+  const double b = srgb_to_linear[blue];
+  const double xyz[3] = { (0.412453 * r + 0.357580 * g + 0.180423 * b) / 0.950456,
+                          0.212671 * r + 0.715160 * g + 0.072169 * b,
+                          (0.019334 * r + 0.119193 * g + 0.950227 * b) / 1.088754 };
+  double f[3];
+  for (int i = 0; i < 3; ++i)
+    f[i] = xyz[i] > 0.008856 ? cbrt(xyz[i]) : 7.787 * xyz[i] + 16.0 / 116.0;
+  return Vector3d(116.0 * f[1] - 16.0, 500.0 * (f[0] - f[1]), 200.0 * (f[1] - f[2]));
+}
+
+}  // namespace
+
+SuperpixelGraph::SuperpixelGraph() : width(0) {
+  pixel_offsets.push_back(0);
+}
+
+void SuperpixelGraph::Init(const Panorama& panorama,
+                           const std::vector<int>& new_labels,
+                           const int num_superpixels) {
+  const ScopedTrace trace("SuperpixelGraph::Init");
+  width = panorama.Width();
+  const int height = panorama.Height();
+  if ((int)new_labels.size() != width * height) {
+    cerr << "Label map size does not match: " << new_labels.size() << ' ' << width * height << endl;
+    exit (1);
+  }
+  labels = new_labels;
+
+  vector<double> srgb_to_linear(256);
+  for (int v = 0; v < 256; ++v) {
+    const double value = v / 255.0;
+    srgb_to_linear[v] =
+      value <= 0.04045 ? value / 12.92 : pow((value + 0.055) / 1.055, 2.4);
+  }
+
+  // One pass: pixel counts, color and depth sums, and the pairs of
+  // different neighboring labels. The pairs are those of
+  // pairSuperpixel (right and down neighbors, without the last row and
+  // column).
+  pixel_offsets.assign(num_superpixels + 1, 0);
+  vector<Vector3d> rgb_sums(num_superpixels, Vector3d(0, 0, 0));
+  vector<Vector3d> lab_sums(num_superpixels, Vector3d(0, 0, 0));
+  vector<double> depth_sums(num_superpixels, 0.0);
+  vector<int> depth_counts(num_superpixels, 0);
+  vector<uint64_t> pairs;
+  const cv::Mat rgb_image = panorama.GetRGBImage();
+  for (int y = 0; y < height; ++y) {
+    const cv::Vec3b* colors = rgb_image.ptr<cv::Vec3b>(y);
+    const int* row = &labels[y * width];
+    for (int x = 0; x < width; ++x) {
+      const int label = row[x];
+      ++pixel_offsets[label + 1];
+      const cv::Vec3b& color = colors[x];
+      rgb_sums[label] += Vector3d(color[0], color[1], color[2]);
+      lab_sums[label] += RGBToLab(srgb_to_linear, color[2], color[1], color[0]);
+      const double depth = panorama.GetDepth(panorama.RGBToDepth(Vector2d(x, y)));
+      if (depth > 0.0) {
+        depth_sums[label] += depth;
+        ++depth_counts[label];
+      }
+
+      if (y == height - 1 || x == width - 1)
+        continue;
+      const int right = row[x + 1];
+      const int down = row[x + width];
+      if (label != right)
+        pairs.push_back((uint64_t)min(label, right) * num_superpixels + max(label, right));
+      if (label != down)
+        pairs.push_back((uint64_t)min(label, down) * num_superpixels + max(label, down));
+    }
+  }
+
+  // Pixels, as a counting sort.
+  for (int s = 0; s < num_superpixels; ++s)
+    pixel_offsets[s + 1] += pixel_offsets[s];
+  pixel_indices.resize(labels.size());
+  {
+    vector<int> next(pixel_offsets.begin(), pixel_offsets.end() - 1);
+    for (int p = 0; p < (int)labels.size(); ++p)
+      pixel_indices[next[labels[p]]++] = p;
+  }
+
+  mean_rgbs.assign(num_superpixels, Vector3d(0, 0, 0));
+  mean_labs.assign(num_superpixels, Vector3d(0, 0, 0));
+  mean_depths.assign(num_superpixels, 0.0);
+  for (int s = 0; s < num_superpixels; ++s) {
+    const int num_pixels = GetNumPixels(s);
+    if (num_pixels != 0) {
+      mean_rgbs[s] = rgb_sums[s] / (double)num_pixels;
+      mean_labs[s] = lab_sums[s] / (double)num_pixels;
+    }
+    if (depth_counts[s] != 0)
+      mean_depths[s] = depth_sums[s] / depth_counts[s];
+  }
+
+  // Edges with boundary lengths, and the edges around each superpixel.
+  sort(pairs.begin(), pairs.end());
+  edges.clear();
+  for (int i = 0; i < (int)pairs.size(); ) {
+    int j = i + 1;
+    while (j < (int)pairs.size() && pairs[j] == pairs[i])
+      ++j;
+    Edge edge;
+    edge.superpixel0 = (int)(pairs[i] / num_superpixels);
+    edge.superpixel1 = (int)(pairs[i] % num_superpixels);
+    edge.boundary_length = j - i;
+    edges.push_back(edge);
+    i = j;
+  }
+
+  edge_offsets.assign(num_superpixels + 1, 0);
+  for (const auto& edge : edges) {
+    ++edge_offsets[edge.superpixel0 + 1];
+    ++edge_offsets[edge.superpixel1 + 1];
+  }
+  for (int s = 0; s < num_superpixels; ++s)
+    edge_offsets[s + 1] += edge_offsets[s];
+  edge_indices.resize(2 * edges.size());
+  {
+    vector<int> next(edge_offsets.begin(), edge_offsets.end() - 1);
+    for (int e = 0; e < (int)edges.size(); ++e) {
+      edge_indices[next[edges[e].superpixel0]++] = e;
+      edge_indices[next[edges[e].superpixel1]++] = e;
+    }
+  }
+  TraceCounter("superpixel_edges", edges.size());
+}
+
+void SuperpixelGraph::ComputeConfidence(const PointCloud& point_cloud,
+                                        const std::vector<int>& object_points,
+                                        const Panorama& panorama,
+                                        const int erode_iterations,
+                                        std::vector<double>* confidence) const {
+  confidence->assign(GetNumSuperpixels(), 0.0);
+  if (point_cloud.isempty())
+    return;
+
+  const Vector3d center = panorama.GetCenter();
+  const double kDepthTolerance = 50;
+  for (const auto point : object_points) {
+    const Vector3d& position = point_cloud.GetPoint(point).position;
+    const Vector2d pixel = panorama.Project(position);
+    if (panorama.GetRGB(pixel).norm() < 0.00001)
+      continue;
+    // Visibility test.
+    const double depth = panorama.GetDepth(panorama.RGBToDepth(pixel));
+    if ((position - center).norm() > depth + kDepthTolerance)
+      continue;
+    confidence->at(labels[(int)pixel[1] * width + (int)pixel[0]]) += 1.0;
+  }
+  Erode(erode_iterations, confidence);
+}
+
+void SuperpixelGraph::ComputeConfidence(const ProjectionCache& projection,
+                                        const std::vector<int>& object_points,
+                                        const int erode_iterations,
+                                        std::vector<double>* confidence) const {
+  confidence->assign(GetNumSuperpixels(), 0.0);
+  const double kDepthTolerance = 50;
+  for (const auto point : object_points) {
+    if (!projection.HasColor(point))
+      continue;
+    // Visibility test.
+    if (projection.GetDistance(point) > projection.GetDepth(point) + kDepthTolerance)
+      continue;
+    int superpixel = projection.GetSuperpixel(point);
+    if (superpixel == -1) {
+      const Vector2d pixel = projection.GetRGBPixel(point);
+      superpixel = labels[(int)pixel[1] * width + (int)pixel[0]];
+    }
+    confidence->at(superpixel) += 1.0;
+  }
+  Erode(erode_iterations, confidence);
+}
+
+void SuperpixelGraph::Erode(const int erode_iterations, std::vector<double>* confidence) const {
+  // Erosion, to avoid conflicts on the border. As in
+  // getSuperpixelConfidence, the first test is on the superpixel id.
+  for (int iteration = 0; iteration < erode_iterations; ++iteration) {
+    for (const auto& edge : edges) {
+      if (edge.superpixel0 < kErodeThreshold || (*confidence)[edge.superpixel1] < kErodeThreshold) {
+        (*confidence)[edge.superpixel0] = 0;
+        (*confidence)[edge.superpixel1] = 0;
+      }
+    }
+  }
+}
+
+void SuperpixelGraph::GetLabelGroup(std::vector<std::vector<int> >* labelgroup) const {
+  labelgroup->resize(GetNumSuperpixels());
+  for (int s = 0; s < GetNumSuperpixels(); ++s)
+    (*labelgroup)[s].assign(GetPixelsBegin(s), GetPixelsEnd(s));
+}
+
+void SuperpixelGraph::GetPairMap(std::map<std::pair<int, int>, int>* pairmap) const {
+  pairmap->clear();
+  for (const auto& edge : edges)
+    pairmap->insert(pairmap->end(),
+                    make_pair(make_pair(edge.superpixel0, edge.superpixel1), edge.boundary_length));
+}
+
+}  // namespace structured_indoor_modeling
@@ -0,0 +1,120 @@
+#pragma once
+
+/*
+  The superpixels of a panorama (SLIC label map) with what the
+  refinement reads per superpixel, built in one pass over the image:
+
+  - the pixels of each superpixel (CSR: offsets + pixel indices),
+  - the region adjacency graph, with the boundary length of each pair,
+  - the mean color (RGB as Panorama::GetRGB, and CIE Lab) and depth.
+
+  The per object confidences (projected points) are computed from it
+  without touching the label map again, and the MRF reads the edges and
+  colors directly, so every step after Init is O(superpixels + edges)
+  (plus the object points).
+
+  < Example >
+
+  SuperpixelGraph graph;
+  graph.Init(panorama, labels, num_superpixels);
+  for (const auto& edge : graph.GetEdges())
+    ... edge.superpixel0, edge.superpixel1, edge.boundary_length
+  for (const int* pixel = graph.GetPixelsBegin(s); pixel != graph.GetPixelsEnd(s); ++pixel)
+    ...
+*/
+
+#include <Eigen/Dense>
+#include <map>
+#include <vector>
+
+namespace structured_indoor_modeling {
+
+class Panorama;
+class PointCloud;
+class ProjectionCache;
+
+class SuperpixelGraph {
+ public:
+  struct Edge {
+    // superpixel0 < superpixel1.
+    int superpixel0;
+    int superpixel1;
+    // The number of neighboring pixel pairs across the two.
+    int boundary_length;
+  };
+
+  SuperpixelGraph();
+
+  // labels[y * width + x] is the superpixel of a pixel of panorama, in
+  // [0, num_superpixels).
+  void Init(const Panorama& panorama,
+            const std::vector<int>& labels,
+            const int num_superpixels);
+
+  int GetNumSuperpixels() const { return (int)pixel_offsets.size() - 1; }
+  int GetSuperpixel(const int pixel) const { return labels[pixel]; }
+
+  // Pixels (y * width + x) of a superpixel, in increasing order.
+  int GetNumPixels(const int superpixel) const {
+    return pixel_offsets[superpixel + 1] - pixel_offsets[superpixel];
+  }
+  const int* GetPixelsBegin(const int superpixel) const {
+    return pixel_indices.data() + pixel_offsets[superpixel];
+  }
+  const int* GetPixelsEnd(const int superpixel) const {
+    return pixel_indices.data() + pixel_offsets[superpixel + 1];
+  }
+
+  // Sorted by (superpixel0, superpixel1), the order of pairSuperpixel.
+  const std::vector<Edge>& GetEdges() const { return edges; }
+  // Indices to GetEdges() of the edges around a superpixel.
+  const int* GetEdgesBegin(const int superpixel) const {
+    return edge_indices.data() + edge_offsets[superpixel];
+  }
+  const int* GetEdgesEnd(const int superpixel) const {
+    return edge_indices.data() + edge_offsets[superpixel + 1];
+  }
+
+  // Zero for a superpixel without pixels (or depths).
+  const std::vector<Eigen::Vector3d>& GetMeanRGBs() const { return mean_rgbs; }
+  const Eigen::Vector3d& GetMeanLab(const int superpixel) const { return mean_labs[superpixel]; }
+  double GetMeanDepth(const int superpixel) const { return mean_depths[superpixel]; }
+
+  // The number of the object points visible from panorama at each
+  // superpixel, then eroded erode_iterations times across the edges
+  // (getSuperpixelConfidence).
+  void ComputeConfidence(const PointCloud& point_cloud,
+                         const std::vector<int>& object_points,
+                         const Panorama& panorama,
+                         const int erode_iterations,
+                         std::vector<double>* confidence) const;
+  // Same from the projections of point_cloud into panorama. The
+  // superpixels of the projections must be of the same label map.
+  void ComputeConfidence(const ProjectionCache& projection,
+                         const std::vector<int>& object_points,
+                         const int erode_iterations,
+                         std::vector<double>* confidence) const;
+
+  // The containers of labelTolabelgroup and pairSuperpixel.
+  void GetLabelGroup(std::vector<std::vector<int> >* labelgroup) const;
+  void GetPairMap(std::map<std::pair<int, int>, int>* pairmap) const;
+
+ private:
+  void Erode(const int erode_iterations, std::vector<double>* confidence) const;
+
+  int width;
+  std::vector<int> labels;
+
+  std::vector<int> pixel_offsets;
+  std::vector<int> pixel_indices;
+
+  std::vector<Edge> edges;
+  std::vector<int> edge_offsets;
+  std::vector<int> edge_indices;
+
+  std::vector<Eigen::Vector3d> mean_rgbs;
+  std::vector<Eigen::Vector3d> mean_labs;
+  std::vector<double> mean_depths;
+};
+
+}  // namespace structured_indoor_modeling
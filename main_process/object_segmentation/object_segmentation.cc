@@ -1,14 +1,18 @@
 #include <Eigen/Dense>
 #include <fstream>
+#include <limits>
 #include <numeric>
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <queue>
+#include <random>
 
 #include "../../base/floorplan.h"
 #include "../../base/indoor_polygon.h"
 #include "../../base/point_cloud.h"
 #include "../../base/kdtree/KDtree.h"
+#include "../../base/parallel.h"
+#include "../../base/tracing.h"
 #include "object_segmentation.h"
 
 using namespace Eigen;
@@ -27,8 +31,17 @@ namespace {
   
   double PointDistance(const Point& lhs, const Point& rhs);
 
+  // Fisher-Yates shuffle on the raw numbers of random (the
+  // distributions of <random> differ between standard libraries).
+  template <typename T>
+  void Shuffle(std::mt19937* random, std::vector<T>* values) {
+    for (int i = (int)values->size() - 1; i > 0; --i)
+      swap(values->at(i), values->at((*random)() % (i + 1)));
+  }
+
   void InitializeCentroids(const std::vector<Point>& points,
                            const int num_initial_clusters,
+                           std::mt19937* random,
                            std::vector<int>* segments);
   
   void ComputeDistances(const std::vector<Point>& points,
@@ -416,23 +429,21 @@ void FilterNoisyPoints(std::vector<Point>* points) {
     }
   }
   KDtree kdtree(point_data);
-  vector<const float*> knn;
+  vector<int> knn_indices;
+  vector<float> knn_dist2s;
+  kdtree.find_k_closest_batch(&point_data[0], points->size(), kNumNeighbors,
+                              knn_indices, knn_dist2s);
   vector<float> neighbor_distances(points->size());
   for (int p = 0; p < points->size(); ++p) {
-    knn.clear();
-    const Vector3f ref_point(points->at(p).position[0],
-                             points->at(p).position[1],
-                             points->at(p).position[2]);
-                      
-    kdtree.find_k_closest_to_pt(knn, kNumNeighbors, &ref_point[0]);
-                               
     double neighbor_distance = 0.0;
-    for (int i = 0; i < knn.size(); ++i) {
-      const float* fp = knn[i];
-      const Vector3f point(fp[0], fp[1], fp[2]);
-      neighbor_distance += (point - ref_point).norm();
+    int num_knn = 0;
+    for (int i = p * kNumNeighbors; i < (p + 1) * kNumNeighbors; ++i) {
+      if (knn_indices[i] == -1)
+        break;
+      neighbor_distance += sqrt(knn_dist2s[i]);
+      ++num_knn;
     }
-    neighbor_distances[p] = neighbor_distance / max(1, (int)knn.size());
+    neighbor_distances[p] = neighbor_distance / max(1, num_knn);
   }
   //----------------------------------------------------------------------
   double average = 0.0;
@@ -458,9 +469,9 @@ void FilterNoisyPoints(std::vector<Point>* points) {
   points->swap(new_points);
 }
 
-void Subsample(const double ratio, std::vector<Point>* points) {
+void Subsample(const double ratio, std::mt19937* random, std::vector<Point>* points) {
   const int new_size = static_cast<int>(round(ratio * points->size()));
-  random_shuffle(points->begin(), points->end());
+  Shuffle(random, points);
   points->resize(new_size);
 }
   
@@ -468,9 +479,12 @@ void SegmentObjects(const std::vector<Point>& points,
                     const double centroid_subsampling_ratio,
                     const int num_initial_clusters,
                     const std::vector<std::vector<int> >& neighbors,
+                    std::mt19937* random,
                     std::vector<int>* segments) {
+  const ScopedTrace trace("SegmentObjects");
+  TraceCounter("segment_points", points.size());
   // WritePointsWithColor(points, *segments, "0_first.ply");
-  InitializeCentroids(points, num_initial_clusters, segments);
+  InitializeCentroids(points, num_initial_clusters, random, segments);
   // WriteObjectPointsWithColor(points, *segments, "1_init.ply");
 
   /*
@@ -624,23 +638,19 @@ void SetNeighbors(const std::vector<Point>& points,
     }
   }
   KDtree kdtree(point_data);
-  vector<const float*> knn;
-  vector<float> neighbor_distances(points.size());
+  vector<int> knn_indices;
+  vector<float> knn_dist2s;
+  kdtree.find_k_closest_batch(&point_data[0], points.size(), num_neighbors,
+                              knn_indices, knn_dist2s);
 
   neighbors->clear();
   neighbors->resize(points.size());
 
   for (int p = 0; p < points.size(); ++p) {
-    knn.clear();
-    const Vector3f ref_point(points[p].position[0],
-                             points[p].position[1],
-                             points[p].position[2]);
-                      
-    kdtree.find_k_closest_to_pt(knn, num_neighbors, &ref_point[0]);
-
-    for (int i = 0; i < (int)knn.size(); ++i) {
-      const int index = (knn[i] - &point_data[0]) / 3;
-      neighbors->at(p).push_back(index);
+    for (int i = p * num_neighbors; i < (p + 1) * num_neighbors; ++i) {
+      if (knn_indices[i] == -1)
+        break;
+      neighbors->at(p).push_back(knn_indices[i]);
     }
   }
 }
@@ -679,6 +689,7 @@ double PointDistance(const Point& lhs, const Point& rhs) {
 
 void InitializeCentroids(const std::vector<Point>& points,
                          const int num_initial_clusters,
+                         std::mt19937* random,
                          std::vector<int>* segments) {
   // Randomly initialize seeds.
   /*
@@ -705,7 +716,7 @@ void InitializeCentroids(const std::vector<Point>& points,
         candidates.push_back(p);
 
     // Pick the first one at random.
-    random_shuffle(candidates.begin(), candidates.end());
+    Shuffle(random, &candidates);
     if (candidates.empty())
       return;
 
@@ -1222,56 +1233,144 @@ void FillOccupancy(const Eigen::Vector3d& v0,
   }
 }
 
+// For the rays from a panorama center over the floorplan grid, the
+// distances (in grid units) where a ray first leaves the room
+// (exits) and where it comes back into a room after that (reentries),
+// for num_angles directions. A cell (x, y) covers [x - 0.5, x + 0.5) x
+// [y - 0.5, y + 0.5) as in the round() of the grid lookups.
+struct ExitDistanceTable {
+  int num_angles;
+  std::vector<float> exits;
+  std::vector<float> reentries;
+
+  int GetAngleIndex(const Eigen::Vector2d& diff) const {
+    const double angle = atan2(diff[1], diff[0]) + M_PI;
+    return min(num_angles - 1, static_cast<int>(angle / (2.0 * M_PI) * num_angles));
+  }
+};
+
+// One DDA sweep over the grid cells per angle. The angular resolution
+// is one cell at the farthest grid corner.
+void BuildExitDistanceTable(const std::vector<int>& room_occupancy_with_doors,
+                            const int width,
+                            const int height,
+                            const Eigen::Vector2d& center,
+                            ExitDistanceTable* table) {
+  double max_radius = 0.0;
+  for (int y = 0; y <= 1; ++y)
+    for (int x = 0; x <= 1; ++x)
+      max_radius = max(max_radius, (Vector2d(x * width, y * height) - center).norm());
+  max_radius += 2.0;
+
+  const float kInfinity = numeric_limits<float>::max();
+  table->num_angles = max(8, static_cast<int>(ceil(2.0 * M_PI * max_radius)));
+  table->exits.assign(table->num_angles, kInfinity);
+  table->reentries.assign(table->num_angles, kInfinity);
+
+  ParallelFor(0, table->num_angles, [&](const int a) {
+    const double angle = (a + 0.5) * 2.0 * M_PI / table->num_angles - M_PI;
+    const Vector2d direction(cos(angle), sin(angle));
+
+    int cell[2];
+    int steps[2];
+    double next_t[2];
+    double delta_t[2];
+    for (int i = 0; i < 2; ++i) {
+      cell[i] = static_cast<int>(floor(center[i] + 0.5));
+      if (direction[i] > 0.0) {
+        steps[i] = 1;
+        next_t[i] = (cell[i] + 0.5 - center[i]) / direction[i];
+        delta_t[i] = 1.0 / direction[i];
+      } else if (direction[i] < 0.0) {
+        steps[i] = -1;
+        next_t[i] = (cell[i] - 0.5 - center[i]) / direction[i];
+        delta_t[i] = -1.0 / direction[i];
+      } else {
+        steps[i] = 0;
+        next_t[i] = numeric_limits<double>::max();
+        delta_t[i] = numeric_limits<double>::max();
+      }
+    }
+
+    // Out of the grid, the border cell is used as in the per point
+    // lookups.
+    bool exited = false;
+    double t = 0.0;
+    while (t < max_radius) {
+      const int x = max(0, min(width - 1, cell[0]));
+      const int y = max(0, min(height - 1, cell[1]));
+      const int occupancy = room_occupancy_with_doors[y * width + x];
+      if (!exited) {
+        if (occupancy < 0) {
+          table->exits[a] = t;
+          exited = true;
+        }
+      } else if (occupancy >= 0) {
+        table->reentries[a] = t;
+        break;
+      }
+
+      const int axis = next_t[0] < next_t[1] ? 0 : 1;
+      t = next_t[axis];
+      next_t[axis] += delta_t[axis];
+      cell[axis] += steps[axis];
+    }
+  });
+}
+
 }  // namespace
 
 void RemoveWindowAndMirror(const Floorplan& floorplan,
                            const vector<int>& room_occupancy_with_doors,
                            const Eigen::Vector3d& center,
                            PointCloud* point_cloud) {
+  const ScopedTrace trace("RemoveWindowAndMirror");
   const Vector2d center_grid = floorplan.LocalToGrid(Vector2d(center[0], center[1]));
   
-  vector<int> remove_indexes;
-
   const int width  = floorplan.GetGridSize()[0];
   const int height = floorplan.GetGridSize()[1];
 
-  for (int p = 0; p < point_cloud->GetNumPoints(); ++p) {
-    const Point& point = point_cloud->GetPoint(p);
-    const Vector2d grid = floorplan.LocalToGrid(Vector2d(point.position[0], point.position[1]));
-
-    // If [ center_grid -> grid ] crosses a room boundary or not.
-    const int sample = static_cast<int>(round((grid - center_grid).norm() / 2));
+  ExitDistanceTable table;
+  BuildExitDistanceTable(room_occupancy_with_doors, width, height, center_grid, &table);
+
+  // [ center_grid -> grid ] is sampled every ~2 grid units, and
+  // room_occupancy must be [ room ... | non-room ... | room ... ]. A
+  // point is removed if the first two blocks have at least 2 samples
+  // each. The block boundaries along the ray come from the table, so
+  // the samples in each block are counted without marching.
+  // Read through a const reference: the non-const GetPoint invalidates
+  // the object index, which must not happen from the threads.
+  const PointCloud& const_point_cloud = *point_cloud;
+  vector<char> removes(const_point_cloud.GetNumPoints(), 0);
+  ParallelFor(0, const_point_cloud.GetNumPoints(), [&](const int p) {
+    const Point& point = const_point_cloud.GetPoint(p);
+    const Vector2d diff =
+      floorplan.LocalToGrid(Vector2d(point.position[0], point.position[1])) - center_grid;
+    const double distance = diff.norm();
+    const int sample = static_cast<int>(round(distance / 2));
+    if (sample == 0)
+      return;
+    const double step = distance / sample;
+    const int angle = table.GetAngleIndex(diff);
 
-    // room_occupancy must be [ room ... | non-room ... | room ... ]
-    int block_counts[3] = {0, 0, 0};
-    int block = 0;
-    for (int s = 0; s < sample; ++s) {
-      const Vector2d current = (grid - center_grid) * s / sample + center_grid;
-      const int x = max(0, min(width - 1, static_cast<int>(round(current[0]))));
-      const int y = max(0, min(height - 1, static_cast<int>(round(current[1]))));
-
-      const int occupancy = room_occupancy_with_doors[y * width + x];
-      
-      if (block == 0) {
-        if (occupancy < 0) {
-          block = 1;
-        }
-      } else if (block == 1) {
-        if (occupancy >= 0) {
-          block = 2;
-        }
-      } else if (block == 2) {
-        if (occupancy < 0)
-          break;
-      }
-      
-      ++block_counts[block];
-    }
+    // Samples s * step with s in [0, sample) before the exit, and
+    // between the exit and the reentry.
+    const double exit = table.exits[angle];
+    const double reentry = min<double>(table.reentries[angle], distance);
+    const int num_inside = exit >= distance ? sample : static_cast<int>(ceil(exit / step));
+    const int num_outside = exit >= distance ? 0 : static_cast<int>(ceil(reentry / step)) - num_inside;
 
     // Remove condition.
-    if (block_counts[0] >= 2 && block_counts[1] >= 2) //  && block_counts[2] >= 2)
+    if (num_inside >= 2 && num_outside >= 2)
+      removes[p] = 1;
+  });
+
+  vector<int> remove_indexes;
+  for (int p = 0; p < point_cloud->GetNumPoints(); ++p) {
+    if (removes[p])
       remove_indexes.push_back(p);
   }
+  TraceCounter("removed_window_points", remove_indexes.size());
 
   /*
   {
@@ -1299,6 +1398,7 @@ void WriteObjectPointsWithColor(const std::vector<Point>& points,
                                 const std::vector<int>& segments,
                                 const std::string& filename,
                                 const Eigen::Matrix3d& rotation,
+                                std::mt19937* random,
                                 map<int, Vector3i>* color_table) {  
   if (points.size() != segments.size()) {
     cerr << "Size do not match: " << (int)points.size() << ' ' << (int)segments.size() << endl;
@@ -1318,9 +1418,9 @@ void WriteObjectPointsWithColor(const std::vector<Point>& points,
     }
     default: {
       if ((*color_table).find(segments[p]) == (*color_table).end()) {
-        (*color_table)[segments[p]][0] = rand() % 255;
-        (*color_table)[segments[p]][1] = rand() % 255;
-        (*color_table)[segments[p]][2] = rand() % 255;
+        (*color_table)[segments[p]][0] = (*random)() % 255;
+        (*color_table)[segments[p]][1] = (*random)() % 255;
+        (*color_table)[segments[p]][2] = (*random)() % 255;
       }
       
       point.color[0] = (*color_table)[segments[p]][0];
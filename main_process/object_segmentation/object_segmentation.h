@@ -1,6 +1,7 @@
 #ifndef OBJECT_SEGMENTATION_H_
 #define OBJECT_SEGMENTATION_H_
 
+#include <random>
 #include <vector>
 
 namespace structured_indoor_modeling {
@@ -50,7 +51,9 @@ void IdentifyDetails(const std::vector<Point>& points,
                      const double rescale_margin,
                      std::vector<int>* segments);                          
  
-void Subsample(const double ratio, std::vector<Point>* points);
+// random: for the random choices of a room, seeded per room (see
+// BuildKey::GetSeed) so that a room does not depend on the others.
+void Subsample(const double ratio, std::mt19937* random, std::vector<Point>* points);
  
 void FilterNoisyPoints(std::vector<Point>* points);
  
@@ -58,6 +61,7 @@ void SegmentObjects(const std::vector<Point>& points,
                     const double centroid_subsampling_ratio,
                     const int num_initial_clusters,
                     const std::vector<std::vector<int> >& neighbors,
+                    std::mt19937* random,
                     std::vector<int>* segments);
 
 void SmoothObjects(const std::vector<std::vector<int> >& neighbors,
@@ -80,6 +84,7 @@ void WriteObjectPointsWithColor(const std::vector<Point>& points,
                                 const std::vector<int>& segments,
                                 const std::string& filename,
                                 const Eigen::Matrix3d& rotation,
+                                std::mt19937* random,
                                 std::map<int, Eigen::Vector3i>* color_table);
 
 void WriteOtherPointsWithColor(const std::vector<Point>& points,
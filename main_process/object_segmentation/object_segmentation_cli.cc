@@ -3,19 +3,23 @@
 #include "gflags/gflags.h"
 #include <iostream>
 #include <map>
+#include <random>
 #include <vector>
 #include <time.h>
 
+#include "../../base/build_cache.h"
 #include "../../base/file_io.h"
 #include "../../base/floorplan.h"
 #include "../../base/indoor_polygon.h"
 #include "../../base/point_cloud.h"
+#include "../../base/tracing_flags.h"
 #include "object_segmentation.h"
 
 DEFINE_double(point_subsampling_ratio, 1.0, "Make the point set smaller.");
 DEFINE_double(centroid_subsampling_ratio, 0.005, "Ratio of centroids in each segment.");
 DEFINE_double(num_initial_clusters, 100, "Initial cluster.");
 DEFINE_double(rescale_margin, 1.0, "Rescale margins for identification.");
+DEFINE_bool(incremental, true, "Skip the rooms whose inputs did not change since the last run.");
 
 using namespace Eigen;
 using namespace structured_indoor_modeling;
@@ -54,17 +58,56 @@ void ReportSegments(const std::vector<int>& segments) {
 //       << " detail " << detail << endl;
 }
     
+void AddFlags(BuildKey* key) {
+  key->Add("point_subsampling_ratio", FLAGS_point_subsampling_ratio);
+  key->Add("centroid_subsampling_ratio", FLAGS_centroid_subsampling_ratio);
+  key->Add("num_initial_clusters", FLAGS_num_initial_clusters);
+  key->Add("rescale_margin", FLAGS_rescale_margin);
+}
+
+// Everything ProcessRoom reads: the points in the room (after window
+// and mirror removal, which depends on the other rooms), the room
+// geometry and the indoor polygon.
+BuildKey GetRoomKey(const Floorplan& floorplan,
+                    const int room,
+                    const std::vector<Point>& points,
+                    const uint64_t indoor_polygon_hash) {
+  BuildKey key;
+  AddFlags(&key);
+  key.AddHash(indoor_polygon_hash);
+  key.AddBytes(floorplan.GetFloorplanToGlobal().data(), 9 * sizeof(double));
+  for (int v = 0; v < floorplan.GetNumRoomVertices(room); ++v)
+    key.AddBytes(floorplan.GetRoomVertexLocal(room, v).data(), 2 * sizeof(double));
+  key.Add("floor_height", floorplan.GetFloorHeight(room));
+  key.Add("ceiling_height", floorplan.GetCeilingHeight(room));
+  for (const auto& point : points) {
+    key.AddBytes(point.position.data(), 3 * sizeof(double));
+    key.AddBytes(point.normal.data(), 3 * sizeof(double));
+    key.AddBytes(point.color.data(), 3 * sizeof(float));
+  }
+  return key;
+}
+
+vector<string> GetRoomOutputs(const FileIO& file_io, const int room) {
+  vector<string> outputs;
+  outputs.push_back(file_io.GetObjectPointClouds(room));
+  outputs.push_back(file_io.GetFloorWallPointClouds(room));
+  return outputs;
+}
+
 bool ProcessRoom(const FileIO& file_io,
                  const int room,
                  const Floorplan& floorplan,
                  const IndoorPolygon& indoor_polygon,
-                 const std::vector<PointCloud>& point_clouds,
-                 const std::vector<int>& room_occupancy) {
+                 const uint32_t seed,
+                 vector<Point>* points_in_room) {
 //  cout << "Room: " << room << endl;
-  vector<Point> points;
-  CollectPointsInRoom(point_clouds, floorplan, room_occupancy, room, &points);
+  vector<Point>& points = *points_in_room;
   if (points.empty())
     return false;
+  // Seeded from the key of the room, so that a room gives the same
+  // segments whether or not the rooms before it were redone.
+  mt19937 random(seed);
 //  cout << "Filtering... " << points.size() << " -> " << flush;
   FilterNoisyPoints(&points);
 //  cout << points.size() << " done." << endl;
@@ -74,7 +117,7 @@ bool ProcessRoom(const FileIO& file_io,
   
   if (FLAGS_point_subsampling_ratio != 1.0) {
 //    cout << "Subsampling... " << points.size() << " -> " << flush;
-    Subsample(FLAGS_point_subsampling_ratio, &points);
+    Subsample(FLAGS_point_subsampling_ratio, &random, &points);
 //    cout << points.size() << " done." << endl;
     if (points.empty())
       return false;
@@ -102,7 +145,7 @@ bool ProcessRoom(const FileIO& file_io,
 
 //  cout << "SegmentObjects..." << flush;
   SegmentObjects(points, FLAGS_centroid_subsampling_ratio, FLAGS_num_initial_clusters, neighbors,
-                 &segments);
+                 &random, &segments);
 //  cout << "done." << endl;
   
   ReportSegments(segments);
@@ -125,6 +168,7 @@ bool ProcessRoom(const FileIO& file_io,
 //    printf("%s\n", file_io.GetObjectPointClouds(room).c_str());
     WriteObjectPointsWithColor(points, segments, file_io.GetObjectPointClouds(room),
                                floorplan.GetFloorplanToGlobal(),
+                               &random,
                                &color_table);
 //    cout << "done." << endl;
   }
@@ -170,10 +214,12 @@ int main(int argc, char* argv[]) {
 #else
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 #endif
+  InitTracingFromFlags();
 
   clock_t totaltime = 0, start_t, end_t;
   FileIO file_io(argv[1]);
-  
+  const int num_panoramas = GetNumPanoramas(file_io);
+
   Floorplan floorplan;
   {
     ifstream ifstr;
@@ -181,6 +227,27 @@ int main(int argc, char* argv[]) {
     ifstr >> floorplan;
     ifstr.close();
   }
+
+  // Nothing to load if no input file changed and all the outputs
+  // exist. Otherwise, only the rooms whose points changed are redone.
+  BuildCache build_cache(file_io, "object_segmentation", FLAGS_incremental);
+  const uint64_t indoor_polygon_hash = build_cache.HashFile(file_io.GetIndoorPolygon());
+  BuildKey inputs_key;
+  AddFlags(&inputs_key);
+  inputs_key.AddHash(build_cache.HashFile(file_io.GetFloorplan()));
+  inputs_key.AddHash(indoor_polygon_hash);
+  inputs_key.AddHash(build_cache.HashPointCloudFiles(num_panoramas));
+  const string kAllRooms = "all_rooms";
+  vector<string> all_outputs;
+  for (int room = 0; room < floorplan.GetNumRooms(); ++room) {
+    const vector<string> outputs = GetRoomOutputs(file_io, room);
+    all_outputs.insert(all_outputs.end(), outputs.begin(), outputs.end());
+  }
+  if (build_cache.IsUpToDate(kAllRooms, inputs_key, all_outputs)) {
+    cout << "Object segmentation is up to date." << endl;
+    return 0;
+  }
+
   IndoorPolygon indoor_polygon;
   {
     ifstream ifstr;
@@ -195,7 +262,6 @@ int main(int argc, char* argv[]) {
   vector<int> room_occupancy_with_doors = room_occupancy;
   SetDoorOccupancy(floorplan, &room_occupancy_with_doors);
   
-  const int num_panoramas = GetNumPanoramas(file_io);
   vector<PointCloud> point_clouds(num_panoramas);
 
   start_t = clock();
@@ -224,8 +290,17 @@ int main(int argc, char* argv[]) {
 
   // Per room processing.
   for (int room = 0; room < floorplan.GetNumRooms(); ++room) {
-    ProcessRoom(file_io, room, floorplan, indoor_polygon, point_clouds, room_occupancy);
+    vector<Point> points;
+    CollectPointsInRoom(point_clouds, floorplan, room_occupancy, room, &points);
+    const string unit = BuildCache::GetUnitName("room", room);
+    const BuildKey key = GetRoomKey(floorplan, room, points, indoor_polygon_hash);
+    const vector<string> outputs = GetRoomOutputs(file_io, room);
+    if (build_cache.IsUpToDate(unit, key, outputs))
+      continue;
+    if (ProcessRoom(file_io, room, floorplan, indoor_polygon, key.GetSeed(), &points))
+      build_cache.Record(unit, key, outputs);
   }
+  build_cache.Record(kAllRooms, inputs_key, all_outputs);
   end_t = clock();
   totaltime += end_t - start_t;
   printf("Running time for object segmentation: %f\n", (float)(end_t - start_t) / CLOCKS_PER_SEC);
@@ -0,0 +1,201 @@
+/*
+  Runs the stages of run.sh in one process. The in-process stages
+  (textures and thumbnails) read one shared DatasetCache, so the
+  floorplan, the indoor polygon, the panorama pyramids and the point
+  clouds are loaded once instead of once per executable. The other
+  stages are not linked in and run as child processes.
+
+  Stages run as soon as the stages they depend on succeeded, up to
+  --num_concurrent_stages at a time. A dependency that is not in
+  --stages is assumed to be done already. Wall time and peak RSS of
+  every stage are reported at the end.
+
+  < Example >
+  ./run_pipeline_cli data_directory
+  ./run_pipeline_cli data_directory --stages=object_segmentation,object_refinement,object_icons
+*/
+
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gflags/gflags.h>
+
+#ifdef _WIN32
+#pragma comment (lib, "gflags.lib")
+#pragma comment (lib, "Shlwapi.lib")
+#endif
+
+#include "../../base/dataset_cache.h"
+#include "../../base/pipeline.h"
+#include "../../base/tracing_flags.h"
+#include "../texture/generate_texture_floorplan.h"
+#include "../texture/generate_texture_indoor_polygon.h"
+#include "../texture/generate_thumbnail.h"
+
+DEFINE_string(stages, "floorplan_texture,indoor_polygon_texture,thumbnail",
+              "Comma separated stages to run: floorplan_texture, indoor_polygon_texture, "
+              "thumbnail, object_segmentation, object_refinement, object_icons, "
+              "indoor_polygon_to_dae, evaluate, prepare_poisson.");
+DEFINE_string(binary_directory, ".", "Top directory of the built executables, for the child process stages.");
+DEFINE_int32(num_concurrent_stages, 0, "Stages running at the same time (0: all cores).");
+DEFINE_int32(num_pyramid_levels, 3, "Num pyramid levels of the shared panoramas.");
+DEFINE_int32(num_threads, 0, "Workers encoding the texture images of each stage (0: all cores).");
+DEFINE_bool(incremental, true, "Reuse the outputs whose inputs did not change since the last run.");
+DECLARE_string(trace_file);
+
+using namespace std;
+using namespace structured_indoor_modeling;
+
+namespace {
+
+struct StageSpec {
+  string name;
+  vector<string> dependencies;
+  // Executable under --binary_directory and extra arguments, if the
+  // stage runs as a child process.
+  string executable;
+  string arguments;
+  // The executable takes --incremental.
+  bool incremental;
+  // The executable takes --trace_file.
+  bool traced;
+};
+
+// The DAG of run.sh.
+const vector<StageSpec>& GetStageSpecs() {
+  static const vector<StageSpec> specs = {
+    { "floorplan_texture",      {}, "", "", false, false },
+    { "indoor_polygon_texture", {}, "", "", false, false },
+    { "thumbnail",              {}, "", "", false, false },
+    { "object_segmentation",    {}, "main_process/object_segmentation/object_segmentation_cli", "", true, true },
+    { "object_refinement",      { "object_segmentation" }, "main_process/object_refinement/Object_refinement", "", true, true },
+    { "object_icons",           { "object_refinement" }, "main_process/object_detection/generate_object_icons_cli", "", false, true },
+    { "indoor_polygon_to_dae",  {}, "post_process/collada/indoor_polygon_to_dae_cli", "", false, false },
+    { "evaluate",               { "object_refinement" }, "post_process/evaluation/evaluate_cli", "--evaluate_all=true", false, true },
+    { "prepare_poisson",        {}, "post_process/evaluation/prepare_poisson_cli", "", false, false },
+  };
+  return specs;
+}
+
+set<string> SplitNames(const string& names) {
+  set<string> result;
+  stringstream sstr(names);
+  string name;
+  while (getline(sstr, name, ',')) {
+    if (!name.empty())
+      result.insert(name);
+  }
+  return result;
+}
+
+// The stage functions outlive this call: they capture the cache by
+// pointer.
+void AddInProcessStage(const string& name,
+                       const vector<string>& dependencies,
+                       const DatasetCache* dataset,
+                       Pipeline* pipeline) {
+  if (name == "floorplan_texture") {
+    pipeline->AddStage(name, dependencies, [dataset]() {
+        FloorplanTextureOptions options;
+        options.num_threads = FLAGS_num_threads;
+        options.incremental = FLAGS_incremental;
+        return GenerateFloorplanTexture(dataset->GetFileIO(),
+                                        dataset->GetFloorplan(),
+                                        dataset->GetPanoramaPyramids(FLAGS_num_pyramid_levels),
+                                        dataset->GetPointClouds(),
+                                        options);
+      });
+  } else if (name == "indoor_polygon_texture") {
+    pipeline->AddStage(name, dependencies, [dataset]() {
+        IndoorPolygonTextureOptions options;
+        options.num_threads = FLAGS_num_threads;
+        options.incremental = FLAGS_incremental;
+        return GenerateIndoorPolygonTexture(dataset->GetFileIO(),
+                                            dataset->GetIndoorPolygon(),
+                                            dataset->GetPanoramaPyramids(FLAGS_num_pyramid_levels),
+                                            dataset->GetPointClouds(),
+                                            options);
+      });
+  } else if (name == "thumbnail") {
+    pipeline->AddStage(name, dependencies, [dataset]() {
+        // Thumbnails sample shrunk panoramas: start from the smallest
+        // cached level that is still large enough.
+        const ThumbnailOptions options;
+        const vector<vector<Panorama> >& pyramids =
+          dataset->GetPanoramaPyramids(FLAGS_num_pyramid_levels);
+        vector<Panorama> panoramas;
+        for (const auto& pyramid : pyramids) {
+          int level = 0;
+          while (level + 1 < (int)pyramid.size() &&
+                 pyramid[level + 1].Width() >= options.panorama_width)
+            ++level;
+          panoramas.push_back(pyramid[level]);
+          panoramas.back().Resize(Eigen::Vector2i(options.panorama_width, options.panorama_width / 2));
+        }
+        GenerateThumbnails(dataset->GetFileIO().GetDataDirectory(), dataset->GetFloorplan(),
+                           panoramas, options);
+        return true;
+      });
+  } else {
+    cerr << "Unknown in-process stage: " << name << endl;
+    exit (1);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0] << " data_directory" << endl;
+    return 1;
+  }
+#ifdef __APPLE__
+  google::ParseCommandLineFlags(&argc, &argv, true);
+#else
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+#endif
+  InitTracingFromFlags();
+
+  const DatasetCache dataset(argv[1]);
+  const set<string> selected = SplitNames(FLAGS_stages);
+
+  Pipeline pipeline;
+  set<string> known;
+  for (const auto& spec : GetStageSpecs()) {
+    known.insert(spec.name);
+    if (selected.find(spec.name) == selected.end())
+      continue;
+    vector<string> dependencies;
+    for (const auto& dependency : spec.dependencies) {
+      if (selected.find(dependency) != selected.end())
+        dependencies.push_back(dependency);
+    }
+
+    if (spec.executable.empty()) {
+      AddInProcessStage(spec.name, dependencies, &dataset, &pipeline);
+    } else {
+      string command = FLAGS_binary_directory + "/" + spec.executable + " '" + argv[1] + "'";
+      if (!spec.arguments.empty())
+        command += " " + spec.arguments;
+      if (spec.incremental)
+        command += FLAGS_incremental ? " --incremental=true" : " --incremental=false";
+      // One trace per process, next to the one of the in-process stages.
+      if (spec.traced && !FLAGS_trace_file.empty())
+        command += " '--trace_file=" + FLAGS_trace_file + "." + spec.name + ".json'";
+      pipeline.AddCommandStage(spec.name, dependencies, command);
+    }
+  }
+  for (const auto& name : selected) {
+    if (known.find(name) == known.end()) {
+      cerr << "Unknown stage: " << name << endl;
+      return 1;
+    }
+  }
+
+  vector<StageReport> reports;
+  const bool success = pipeline.Run(FLAGS_num_concurrent_stages, &reports);
+  PrintStageReports(reports, cout);
+  return success ? 0 : 1;
+}
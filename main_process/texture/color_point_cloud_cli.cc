@@ -1,6 +1,8 @@
 #include <Eigen/Dense>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include <string>
 #include <vector>
@@ -13,8 +15,13 @@
 
 #include "../../base/kdtree/KDtree.h"
 #include "../../base/file_io.h"
+#include "../../base/floorplan.h"
 #include "../../base/panorama.h"
+#include "../../base/parallel.h"
 #include "../../base/point_cloud.h"
+#include "../../base/tracing.h"
+#include "../../base/tracing_flags.h"
+#include "../../base/visibility.h"
 #include "generate_texture_floorplan.h"
 
 using namespace Eigen;
@@ -24,6 +31,10 @@ using namespace structured_indoor_modeling;
 DEFINE_int32(num_pyramid_levels, 4, "Num pyramid levels.");
 DEFINE_int32(max_num_rooms, 200, "Maximum number of rooms.");
 DEFINE_int32(pyramid_level, 1, "Which level of pyramid to collect colors.");
+DEFINE_int32(num_threads, 0, "Points colored in parallel (0: all cores).");
+DEFINE_bool(visibility_check, true, "Prefer the panoramas that see a point over the closer ones behind which it is hidden.");
+DEFINE_double(visibility_margin_ratio, 0.05, "Depth margin of the visibility check, relative to the average distance of a panorama.");
+DEFINE_int32(max_door_hops, -1, "If >= 0, the visibility check also drops the panoramas more than this many doors away from the room of a point.");
 // DEFINE_string(input_ply, "object_cloud_org.ply", "Input ply.");
 // DEFINE_string(output_ply, "object_cloud2.ply", "Output ply.");
 
@@ -32,61 +43,96 @@ typedef std::vector<ColoredPoint> ColoredPointCloud;
 
 namespace {
 
-void FindVisiblePanoramas(const std::vector<std::vector<Panorama> >& panoramas,
-                          const Point& point,
-                          const int pyramid_level,
-                          std::set<int>* visible_panoramas) {
-  //  visible_panoramas->insert(4);
-  // return;
-
-  // Use visible panoramas to average colors. (blurred and not good).
-  /*  
-  for (int p = 0; p < (int)panoramas.size(); ++p) {
-    const Panorama& panorama = panoramas[p][pyramid_level];
-    
-    const Vector2d pixel = panorama.Project(point.position);
-    const Vector3f rgb = panorama.GetRGB(pixel);
-    if (rgb == Vector3f(0, 0, 0))
-      continue;
-
-    Vector3d point_to_camera = (panorama.GetCenter() - point.position).normalized();
-    if (point_to_camera.dot(point.normal) <= 0.0)
-      continue;
-    
-    const Vector2d depth_pixel = panorama.ProjectToDepth(point.position);
-    const double depth = panorama.GetDepth(depth_pixel);
-    const double dtmp = (point.position - panorama.GetCenter()).norm();
-    const double margin = panorama.GetAverageDistance() / 100.0; // 20.0;
-    if (dtmp < depth + margin) {
-      visible_panoramas->insert(p);
+// Returns the closest panorama with a non-black color at the point
+// (kInvalid if none), and the color. Panoramas are tried in the order
+// of the distance, so the search stops at the first one with a color
+// instead of projecting to every panorama. Ties keep the smallest
+// index. If visible is given (one entry per panorama), the visible
+// panoramas are tried first. distances is a workspace.
+const int kInvalid = -1;
+int FindClosestPanorama(const std::vector<std::vector<Panorama> >& panoramas,
+                        const std::vector<Vector3d>& centers,
+                        const Point& point,
+                        const int pyramid_level,
+                        const char* visible,
+                        std::vector<std::pair<double, int> >* distances,
+                        Vector3f* rgb) {
+  distances->resize(centers.size());
+  for (int p = 0; p < (int)centers.size(); ++p)
+    (*distances)[p] = make_pair((point.position - centers[p]).norm(), p);
+  sort(distances->begin(), distances->end());
+
+  if (visible != NULL) {
+    for (const auto& distance : *distances) {
+      if (!visible[distance.second])
+        continue;
+      const Panorama& panorama = panoramas[distance.second][pyramid_level];
+      *rgb = panorama.GetRGB(panorama.Project(point.position));
+      if (*rgb != Vector3f(0, 0, 0))
+        return distance.second;
     }
   }
-  */
-
-  
-  // Use only a single pano. Sharp but needs to be careful about
-  // stitching artifacts. Also, point density needs to be controlled.
-  visible_panoramas->clear();
-  
-  if (visible_panoramas->empty()) {
-    const int kInvalid = -1;
-    double closest_distance = 0.0;
-    int closest_panorama = kInvalid;
-    for (int p = 0; p < (int)panoramas.size(); ++p) {
-      const Panorama& panorama = panoramas[p][pyramid_level];
-      const Vector2d pixel = panorama.Project(point.position);
-      const Vector3f rgb = panorama.GetRGB(pixel);
-      if (rgb == Vector3f(0, 0, 0))
-        continue;
-      
-      const double distance = (point.position - panoramas[p][pyramid_level].GetCenter()).norm();
-      if (distance < closest_distance || closest_panorama == kInvalid) {
-        closest_distance = distance;
-        closest_panorama = p;
-      }
+  for (const auto& distance : *distances) {
+    const Panorama& panorama = panoramas[distance.second][pyramid_level];
+    *rgb = panorama.GetRGB(panorama.Project(point.position));
+    if (*rgb != Vector3f(0, 0, 0))
+      return distance.second;
+  }
+  return kInvalid;
+}
+
+// Uses only a single panorama per point. Sharp but needs to be careful
+// about stitching artifacts. Also, point density needs to be
+// controlled. (Averaging the visible panoramas was blurred and not
+// good.)
+//
+// With a visibility index, the panoramas of a point are taken from
+// the visible ones first (a point without one keeps the closest
+// panorama with a color).
+void ColorPoints(const std::vector<std::vector<Panorama> >& panoramas,
+                 const int pyramid_level,
+                 const VisibilityIndex* visibility,
+                 const double visibility_margin_ratio,
+                 const int num_threads,
+                 PointCloud* point_cloud) {
+  const ScopedTrace trace("ColorPoints");
+  const int num_panoramas = panoramas.size();
+  vector<Vector3d> centers(num_panoramas);
+  for (int p = 0; p < num_panoramas; ++p)
+    centers[p] = panoramas[p][pyramid_level].GetCenter();
+
+  // Taken once: the non-const GetPoint invalidates the object index,
+  // which must not happen from the threads.
+  vector<Point>& points = point_cloud->GetPointData();
+  const int num_points = points.size();
+  vector<vector<pair<double, int> > > distances(GetNumThreads(num_threads));
+  // The visibility table is computed for a chunk of points at a time.
+  const int kChunkSize = 65536;
+  vector<Vector3d> positions;
+  vector<char> visible;
+  for (int begin = 0; begin < num_points; begin += kChunkSize) {
+    const int end = min(num_points, begin + kChunkSize);
+    if (visibility != NULL) {
+      positions.resize(end - begin);
+      for (int p = begin; p < end; ++p)
+        positions[p - begin] = points[p].position;
+      visibility->ComputeVisibility(positions, visibility_margin_ratio, &visible);
     }
-    visible_panoramas->insert(closest_panorama);
+    ParallelForWithThreadId(begin, end, [&](const int p, const int thread) {
+      Point& point = points[p];
+      point.color = Vector3f(0, 0, 0);
+      const char* point_visible =
+        visible.empty() ? NULL : &visible[static_cast<size_t>(p - begin) * num_panoramas];
+      Vector3f rgb;
+      if (FindClosestPanorama(panoramas, centers, point, pyramid_level, point_visible,
+                              &distances[thread], &rgb) == kInvalid)
+        return;
+      // BGR to RGB.
+      for (int i = 0; i < 3; ++i)
+        point.color[i] = rgb[2 - i];
+    }, num_threads);
   }
+  TraceCounter("colored_points", point_cloud->GetNumPoints());
 }
 
 void ReadPointClouds(const FileIO& file_io,
@@ -111,6 +157,7 @@ int main(int argc, char* argv[]) {
 #else
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 #endif
+  InitTracingFromFlags();
   FileIO file_io(argv[1]);
 
   vector<vector<Panorama> > panoramas;
@@ -129,31 +176,19 @@ int main(int argc, char* argv[]) {
   PointCloud point_cloud;
   ReadPointClouds(file_io, &point_cloud);
 
-  for (int p = 0; p < point_cloud.GetNumPoints(); ++p) {
-    if (p % (point_cloud.GetNumPoints() / 100) == 0)
-      cerr << '.' << flush;
-    Point& point = point_cloud.GetPoint(p);
-    point.color = Vector3f(0, 0, 0);
-    int denom = 0;
-      
-    set<int> visible_panoramas;
-    FindVisiblePanoramas(panoramas, point, FLAGS_pyramid_level, &visible_panoramas);
-    if (visible_panoramas.empty()) {
-      continue;
-    }
-    for (const auto panorama_id : visible_panoramas) {
-      const Vector3f color =
-        panoramas[panorama_id][FLAGS_pyramid_level].GetRGB(panoramas[panorama_id][FLAGS_pyramid_level].Project(point.position));
-      if (color != Vector3f(0, 0, 0)) {
-        for (int i = 0; i < 3; ++i)
-          point.color[i] += color[2 - i];
-        ++denom;
-      }
-    }
-    if (denom != 0) {
-      point.color /= denom;
+  const int kFirstLevel = 0;
+  unique_ptr<VisibilityIndex> visibility;
+  unique_ptr<Floorplan> floorplan;
+  if (FLAGS_visibility_check) {
+    visibility.reset(new VisibilityIndex(panoramas, kFirstLevel, FLAGS_num_threads));
+    if (FLAGS_max_door_hops >= 0) {
+      floorplan.reset(new Floorplan(file_io.GetFloorplan()));
+      visibility->SetFloorplan(*floorplan, FLAGS_max_door_hops);
     }
   }
+
+  ColorPoints(panoramas, FLAGS_pyramid_level, visibility.get(), FLAGS_visibility_margin_ratio,
+              FLAGS_num_threads, &point_cloud);
   cerr << "done." << endl;
   point_cloud.Write(file_io.GetObjectPointCloudsWithColor());
 }
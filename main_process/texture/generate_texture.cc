@@ -49,5 +49,39 @@ void Invert(const vector<Matrix4d>& panorama_to_globals,
   }
 }
 
+bool ReadPatchTexture(const string& filename,
+                      Vector2i* texture_size,
+                      vector<unsigned char>* texture) {
+  ifstream ifstr;
+  ifstr.open(filename.c_str(), ios::binary);
+  if (!ifstr.is_open())
+    return false;
+  int size[2];
+  ifstr.read(reinterpret_cast<char*>(size), sizeof(size));
+  if (!ifstr || size[0] < 0 || size[1] < 0)
+    return false;
+  *texture_size = Vector2i(size[0], size[1]);
+  texture->resize(3 * size[0] * size[1]);
+  if (!texture->empty())
+    ifstr.read(reinterpret_cast<char*>(&texture->at(0)), texture->size());
+  return static_cast<bool>(ifstr);
+}
+
+void WritePatchTexture(const string& filename,
+                       const Vector2i& texture_size,
+                       const vector<unsigned char>& texture) {
+  ofstream ofstr;
+  ofstr.open(filename.c_str(), ios::binary);
+  if (!ofstr.is_open()) {
+    cerr << "Cannot open a file: " << filename << endl;
+    return;
+  }
+  const int size[2] = { texture_size[0], texture_size[1] };
+  ofstr.write(reinterpret_cast<const char*>(size), sizeof(size));
+  if (!texture.empty())
+    ofstr.write(reinterpret_cast<const char*>(&texture[0]), texture.size());
+  ofstr.close();
+}
+
 }  // namespace structured_indoor_modeling
   
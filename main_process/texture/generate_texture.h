@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Eigen/Dense>
+#include <string>
 #include <vector>
 #include "../../base/point_cloud.h"
 
@@ -14,6 +15,16 @@ void ReadPanoramaToGlobals(const FileIO& file_io,
 
 void Invert(const std::vector<Eigen::Matrix4d>& panorama_to_globals,
             std::vector<Eigen::Matrix4d>* global_to_panoramas);
+
+// Raw patch texture (row major RGB), kept across runs in the build
+// cache. Read returns false if the file is missing or truncated.
+bool ReadPatchTexture(const std::string& filename,
+                      Eigen::Vector2i* texture_size,
+                      std::vector<unsigned char>* texture);
+
+void WritePatchTexture(const std::string& filename,
+                       const Eigen::Vector2i& texture_size,
+                       const std::vector<unsigned char>& texture);
  
 }  // namespace structured_indoor_modeling
  
@@ -1,9 +1,13 @@
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 
 #include "generate_texture_floorplan.h"
 #include "synthesize.h"
+#include "texture_atlas.h"
 #include "../../base/imageProcess/morphological_operation.h"
+#include "../../base/build_cache.h"
 #include "../../base/point_cloud.h"
 #include "../../base/floorplan.h"
 #include "../../base/file_io.h"
@@ -32,26 +36,8 @@ int ChoosePyramidLevel(const std::vector<Panorama>& panorama,
 
 void ConvertPatchToMat(const Patch& patch, cv::Mat* mat);
 
-void PackWallTexture(const Patch& patch,
-                     const int texture_image_size,
-                     WallTriangulation* wall_triangulation,
-                     std::vector<std::vector<unsigned char> >* texture_images,
-                     std::pair<int, Eigen::Vector2i>* iuv,
-                     int* max_texture_height);
-  
-void UpdateIUV(const Eigen::Vector2i& size,
-               const int texture_image_size,
-               std::pair<int, Eigen::Vector2i>* iuv,
-               int* max_texture_height);
-
-void CopyTexel(const Patch& patch,
-               const int texture_image_size,
-               const std::pair<int, Eigen::Vector2i>& iuv,
-               std::vector<std::vector<unsigned char> >* texture_images);
-  
-void SetIUVInWall(const Vector2i& texture_size,
-                  const int texture_image_size,
-                  const std::pair<int, Eigen::Vector2i>& iuv,
+void SetIUVInWall(const int texture_image_size,
+                  const AtlasPlacement& placement,
                   WallTriangulation* wall_triangulation);
 
 void MarkWalls(const Floorplan& floorplan,
@@ -71,7 +57,7 @@ void SetManhattanDelaunay(const Floorplan& floorplan,
 
 void SetIUVInFloor(const Patch& floor_patch,
                    const int texture_image_size,
-                   const std::pair<int, Eigen::Vector2i>& iuv,
+                   const AtlasPlacement& placement,
                    Floorplan* floorplan);
 
 void SetBoundingBox(const Floorplan& floorplan,
@@ -124,12 +110,27 @@ void GenerateFloorTexture(const int room,
 			  const std::vector<double>& weights,
                           const cv::Mat& room_segments,
                           const Patch& floor_patch,
+                          const unsigned int seed,
                           cv::Mat* floor_texture);
 
-void SynthesizePatch(Patch* patch);
+void SynthesizePatch(const unsigned int seed, Patch* patch);
 
 void ShrinkTexture(const int shrink_pixels, Patch* patch);
 
+BuildKey GetFloorPatchKey(const TextureInput& texture_input);
+
+BuildKey GetWallPatchKey(const TextureInput& texture_input, const Patch& patch);
+
+bool ReadCachedTexture(const TextureInput& texture_input,
+                       const std::string& unit,
+                       const BuildKey& key,
+                       Patch* patch);
+
+void CacheTexture(const TextureInput& texture_input,
+                  const std::string& unit,
+                  const BuildKey& key,
+                  const Patch& patch);
+
 }  // namespace
 
 bool IsOnFloor(const Floorplan& floorplan,
@@ -175,6 +176,13 @@ void SetFloorPatch(const TextureInput& texture_input, Patch* floor_patch) {
     ComputeTextureSize(floor_patch->min_xy_local, floor_patch->max_xy_local,
                        texture_input.max_texture_size_per_floor_patch);
 
+  const string kUnit = "floor";
+  const BuildKey key = GetFloorPatchKey(texture_input);
+  if (ReadCachedTexture(texture_input, kUnit, key, floor_patch)) {
+    cout << "Floor texture is up to date." << endl;
+    return;
+  }
+
   // Compute a room segmentation.
   cv::Mat room_segments;
   const unsigned char kBackground = 255;
@@ -212,7 +220,7 @@ void SetFloorPatch(const TextureInput& texture_input, Patch* floor_patch) {
   for (int room = 0; room < floorplan.GetNumRooms(); ++room) {
     cout << room << '.' << flush;
     GenerateFloorTexture(room, texture_input, projected_textures, weights, room_segments,
-                         *floor_patch, &floor_texture);
+                         *floor_patch, key.GetSeed() + room, &floor_texture);
   }
   cout << "done." << endl;
 
@@ -224,6 +232,7 @@ void SetFloorPatch(const TextureInput& texture_input, Patch* floor_patch) {
         floor_patch->texture.push_back(color[c]);
     }
   }
+  CacheTexture(texture_input, kUnit, key, *floor_patch);
 }  
 
 void SetWallPatches(const TextureInput& texture_input,
@@ -243,6 +252,11 @@ void SetWallPatches(const TextureInput& texture_input,
       patch.vertices[2] = floorplan.GetFloorVertexGlobal(room, next_wall);
       patch.vertices[3] = floorplan.GetFloorVertexGlobal(room, wall);
 
+      const string unit = BuildCache::GetUnitName("wall", room) + BuildCache::GetUnitName("", wall);
+      const BuildKey key = GetWallPatchKey(texture_input, patch);
+      if (ReadCachedTexture(texture_input, unit, key, &patch))
+        continue;
+
       // Identify visible panoramas.
       vector<pair<double, int> > visible_panoramas_weights;
       FindVisiblePanoramas(texture_input.panoramas, patch, &visible_panoramas_weights);
@@ -268,7 +282,8 @@ void SetWallPatches(const TextureInput& texture_input,
         }
       }
       if (hole)
-        SynthesizePatch(&patch);
+        SynthesizePatch(key.GetSeed(), &patch);
+      CacheTexture(texture_input, unit, key, patch);
       /*
       cv::Mat patch_mat;
       ConvertPatchToMat(patch, &patch_mat);
@@ -279,53 +294,130 @@ void SetWallPatches(const TextureInput& texture_input,
   }
 }
 
-void PackFloorTexture(const Patch& floor_patch,
-                      const int texture_image_size,
-                      Floorplan* floorplan,
-                      std::vector<std::vector<unsigned char> >* texture_images,
-                      std::pair<int, Eigen::Vector2i>* iuv,
-                      int* max_texture_height) {
-  UpdateIUV(floor_patch.texture_size, texture_image_size, iuv, max_texture_height);
-  // Copy texel data.
-  CopyTexel(floor_patch, texture_image_size, *iuv, texture_images);
-  // Update IUV in floorplan.
-  SetIUVInFloor(floor_patch, texture_image_size, *iuv, floorplan);
-  // Update iuv.
-  iuv->second[0] += floor_patch.texture_size[0];
-}
-  
-void PackWallTextures(const std::vector<std::vector<Patch> >& patches,
-                      const int texture_image_size,
-                      Floorplan* floorplan,
-                      std::vector<std::vector<unsigned char> >* texture_images,
-                      std::pair<int, Eigen::Vector2i>* iuv,
-                      int* max_texture_height) {
-  for (int room = 0; room < patches.size(); ++room) {
-    for (int wall = 0; wall < patches[room].size(); ++wall) {
-      const Patch& patch = patches[room][wall];
-      WallTriangulation& wall_triangulation = floorplan->GetWallTriangulation(room, wall);
-      PackWallTexture(patch, texture_image_size,
-                      &wall_triangulation, texture_images, iuv, max_texture_height);
+void PackTextures(const Patch& floor_patch,
+                  const std::vector<std::vector<Patch> >& wall_patches,
+                  const AtlasOptions& atlas_options,
+                  const bool rotate_walls,
+                  Floorplan* floorplan,
+                  std::vector<std::vector<unsigned char> >* texture_images) {
+  TextureAtlas atlas(atlas_options);
+  const int floor_id = atlas.AddPatch(floor_patch.texture_size, false);
+  vector<vector<int> > wall_ids(wall_patches.size());
+  for (int room = 0; room < wall_patches.size(); ++room) {
+    for (int wall = 0; wall < wall_patches[room].size(); ++wall)
+      wall_ids[room].push_back(atlas.AddPatch(wall_patches[room][wall].texture_size, rotate_walls));
+  }
+  atlas.Pack();
+
+  texture_images->clear();
+  atlas.CopyTexels(floor_id, floor_patch.texture, texture_images);
+  SetIUVInFloor(floor_patch, atlas.GetPageSize(), atlas.GetPlacement(floor_id), floorplan);
+  for (int room = 0; room < wall_patches.size(); ++room) {
+    for (int wall = 0; wall < wall_patches[room].size(); ++wall) {
+      const int id = wall_ids[room][wall];
+      atlas.CopyTexels(id, wall_patches[room][wall].texture, texture_images);
+      SetIUVInWall(atlas.GetPageSize(), atlas.GetPlacement(id),
+                   &floorplan->GetWallTriangulation(room, wall));
     }
   }
+
+  cout << atlas.GetNumPages() << " texture images, fill:";
+  for (int page = 0; page < atlas.GetNumPages(); ++page)
+    cout << ' ' << atlas.GetFillEfficiency(page);
+  cout << endl;
 }
 
 void WriteTextureImages(const FileIO& file_io,
                         const int texture_image_size,
-                        const std::vector<std::vector<unsigned char> >& texture_images) {
+                        const std::vector<std::vector<unsigned char> >& texture_images,
+                        const bool compressed,
+                        TextureImageWriter* writer) {
   for (int t = 0; t < texture_images.size(); ++t) {
-    cv::Mat image(texture_image_size, texture_image_size, CV_8UC3);
-    int index = 0;
-    for (int y = 0; y < texture_image_size; ++y) {
-      for (int x = 0; x < texture_image_size; ++x) {
-        for (int i = 0; i < 3; ++i) {
-          image.at<cv::Vec3b>(y, x)[i] = texture_images[t][index++];
-        }
-      }
+    writer->Write(file_io.GetTextureImage(t), texture_images[t], texture_image_size, texture_image_size);
+    if (compressed) {
+      writer->Write(file_io.GetTextureImageDDS(t), texture_images[t],
+                    texture_image_size, texture_image_size);
+    } else {
+      // The viewer prefers a full DDS set, which would be stale now.
+      remove(file_io.GetTextureImageDDS(t).c_str());
     }
+  }
+}
+
+FloorplanTextureOptions::FloorplanTextureOptions()
+  : pyramid_level_for_floor(1),
+    max_texture_size_per_floor_patch(1500),
+    max_texture_size_per_wall_patch(1024),
+    texture_height_per_wall(512),
+    position_error_for_floor(0.08),
+    patch_size_for_synthesis(45),
+    num_cg_iterations(40),
+    texture_image_size(2048),
+    texture_padding(2),
+    rotate_wall_textures(true),
+    compressed_texture(false),
+    png_compression(3),
+    num_threads(0),
+    incremental(true) {
+}
 
-    imwrite(file_io.GetTextureImage(t), image);
+bool GenerateFloorplanTexture(const FileIO& file_io,
+                              const Floorplan& floorplan,
+                              const std::vector<std::vector<Panorama> >& panoramas,
+                              const std::vector<PointCloud>& point_clouds,
+                              const FloorplanTextureOptions& options) {
+  TextureInput texture_input(panoramas, point_clouds);
+  texture_input.floorplan = floorplan;
+  texture_input.pyramid_level_for_floor = options.pyramid_level_for_floor;
+  texture_input.max_texture_size_per_floor_patch = options.max_texture_size_per_floor_patch;
+  texture_input.max_texture_size_per_wall_patch = options.max_texture_size_per_wall_patch;
+  texture_input.texture_height_per_wall  = options.texture_height_per_wall;
+  texture_input.position_error_for_floor = options.position_error_for_floor;
+  texture_input.patch_size_for_synthesis = options.patch_size_for_synthesis;
+  texture_input.num_cg_iterations        = options.num_cg_iterations;
+
+  BuildCache build_cache(file_io, "floorplan_texture", options.incremental);
+  texture_input.build_cache = &build_cache;
+  texture_input.inputs_hash =
+    BuildKey().AddHash(build_cache.HashPanoramaFiles(panoramas.size()))
+    .AddHash(build_cache.HashPointCloudFiles(point_clouds.size())).GetHash();
+
+  // For each wall rectangle, floor, and ceiling,
+  // 0. Identify visible panoramas.
+  // 1. Grab texture
+  // 2. Stitch
+  // Floor texture.
+  cerr << "Set floor patch." << endl;
+  Patch floor_patch;
+  SetFloorPatch(texture_input, &floor_patch);
+  cerr << "done." << endl << "Set wall patches." << endl;
+  // Wall textures.
+  vector<vector<Patch> > wall_patches;
+  SetWallPatches(texture_input, &wall_patches);
+  cerr << "done." << endl << "Pack textures." << endl;
+  // Texture image.
+  vector<vector<unsigned char> > texture_images;
+
+  // Set texture coordinates.
+  AtlasOptions atlas_options;
+  atlas_options.page_size = options.texture_image_size;
+  atlas_options.padding = options.texture_padding;
+  PackTextures(floor_patch, wall_patches, atlas_options, options.rotate_wall_textures,
+               &texture_input.floorplan, &texture_images);
+  cerr << "done." << endl;
+  TextureImageWriterOptions writer_options;
+  writer_options.png_compression = options.png_compression;
+  writer_options.num_threads = options.num_threads;
+  TextureImageWriter writer(writer_options);
+  WriteTextureImages(file_io, options.texture_image_size, texture_images,
+                     options.compressed_texture, &writer);
+  {
+    ofstream ofstr;
+    ofstr.open(file_io.GetFloorplanFinal().c_str());
+    ofstr << texture_input.floorplan;
+    ofstr.close();
   }
+  return writer.Wait();
 }
 
 
@@ -436,95 +528,16 @@ void ConvertPatchToMat(const Patch& patch, cv::Mat* mat) {
         mat->at<cv::Vec3b>(y, x)[i] = patch.texture[index];
 }
   
-void PackWallTexture(const Patch& patch,
-                     const int texture_image_size,
-                     WallTriangulation* wall_triangulation,
-                     std::vector<std::vector<unsigned char> >* texture_images,
-                     std::pair<int, Eigen::Vector2i>* iuv,
-                     int* max_texture_height) {
-  UpdateIUV(patch.texture_size, texture_image_size, iuv, max_texture_height);
-  // Copy texel data.
-  CopyTexel(patch, texture_image_size, *iuv, texture_images);
-  // Update IUV in floorplan (wall_triangulation).
-  SetIUVInWall(patch.texture_size, texture_image_size, *iuv, wall_triangulation);
-  // Update iuv.
-  iuv->second[0] += patch.texture_size[0];
-}
-
-void UpdateIUV(const Eigen::Vector2i& size,
-               const int texture_image_size,
-               std::pair<int, Eigen::Vector2i>* iuv,
-               int* max_texture_height) {
-  // New row.
-  if (iuv->second[0] + size[0] > texture_image_size) {
-    iuv->second[0] = 0;
-    iuv->second[1] += *max_texture_height;
-    *max_texture_height = 0;
-  }
-  
-  // New image.
-  if (iuv->second[1] + size[1] > texture_image_size) {
-    ++iuv->first;
-    iuv->second[0] = 0;
-    iuv->second[1] = 0;
-    *max_texture_height = 0;
-  }
-
-  // Add a patch.
-  *max_texture_height = max(*max_texture_height, size[1]);
-}
-
-void CopyTexel(const Patch& patch,
-               const int texture_image_size,
-               const std::pair<int, Eigen::Vector2i>& iuv,
-               std::vector<std::vector<unsigned char> >* texture_images) {
-  const int kNumChannels = 3;
-  if (iuv.first >= texture_images->size()) {
-    texture_images->push_back(vector<unsigned char>());
-    texture_images->back().resize(kNumChannels * texture_image_size * texture_image_size);
-  }
-  
-  const int index = iuv.first;
-  const Vector2i& start_uv = iuv.second;
-
-  if (texture_images->size() <= index) {
-    cerr << "Impossible." << endl;
-    exit (1);
-  }
-
-  for (int y = 0; y < patch.texture_size[1]; ++y) {
-    const int ytmp = y + start_uv[1];
-    for (int x = 0; x < patch.texture_size[0]; ++x) {
-      const int xtmp = x + start_uv[0];
-      for (int c = 0; c < kNumChannels; ++c) {
-        const int texture_index = kNumChannels * (ytmp * texture_image_size + xtmp);
-        const int patch_index = kNumChannels * (y * patch.texture_size[0] + x);
-        texture_images->at(index)[texture_index + c] = patch.texture[patch_index + c];
-      }
-    }
-  }
-}
-
-void SetIUVInWall(const Vector2i& texture_size,
-                  const int texture_image_size,
-                  const std::pair<int, Eigen::Vector2i>& iuv,
+void SetIUVInWall(const int texture_image_size,
+                  const AtlasPlacement& placement,
                   WallTriangulation* wall_triangulation) {
-  Vector2d top_left_uv(iuv.second[0], iuv.second[1]);
-  Vector2d bottom_right_uv(iuv.second[0] + texture_size[0],
-                           iuv.second[1] + texture_size[1]);
-
-  // Convert to [0, 1].
-  top_left_uv /= texture_image_size;
-  bottom_right_uv /= texture_image_size;
-  Vector2d uv_diff = bottom_right_uv - top_left_uv;
-  
   for (auto& triangle : wall_triangulation->triangles) {
-    triangle.image_index = iuv.first;
+    triangle.image_index = placement.page;
     for (int i = 0; i < 3; ++i) {
       Vector2d uv_in_wall = wall_triangulation->vertices_in_uv[triangle.indices[i]];
       // May need to change depending on the definition of uv(0, 0).
-      triangle.uvs[i] = top_left_uv + Vector2d(uv_in_wall[0] * uv_diff[0],
-                                               (1.0 - uv_in_wall[1]) * uv_diff[1]);
+      triangle.uvs[i] = placement.ToPageUV(Vector2d(uv_in_wall[0], 1.0 - uv_in_wall[1]),
+                                           texture_image_size);
 
       for (int j = 0; j < 2; ++j)
         triangle.uvs[i][j] = min(1.0, triangle.uvs[i][j]);
@@ -632,33 +645,23 @@ void SetManhattanDelaunay(const Floorplan& floorplan,
 
 void SetIUVInFloor(const Patch& floor_patch,
                    const int texture_image_size,
-                   const std::pair<int, Eigen::Vector2i>& iuv,
+                   const AtlasPlacement& placement,
                    Floorplan* floorplan) {
   const Vector2d& min_xy_local = floor_patch.min_xy_local;
   const Vector2d& max_xy_local = floor_patch.max_xy_local;
-  
-  Vector2d top_left_uv(iuv.second[0], iuv.second[1]);
-  Vector2d bottom_right_uv(iuv.second[0] + floor_patch.texture_size[0],
-                           iuv.second[1] + floor_patch.texture_size[1]);
-
-  // Convert to [0, 1].
-  top_left_uv /= texture_image_size;
-  bottom_right_uv /= texture_image_size;
-  Vector2d uv_diff = bottom_right_uv - top_left_uv;
 
   //----------------------------------------------------------------------
   // Set triangulation for room floors.
   for (int room = 0; room < floorplan->GetNumRooms(); ++room) {
     FloorCeilingTriangulation& triangulation = floorplan->GetFloorTriangulation(room);
     for (auto& triangle : triangulation.triangles) {
-      triangle.image_index = iuv.first;
+      triangle.image_index = placement.page;
       for (int i = 0; i < 3; ++i) {
         const Vector2d local = floorplan->GetRoomVertexLocal(room, triangle.indices[i]);
         Vector2d uv_in_floor((local[0] - min_xy_local[0]) / (max_xy_local[0] - min_xy_local[0]),
                              (local[1] - min_xy_local[1]) / (max_xy_local[1] - min_xy_local[1]));
         
-        triangle.uvs[i] = top_left_uv + Vector2d(uv_in_floor[0] * uv_diff[0],
-                                                 uv_in_floor[1] * uv_diff[1]);
+        triangle.uvs[i] = placement.ToPageUV(uv_in_floor, texture_image_size);
         for (int j = 0; j < 2; ++j)
           triangle.uvs[i][j] = min(1.0, triangle.uvs[i][j]);
       }
@@ -894,6 +897,7 @@ void GenerateFloorTexture(const int room,
 			  const std::vector<double>& weights,
                           const cv::Mat& room_segments,
                           const Patch& floor_patch,
+                          const unsigned int seed,
                           cv::Mat* floor_texture) {
   const int kMinPatchSize = 6;
   SynthesisData synthesis_data(projected_textures, weights);
@@ -902,6 +906,7 @@ void GenerateFloorTexture(const int room,
   synthesis_data.patch_size   = max(kMinPatchSize, texture_input.patch_size_for_synthesis);
   synthesis_data.margin       = synthesis_data.patch_size / 6;
   synthesis_data.mask.resize(floor_patch.texture_size[0] * floor_patch.texture_size[1], false);
+  synthesis_data.seed         = seed;
   int index = 0;
   for (int y = 0; y < floor_patch.texture_size[1]; ++y) {
     for (int x = 0; x < floor_patch.texture_size[0]; ++x, ++index) {
@@ -945,7 +950,7 @@ void GenerateFloorTexture(const int room,
   cv::imshow("result", *floor_texture);
 }
 
-void SynthesizePatch(Patch* patch) {
+void SynthesizePatch(const unsigned int seed, Patch* patch) {
   vector<cv::Mat> projected_textures;
   cv::Mat projected_texture(patch->texture_size[1],
                             patch->texture_size[0],
@@ -970,6 +975,7 @@ void SynthesizePatch(Patch* patch) {
     min(80, min(patch->texture_size[0], patch->texture_size[1]));
   synthesis_data.margin = max(1, synthesis_data.patch_size / 4);
   synthesis_data.mask.resize(patch->texture_size[0] * patch->texture_size[1], true);
+  synthesis_data.seed = seed;
 
   vector<cv::Mat> patches;
   vector<Eigen::Vector2i> patch_positions;
@@ -1039,6 +1045,58 @@ void ShrinkTexture(const int shrink_pixels, Patch* patch) {
     }
   }
 }
+
+BuildKey GetFloorPatchKey(const TextureInput& texture_input) {
+  BuildKey key;
+  key.AddHash(texture_input.inputs_hash);
+  key.Add("num_pyramid_levels",
+          texture_input.panoramas.empty() ? 0 : texture_input.panoramas[0].size());
+  key.Add("pyramid_level_for_floor", texture_input.pyramid_level_for_floor);
+  key.Add("max_texture_size_per_floor_patch", texture_input.max_texture_size_per_floor_patch);
+  key.Add("position_error_for_floor", texture_input.position_error_for_floor);
+  key.Add("patch_size_for_synthesis", texture_input.patch_size_for_synthesis);
+  key.Add("num_cg_iterations", texture_input.num_cg_iterations);
+  // The room segmentation and the heights come from every room.
+  ostringstream ostr;
+  ostr.precision(17);
+  ostr << texture_input.floorplan;
+  key.AddString(ostr.str());
+  return key;
+}
+
+BuildKey GetWallPatchKey(const TextureInput& texture_input, const Patch& patch) {
+  BuildKey key;
+  key.AddHash(texture_input.inputs_hash);
+  key.Add("num_pyramid_levels",
+          texture_input.panoramas.empty() ? 0 : texture_input.panoramas[0].size());
+  key.Add("max_texture_size_per_wall_patch", texture_input.max_texture_size_per_wall_patch);
+  key.Add("texture_height_per_wall", texture_input.texture_height_per_wall);
+  for (int v = 0; v < 4; ++v)
+    key.AddBytes(patch.vertices[v].data(), 3 * sizeof(double));
+  return key;
+}
+
+bool ReadCachedTexture(const TextureInput& texture_input,
+                       const std::string& unit,
+                       const BuildKey& key,
+                       Patch* patch) {
+  if (texture_input.build_cache == NULL)
+    return false;
+  const string blob = texture_input.build_cache->GetBlob(unit);
+  return texture_input.build_cache->IsUpToDate(unit, key, vector<string>(1, blob)) &&
+    ReadPatchTexture(blob, &patch->texture_size, &patch->texture);
+}
+
+void CacheTexture(const TextureInput& texture_input,
+                  const std::string& unit,
+                  const BuildKey& key,
+                  const Patch& patch) {
+  if (texture_input.build_cache == NULL)
+    return;
+  const string blob = texture_input.build_cache->GetBlob(unit);
+  WritePatchTexture(blob, patch.texture_size, patch.texture);
+  texture_input.build_cache->Record(unit, key, vector<string>(1, blob));
+}
   
 }  // namespace
 }  // namespace structured_indoor_modeling
@@ -2,14 +2,18 @@
 #define GENERATE_TEXTURE_H_
 
 #include <Eigen/Dense>
+#include <cstdint>
 #include <opencv2/opencv.hpp>
 #include <vector>
 #include "../../base/floorplan.h"
 #include "../../base/point_cloud.h"
 #include "generate_texture.h"
+#include "texture_atlas.h"
+#include "texture_image_writer.h"
 
 namespace structured_indoor_modeling {
 
+class BuildCache;
 class FileIO;
 class Panorama;
 class WallTriangulation;
@@ -49,9 +53,14 @@ struct Patch {
 
 // Input data from cli.cc.
 struct TextureInput {
+  TextureInput(const std::vector<std::vector<Panorama> >& panoramas,
+               const std::vector<PointCloud>& point_clouds)
+    : panoramas(panoramas), point_clouds(point_clouds), build_cache(NULL), inputs_hash(0) {}
+
   Floorplan floorplan;
-  std::vector<std::vector<Panorama> > panoramas;
-  std::vector<PointCloud> point_clouds;
+  // Shared, read-only (see DatasetCache).
+  const std::vector<std::vector<Panorama> >& panoramas;
+  const std::vector<PointCloud>& point_clouds;
   int pyramid_level_for_floor;
   int max_texture_size_per_floor_patch;
   int max_texture_size_per_wall_patch;
@@ -59,37 +68,72 @@ struct TextureInput {
   double position_error_for_floor;
   int patch_size_for_synthesis;
   int num_cg_iterations;
-};
 
-void PackWallTextures(const std::vector<std::vector<Patch> >& wall_patches,
-                      const int texture_image_size,
-                      Floorplan* floorplan,
-                      int* max_texture_height);
+  // If set, patch textures whose inputs did not change are read back
+  // from the last run. inputs_hash covers the panorama and point cloud
+  // files.
+  BuildCache* build_cache;
+  uint64_t inputs_hash;
+};
 
 // Walls.
 void SetWallPatches(const TextureInput& texture_input,
                     std::vector<std::vector<Patch> >* wall_patches);
 
-void PackWallTextures(const std::vector<std::vector<Patch> >& patches,
-                      const int texture_image_size,
-                      Floorplan* floorplan,
-                      std::vector<std::vector<unsigned char> >* texture_images,
-                      std::pair<int, Eigen::Vector2i>* iuv,
-                      int* max_texture_height);
- 
 // Floor.
 void SetFloorPatch(const TextureInput& texture_input, Patch* floor_patch);
 
-void PackFloorTexture(const Patch& floor_patch,
-                      const int texture_image_size,
-                      Floorplan* floorplan,
-                      std::vector<std::vector<unsigned char> >* texture_images,
-                      std::pair<int, Eigen::Vector2i>* iuv,
-                      int* max_texture_height);
+// Packs the floor and wall textures into texture images (pages of
+// atlas_options.page_size) and sets the texture coordinates in the
+// floorplan. Wall strips may be transposed if rotate_walls.
+void PackTextures(const Patch& floor_patch,
+                  const std::vector<std::vector<Patch> >& wall_patches,
+                  const AtlasOptions& atlas_options,
+                  const bool rotate_walls,
+                  Floorplan* floorplan,
+                  std::vector<std::vector<unsigned char> >* texture_images);
 
+// Queues the texture images, and their block compressed mipmapped
+// versions (DDS) if compressed, to the writer. Otherwise, removes the
+// DDS files of a previous run. texture_images must be kept until
+// writer->Wait().
 void WriteTextureImages(const FileIO& file_io,
                         const int texture_image_size,
-                        const std::vector<std::vector<unsigned char> >& texture_images);
+                        const std::vector<std::vector<unsigned char> >& texture_images,
+                        const bool compressed,
+                        TextureImageWriter* writer);
+
+// Flags of generate_texture_floorplan_cli, with the same defaults.
+struct FloorplanTextureOptions {
+  FloorplanTextureOptions();
+
+  int pyramid_level_for_floor;
+  int max_texture_size_per_floor_patch;
+  int max_texture_size_per_wall_patch;
+  int texture_height_per_wall;
+  double position_error_for_floor;
+  int patch_size_for_synthesis;
+  int num_cg_iterations;
+
+  int texture_image_size;
+  int texture_padding;
+  bool rotate_wall_textures;
+  bool compressed_texture;
+  int png_compression;
+  int num_threads;
+  // Reuse the patch textures of the last run (see build_cache.h).
+  bool incremental;
+};
+
+// The whole stage: textures the floor and the walls, then writes the
+// texture images and the textured floorplan (GetFloorplanFinal).
+// panoramas and point_clouds are only read, so they may be shared.
+// Returns false if an image could not be written.
+bool GenerateFloorplanTexture(const FileIO& file_io,
+                              const Floorplan& floorplan,
+                              const std::vector<std::vector<Panorama> >& panoramas,
+                              const std::vector<PointCloud>& point_clouds,
+                              const FloorplanTextureOptions& options);
  
 }  // namespace structured_indoor_modeling
  
@@ -13,6 +13,7 @@
 #include "../../base/file_io.h"
 #include "../../base/floorplan.h"
 #include "../../base/panorama.h"
+#include "../../base/tracing_flags.h"
 #include "generate_texture_floorplan.h"
 
 DEFINE_int32(num_pyramid_levels, 3, "Num pyramid levels.");
@@ -21,6 +22,12 @@ DEFINE_int32(pyramid_level_for_floor, 1, "Level of pyramid for floor texture.");
 DEFINE_int32(max_texture_size_per_wall_patch, 1024, "Maximum texture size for each wall patch.");
 DEFINE_int32(texture_height_per_wall, 512, "Texture height for each wall patch.");
 DEFINE_int32(texture_image_size, 2048, "Texture image size to be written.");
+DEFINE_int32(texture_padding, 2, "Gutter texels around each patch in the texture images.");
+DEFINE_bool(rotate_wall_textures, true, "Allow wall patches to be transposed when packed.");
+DEFINE_bool(compressed_texture, false, "Also write mipmapped BC1 (DDS) texture images for the viewer.");
+DEFINE_int32(png_compression, 3, "PNG compression level of the texture images (0-9).");
+DEFINE_int32(num_threads, 0, "Workers encoding the texture images (0: all cores).");
+DEFINE_bool(incremental, true, "Reuse the patch textures whose inputs did not change since the last run.");
 
 DEFINE_double(position_error_for_floor, 0.08, "How much error is allowed for a point to be on a floor.");
 
@@ -43,69 +50,42 @@ int main(int argc, char* argv[]) {
 #else
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 #endif
+  InitTracingFromFlags();
   // google::InitGoogleLogging(argv[0]);
 
   // Read data from the directory.
   FileIO file_io(argv[1]);
 
-  TextureInput texture_input;
-  {
-    ReadPanoramaPyramids(file_io,
-                         FLAGS_num_pyramid_levels,
-                         &texture_input.panoramas);
-  }
-  {
-    ReadPointClouds(file_io, &texture_input.point_clouds);
-  }
+  vector<vector<Panorama> > panoramas;
+  ReadPanoramaPyramids(file_io, FLAGS_num_pyramid_levels, &panoramas);
+  vector<PointCloud> point_clouds;
+  ReadPointClouds(file_io, &point_clouds);
+  Floorplan floorplan;
   {
     const string filename = file_io.GetFloorplan();
     ifstream ifstr;
     ifstr.open(filename.c_str());
-    ifstr >> texture_input.floorplan;
+    ifstr >> floorplan;
     ifstr.close();
   }
-  {
-    texture_input.pyramid_level_for_floor = FLAGS_pyramid_level_for_floor;
-    texture_input.max_texture_size_per_floor_patch = FLAGS_max_texture_size_per_floor_patch;
-    texture_input.max_texture_size_per_wall_patch = FLAGS_max_texture_size_per_wall_patch;
-    texture_input.texture_height_per_wall  = FLAGS_texture_height_per_wall;
-    texture_input.position_error_for_floor = FLAGS_position_error_for_floor;
-    texture_input.patch_size_for_synthesis = FLAGS_patch_size_for_synthesis;
-    texture_input.num_cg_iterations        = FLAGS_num_cg_iterations;
-  }
-  // Unit for a texel.
-  // const double texel_size = ComputeTexelSize(panoramas) * FLAGS_texel_size_rescale;
-  
-  // For each wall rectangle, floor, and ceiling,
-  // 0. Identify visible panoramas.
-  // 1. Grab texture
-  // 2. Stitch
-  // Floor texture.
-  cerr << "Set floor patch." << endl;
-  Patch floor_patch;
-  SetFloorPatch(texture_input, &floor_patch);
-  cerr << "done." << endl << "Set wall patches." << endl;
-  // Wall textures.
-  vector<vector<Patch> > wall_patches;
-  SetWallPatches(texture_input, &wall_patches);
-  cerr << "done." << endl << "Pack textures." << endl;
-  // Texture image.
-  vector<vector<unsigned char> > texture_images;
-  // Texture coordinate.
-  pair<int, Vector2i> iuv(0, Vector2i(0, 0));
-  int max_texture_height = 0;
 
-  // Set texture coordinates.
-  PackFloorTexture(floor_patch, FLAGS_texture_image_size,
-                   &texture_input.floorplan, &texture_images, &iuv, &max_texture_height);
-  PackWallTextures(wall_patches, FLAGS_texture_image_size,
-                   &texture_input.floorplan, &texture_images, &iuv, &max_texture_height);
-  cerr << "done." << endl;
-  WriteTextureImages(file_io, FLAGS_texture_image_size, texture_images);
-  {
-    ofstream ofstr;
-    ofstr.open(file_io.GetFloorplanFinal().c_str());
-    ofstr << texture_input.floorplan;
-    ofstr.close();
-  }
+  FloorplanTextureOptions options;
+  options.pyramid_level_for_floor = FLAGS_pyramid_level_for_floor;
+  options.max_texture_size_per_floor_patch = FLAGS_max_texture_size_per_floor_patch;
+  options.max_texture_size_per_wall_patch = FLAGS_max_texture_size_per_wall_patch;
+  options.texture_height_per_wall  = FLAGS_texture_height_per_wall;
+  options.position_error_for_floor = FLAGS_position_error_for_floor;
+  options.patch_size_for_synthesis = FLAGS_patch_size_for_synthesis;
+  options.num_cg_iterations        = FLAGS_num_cg_iterations;
+  options.texture_image_size   = FLAGS_texture_image_size;
+  options.texture_padding      = FLAGS_texture_padding;
+  options.rotate_wall_textures = FLAGS_rotate_wall_textures;
+  options.compressed_texture   = FLAGS_compressed_texture;
+  options.png_compression      = FLAGS_png_compression;
+  options.num_threads          = FLAGS_num_threads;
+  options.incremental          = FLAGS_incremental;
+
+  if (!GenerateFloorplanTexture(file_io, floorplan, panoramas, point_clouds, options))
+    return 1;
+  return 0;
 }
@@ -1,8 +1,15 @@
 #include <Eigen/Sparse>
+#include <cstdio>
 #include <fstream>
+#include <set>
+#include <sstream>
+#include "../../base/build_cache.h"
 #include "../../base/file_io.h"
 #include "../../base/panorama.h"
 #include "../../base/imageProcess/morphological_operation.h"
+#include "../../base/parallel.h"
+#include "../../base/tracing.h"
+#include "../../base/visibility.h"
 #include "generate_texture_indoor_polygon.h"
 #include "synthesize.h"
 
@@ -46,9 +53,9 @@ void WriteDepthImage(const int width, const int height, const double hole,
   ofstr.close();
 }
 
-void PreparePatch(const TextureInput& texture_input,
+void PreparePatch(const PolygonTextureInput& texture_input,
                   const Segment& segment,
-                  Patch* patch) {
+                  PolygonPatch* patch) {
   // Set patch_axes.
   const Vector3d kUpVector(0, 0, 1);
   
@@ -139,8 +146,8 @@ void PreparePatch(const TextureInput& texture_input,
     min(max_size, max(2, static_cast<int>((max_xyz[1] - min_xyz[1]) / texture_input.texel_unit)));
 }
 
-int FindBestPanorama(const TextureInput& texture_input,
-                     const Patch& patch) {
+int FindBestPanorama(const PolygonTextureInput& texture_input,
+                     const PolygonPatch& patch) {
   const IndoorPolygon& indoor_polygon = texture_input.indoor_polygon;
   const std::vector<std::vector<Panorama> >& panoramas = texture_input.panoramas;
                           
@@ -195,7 +202,7 @@ int FindBestPanorama(const TextureInput& texture_input,
 
 int ChoosePyramidLevel(const IndoorPolygon& indoor_polygon,
                        const std::vector<Panorama>& panorama,
-                       const Patch& patch) {
+                       const PolygonPatch& patch) {
   const int kLevelZero = 0;
   const Vector3d center =
     indoor_polygon.ManhattanToGlobal(patch.UVToManhattan(Vector2d(0.5, 0.5)));
@@ -217,7 +224,7 @@ int ChoosePyramidLevel(const IndoorPolygon& indoor_polygon,
   
 void GrabTexture(const IndoorPolygon& indoor_polygon,
                  const std::vector<Panorama>& panorama,
-                 Patch* patch) {
+                 PolygonPatch* patch) {
   const int level = ChoosePyramidLevel(indoor_polygon, panorama, *patch);
   const Panorama& pano = panorama[level];
 
@@ -236,83 +243,18 @@ void GrabTexture(const IndoorPolygon& indoor_polygon,
   }
 }
 
-void UpdateIUV(const Eigen::Vector2i& size,
-               const int texture_image_size,
-               std::pair<int, Eigen::Vector2i>* iuv,
-               int* max_texture_height) {
-  // New row.
-  if (iuv->second[0] + size[0] > texture_image_size) {
-    iuv->second[0] = 0;
-    iuv->second[1] += *max_texture_height;
-    *max_texture_height = 0;
-  }
-  
-  // New image.
-  if (iuv->second[1] + size[1] > texture_image_size) {
-    ++iuv->first;
-    iuv->second[0] = 0;
-    iuv->second[1] = 0;
-    *max_texture_height = 0;
-  }
-
-  // Add a patch.
-  *max_texture_height = max(*max_texture_height, size[1]);
-}
-
-void CopyTexel(const Patch& patch,
-               const int texture_image_size,
-               const std::pair<int, Eigen::Vector2i>& iuv,
-               std::vector<std::vector<unsigned char> >* texture_images) {
-  const int kNumChannels = 3;
-  if (iuv.first >= texture_images->size()) {
-    texture_images->push_back(vector<unsigned char>());
-    texture_images->back().resize(kNumChannels * texture_image_size * texture_image_size);
-  }
-  
-  const int index = iuv.first;
-  const Vector2i& start_uv = iuv.second;
-
-  if (texture_images->size() <= index) {
-    cerr << "Impossible." << endl;
-    exit (1);
-  }
-
-  for (int y = 0; y < patch.texture_size[1]; ++y) {
-    const int ytmp = y + start_uv[1];
-    for (int x = 0; x < patch.texture_size[0]; ++x) {
-      const int xtmp = x + start_uv[0];
-      for (int c = 0; c < kNumChannels; ++c) {
-        const int texture_index = kNumChannels * (ytmp * texture_image_size + xtmp);
-        const int patch_index = kNumChannels * (y * patch.texture_size[0] + x);
-        texture_images->at(index)[texture_index + c] = patch.texture[patch_index + c];
-      }
-    }
-  }
-}
-
-void SetIUVInSegment(const Patch& patch,
+void SetIUVInSegment(const PolygonPatch& patch,
                      const int texture_image_size,
-                     const std::pair<int, Eigen::Vector2i>& iuv,
+                     const AtlasPlacement& placement,
                      Segment* segment) {
-  const Vector2i& texture_size = patch.texture_size;
-  Vector2d top_left_uv(iuv.second[0], iuv.second[1]);
-  Vector2d bottom_right_uv(iuv.second[0] + texture_size[0],
-                           iuv.second[1] + texture_size[1]);
-
-  // Convert to [0, 1].
-  top_left_uv /= texture_image_size;
-  bottom_right_uv /= texture_image_size;
-  Vector2d uv_diff = bottom_right_uv - top_left_uv;
-  
   for (auto& triangle : segment->triangles) {
-    triangle.image_index = iuv.first;
+    triangle.image_index = placement.page;
     for (int i = 0; i < 3; ++i) {      
       Vector2d uv_in_patch =
         patch.ManhattanToUV(segment->vertices[triangle.indices[i]]);
 
       // May need to change depending on the definition of uv(0, 0).
-      triangle.uvs[i] = top_left_uv + Vector2d(uv_in_patch[0] * uv_diff[0],
-                                               uv_in_patch[1] * uv_diff[1]);
+      triangle.uvs[i] = placement.ToPageUV(uv_in_patch, texture_image_size);
 
       for (int j = 0; j < 2; ++j)
         triangle.uvs[i][j] = min(1.0, triangle.uvs[i][j]);
@@ -320,7 +262,7 @@ void SetIUVInSegment(const Patch& patch,
   }
 }
 
-void ShrinkTexture(const int shrink_pixels, Patch* patch) {
+void ShrinkTexture(const int shrink_pixels, PolygonPatch* patch) {
   vector<bool> valids(patch->texture_size[0] * patch->texture_size[1], false);
   int index = 0;
   for (int y = 0; y < patch->texture_size[1]; ++y) {
@@ -379,8 +321,10 @@ void SynthesizePatch(const int patch_size_for_synthesis,
 		     const std::vector<double>& weights,
                      const bool vertical_constraint,
                      const int num_patch_half_iterations,
-                     Patch* patch) {
+                     const unsigned int seed,
+                     PolygonPatch* patch) {
   SynthesisData synthesis_data(projected_textures, weights);
+  synthesis_data.seed = seed;
   // This must be more than 4 for margin.
   const int kMinPatchSize = 4;
   synthesis_data.num_cg_iterations = 50;
@@ -488,15 +432,23 @@ void ShrinkTexture(const int width,
   }
 }
   
-void ComputeProjectedTextures(const TextureInput& texture_input,
-                              const Patch& patch,
+void ComputeProjectedTextures(const PolygonTextureInput& texture_input,
+                              const PolygonPatch& patch,
                               std::vector<cv::Mat>* projected_textures,
 			      std::vector<double>* weights) {
   const int kFirstLevel = 0;
   const int level = texture_input.pyramid_level;
   const double threshold = texture_input.visibility_margin * 2;
+
+  Eigen::AlignedBox3d patch_box;
+  for (int v = 0; v < 4; ++v)
+    patch_box.extend(texture_input.indoor_polygon.ManhattanToGlobal(patch.vertices[v]));
   
   for (int p = 0; p < texture_input.panoramas.size(); ++p) {
+    // The whole patch is behind the depths: the texture would be empty.
+    if (texture_input.visibility != NULL &&
+        texture_input.visibility->TestBox(patch_box, p, threshold) == VisibilityIndex::kInvisible)
+      continue;
     const Panorama& panorama = texture_input.panoramas[p][level];
     const Panorama& panorama_for_depth = texture_input.panoramas[p][kFirstLevel];
     const int depth_width  = panorama_for_depth.DepthWidth();
@@ -572,13 +524,46 @@ void ComputeProjectedTextures(const TextureInput& texture_input,
   }
 }
 
+// Everything SetPatch reads for a segment. inputs_hash covers the
+// panorama and point cloud files.
+BuildKey GetPatchKey(const PolygonTextureInput& texture_input,
+                     const Segment& segment,
+                     const bool visibility_check,
+                     const uint64_t inputs_hash) {
+  BuildKey key;
+  key.AddHash(inputs_hash);
+  key.Add("num_pyramid_levels",
+          texture_input.panoramas.empty() ? 0 : texture_input.panoramas[0].size());
+  key.Add("pyramid_level", texture_input.pyramid_level);
+  key.Add("max_texture_size_per_floor_patch", texture_input.max_texture_size_per_floor_patch);
+  key.Add("max_texture_size_per_non_floor_patch", texture_input.max_texture_size_per_non_floor_patch);
+  key.Add("position_error_for_floor", texture_input.position_error_for_floor);
+  key.Add("patch_size_for_synthesis", texture_input.patch_size_for_synthesis);
+  key.Add("num_cg_iterations", texture_input.num_cg_iterations);
+  key.Add("texel_unit", texture_input.texel_unit);
+  key.Add("visibility_margin", texture_input.visibility_margin);
+  key.Add("num_patch_half_iterations", texture_input.num_patch_half_iterations);
+  key.Add("erode_texture", texture_input.erode_texture);
+  key.Add("visibility_check", visibility_check);
+  // The manhattan frame.
+  const IndoorPolygon& indoor_polygon = texture_input.indoor_polygon;
+  key.AddBytes(indoor_polygon.ManhattanToGlobal(Vector3d(0, 0, 0)).data(), 3 * sizeof(double));
+  for (int a = 0; a < 3; ++a)
+    key.AddBytes(indoor_polygon.ManhattanToGlobal(Vector3d::Unit(a)).data(), 3 * sizeof(double));
+  ostringstream ostr;
+  ostr.precision(17);
+  ostr << segment;
+  key.AddString(ostr.str());
+  return key;
+}
+
 }  // namespace
 
-Eigen::Vector3d Patch::UVToManhattan(const Eigen::Vector2d& uv) const {
+Eigen::Vector3d PolygonPatch::UVToManhattan(const Eigen::Vector2d& uv) const {
   return vertices[0] + uv[0] * (vertices[1] - vertices[0]) + uv[1] * (vertices[3] - vertices[0]);
 }
 
-Eigen::Vector2d Patch::ManhattanToUV(const Eigen::Vector3d& manhattan) const {
+Eigen::Vector2d PolygonPatch::ManhattanToUV(const Eigen::Vector3d& manhattan) const {
   const double x_length = (vertices[1] - vertices[0]).norm();
   const double y_length = (vertices[3] - vertices[0]).norm();
   
@@ -586,11 +571,11 @@ Eigen::Vector2d Patch::ManhattanToUV(const Eigen::Vector3d& manhattan) const {
                          std::max(0.0, std::min(1.0, (manhattan - vertices[0]).dot(axes[1]) / y_length)));
 }
   
-Eigen::Vector2d Patch::UVToTexture(const Eigen::Vector2d& uv) const {
+Eigen::Vector2d PolygonPatch::UVToTexture(const Eigen::Vector2d& uv) const {
   return Eigen::Vector2d(texture_size[0] * uv[0], texture_size[1] * uv[1]);
 }
   
-Eigen::Vector2d Patch::TextureToUV(const Eigen::Vector2d& texture) const {
+Eigen::Vector2d PolygonPatch::TextureToUV(const Eigen::Vector2d& texture) const {
   return Eigen::Vector2d(texture[0] / texture_size[0], texture[1] / texture_size[1]);
 }
 
@@ -649,10 +634,11 @@ double ComputeVisibilityMargin(const IndoorPolygon& indoor_polygon) {
   return (ceiling_z - floor_z) / 10;
 }
   
-void SetPatch(const TextureInput& texture_input,
+void SetPatch(const PolygonTextureInput& texture_input,
               const Segment& segment,
               const bool visibility_check,
-              Patch* patch) {
+              const unsigned int seed,
+              PolygonPatch* patch) {
   PreparePatch(texture_input, segment, patch);
 
   if (visibility_check) {
@@ -676,7 +662,7 @@ void SetPatch(const TextureInput& texture_input,
       }
     } else {
       const bool kNoVerticalConstraint = false;     
-      SynthesizePatch(texture_input.patch_size_for_synthesis, projected_textures, weights, kNoVerticalConstraint, texture_input.num_patch_half_iterations, patch);
+      SynthesizePatch(texture_input.patch_size_for_synthesis, projected_textures, weights, kNoVerticalConstraint, texture_input.num_patch_half_iterations, seed, patch);
     }    
   } else {
     // Pick the best one and inpaint.
@@ -717,43 +703,197 @@ void SetPatch(const TextureInput& texture_input,
       projected_textures_empty.push_back(projected_texture);
       weights.push_back(1.0);
       
-      SynthesizePatch(texture_input.patch_size_for_synthesis, projected_textures_empty, weights, kVerticalConstraint, texture_input.num_patch_half_iterations, patch);
+      SynthesizePatch(texture_input.patch_size_for_synthesis, projected_textures_empty, weights, kVerticalConstraint, texture_input.num_patch_half_iterations, seed, patch);
     }
   }  
 }
 
-void PackTexture(const Patch& patch,
-                 const int texture_image_size,
-                 Segment* segment,
-                 std::vector<std::vector<unsigned char> >* texture_images,
-                 std::pair<int, Eigen::Vector2i>* iuv,
-                 int* max_texture_height) {
-  UpdateIUV(patch.texture_size, texture_image_size, iuv, max_texture_height);
-  // Copy texel data.
-  CopyTexel(patch, texture_image_size, *iuv, texture_images);
-  // Update IUV in segment.
-  SetIUVInSegment(patch, texture_image_size, *iuv, segment);
-  // Update iuv.
-  iuv->second[0] += patch.texture_size[0];
+void PackTextures(const std::vector<PolygonPatch>& patches,
+                  const AtlasOptions& atlas_options,
+                  const bool rotate_walls,
+                  IndoorPolygon* indoor_polygon,
+                  std::vector<std::vector<unsigned char> >* texture_images) {
+  TextureAtlas atlas(atlas_options);
+  for (int p = 0; p < patches.size(); ++p) {
+    const bool rotatable = rotate_walls && indoor_polygon->GetSegment(p).type == Segment::WALL;
+    atlas.AddPatch(patches[p].texture_size, rotatable);
+  }
+  atlas.Pack();
+
+  texture_images->clear();
+  for (int p = 0; p < patches.size(); ++p) {
+    atlas.CopyTexels(p, patches[p].texture, texture_images);
+    SetIUVInSegment(patches[p], atlas.GetPageSize(), atlas.GetPlacement(p),
+                    &indoor_polygon->GetSegment(p));
+  }
+
+  cout << atlas.GetNumPages() << " texture images, fill:";
+  for (int page = 0; page < atlas.GetNumPages(); ++page)
+    cout << ' ' << atlas.GetFillEfficiency(page);
+  cout << endl;
 }
 
 void WriteTextureImages(const FileIO& file_io,
                         const int texture_image_size,
                         const std::vector<std::vector<unsigned char> >& texture_images,
-                        const std::string& suffix) {
+                        const std::string& suffix,
+                        const bool compressed,
+                        TextureImageWriter* writer) {
   for (int t = 0; t < texture_images.size(); ++t) {
-    cv::Mat image(texture_image_size, texture_image_size, CV_8UC3);
-    int index = 0;
-    for (int y = 0; y < texture_image_size; ++y) {
-      for (int x = 0; x < texture_image_size; ++x) {
-        for (int i = 0; i < 3; ++i) {
-          image.at<cv::Vec3b>(y, x)[i] = texture_images[t][index++];
-        }
-      }
+    writer->Write(file_io.GetTextureImageIndoorPolygon(t, suffix), texture_images[t], texture_image_size, texture_image_size);
+    if (compressed) {
+      writer->Write(file_io.GetTextureImageIndoorPolygonDDS(t, suffix), texture_images[t],
+                    texture_image_size, texture_image_size);
+    } else {
+      // The viewer prefers a full DDS set, which would be stale now.
+      remove(file_io.GetTextureImageIndoorPolygonDDS(t, suffix).c_str());
     }
+  }
+}
+
+IndoorPolygonTextureOptions::IndoorPolygonTextureOptions()
+  : pyramid_level(1),
+    max_texture_size_per_floor_patch(1500),
+    max_texture_size_per_non_floor_patch(1024),
+    target_texture_size_for_vertical(250),
+    position_error_for_floor(0.08),
+    patch_size_for_synthesis(45),
+    num_cg_iterations(40),
+    num_patch_half_iterations(3),
+    erode_texture(true),
+    texture_image_size(2048),
+    texture_padding(2),
+    rotate_wall_textures(true),
+    compressed_texture(false),
+    png_compression(3),
+    num_threads(0),
+    incremental(true) {
+}
+
+bool GenerateIndoorPolygonTexture(const FileIO& file_io,
+                                  const IndoorPolygon& indoor_polygon,
+                                  const std::vector<std::vector<Panorama> >& panoramas,
+                                  const std::vector<PointCloud>& point_clouds,
+                                  const IndoorPolygonTextureOptions& options) {
+  const int kFirstLevel = 0;
+  const VisibilityIndex visibility(panoramas, kFirstLevel, options.num_threads);
+  return GenerateIndoorPolygonTexture(file_io, indoor_polygon, panoramas, point_clouds,
+                                      visibility, options);
+}
 
-    imwrite(file_io.GetTextureImageIndoorPolygon(t, suffix), image);
+bool GenerateIndoorPolygonTexture(const FileIO& file_io,
+                                  const IndoorPolygon& indoor_polygon,
+                                  const std::vector<std::vector<Panorama> >& panoramas,
+                                  const std::vector<PointCloud>& point_clouds,
+                                  const VisibilityIndex& visibility,
+                                  const IndoorPolygonTextureOptions& options) {
+  PolygonTextureInput texture_input(panoramas, point_clouds);
+  texture_input.visibility = &visibility;
+  texture_input.indoor_polygon = indoor_polygon;
+  texture_input.num_patch_half_iterations = options.num_patch_half_iterations;
+  texture_input.erode_texture = options.erode_texture;
+  texture_input.pyramid_level            = options.pyramid_level;
+  texture_input.max_texture_size_per_floor_patch     = options.max_texture_size_per_floor_patch;
+  texture_input.max_texture_size_per_non_floor_patch = options.max_texture_size_per_non_floor_patch;
+  texture_input.position_error_for_floor = options.position_error_for_floor;
+  texture_input.patch_size_for_synthesis = options.patch_size_for_synthesis;
+  texture_input.num_cg_iterations        = options.num_cg_iterations;
+  texture_input.texel_unit =
+    ComputeTexelUnit(texture_input.indoor_polygon, options.target_texture_size_for_vertical);
+  const double default_visibility_margin = ComputeVisibilityMargin(texture_input.indoor_polygon);
+
+  // Segments whose inputs did not change get the texture of the last
+  // run.
+  BuildCache build_cache(file_io,
+                         options.suffix.empty() ? "indoor_polygon_texture" : "indoor_polygon_texture_" + options.suffix,
+                         options.incremental);
+  const uint64_t inputs_hash =
+    BuildKey().AddHash(build_cache.HashPanoramaFiles(panoramas.size()))
+    .AddHash(build_cache.HashPointCloudFiles(point_clouds.size())).GetHash();
+
+  vector<PolygonPatch> patches(texture_input.indoor_polygon.GetNumSegments());
+
+  for (int p = 0; p < patches.size(); ++p) {
+    const Segment& segment = texture_input.indoor_polygon.GetSegment(p);
+
+    bool visibility_check;
+    if (segment.type == Segment::FLOOR) {
+      visibility_check = true;
+      texture_input.visibility_margin = default_visibility_margin / 2;
+    } else {
+      // visibility_check = false;
+      visibility_check = true;
+      texture_input.visibility_margin = default_visibility_margin;
+    }
+    const string unit = BuildCache::GetUnitName("segment", p);
+    const BuildKey key = GetPatchKey(texture_input, segment, visibility_check, inputs_hash);
+    const vector<string> outputs(1, build_cache.GetBlob(unit));
+    if (build_cache.IsUpToDate(unit, key, outputs)) {
+      PreparePatch(texture_input, segment, &patches[p]);
+      if (ReadPatchTexture(outputs[0], &patches[p].texture_size, &patches[p].texture))
+        continue;
+    }
+    // Seeded from the key, so that a segment gets the same texture in
+    // any run (incremental or not, alone or with other meshes).
+    SetPatch(texture_input, segment, visibility_check, key.GetSeed(), &patches[p]);
+    WritePatchTexture(outputs[0], patches[p].texture_size, patches[p].texture);
+    build_cache.Record(unit, key, outputs);
+  }
+
+  // Texture image.
+  vector<vector<unsigned char> > texture_images;
+  AtlasOptions atlas_options;
+  atlas_options.page_size = options.texture_image_size;
+  atlas_options.padding = options.texture_padding;
+  PackTextures(patches, atlas_options, options.rotate_wall_textures,
+               &texture_input.indoor_polygon, &texture_images);
+
+  TextureImageWriterOptions writer_options;
+  writer_options.png_compression = options.png_compression;
+  writer_options.num_threads = options.num_threads;
+  TextureImageWriter writer(writer_options);
+  WriteTextureImages(file_io, options.texture_image_size, texture_images, options.suffix,
+                     options.compressed_texture, &writer);
+  {
+    ofstream ofstr;
+    ofstr.open(file_io.GetIndoorPolygonFinal(options.suffix).c_str());
+    ofstr << texture_input.indoor_polygon;
+    ofstr.close();
+  }
+  return writer.Wait();
+}
+
+bool GenerateIndoorPolygonTextures(const FileIO& file_io,
+                                   const std::vector<IndoorPolygonTextureJob>& jobs,
+                                   const std::vector<std::vector<Panorama> >& panoramas,
+                                   const std::vector<PointCloud>& point_clouds,
+                                   const int num_parallel_jobs) {
+  const ScopedTrace trace("GenerateIndoorPolygonTextures");
+  // Jobs writing the same files would overwrite each other.
+  set<string> suffixes;
+  for (const auto& job : jobs) {
+    if (!suffixes.insert(job.options.suffix).second) {
+      cerr << "Duplicated mesh suffix: " << job.options.suffix << endl;
+      exit (1);
+    }
+  }
+
+  const int kFirstLevel = 0;
+  const VisibilityIndex visibility(panoramas, kFirstLevel);
+  vector<char> successes(jobs.size(), 0);
+  ParallelFor(0, jobs.size(), [&](const int j) {
+      successes[j] = GenerateIndoorPolygonTexture(file_io, jobs[j].indoor_polygon, panoramas,
+                                                  point_clouds, visibility, jobs[j].options);
+    }, num_parallel_jobs);
+
+  bool success = true;
+  for (int j = 0; j < (int)jobs.size(); ++j) {
+    if (!successes[j]) {
+      cerr << "Failed in texturing: " << jobs[j].options.suffix << endl;
+      success = false;
+    }
   }
+  return success;
 }
 
 }  // namespace structured_indoor_modeling
@@ -7,11 +7,15 @@
 #include "../../base/indoor_polygon.h"
 #include "../../base/point_cloud.h"
 #include "generate_texture.h"
+#include "texture_atlas.h"
+#include "texture_image_writer.h"
 
 namespace structured_indoor_modeling {
 
+class VisibilityIndex;
+
 // All the coordinates are in the manhattan coordinate frame.
-struct Patch {
+struct PolygonPatch {
   //      patch xaxis
   //       0------1
   // patch |      |
@@ -34,10 +38,18 @@ struct Patch {
 };
   
 // Input data from cli.cc.
-struct TextureInput {
+struct PolygonTextureInput {
+  PolygonTextureInput(const std::vector<std::vector<Panorama> >& panoramas,
+                      const std::vector<PointCloud>& point_clouds)
+    : panoramas(panoramas), point_clouds(point_clouds), visibility(NULL) {}
+
   IndoorPolygon indoor_polygon;
-  std::vector<std::vector<Panorama> > panoramas;
-  std::vector<PointCloud> point_clouds;
+  // Shared, read-only (see DatasetCache).
+  const std::vector<std::vector<Panorama> >& panoramas;
+  const std::vector<PointCloud>& point_clouds;
+  // Depth pyramids of the first level of panoramas, to skip the
+  // panoramas that cannot see a patch. Optional.
+  const VisibilityIndex* visibility;
 
   int pyramid_level;
   int max_texture_size_per_floor_patch;
@@ -58,21 +70,95 @@ double ComputeTexelUnit(const IndoorPolygon& indoor_polygon,
 
 double ComputeVisibilityMargin(const IndoorPolygon& indoor_polygon);
 
-void SetPatch(const TextureInput& texture_input,
+// seed: of the texture synthesis (see SynthesisData).
+void SetPatch(const PolygonTextureInput& texture_input,
               const Segment& segment,
               const bool visibility_check,
-              Patch* patch);
+              const unsigned int seed,
+              PolygonPatch* patch);
 
-void PackTexture(const Patch& patch,
-                 const int texture_image_size,
-                 Segment* segment,
-                 std::vector<std::vector<unsigned char> >* texture_images,
-                 std::pair<int, Eigen::Vector2i>* iuv,
-                 int* max_texture_height);
+// Packs the textures of all the patches (one per segment) into texture
+// images (pages of atlas_options.page_size) and sets the texture
+// coordinates of the segments. Wall strips may be transposed if
+// rotate_walls.
+void PackTextures(const std::vector<PolygonPatch>& patches,
+                  const AtlasOptions& atlas_options,
+                  const bool rotate_walls,
+                  IndoorPolygon* indoor_polygon,
+                  std::vector<std::vector<unsigned char> >* texture_images);
 
+// Queues the texture images, and their block compressed mipmapped
+// versions (DDS) if compressed, to the writer. Otherwise, removes the
+// DDS files of a previous run. texture_images must be kept until
+// writer->Wait().
 void WriteTextureImages(const FileIO& file_io,
                         const int texture_image_size,
                         const std::vector<std::vector<unsigned char> >& texture_images,
-                        const std::string& suffix);
+                        const std::string& suffix,
+                        const bool compressed,
+                        TextureImageWriter* writer);
+
+// Flags of generate_texture_indoor_polygon_cli, with the same defaults.
+struct IndoorPolygonTextureOptions {
+  IndoorPolygonTextureOptions();
+
+  int pyramid_level;
+  int max_texture_size_per_floor_patch;
+  int max_texture_size_per_non_floor_patch;
+  int target_texture_size_for_vertical;
+  double position_error_for_floor;
+  int patch_size_for_synthesis;
+  int num_cg_iterations;
+  // 12 and false for a mesh given as a binary ply.
+  int num_patch_half_iterations;
+  bool erode_texture;
+
+  int texture_image_size;
+  int texture_padding;
+  bool rotate_wall_textures;
+  bool compressed_texture;
+  int png_compression;
+  int num_threads;
+  // Reuse the patch textures of the last run (see build_cache.h).
+  bool incremental;
+  // Appended to the output file names ("" for the indoor polygon).
+  std::string suffix;
+};
+
+// The whole stage: textures every segment, then writes the texture
+// images and the textured indoor polygon (GetIndoorPolygonFinal).
+// panoramas and point_clouds are only read, so they may be shared.
+// Returns false if an image could not be written.
+bool GenerateIndoorPolygonTexture(const FileIO& file_io,
+                                  const IndoorPolygon& indoor_polygon,
+                                  const std::vector<std::vector<Panorama> >& panoramas,
+                                  const std::vector<PointCloud>& point_clouds,
+                                  const IndoorPolygonTextureOptions& options);
+
+// Same with a visibility index of panoramas at level 0, which can be
+// shared by the meshes of a house.
+bool GenerateIndoorPolygonTexture(const FileIO& file_io,
+                                  const IndoorPolygon& indoor_polygon,
+                                  const std::vector<std::vector<Panorama> >& panoramas,
+                                  const std::vector<PointCloud>& point_clouds,
+                                  const VisibilityIndex& visibility,
+                                  const IndoorPolygonTextureOptions& options);
+
+// A mesh to texture with GenerateIndoorPolygonTextures.
+struct IndoorPolygonTextureJob {
+  IndoorPolygon indoor_polygon;
+  // options.suffix must be different for every job.
+  IndoorPolygonTextureOptions options;
+};
+
+// Textures several meshes of the same house in one process: the
+// panoramas, point clouds and visibility index are shared, and
+// num_parallel_jobs meshes are textured at a time (all cores if <= 0).
+// Returns false if any mesh failed.
+bool GenerateIndoorPolygonTextures(const FileIO& file_io,
+                                   const std::vector<IndoorPolygonTextureJob>& jobs,
+                                   const std::vector<std::vector<Panorama> >& panoramas,
+                                   const std::vector<PointCloud>& point_clouds,
+                                   const int num_parallel_jobs);
 
 }  // namespace structured_indoor_modeling
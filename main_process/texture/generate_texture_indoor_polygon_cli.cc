@@ -2,6 +2,7 @@
 #include <fstream>
 #include <iostream>
 #include <opencv2/opencv.hpp>
+#include <sstream>
 #include <vector>
 #include <gflags/gflags.h>
 
@@ -13,6 +14,7 @@
 #include "../../base/file_io.h"
 #include "../../base/floorplan.h"
 #include "../../base/panorama.h"
+#include "../../base/tracing_flags.h"
 #include "generate_texture.h"
 #include "generate_texture_indoor_polygon.h"
 
@@ -30,9 +32,21 @@ DEFINE_int32(patch_size_for_synthesis, 45, "Patch size for synthesis."); // 45
 DEFINE_int32(num_cg_iterations, 40, "Number of CG iterations.");
 
 DEFINE_int32(texture_image_size, 2048, "Texture image size to be written.");
+DEFINE_int32(texture_padding, 2, "Gutter texels around each patch in the texture images.");
+DEFINE_bool(rotate_wall_textures, true, "Allow wall patches to be transposed when packed.");
+DEFINE_bool(compressed_texture, false, "Also write mipmapped BC1 (DDS) texture images for the viewer.");
+DEFINE_int32(png_compression, 3, "PNG compression level of the texture images (0-9).");
+DEFINE_int32(num_threads, 0, "Workers encoding the texture images (0: all cores).");
+DEFINE_bool(incremental, true, "Reuse the patch textures whose inputs did not change since the last run.");
 
 DEFINE_string(binary_ply, "", "A file name under directory.");
 DEFINE_string(ascii_ply, "", "A file name under directory.");
+DEFINE_string(mesh_list, "",
+              "A file listing meshes to texture in one run, a line each: "
+              "'binary|ascii <file name under directory> [output suffix]'.");
+// Every mesh has its own pool of --num_threads writers and its own
+// patch textures in memory, so a few at a time is enough.
+DEFINE_int32(num_parallel_meshes, 2, "Meshes of mesh_list textured at a time (0: all cores).");
 
 using namespace Eigen;
 using namespace std;
@@ -44,6 +58,58 @@ string ExtractSuffix(const string filename) {
   // filename.find_last_of('.'));
 }
 
+// Reads a mesh given as a binary or ascii ply under the directory, and
+// sets the options that depend on its type.
+void ReadMesh(const string& directory,
+              const string& type,
+              const string& ply,
+              IndoorPolygon* indoor_polygon,
+              IndoorPolygonTextureOptions* options) {
+  char buffer[1024];
+  sprintf(buffer, "%s%s", directory.c_str(), ply.c_str());
+  if (type == "binary") {
+    indoor_polygon->InitFromBinaryPly(buffer);
+
+    options->num_patch_half_iterations = 12;
+    options->erode_texture = false;
+  } else if (type == "ascii") {
+    indoor_polygon->InitFromAsciiPly(buffer);
+
+    options->num_patch_half_iterations = 3;
+    options->erode_texture = true;
+  } else {
+    cerr << "Unknown mesh type: " << type << endl;
+    exit (1);
+  }
+  options->suffix = ExtractSuffix(ply);
+}
+
+void ReadMeshList(const string& directory,
+                  const string& mesh_list,
+                  const IndoorPolygonTextureOptions& options,
+                  vector<IndoorPolygonTextureJob>* jobs) {
+  ifstream ifstr;
+  ifstr.open(mesh_list.c_str());
+  if (!ifstr.is_open()) {
+    cerr << "Cannot open a file: " << mesh_list << endl;
+    exit (1);
+  }
+  string line;
+  while (getline(ifstr, line)) {
+    istringstream istr(line);
+    string type, ply, suffix;
+    if (!(istr >> type >> ply) || type[0] == '#')
+      continue;
+    IndoorPolygonTextureJob job;
+    job.options = options;
+    ReadMesh(directory, type, ply, &job.indoor_polygon, &job.options);
+    if (istr >> suffix)
+      job.options.suffix = suffix;
+    jobs->push_back(job);
+  }
+  ifstr.close();
+}
+
 int main(int argc, char* argv[]) {
   if (argc < 2) {
     cerr << "Usage: " << argv[0] << " data_directory" << endl;
@@ -54,104 +120,62 @@ int main(int argc, char* argv[]) {
 #else
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 #endif
+  InitTracingFromFlags();
 
   // Read data from the directory.
   FileIO file_io(argv[1]);
 
-  TextureInput texture_input;
-  {
-    ReadPanoramaPyramids(file_io, FLAGS_num_pyramid_levels, &texture_input.panoramas);
-  }
-  
-  {
-    ReadPointClouds(file_io, &texture_input.point_clouds);
+  vector<vector<Panorama> > panoramas;
+  ReadPanoramaPyramids(file_io, FLAGS_num_pyramid_levels, &panoramas);
+  vector<PointCloud> point_clouds;
+  ReadPointClouds(file_io, &point_clouds);
+
+  IndoorPolygonTextureOptions options;
+  options.pyramid_level            = FLAGS_pyramid_level;
+  options.max_texture_size_per_floor_patch     = FLAGS_max_texture_size_per_floor_patch;
+  options.max_texture_size_per_non_floor_patch = FLAGS_max_texture_size_per_non_floor_patch;
+  options.target_texture_size_for_vertical     = FLAGS_target_texture_size_for_vertical;
+  options.position_error_for_floor = FLAGS_position_error_for_floor;
+  options.patch_size_for_synthesis = FLAGS_patch_size_for_synthesis;
+  options.num_cg_iterations        = FLAGS_num_cg_iterations;
+  options.texture_image_size   = FLAGS_texture_image_size;
+  options.texture_padding      = FLAGS_texture_padding;
+  options.rotate_wall_textures = FLAGS_rotate_wall_textures;
+  options.compressed_texture   = FLAGS_compressed_texture;
+  options.png_compression      = FLAGS_png_compression;
+  options.num_threads          = FLAGS_num_threads;
+  options.incremental          = FLAGS_incremental;
+
+  if (FLAGS_mesh_list != "") {
+    vector<IndoorPolygonTextureJob> jobs;
+    ReadMeshList(argv[1], FLAGS_mesh_list, options, &jobs);
+    if (!GenerateIndoorPolygonTextures(file_io, jobs, panoramas, point_clouds,
+                                       FLAGS_num_parallel_meshes))
+      return 1;
+    return 0;
   }
-  
+
+  IndoorPolygon indoor_polygon;
   if (FLAGS_binary_ply == "" && FLAGS_ascii_ply == "") {
     const string filename = file_io.GetIndoorPolygon();
     ifstream ifstr;
     ifstr.open(filename.c_str());
-    ifstr >> texture_input.indoor_polygon;
+    ifstr >> indoor_polygon;
     ifstr.close();
 
-    texture_input.num_patch_half_iterations = 3;
-    texture_input.erode_texture = true;
+    options.num_patch_half_iterations = 3;
+    options.erode_texture = true;
   } else if (FLAGS_binary_ply != "") {
-    char buffer[1024];
-    sprintf(buffer, "%s%s", argv[1], FLAGS_binary_ply.c_str());
-    texture_input.indoor_polygon.InitFromBinaryPly(buffer);
-
-    texture_input.num_patch_half_iterations = 12;
-    texture_input.erode_texture = false;
+    ReadMesh(argv[1], "binary", FLAGS_binary_ply, &indoor_polygon, &options);
   } else if (FLAGS_ascii_ply != "") {
-    char buffer[1024];
-    sprintf(buffer, "%s%s", argv[1], FLAGS_ascii_ply.c_str());
-    texture_input.indoor_polygon.InitFromAsciiPly(buffer);
-
-    texture_input.num_patch_half_iterations = 3;
-    texture_input.erode_texture = true;
+    ReadMesh(argv[1], "ascii", FLAGS_ascii_ply, &indoor_polygon, &options);
   } else {
     cerr << "Impossible." << endl;
     exit (1);
   }
 
-  {
-    texture_input.pyramid_level            = FLAGS_pyramid_level;
-    texture_input.max_texture_size_per_floor_patch     = FLAGS_max_texture_size_per_floor_patch;
-    texture_input.max_texture_size_per_non_floor_patch = FLAGS_max_texture_size_per_non_floor_patch;
-    texture_input.position_error_for_floor = FLAGS_position_error_for_floor;
-    texture_input.patch_size_for_synthesis = FLAGS_patch_size_for_synthesis;
-    texture_input.num_cg_iterations        = FLAGS_num_cg_iterations;
-  }
-  texture_input.texel_unit =
-    ComputeTexelUnit(texture_input.indoor_polygon, FLAGS_target_texture_size_for_vertical);
-  const double default_visibility_margin = ComputeVisibilityMargin(texture_input.indoor_polygon);
-
-  vector<Patch> patches(texture_input.indoor_polygon.GetNumSegments());
-
-  for (int p = 0; p < patches.size(); ++p) {
-    const Segment& segment = texture_input.indoor_polygon.GetSegment(p);
-
-    bool visibility_check;
-    if (segment.type == Segment::FLOOR) {
-      visibility_check = true;
-      texture_input.visibility_margin = default_visibility_margin / 2;
-    } else {
-      // visibility_check = false;
-      visibility_check = true;
-      texture_input.visibility_margin = default_visibility_margin;
-    }
-    SetPatch(texture_input, segment, visibility_check, &patches[p]);
-  }
-
-  // Texture image.
-  vector<vector<unsigned char> > texture_images;
-  // Texture coordinate.
-  pair<int, Vector2i> iuv(0, Vector2i(0, 0));
-  int max_texture_height = 0;
-
-  for (int p = 0; p < patches.size(); ++p) {
-    PackTexture(patches[p],
-                FLAGS_texture_image_size,
-                &texture_input.indoor_polygon.GetSegment(p),
-                &texture_images,
-                &iuv,
-                &max_texture_height);
-  }
-
-  string suffix("");
-  if (FLAGS_binary_ply != "")
-    suffix = ExtractSuffix(FLAGS_binary_ply);
-  else if (FLAGS_ascii_ply != "")
-    suffix = ExtractSuffix(FLAGS_ascii_ply);
-  
-  WriteTextureImages(file_io, FLAGS_texture_image_size, texture_images, suffix);
-  {
-    ofstream ofstr;
-    ofstr.open(file_io.GetIndoorPolygonFinal(suffix).c_str());
-    ofstr << texture_input.indoor_polygon;
-    ofstr.close();
-  }
+  if (!GenerateIndoorPolygonTexture(file_io, indoor_polygon, panoramas, point_clouds, options))
+    return 1;
 
   return 0;
 }
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace structured_indoor_modeling {
+
+class Floorplan;
+class Panorama;
+
+// Settings of the thumbnails, the values generate_thumbnail_cli uses.
+struct ThumbnailOptions {
+  ThumbnailOptions();
+
+  int thumbnail_width;
+  int thumbnail_height;
+  double thumbnail_horizontal_angle;
+  // Panoramas are shrunk to this width (and half the height) before
+  // sampling.
+  int panorama_width;
+};
+
+// Writes the thumbnail of every room, and the ones of the panoramas
+// inside each room. panoramas are only read (copies are shrunk).
+void GenerateThumbnails(const std::string& data_directory,
+                        const Floorplan& floorplan,
+                        const std::vector<Panorama>& panoramas,
+                        const ThumbnailOptions& options);
+
+}  // namespace structured_indoor_modeling
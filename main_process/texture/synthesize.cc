@@ -1,6 +1,8 @@
 #include <Eigen/Sparse>
 #include <fstream>
+#include <random>
 #include "synthesize.h"
+#include "../../base/tracing.h"
 
 using namespace Eigen;
 using namespace std;
@@ -657,6 +659,8 @@ void SynthesizePoisson(const SynthesisData& synthesis_data,
                        const std::vector<Eigen::Vector2i>& patch_positions,
                        const bool vertical_constraint,
                        cv::Mat* texture) {
+  const ScopedTrace trace("SynthesizePoisson");
+  mt19937 random(synthesis_data.seed);
   // First identify the projected texture with the most area.
   const cv::Vec3b kHole(0, 0, 0);
   // Pixels that are right around the initial texture. "Value"
@@ -779,7 +783,7 @@ void SynthesizePoisson(const SynthesisData& synthesis_data,
       }
       // cerr << "Candidate: " << (int)candidates.size() << '/' << residuals.size() << endl;
       // << min_residual << ' ' << threshold;
-      const int patch_id = candidates[rand() % candidates.size()];
+      const int patch_id = candidates[random() % candidates.size()];
       // cerr << "  patch: " << patch_id << endl;
       patch_with_initial_texture = patches[patch_id];
       // overwrite with texture and initial_mask.
@@ -820,6 +824,7 @@ void SynthesizePoisson(const SynthesisData& synthesis_data,
 void SynthesizeQuilt(const SynthesisData& synthesis_data,
                      const std::vector<cv::Mat>& patches,
                      cv::Mat* floor_texture) {
+  mt19937 random(synthesis_data.seed);
   // First identify the projected texture with the most area.
   const cv::Vec3b kHole(0, 0, 0);
   InitializeTexture(synthesis_data, floor_texture);
@@ -877,7 +882,7 @@ void SynthesizeQuilt(const SynthesisData& synthesis_data,
 
     // cerr << "Candidate: " << (int)candidates.size() << '/' << residuals.size() << ' '
     // << min_residual << ' ' << threshold;
-    const int patch_id = candidates[rand() % candidates.size()];
+    const int patch_id = candidates[random() % candidates.size()];
     // cerr << "  patch: " << patch_id << endl;
     CopyPatch(synthesis_data.mask, patches[patch_id], x_range, y_range, floor_texture);
 
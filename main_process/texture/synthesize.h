@@ -10,7 +10,7 @@ namespace structured_indoor_modeling {
 struct SynthesisData {
 SynthesisData(const std::vector<cv::Mat>& projected_textures,
 	      const std::vector<double>& weights) :
-  projected_textures(projected_textures), weights(weights) {
+  projected_textures(projected_textures), weights(weights), seed(0) {
   }
   
   const std::vector<cv::Mat>& projected_textures;
@@ -21,6 +21,8 @@ SynthesisData(const std::vector<cv::Mat>& projected_textures,
   int patch_size;
   int margin;
   std::vector<bool> mask;
+  // Seed of the random patch choices (see BuildKey::GetSeed).
+  unsigned int seed;
 };
 
 void CollectCandidatePatches(const SynthesisData& synthesis_data,
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include "texture_atlas.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace structured_indoor_modeling {
+
+Vector2d AtlasPlacement::ToPageUV(const Vector2d& uv, const int page_size) const {
+  Vector2d texel(uv[0] * size[0], uv[1] * size[1]);
+  if (rotated)
+    swap(texel[0], texel[1]);
+  return (Vector2d(position[0], position[1]) + texel) / page_size;
+}
+
+TextureAtlas::TextureAtlas(const AtlasOptions& options) : options(options) {
+}
+
+int TextureAtlas::AddPatch(const Eigen::Vector2i& size, const bool rotatable) {
+  AtlasPlacement placement;
+  placement.page = -1;
+  placement.position = Vector2i(0, 0);
+  placement.size = size;
+  placement.rotated = false;
+  placements.push_back(placement);
+  rotatables.push_back(rotatable);
+  return static_cast<int>(placements.size()) - 1;
+}
+
+void TextureAtlas::Pack() {
+  skylines.clear();
+  used_texels.clear();
+
+  // Tallest first. A rotatable patch is counted by its longer side,
+  // which it can be stood on.
+  vector<pair<Vector2i, int> > order;
+  for (int p = 0; p < (int)placements.size(); ++p) {
+    const Vector2i& size = placements[p].size;
+    const int height = rotatables[p] ? max(size[0], size[1]) : size[1];
+    const int width = rotatables[p] ? min(size[0], size[1]) : size[0];
+    order.push_back(make_pair(Vector2i(height, width), p));
+  }
+  sort(order.begin(), order.end(),
+       [](const pair<Vector2i, int>& lhs, const pair<Vector2i, int>& rhs) {
+         if (lhs.first[0] != rhs.first[0])
+           return lhs.first[0] > rhs.first[0];
+         if (lhs.first[1] != rhs.first[1])
+           return lhs.first[1] > rhs.first[1];
+         return lhs.second < rhs.second;
+       });
+
+  for (const auto& item : order) {
+    const int patch = item.second;
+    bool placed = false;
+    for (int page = 0; page < GetNumPages() && !placed; ++page)
+      placed = PlaceInPage(patch, page);
+    if (!placed) {
+      skylines.push_back(Skyline(1, SkylineSegment{0, 0, options.page_size}));
+      used_texels.push_back(0);
+      if (!PlaceInPage(patch, GetNumPages() - 1)) {
+        cerr << "Patch " << patch << " (" << placements[patch].size.transpose()
+             << ") does not fit in a page of size " << options.page_size << endl;
+        exit (1);
+      }
+    }
+  }
+}
+
+double TextureAtlas::GetFillEfficiency(const int page) const {
+  return used_texels[page] / static_cast<double>(options.page_size) / options.page_size;
+}
+
+bool TextureAtlas::FindPosition(const Skyline& skyline,
+                                const int width,
+                                const int height,
+                                Eigen::Vector2i* position) const {
+  bool found = false;
+  int best_top = 0;
+  for (int s = 0; s < (int)skyline.size(); ++s) {
+    const int x = skyline[s].x;
+    if (x + width > options.page_size)
+      break;
+    // The footprint rests on the highest segment it spans.
+    int y = 0;
+    for (int t = s; t < (int)skyline.size() && skyline[t].x < x + width; ++t)
+      y = max(y, skyline[t].y);
+    if (y + height > options.page_size)
+      continue;
+    if (!found || y + height < best_top) {
+      found = true;
+      best_top = y + height;
+      *position = Vector2i(x, y);
+    }
+  }
+  return found;
+}
+
+void TextureAtlas::AddToSkyline(const Eigen::Vector2i& position,
+                                const int width,
+                                const int height,
+                                Skyline* skyline) const {
+  const int left = position[0];
+  const int right = position[0] + width;
+  Skyline updated;
+  for (const auto& segment : *skyline) {
+    const int segment_right = segment.x + segment.width;
+    // Parts of the segment outside [left, right) stay.
+    if (segment.x < left)
+      updated.push_back(SkylineSegment{segment.x, segment.y, min(segment_right, left) - segment.x});
+    if (segment.x < right && left < segment_right && segment.x <= left)
+      updated.push_back(SkylineSegment{left, position[1] + height, width});
+    if (segment_right > right) {
+      const int x = max(segment.x, right);
+      updated.push_back(SkylineSegment{x, segment.y, segment_right - x});
+    }
+  }
+  // Merge neighbors at the same height.
+  skyline->clear();
+  for (const auto& segment : updated) {
+    if (!skyline->empty() && skyline->back().y == segment.y)
+      skyline->back().width += segment.width;
+    else
+      skyline->push_back(segment);
+  }
+}
+
+bool TextureAtlas::PlaceInPage(const int patch, const int page) {
+  const Vector2i& size = placements[patch].size;
+  const int padding = options.padding;
+  Skyline& skyline = skylines[page];
+
+  Vector2i position;
+  bool found = FindPosition(skyline, size[0] + 2 * padding, size[1] + 2 * padding, &position);
+  bool rotated = false;
+  if (rotatables[patch]) {
+    Vector2i rotated_position;
+    if (FindPosition(skyline, size[1] + 2 * padding, size[0] + 2 * padding, &rotated_position) &&
+        (!found || rotated_position[1] + size[0] < position[1] + size[1])) {
+      found = true;
+      rotated = true;
+      position = rotated_position;
+    }
+  }
+  if (!found)
+    return false;
+
+  const Vector2i footprint = rotated ? Vector2i(size[1], size[0]) : size;
+  AddToSkyline(position, footprint[0] + 2 * padding, footprint[1] + 2 * padding, &skyline);
+
+  AtlasPlacement& placement = placements[patch];
+  placement.page = page;
+  placement.position = position + Vector2i(padding, padding);
+  placement.rotated = rotated;
+  used_texels[page] += static_cast<long long>(size[0]) * size[1];
+  return true;
+}
+
+void TextureAtlas::CopyTexels(const int patch,
+                              const std::vector<unsigned char>& texture,
+                              std::vector<std::vector<unsigned char> >* pages) const {
+  const int kNumChannels = 3;
+  const int page_size = options.page_size;
+  const int padding = options.padding;
+  const AtlasPlacement& placement = placements[patch];
+  while ((int)pages->size() <= placement.page)
+    pages->push_back(vector<unsigned char>(kNumChannels * page_size * page_size, 0));
+  vector<unsigned char>& page = pages->at(placement.page);
+
+  const Vector2i& size = placement.size;
+  if (size[0] <= 0 || size[1] <= 0)
+    return;
+  for (int y = -padding; y < size[1] + padding; ++y) {
+    const int ysrc = min(max(y, 0), size[1] - 1);
+    for (int x = -padding; x < size[0] + padding; ++x) {
+      const int xsrc = min(max(x, 0), size[0] - 1);
+      const int xdst = placement.position[0] + (placement.rotated ? y : x);
+      const int ydst = placement.position[1] + (placement.rotated ? x : y);
+      const int texture_index = kNumChannels * (ydst * page_size + xdst);
+      const int patch_index = kNumChannels * (ysrc * size[0] + xsrc);
+      for (int c = 0; c < kNumChannels; ++c)
+        page[texture_index + c] = texture[patch_index + c];
+    }
+  }
+}
+
+}  // namespace structured_indoor_modeling
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <vector>
+
+namespace structured_indoor_modeling {
+
+// Where a patch is stored in the texture pages.
+struct AtlasPlacement {
+  int page;
+  // Top-left texel of the patch (the padding is outside).
+  Eigen::Vector2i position;
+  // Patch size before rotation.
+  Eigen::Vector2i size;
+  // If true, the patch is transposed: texel (x, y) of the patch is
+  // stored at position + (y, x).
+  bool rotated;
+
+  // Converts a patch texture coordinate in [0, 1]^2 (x to the right, y
+  // downwards) to a page coordinate in [0, 1]^2.
+  Eigen::Vector2d ToPageUV(const Eigen::Vector2d& uv, const int page_size) const;
+};
+
+struct AtlasOptions {
+  AtlasOptions() : page_size(2048), padding(2) {}
+  // Pages are page_size x page_size.
+  int page_size;
+  // Gutter around each patch, filled by replicating the patch border
+  // so that filtering does not bleed neighbors in.
+  int padding;
+};
+
+// Packs rectangular patches into as few square pages as possible.
+// Patches are sorted by decreasing height and placed by a skyline
+// bottom-left rule, each into the first page with room. Rotatable
+// patches (e.g., long wall strips) try both orientations.
+//
+// < Example >
+//
+// TextureAtlas atlas(options);
+// for (const auto& patch : patches)
+//   atlas.AddPatch(patch.texture_size, true);
+// atlas.Pack();
+// vector<vector<unsigned char> > texture_images;
+// for (int p = 0; p < patches.size(); ++p)
+//   atlas.CopyTexels(p, patches[p].texture, &texture_images);
+class TextureAtlas {
+ public:
+  TextureAtlas(const AtlasOptions& options);
+
+  // Returns the id of the patch (ids are given in order from 0).
+  int AddPatch(const Eigen::Vector2i& size, const bool rotatable);
+  void Pack();
+
+  const AtlasPlacement& GetPlacement(const int patch) const { return placements[patch]; }
+  int GetNumPages() const { return static_cast<int>(skylines.size()); }
+  int GetPageSize() const { return options.page_size; }
+  // Ratio of patch texels (padding excluded) to page texels.
+  double GetFillEfficiency(const int page) const;
+
+  // Copies the texture of a patch (3 channels, row major) and its
+  // padding to the pages (3 * page_size * page_size bytes each), which
+  // are allocated as needed.
+  void CopyTexels(const int patch,
+                  const std::vector<unsigned char>& texture,
+                  std::vector<std::vector<unsigned char> >* pages) const;
+
+ private:
+  // Horizontal segment of a page outline: [x, x + width) is filled up
+  // to y.
+  struct SkylineSegment {
+    int x;
+    int y;
+    int width;
+  };
+  typedef std::vector<SkylineSegment> Skyline;
+
+  // Lowest top-left position for a width x height footprint, or false.
+  bool FindPosition(const Skyline& skyline,
+                    const int width,
+                    const int height,
+                    Eigen::Vector2i* position) const;
+  void AddToSkyline(const Eigen::Vector2i& position,
+                    const int width,
+                    const int height,
+                    Skyline* skyline) const;
+  bool PlaceInPage(const int patch, const int page);
+
+  AtlasOptions options;
+  std::vector<AtlasPlacement> placements;
+  std::vector<bool> rotatables;
+  std::vector<Skyline> skylines;
+  std::vector<long long> used_texels;
+};
+
+}  // namespace structured_indoor_modeling
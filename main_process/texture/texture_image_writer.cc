@@ -0,0 +1,146 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+
+#include "../../base/parallel.h"
+#include "../../base/texture_compression.h"
+#include "texture_image_writer.h"
+
+using namespace std;
+
+namespace structured_indoor_modeling {
+
+namespace {
+
+bool HasExtension(const string& filename, const string& extension) {
+  return filename.size() >= extension.size() &&
+    filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+long long FileSize(const string& filename) {
+  ifstream ifstr(filename.c_str(), ios::binary | ios::ate);
+  return ifstr.is_open() ? static_cast<long long>(ifstr.tellg()) : 0;
+}
+
+}  // namespace
+
+TextureImageWriter::TextureImageWriter(const TextureImageWriterOptions& options)
+  : options(options), num_running(0), stop(false) {
+  const int num_workers = GetNumThreads(options.num_threads);
+  for (int w = 0; w < num_workers; ++w)
+    workers.push_back(thread(&TextureImageWriter::RunWorker, this));
+}
+
+TextureImageWriter::~TextureImageWriter() {
+  Wait();
+  {
+    unique_lock<mutex> lock(queue_mutex);
+    stop = true;
+  }
+  job_available.notify_all();
+  for (auto& worker : workers)
+    worker.join();
+}
+
+void TextureImageWriter::Write(const std::string& filename,
+                               const std::vector<unsigned char>& image,
+                               const int width,
+                               const int height) {
+  Job job;
+  job.filename = filename;
+  job.image = &image;
+  job.width = width;
+  job.height = height;
+  {
+    unique_lock<mutex> lock(queue_mutex);
+    jobs.push_back(job);
+  }
+  job_available.notify_one();
+}
+
+bool TextureImageWriter::Wait() {
+  vector<Result> finished;
+  {
+    unique_lock<mutex> lock(queue_mutex);
+    job_done.wait(lock, [this]() { return jobs.empty() && num_running == 0; });
+    finished.swap(results);
+  }
+
+  bool success = true;
+  for (const auto& result : finished) {
+    if (!result.success) {
+      cerr << "Failed to write " << result.filename << endl;
+      success = false;
+      continue;
+    }
+    cout << result.filename << ": " << result.bytes << " bytes, "
+         << result.seconds << " sec" << endl;
+  }
+  return success;
+}
+
+void TextureImageWriter::RunWorker() {
+  while (true) {
+    Job job;
+    {
+      unique_lock<mutex> lock(queue_mutex);
+      job_available.wait(lock, [this]() { return stop || !jobs.empty(); });
+      if (jobs.empty())
+        return;
+      job = jobs.front();
+      jobs.pop_front();
+      ++num_running;
+    }
+
+    const Result result = Encode(job);
+
+    {
+      unique_lock<mutex> lock(queue_mutex);
+      results.push_back(result);
+      --num_running;
+    }
+    job_done.notify_all();
+  }
+}
+
+TextureImageWriter::Result TextureImageWriter::Encode(const Job& job) const {
+  const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  Result result;
+  result.filename = job.filename;
+  result.bytes = 0;
+
+  if (HasExtension(job.filename, ".dds")) {
+    // One page at a time per worker: the pool already keeps cores busy.
+    CompressedImage compressed_image;
+    CompressTextureImage(*job.image, job.width, job.height, &compressed_image, 1);
+    result.success = WriteDDS(job.filename, compressed_image);
+    result.bytes = FileSize(job.filename);
+  } else {
+    const cv::Mat image(job.height, job.width, CV_8UC3,
+                        const_cast<unsigned char*>(&job.image->at(0)));
+    vector<int> params;
+    if (HasExtension(job.filename, ".png")) {
+      params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+      params.push_back(options.png_compression);
+    } else if (HasExtension(job.filename, ".jpg") || HasExtension(job.filename, ".jpeg")) {
+      params.push_back(cv::IMWRITE_JPEG_QUALITY);
+      params.push_back(options.jpeg_quality);
+    }
+    const size_t dot = job.filename.find_last_of('.');
+    const string extension = (dot == string::npos) ? ".png" : job.filename.substr(dot);
+    vector<unsigned char> buffer;
+    result.success = cv::imencode(extension, image, buffer, params);
+    if (result.success) {
+      ofstream ofstr(job.filename.c_str(), ios::binary);
+      ofstr.write(reinterpret_cast<const char*>(&buffer[0]), buffer.size());
+      result.success = static_cast<bool>(ofstr);
+      result.bytes = buffer.size();
+    }
+  }
+
+  result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+}  // namespace structured_indoor_modeling
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace structured_indoor_modeling {
+
+struct TextureImageWriterOptions {
+  TextureImageWriterOptions() : png_compression(3), jpeg_quality(95), num_threads(0) {}
+  // 0 (fast, large) to 9 (slow, small). Used for .png files.
+  int png_compression;
+  // 0 to 100. Used for .jpg files.
+  int jpeg_quality;
+  // Encoding workers (all cores if <= 0).
+  int num_threads;
+};
+
+// Encodes and writes texture images on a pool of workers, so that the
+// caller can go on while pages are compressed. The image format comes
+// from the file extension (cv::imencode), and ".dds" writes a BC1
+// mipmapped image (see base/texture_compression.h).
+//
+// Images are wrapped without copies: a buffer passed to Write() must
+// stay alive and unchanged until Wait() returns.
+//
+// < Example >
+//
+// TextureImageWriter writer(options);
+// for (int t = 0; t < texture_images.size(); ++t)
+//   writer.Write(file_io.GetTextureImage(t), texture_images[t], size, size);
+// ...  // Other work.
+// writer.Wait();
+class TextureImageWriter {
+ public:
+  TextureImageWriter(const TextureImageWriterOptions& options);
+  // Waits for the pending images.
+  ~TextureImageWriter();
+
+  // image is 3 channel, row major, BGR (the texture image layout).
+  void Write(const std::string& filename,
+             const std::vector<unsigned char>& image,
+             const int width,
+             const int height);
+
+  // Blocks until all queued images are written, and prints the bytes
+  // and the encoding time of each. Returns false if any write failed.
+  bool Wait();
+
+ private:
+  struct Job {
+    std::string filename;
+    const std::vector<unsigned char>* image;
+    int width;
+    int height;
+  };
+  struct Result {
+    std::string filename;
+    long long bytes;
+    double seconds;
+    bool success;
+  };
+
+  void RunWorker();
+  Result Encode(const Job& job) const;
+
+  const TextureImageWriterOptions options;
+  std::vector<std::thread> workers;
+
+  std::mutex queue_mutex;
+  std::condition_variable job_available;
+  std::condition_variable job_done;
+  std::deque<Job> jobs;
+  int num_running;
+  bool stop;
+  std::vector<Result> results;
+};
+
+}  // namespace structured_indoor_modeling
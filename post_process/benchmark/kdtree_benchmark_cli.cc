@@ -0,0 +1,193 @@
+/*
+  Times KDtree on the per-panorama (room sized) point clouds of a
+  dataset. For each cloud, the original KDtree (vendored unchanged in
+  legacy_kdtree/, namespace legacy_kdtree) answers one kNN query per
+  point through its pointer API, as the segmentation code used to do,
+  and the current KDtree answers the same queries through the pointer
+  wrapper and the batch index queries. Both trees run in this binary
+  on the same data.
+
+  mismatches counts the kNN results of the batch queries whose distance
+  differs from the original tree's at the same rank (equidistant
+  points returned in another order, or another one of them at the k-th
+  rank, are ties, not mismatches). The tool fails if any differ.
+
+  < Example >
+  ./kdtree_benchmark_cli ~/data/office0 --num_neighbors=20 --num_threads=8
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "../../base/file_io.h"
+#include "../../base/kdtree/KDtree.h"
+#include "../../base/point_cloud.h"
+#include "legacy_kdtree/KDtree.h"
+
+#ifdef _WIN32
+#pragma comment (lib, "gflags.lib")
+#pragma comment (lib, "Shlwapi.lib")
+#endif
+
+DEFINE_int32(num_neighbors, 20, "k for the kNN queries.");
+DEFINE_double(radius, 0.05, "Radius (in point cloud units) for the radius queries.");
+DEFINE_int32(num_threads, 0, "Workers for the batch queries (0: all cores).");
+
+using namespace std;
+using namespace structured_indoor_modeling;
+
+namespace {
+
+double Seconds(const chrono::steady_clock::time_point& start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// The original tree ranks by float (not squared) distances, so points
+// a rounding step apart are ties to it.
+const float kDistanceTolerance = 1e-6f;
+
+// Distance between points lhs and rhs (index -1 is a missing result).
+float Distance(const vector<float>& point_data, const int lhs, const int rhs) {
+  if (lhs == -1)
+    return numeric_limits<float>::max();
+  float distance2 = 0.0f;
+  for (int i = 0; i < 3; ++i) {
+    const float diff = point_data[3 * lhs + i] - point_data[3 * rhs + i];
+    distance2 += diff * diff;
+  }
+  return sqrt(distance2);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0] << " data_directory" << endl;
+    return 1;
+  }
+#ifdef __APPLE__
+  google::ParseCommandLineFlags(&argc, &argv, true);
+#else
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+#endif
+
+  FileIO file_io(argv[1]);
+  const int num_panoramas = GetNumPanoramas(file_io);
+  const int k = FLAGS_num_neighbors;
+
+  cout << "panorama points legacy_build build legacy_knn wrapper_knn batch_knn_1 batch_knn_n radius_n mismatches" << endl;
+  double total_legacy = 0.0;
+  double total_wrapper = 0.0;
+  double total_batch_single = 0.0;
+  double total_batch = 0.0;
+  int total_mismatches = 0;
+  for (int panorama = 0; panorama < num_panoramas; ++panorama) {
+    PointCloud point_cloud;
+    if (!point_cloud.Init(file_io, panorama) || point_cloud.isempty())
+      continue;
+
+    vector<float> point_data;
+    point_data.reserve(3 * point_cloud.GetNumPoints());
+    for (int p = 0; p < point_cloud.GetNumPoints(); ++p) {
+      for (int i = 0; i < 3; ++i)
+        point_data.push_back(point_cloud.GetPoint(p).position[i]);
+    }
+    const int num_points = point_cloud.GetNumPoints();
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    legacy_kdtree::KDtree original_kdtree(point_data);
+    const double legacy_build_time = Seconds(start);
+
+    start = chrono::steady_clock::now();
+    KDtree kdtree(point_data);
+    const double build_time = Seconds(start);
+
+    // Per-query pointer API: one vector per query and pointer arithmetic.
+    start = chrono::steady_clock::now();
+    vector<int> legacy_indices(num_points * k, -1);
+    for (int p = 0; p < num_points; ++p) {
+      vector<const float*> knn;
+      original_kdtree.find_k_closest_to_pt(knn, k, &point_data[3 * p]);
+      for (int i = 0; i < (int)knn.size(); ++i)
+        legacy_indices[p * k + i] = (knn[i] - &point_data[0]) / 3;
+    }
+    const double legacy_time = Seconds(start);
+
+    start = chrono::steady_clock::now();
+    vector<int> wrapper_indices(num_points * k, -1);
+    for (int p = 0; p < num_points; ++p) {
+      vector<const float*> knn;
+      kdtree.find_k_closest_to_pt(knn, k, &point_data[3 * p]);
+      for (int i = 0; i < (int)knn.size(); ++i)
+        wrapper_indices[p * k + i] = (knn[i] - &point_data[0]) / 3;
+    }
+    const double wrapper_time = Seconds(start);
+
+    vector<int> indices;
+    vector<float> dist2s;
+    start = chrono::steady_clock::now();
+    kdtree.find_k_closest_batch(&point_data[0], num_points, k, indices, dist2s, 0.0f, 1);
+    const double batch_single_time = Seconds(start);
+
+    start = chrono::steady_clock::now();
+    kdtree.find_k_closest_batch(&point_data[0], num_points, k, indices, dist2s, 0.0f,
+                                FLAGS_num_threads);
+    const double batch_time = Seconds(start);
+
+    vector<int> offsets;
+    vector<int> radius_indices;
+    vector<float> radius_dist2s;
+    start = chrono::steady_clock::now();
+    kdtree.find_within_radius_batch(&point_data[0], num_points, FLAGS_radius * FLAGS_radius,
+                                    offsets, radius_indices, radius_dist2s,
+                                    FLAGS_num_threads);
+    const double radius_time = Seconds(start);
+
+    // Compare the sorted distances, not the indices: equidistant points
+    // may be returned in either order, or either one at the k-th slot.
+    int mismatches = 0;
+    vector<float> legacy_distances(k), distances(k);
+    for (int p = 0; p < num_points; ++p) {
+      for (int i = 0; i < k; ++i) {
+        legacy_distances[i] = Distance(point_data, legacy_indices[p * k + i], p);
+        distances[i] = Distance(point_data, indices[p * k + i], p);
+      }
+      sort(legacy_distances.begin(), legacy_distances.end());
+      sort(distances.begin(), distances.end());
+      for (int i = 0; i < k; ++i) {
+        if (fabs(legacy_distances[i] - distances[i]) >
+            kDistanceTolerance * max(legacy_distances[i], distances[i]))
+          ++mismatches;
+      }
+    }
+
+    total_legacy += legacy_time;
+    total_wrapper += wrapper_time;
+    total_batch_single += batch_single_time;
+    total_batch += batch_time;
+    total_mismatches += mismatches;
+    cout << setw(3) << panorama << ' ' << num_points << ' '
+         << legacy_build_time << ' ' << build_time << ' '
+         << legacy_time << ' ' << wrapper_time << ' ' << batch_single_time << ' '
+         << batch_time << ' ' << radius_time << ' ' << mismatches << endl;
+  }
+  if (total_batch > 0.0) {
+    cout << "kNN speed-up over the original KDtree: "
+         << total_legacy / total_wrapper << " (pointer API), "
+         << total_legacy / total_batch_single << " (batch, 1 thread), "
+         << total_legacy / total_batch << " (batch)" << endl;
+  }
+  if (total_mismatches != 0) {
+    cerr << total_mismatches << " kNN results differ from the original KDtree." << endl;
+    return 1;
+  }
+
+  return 0;
+}
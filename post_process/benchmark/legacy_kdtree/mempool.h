@@ -1,5 +1,5 @@
-#ifndef MEMPOOL_H
-#define MEMPOOL_H
+#ifndef LEGACY_MEMPOOL_H
+#define LEGACY_MEMPOOL_H
 /*
 Szymon Rusinkiewicz
 Princeton University
@@ -30,6 +30,8 @@ Based on the description of the Pool class in _Effective C++_ by Scott Meyers.
 #define POOL_MEMBLOCK 4088
 
 
+namespace legacy_kdtree {
+
 class PoolAlloc {
 private:
 	size_t itemsize;
@@ -85,4 +87,6 @@ public:
 	}
 };
 
+} // namespace legacy_kdtree
+
 #endif
@@ -0,0 +1,230 @@
+/*
+  Times the sparse solvers on the two Laplacian systems the pipeline
+  solves: depth hole filling (object_refinement/depth_filling.cpp,
+  Dirichlet Laplacian over the hole) and Poisson blending of floor
+  textures (texture/synthesize.cc, masked Laplacian plus data terms).
+  Systems are assembled with the same stencils and weights as the
+  pipeline on synthetic images of the given sizes.
+
+  Eigen's Cholesky (what the texture code uses) gives the reference
+  solution. The numeric solvers read the very same matrices through
+  the zero-copy adapters in base/numeric/sparseMatEigen.h.
+
+  < Example >
+  ./sparse_solver_benchmark_cli --depth_width=1024 --texture_size=1024 --num_threads=8
+*/
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Eigen/Sparse>
+#include <gflags/gflags.h>
+
+#include "../../base/numeric/sparseMat.h"
+#include "../../base/numeric/cooMat.h"
+#include "../../base/numeric/sparseMatEigen.h"
+
+#ifdef _WIN32
+#pragma comment (lib, "gflags.lib")
+#pragma comment (lib, "Shlwapi.lib")
+#endif
+
+DEFINE_int32(depth_width, 1024, "Depth map width (height is half) for the depth filling system.");
+DEFINE_double(hole_ratio, 0.3, "Fraction of the depth map covered by the hole.");
+DEFINE_int32(texture_size, 1024, "Texture size for the Poisson blending system.");
+DEFINE_double(data_ratio, 0.1, "Fraction of texture pixels with a data term.");
+DEFINE_double(rtol, 1e-6, "Relative residual for the iterative solvers.");
+DEFINE_int32(max_iterations, 5000, "Iteration limit of the iterative solvers.");
+DEFINE_int32(num_threads, 0, "Workers for the parallel runs (0: all cores).");
+
+using namespace Eigen;
+using namespace std;
+
+namespace {
+
+typedef Eigen::SparseMatrix<double> EigenMatrix;
+
+double Seconds(const chrono::steady_clock::time_point& start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Depth filling: unknowns inside an elliptic hole, known depths (a
+// smooth wall plus noise) outside. Same stencil as DepthFilling.
+void BuildDepthFillingSystem(const int width, const int height, const double hole_ratio,
+                             CsparseMat<double>* A, vector<double>* b) {
+  mt19937 generator(0);
+  normal_distribution<double> noise(0.0, 5.0);
+  vector<double> depthmap(width * height);
+  vector<int> variable(width * height, -1);
+  int num_variables = 0;
+  const double radius = sqrt(hole_ratio / M_PI);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const double dx = (x - width / 2.0) / width;
+      const double dy = (y - height / 2.0) / height;
+      const int index = y * width + x;
+      if (dx * dx + dy * dy < radius * radius)
+        variable[index] = num_variables++;
+      else
+        depthmap[index] = 3000.0 + 500.0 * sin(x * 0.01) + 300.0 * cos(y * 0.02) + noise(generator);
+    }
+  }
+
+  CcooMat<double> coo(num_variables, num_variables);
+  b->assign(num_variables, 0.0);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const int i = variable[y * width + x];
+      if (i == -1)
+        continue;
+      const int neighbors[4][2] = {{x - 1, y}, {x + 1, y}, {x, y - 1}, {x, y + 1}};
+      int count = 0;
+      for (int n = 0; n < 4; ++n) {
+        const int nx = neighbors[n][0];
+        const int ny = neighbors[n][1];
+        if (nx < 0 || nx >= width || ny < 0 || ny >= height)
+          continue;
+        ++count;
+        const int j = variable[ny * width + nx];
+        if (j != -1)
+          coo.set(i, j, -1.0, 1);
+        else
+          b->at(i) += depthmap[ny * width + nx];
+      }
+      coo.set(i, i, count, 1);
+    }
+  }
+  coo2csr(coo, *A);
+}
+
+// Poisson blending: every pixel is a variable, Laplacian constraints
+// with the average Laplacian as target, and a data term of weight 2
+// where a single texture observes the pixel. Same assembly as
+// PoissonBlendSubNew (column major Eigen matrix from triplets).
+void BuildPoissonBlendSystem(const int size, const double data_ratio,
+                             EigenMatrix* A, VectorXd* b) {
+  mt19937 generator(1);
+  uniform_real_distribution<double> uniform(0.0, 1.0);
+  normal_distribution<double> laplacian(0.0, 4.0);
+  const int num_variables = size * size;
+  vector<Triplet<double> > triplets;
+  *b = VectorXd(num_variables);
+  for (int y = 0; y < size; ++y) {
+    for (int x = 0; x < size; ++x) {
+      const int i = y * size + x;
+      int count = 0;
+      const int neighbors[4][2] = {{x - 1, y}, {x + 1, y}, {x, y - 1}, {x, y + 1}};
+      for (int n = 0; n < 4; ++n) {
+        const int nx = neighbors[n][0];
+        const int ny = neighbors[n][1];
+        if (nx < 0 || nx >= size || ny < 0 || ny >= size)
+          continue;
+        triplets.push_back(Triplet<double>(i, ny * size + nx, -1));
+        ++count;
+      }
+      triplets.push_back(Triplet<double>(i, i, count));
+      (*b)[i] = laplacian(generator);
+    }
+  }
+  const double kDataWeight = 2.0;
+  for (int i = 0; i < num_variables; ++i) {
+    if (uniform(generator) < data_ratio) {
+      triplets.push_back(Triplet<double>(i, i, kDataWeight));
+      (*b)[i] += kDataWeight * 255.0 * uniform(generator);
+    }
+  }
+  *A = EigenMatrix(num_variables, num_variables);
+  A->setFromTriplets(triplets.begin(), triplets.end());
+}
+
+double RelativeResidual(const CcsrView<double>& A, const VectorXd& b, const VectorXd& x) {
+  VectorXd ax(b.size());
+  spmv(A, x.data(), ax.data());
+  return (b - ax).norm() / b.norm();
+}
+
+void Report(const string& system, const string& solver, const int threads,
+            const int iterations, const double seconds,
+            const CcsrView<double>& A, const VectorXd& b,
+            const VectorXd& x, const VectorXd& reference) {
+  cout << setw(14) << system << setw(16) << solver << setw(8) << threads
+       << setw(8) << iterations << setw(10) << fixed << setprecision(3) << seconds
+       << setw(12) << scientific << setprecision(2) << RelativeResidual(A, b, x)
+       << setw(12) << (x - reference).lpNorm<Infinity>() << endl;
+}
+
+// Runs every solver on A x = b. A is viewed, never copied.
+void RunSolvers(const string& system, const CcsrView<double>& view, const EigenMatrix& A,
+                const VectorXd& b) {
+  cout << system << ": " << view.m_row << " unknowns, "
+       << view.m_rowind[view.m_row] << " nonzeros" << endl;
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  SimplicialCholesky<EigenMatrix> chol(A);
+  const VectorXd reference = chol.solve(b);
+  Report(system, "eigen_cholesky", 1, 0, Seconds(start), view, b, reference, reference);
+
+  {
+    start = chrono::steady_clock::now();
+    ConjugateGradient<EigenMatrix, Lower | Upper> cg;
+    cg.setTolerance(FLAGS_rtol);
+    cg.setMaxIterations(FLAGS_max_iterations);
+    cg.compute(A);
+    const VectorXd x = cg.solve(b);
+    Report(system, "eigen_cg", 1, cg.iterations(), Seconds(start), view, b, x, reference);
+  }
+
+  CsolverWorkspace<double> workspace;
+  const int num_threads = structured_indoor_modeling::GetNumThreads(FLAGS_num_threads);
+  vector<int> thread_counts(1, 1);
+  if (num_threads > 1)
+    thread_counts.push_back(num_threads);
+  for (const int threads : thread_counts) {
+    VectorXd x = VectorXd::Zero(b.size());
+    start = chrono::steady_clock::now();
+    int iterations = CG(view, b.data(), x.data(), FLAGS_rtol, FLAGS_max_iterations, workspace, threads);
+    Report(system, "numeric_cg", threads, iterations, Seconds(start), view, b, x, reference);
+
+    x.setZero();
+    start = chrono::steady_clock::now();
+    iterations = PCG(view, b.data(), x.data(), FLAGS_rtol, FLAGS_max_iterations, workspace, threads);
+    Report(system, "numeric_pcg", threads, iterations, Seconds(start), view, b, x, reference);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+#ifdef __APPLE__
+  google::ParseCommandLineFlags(&argc, &argv, true);
+#else
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+#endif
+
+  cout << setw(14) << "system" << setw(16) << "solver" << setw(8) << "threads"
+       << setw(8) << "iters" << setw(10) << "sec" << setw(12) << "residual"
+       << setw(12) << "max_diff" << endl;
+  {
+    // CsparseMat -> Eigen: toEigen() maps the CSR arrays in place. The
+    // Cholesky reference wants column major, so Eigen converts once.
+    CsparseMat<double> A;
+    vector<double> b;
+    BuildDepthFillingSystem(FLAGS_depth_width, FLAGS_depth_width / 2, FLAGS_hole_ratio, &A, &b);
+    const EigenMatrix eigen_matrix = toEigen(A);
+    RunSolvers("depth_filling", A.view(), eigen_matrix,
+               Map<const VectorXd>(b.data(), b.size()));
+  }
+  {
+    // Eigen -> numeric: the column major matrix is viewed as CSR.
+    EigenMatrix A;
+    VectorXd b;
+    BuildPoissonBlendSystem(FLAGS_texture_size, FLAGS_data_ratio, &A, &b);
+    RunSolvers("poisson_blend", makeCsrViewOfTranspose(A), A, b);
+  }
+  return 0;
+}
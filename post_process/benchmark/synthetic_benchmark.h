@@ -0,0 +1,21 @@
+#ifndef SYNTHETIC_BENCHMARK_H_
+#define SYNTHETIC_BENCHMARK_H_
+
+#include <vector>
+
+namespace structured_indoor_modeling {
+
+class Floorplan;
+class IndoorPolygon;
+class PointCloud;
+
+// The per-room steps of object_segmentation_cli, without the writes.
+// Returns the number of points in the rooms. In its own file, because
+// object_segmentation.h and evaluate.h both define kFloor.
+long long SegmentRooms(const Floorplan& floorplan,
+                       const IndoorPolygon& indoor_polygon,
+                       const std::vector<PointCloud>& point_clouds);
+
+}  // namespace structured_indoor_modeling
+
+#endif  // SYNTHETIC_BENCHMARK_H_
@@ -0,0 +1,379 @@
+/*
+  Generates a synthetic house (post_process/synthetic/synthetic_scene.h)
+  in data_directory and times the hot paths of the pipeline on it, so
+  that the numbers do not depend on a private dataset. The same flags
+  always give the same house, and a sweep over --num_rooms or
+  --depth_width gives the scaling curves. data_directory must be
+  missing or empty (a fresh one per house), unless --reuse_house runs
+  on a house generated before.
+
+  Micro benchmarks: load_ply, load_panorama, project_get_rgb,
+  kdtree_build, kdtree_knn. Macro benchmarks: generate_house,
+  segmentation (the per-room steps of object_segmentation_cli without
+  the writes), poisson_synthesis (a floor texture hole filled by
+  SynthesizePoisson), evaluation_rasterization (floorplan and indoor
+  polygon depth maps of all the panoramas).
+
+  Each benchmark runs --repetitions times. The results are written as
+  JSON to --output (stdout if empty):
+  { "parameters": { ... },
+    "benchmarks": [ { "name": ..., "repetitions": ..., "items": ...,
+                      "min_seconds": ..., "mean_seconds": ...,
+                      "items_per_second": ... }, ... ] }
+  items_per_second uses min_seconds.
+
+  < Example >
+  ./synthetic_benchmark_cli /tmp/house16 --num_rooms=16 --depth_width=1024 --output=rooms16.json
+  ./synthetic_benchmark_cli /tmp/house16 --reuse_house --benchmarks=kdtree_knn,segmentation
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <opencv2/opencv.hpp>
+
+#include "../../base/file_io.h"
+#include "../../base/floorplan.h"
+#include "../../base/indoor_polygon.h"
+#include "../../base/kdtree/KDtree.h"
+#include "../../base/panorama.h"
+#include "../../base/point_cloud.h"
+#include "../../base/tracing_flags.h"
+#include "../../main_process/texture/synthesize.h"
+#include "../evaluation/evaluate.h"
+#include "../synthetic/synthetic_scene.h"
+#include "synthetic_benchmark.h"
+
+#ifdef _WIN32
+#pragma comment (lib, "gflags.lib")
+#pragma comment (lib, "Shlwapi.lib")
+#endif
+
+DEFINE_int32(num_rooms, 4, "Rooms of the synthetic house.");
+DEFINE_int32(panoramas_per_room, 2, "Panoramas in each room.");
+DEFINE_int32(objects_per_room, 3, "Box objects in each room.");
+DEFINE_int32(depth_width, 512, "Width of the depth panoramas (points per row of the local plys).");
+DEFINE_int32(image_width, 1024, "Width of the panorama images.");
+DEFINE_double(point_ratio, 1.0, "Ratio of the depth pixels kept in the local plys.");
+DEFINE_int32(seed, 0, "Seed of the synthetic house.");
+DEFINE_bool(reuse_house, false, "Do not generate the house, use the one in data_directory.");
+DEFINE_string(benchmarks, "", "Comma separated benchmarks to run (all if empty).");
+DEFINE_int32(repetitions, 3, "Runs of each benchmark.");
+DEFINE_int32(num_neighbors, 20, "k for kdtree_knn.");
+DEFINE_int32(num_threads, 0, "Workers for kdtree_knn (0: all cores).");
+DEFINE_int32(texture_size, 256, "Side of the poisson_synthesis texture.");
+DEFINE_string(output, "", "JSON output file (stdout if empty).");
+
+using namespace Eigen;
+using namespace std;
+using namespace structured_indoor_modeling;
+
+namespace {
+
+double Seconds(const chrono::steady_clock::time_point& start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+struct BenchmarkResult {
+  string name;
+  int repetitions;
+  long long items;
+  double min_seconds;
+  double mean_seconds;
+};
+
+// Runs the selected benchmarks. A benchmark returns the number of
+// items it processed (points, pixels, ...).
+class BenchmarkRunner {
+ public:
+  BenchmarkRunner(const string& names, const int repetitions)
+    : repetitions(max(1, repetitions)) {
+    stringstream sstr(names);
+    string name;
+    while (getline(sstr, name, ',')) {
+      if (!name.empty())
+        selected.insert(name);
+    }
+  }
+
+  bool IsSelected(const string& name) const {
+    return selected.empty() || selected.find(name) != selected.end();
+  }
+
+  void Run(const string& name, const function<long long()>& benchmark) {
+    RunRepeated(name, repetitions, benchmark);
+  }
+
+  void RunRepeated(const string& name, const int times, const function<long long()>& benchmark) {
+    if (!IsSelected(name))
+      return;
+    cerr << name << flush;
+    BenchmarkResult result;
+    result.name = name;
+    result.repetitions = times;
+    result.items = 0;
+    result.min_seconds = numeric_limits<double>::max();
+    double total_seconds = 0.0;
+    for (int r = 0; r < times; ++r) {
+      const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      result.items = benchmark();
+      const double seconds = Seconds(start);
+      result.min_seconds = min(result.min_seconds, seconds);
+      total_seconds += seconds;
+      cerr << ' ' << seconds << flush;
+    }
+    cerr << endl;
+    result.mean_seconds = total_seconds / times;
+    results.push_back(result);
+  }
+
+  const vector<BenchmarkResult>& GetResults() const { return results; }
+
+ private:
+  const int repetitions;
+  set<string> selected;
+  vector<BenchmarkResult> results;
+};
+
+void WriteJson(const vector<BenchmarkResult>& results, ostream& ostr) {
+  ostr << setprecision(9);
+  ostr << "{" << endl
+       << "  \"parameters\": {" << endl
+       << "    \"num_rooms\": " << FLAGS_num_rooms << "," << endl
+       << "    \"panoramas_per_room\": " << FLAGS_panoramas_per_room << "," << endl
+       << "    \"objects_per_room\": " << FLAGS_objects_per_room << "," << endl
+       << "    \"depth_width\": " << FLAGS_depth_width << "," << endl
+       << "    \"image_width\": " << FLAGS_image_width << "," << endl
+       << "    \"point_ratio\": " << FLAGS_point_ratio << "," << endl
+       << "    \"seed\": " << FLAGS_seed << "," << endl
+       << "    \"num_neighbors\": " << FLAGS_num_neighbors << "," << endl
+       << "    \"num_threads\": " << FLAGS_num_threads << "," << endl
+       << "    \"texture_size\": " << FLAGS_texture_size << endl
+       << "  }," << endl
+       << "  \"benchmarks\": [" << endl;
+  for (int i = 0; i < (int)results.size(); ++i) {
+    const BenchmarkResult& result = results[i];
+    ostr << "    { \"name\": \"" << result.name << "\""
+         << ", \"repetitions\": " << result.repetitions
+         << ", \"items\": " << result.items
+         << ", \"min_seconds\": " << result.min_seconds
+         << ", \"mean_seconds\": " << result.mean_seconds
+         << ", \"items_per_second\": "
+         << (result.min_seconds > 0.0 ? result.items / result.min_seconds : 0.0)
+         << " }" << (i + 1 < (int)results.size() ? "," : "") << endl;
+  }
+  ostr << "  ]" << endl
+       << "}" << endl;
+}
+
+// Global point clouds, as in object_segmentation_cli (the floorplan is
+// axis aligned, so no window and mirror removal).
+void ReadGlobalPointClouds(const FileIO& file_io,
+                           const int num_panoramas,
+                           const Floorplan& floorplan,
+                           vector<PointCloud>* point_clouds) {
+  point_clouds->resize(num_panoramas);
+  const Matrix3d global_to_floorplan = floorplan.GetFloorplanToGlobal().transpose();
+  for (int p = 0; p < num_panoramas; ++p) {
+    if (!point_clouds->at(p).Init(file_io, p)) {
+      cerr << "Cannot open a file: " << file_io.GetLocalPly(p) << endl;
+      exit (1);
+    }
+    point_clouds->at(p).ToGlobal(file_io, p);
+    point_clouds->at(p).Rotate(global_to_floorplan);
+  }
+}
+
+// Fills the center of a crop of the panorama image from the patches
+// around it, as the floor textures are.
+long long SynthesizeHole(const Panorama& panorama, const int texture_size) {
+  const int size = min(texture_size, min(panorama.Width(), panorama.Height()));
+  const cv::Mat crop =
+    panorama.GetRGBImage()(cv::Rect((panorama.Width() - size) / 2,
+                                     (panorama.Height() - size) / 2,
+                                     size, size)).clone();
+  vector<cv::Mat> projected_textures(1, crop);
+  vector<double> weights(1, 1.0);
+  SynthesisData synthesis_data(projected_textures, weights);
+  synthesis_data.num_cg_iterations = 50;
+  synthesis_data.texture_size = Vector2i(size, size);
+  synthesis_data.patch_size = max(6, size / 8);
+  synthesis_data.margin = max(1, synthesis_data.patch_size / 6);
+  synthesis_data.mask.resize(size * size, false);
+  for (int y = size / 4; y < size * 3 / 4; ++y)
+    for (int x = size / 4; x < size * 3 / 4; ++x)
+      synthesis_data.mask[y * size + x] = true;
+
+  vector<cv::Mat> patches;
+  vector<Vector2i> patch_positions;
+  CollectCandidatePatches(synthesis_data, &patches, &patch_positions);
+  if (patches.empty())
+    return 0;
+  cv::Mat texture = crop.clone();
+  const bool kNoVerticalConstraint = false;
+  SynthesizePoisson(synthesis_data, patches, patch_positions, kNoVerticalConstraint, &texture);
+  return static_cast<long long>(size) * size;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0] << " data_directory" << endl;
+    return 1;
+  }
+#ifdef __APPLE__
+  google::ParseCommandLineFlags(&argc, &argv, true);
+#else
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+#endif
+  InitTracingFromFlags();
+
+  FileIO file_io(argv[1]);
+  BenchmarkRunner runner(FLAGS_benchmarks, FLAGS_repetitions);
+
+  if (!FLAGS_reuse_house) {
+    SyntheticHouseOptions options;
+    options.num_rooms = FLAGS_num_rooms;
+    options.panoramas_per_room = FLAGS_panoramas_per_room;
+    options.objects_per_room = FLAGS_objects_per_room;
+    options.depth_width = FLAGS_depth_width;
+    options.image_width = FLAGS_image_width;
+    options.point_ratio = FLAGS_point_ratio;
+    options.seed = FLAGS_seed;
+    // Generated once, whatever is selected: the others need the files.
+    const bool selected = runner.IsSelected("generate_house");
+    if (selected) {
+      runner.RunRepeated("generate_house", 1, [&file_io, &options]() {
+          return WriteSyntheticHouse(file_io, options);
+        });
+    } else {
+      WriteSyntheticHouse(file_io, options);
+    }
+  }
+
+  const int num_panoramas = GetNumPanoramas(file_io);
+  if (num_panoramas == 0) {
+    cerr << "No panoramas in " << argv[1] << endl;
+    return 1;
+  }
+  const Floorplan floorplan(file_io.GetFloorplan());
+  const IndoorPolygon indoor_polygon(file_io.GetIndoorPolygon());
+
+  // Inputs of the other benchmarks, loaded once.
+  vector<PointCloud> point_clouds;
+  ReadGlobalPointClouds(file_io, num_panoramas, floorplan, &point_clouds);
+  vector<Panorama> panoramas(num_panoramas);
+  for (int p = 0; p < num_panoramas; ++p) {
+    if (!panoramas[p].Init(file_io, p))
+      exit (1);
+  }
+  vector<float> point_data;
+  for (const auto& point_cloud : point_clouds) {
+    for (int p = 0; p < point_cloud.GetNumPoints(); ++p) {
+      for (int i = 0; i < 3; ++i)
+        point_data.push_back(point_cloud.GetPoint(p).position[i]);
+    }
+  }
+  const int num_points = static_cast<int>(point_data.size() / 3);
+
+  //----------------------------------------------------------------------
+  // Micro benchmarks.
+  runner.Run("load_ply", [&file_io, num_panoramas]() {
+      long long num_points = 0;
+      for (int p = 0; p < num_panoramas; ++p) {
+        PointCloud point_cloud;
+        point_cloud.Init(file_io, p);
+        num_points += point_cloud.GetNumPoints();
+      }
+      return num_points;
+    });
+
+  runner.Run("load_panorama", [&file_io, num_panoramas]() {
+      for (int p = 0; p < num_panoramas; ++p) {
+        Panorama panorama;
+        panorama.Init(file_io, p);
+      }
+      return static_cast<long long>(num_panoramas);
+    });
+
+  // The checksum keeps the loop alive.
+  double checksum = 0.0;
+  runner.Run("project_get_rgb", [&panoramas, &point_clouds, &checksum]() {
+      long long num_points = 0;
+      for (int p = 0; p < (int)panoramas.size(); ++p) {
+        for (int q = 0; q < point_clouds[p].GetNumPoints(); ++q) {
+          const Vector2d pixel = panoramas[p].Project(point_clouds[p].GetPoint(q).position);
+          checksum += panoramas[p].GetRGB(pixel)[0];
+        }
+        num_points += point_clouds[p].GetNumPoints();
+      }
+      return num_points;
+    });
+
+  runner.Run("kdtree_build", [&point_data, num_points]() {
+      KDtree kdtree(point_data);
+      return static_cast<long long>(num_points);
+    });
+
+  if (runner.IsSelected("kdtree_knn") && num_points > 0) {
+    const KDtree kdtree(point_data);
+    runner.Run("kdtree_knn", [&kdtree, &point_data, num_points]() {
+        vector<int> indices;
+        vector<float> dist2s;
+        kdtree.find_k_closest_batch(&point_data[0], num_points, FLAGS_num_neighbors,
+                                    indices, dist2s, 0.0f, FLAGS_num_threads);
+        return static_cast<long long>(num_points);
+      });
+  }
+
+  //----------------------------------------------------------------------
+  // Macro benchmarks.
+  runner.Run("segmentation", [&floorplan, &indoor_polygon, &point_clouds]() {
+      return SegmentRooms(floorplan, indoor_polygon, point_clouds);
+    });
+
+  runner.Run("poisson_synthesis", [&panoramas]() {
+      return SynthesizeHole(panoramas[0], FLAGS_texture_size);
+    });
+
+  runner.Run("evaluation_rasterization", [&floorplan, &indoor_polygon, &panoramas]() {
+      const RasterizedGeometry kInitial(numeric_limits<double>::max(), Vector3d(0, 0, 0), kHole);
+      vector<vector<RasterizedGeometry> > rasterized_geometries;
+      Initialize(panoramas, kInitial, &rasterized_geometries);
+      RasterizeFloorplan(floorplan, panoramas, &rasterized_geometries);
+      Initialize(panoramas, kInitial, &rasterized_geometries);
+      RasterizeIndoorPolygon(indoor_polygon, panoramas, &rasterized_geometries);
+      long long num_pixels = 0;
+      for (const auto& rasterized_geometry : rasterized_geometries)
+        num_pixels += rasterized_geometry.size();
+      return 2 * num_pixels;
+    });
+
+  if (checksum == numeric_limits<double>::infinity())
+    cerr << "Unexpected checksum." << endl;
+
+  if (FLAGS_output.empty()) {
+    WriteJson(runner.GetResults(), cout);
+  } else {
+    ofstream ofstr;
+    ofstr.open(FLAGS_output.c_str());
+    if (!ofstr.is_open()) {
+      cerr << "Cannot open a file: " << FLAGS_output << endl;
+      return 1;
+    }
+    WriteJson(runner.GetResults(), ofstr);
+    ofstr.close();
+  }
+  return 0;
+}
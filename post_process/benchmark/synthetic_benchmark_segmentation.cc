@@ -0,0 +1,47 @@
+#include <Eigen/Dense>
+#include <map>
+#include <random>
+#include <string>
+
+#include "../../base/floorplan.h"
+#include "../../base/indoor_polygon.h"
+#include "../../base/point_cloud.h"
+#include "../../main_process/object_segmentation/object_segmentation.h"
+#include "synthetic_benchmark.h"
+
+using namespace std;
+
+namespace structured_indoor_modeling {
+
+long long SegmentRooms(const Floorplan& floorplan,
+                       const IndoorPolygon& indoor_polygon,
+                       const vector<PointCloud>& point_clouds) {
+  // The defaults of object_segmentation_cli.
+  const double kCentroidSubsamplingRatio = 0.005;
+  const int kNumInitialClusters = 100;
+  const double kRescaleMargin = 1.0;
+  const int kNumNeighbors = 8;
+
+  vector<int> room_occupancy;
+  SetRoomOccupancy(floorplan, &room_occupancy);
+  long long num_points = 0;
+  for (int room = 0; room < floorplan.GetNumRooms(); ++room) {
+    vector<Point> points;
+    CollectPointsInRoom(point_clouds, floorplan, room_occupancy, room, &points);
+    FilterNoisyPoints(&points);
+    if (points.empty())
+      continue;
+    num_points += points.size();
+    vector<int> segments;
+    IdentifyFloorWallCeiling(points, floorplan, room, kRescaleMargin, &segments);
+    IdentifyDetails(points, floorplan, indoor_polygon, room, kRescaleMargin, &segments);
+    vector<vector<int> > neighbors;
+    SetNeighbors(points, kNumNeighbors, &neighbors);
+    mt19937 random(room);
+    SegmentObjects(points, kCentroidSubsamplingRatio, kNumInitialClusters, neighbors, &random,
+                   &segments);
+  }
+  return num_points;
+}
+
+}  // namespace structured_indoor_modeling
@@ -8,6 +8,7 @@
 #include "../../base/indoor_polygon.h"
 #include "../../base/panorama.h"
 #include "../../base/point_cloud.h"
+#include "../../base/tracing.h"
 
 using namespace Eigen;
 using namespace std;
@@ -66,6 +67,7 @@ double UVDistance(const Eigen::Vector2d& lhs, const Eigen::Vector2d& rhs, const
 void RasterizeMeshForPanorama(const Panorama& panorama,
                               const Mesh& mesh,
                               std::vector<RasterizedGeometry>* rasterized_geometry) {
+  const ScopedTrace trace("RasterizeMeshForPanorama");
   const int width = panorama.DepthWidth();
   const int height = panorama.DepthHeight();
 
@@ -209,6 +211,72 @@ void RasterizeMeshForPanorama(const Panorama& panorama,
   }
   */  
 }
+
+// Returns false if no geometry is rasterized where the point projects.
+bool ComputePointErrors(const Panorama& panorama,
+                        const std::vector<RasterizedGeometry>& rasterized_geometry,
+                        const RasterizedGeometry& initial_value,
+                        const double depth_unit,
+                        const Point& point,
+                        double* depth_error,
+                        double* normal_error,
+                        GeometryType* type) {
+  const int width  = panorama.DepthWidth();
+  const int height = panorama.DepthHeight();
+  const Vector2d pixel = panorama.ProjectToDepth(point.position);
+  const int u = max(0, min(width - 1, static_cast<int>(round(pixel[0]))));
+  const int v = max(0, min(height - 1, static_cast<int>(round(pixel[1]))));
+  const int index = v * width + u;
+
+  // No rasterized geometry. Very unlikely...
+  if (rasterized_geometry[index].depth == initial_value.depth) {
+    // cerr << "Rendering hole. This should rarely happen." << endl;
+    return false;
+  }
+
+  *depth_error =
+    fabs(rasterized_geometry[index].depth - (panorama.GetCenter() - point.position).norm()) / depth_unit;
+  *normal_error =
+    acos(min(1.0, max(-1.0, rasterized_geometry[index].normal.dot(point.normal)))) * 180.0 / M_PI;
+  *type = rasterized_geometry[index].geometry_type;
+  return true;
+}
+
+// Half the largest depth steps (relative to depth_unit) from the pixel
+// of point to its horizontal and vertical neighbors: how much the
+// rasterized depth may change within the pixel. Holes are skipped.
+double GetDepthStepInPixel(const Panorama& panorama,
+                           const std::vector<RasterizedGeometry>& rasterized_geometry,
+                           const RasterizedGeometry& initial_value,
+                           const double depth_unit,
+                           const Point& point) {
+  const int width  = panorama.DepthWidth();
+  const int height = panorama.DepthHeight();
+  const Vector2d pixel = panorama.ProjectToDepth(point.position);
+  const int u = max(0, min(width - 1, static_cast<int>(round(pixel[0]))));
+  const int v = max(0, min(height - 1, static_cast<int>(round(pixel[1]))));
+  const double depth = rasterized_geometry[v * width + u].depth;
+
+  // The columns wrap around.
+  const int neighbors[2][2][2] = { { { (u + width - 1) % width, v }, { (u + 1) % width, v } },
+                                   { { u, v - 1 }, { u, v + 1 } } };
+  double step = 0.0;
+  for (int axis = 0; axis < 2; ++axis) {
+    double max_step = 0.0;
+    for (int n = 0; n < 2; ++n) {
+      const int x = neighbors[axis][n][0];
+      const int y = neighbors[axis][n][1];
+      if (y < 0 || height <= y)
+        continue;
+      const double neighbor_depth = rasterized_geometry[y * width + x].depth;
+      if (neighbor_depth == initial_value.depth)
+        continue;
+      max_step = max(max_step, fabs(neighbor_depth - depth));
+    }
+    step += max_step / 2.0;
+  }
+  return step / depth_unit;
+}
   
 }  // namespace  
 
@@ -521,28 +589,13 @@ void ReportErrors(const FileIO& file_io,
     const Panorama& panorama = panoramas[p];
     const vector<RasterizedGeometry>& rasterized_geometry = rasterized_geometries[p];
 
-    const int width  = panorama.DepthWidth();
-    const int height = panorama.DepthHeight();
-
     for (int q = 0; q < (int)input_point_cloud.GetNumPoints(); ++q) {
-      const Point& point = input_point_cloud.GetPoint(q);
-      const Vector2d pixel = panorama.ProjectToDepth(point.position);
-      const int u = max(0, min(width - 1, static_cast<int>(round(pixel[0]))));
-      const int v = max(0, min(height - 1, static_cast<int>(round(pixel[1]))));
-      const int index = v * width + u;
-
-      // No rasterized geometry. Very unlikely...
-      if (rasterized_geometry[index].depth == initial_value.depth) {
-        // cerr << "Rendering hole. This should rarely happen." << endl;
+      double depth_error, normal_error;
+      GeometryType type;
+      if (!ComputePointErrors(panorama, rasterized_geometry, initial_value, depth_unit,
+                              input_point_cloud.GetPoint(q), &depth_error, &normal_error, &type))
         continue;
-      }
-      
-      const double depth_error = 
-        fabs(rasterized_geometry[index].depth - (panorama.GetCenter() - point.position).norm()) / depth_unit;
-      const double normal_error =
-        acos(min(1.0, max(-1.0, rasterized_geometry[index].normal.dot(point.normal)))) * 180.0 / M_PI;
 
-      const auto& type = rasterized_geometry[index].geometry_type;
       errors[p][type].first[0] += depth_error;
       errors[p][type].first[1] += normal_error; // min(normal_error, 180.0 - normal_error); //???
       errors[p][type].second += 1;
@@ -648,5 +701,45 @@ void ReportErrors(const FileIO& file_io,
   }
   */
 }
+
+ErrorSummary SummarizeErrors(const std::vector<PointCloud>& input_point_clouds,
+                             const std::vector<std::vector<RasterizedGeometry> >& rasterized_geometries,
+                             const std::vector<Panorama>& panoramas,
+                             const RasterizedGeometry& initial_value,
+                             const double depth_unit) {
+  Vector2d sum(0, 0), sum2(0, 0);
+  ErrorSummary summary;
+  for (int p = 0; p < (int)input_point_clouds.size(); ++p) {
+    const PointCloud& input_point_cloud = input_point_clouds[p];
+    for (int q = 0; q < (int)input_point_cloud.GetNumPoints(); ++q) {
+      double depth_error, normal_error;
+      GeometryType type;
+      if (!ComputePointErrors(panoramas[p], rasterized_geometries[p], initial_value, depth_unit,
+                              input_point_cloud.GetPoint(q), &depth_error, &normal_error, &type))
+        continue;
+      const Vector2d error(depth_error, normal_error);
+      sum += error;
+      sum2 += error.cwiseProduct(error);
+      summary.resolution_bound +=
+        GetDepthStepInPixel(panoramas[p], rasterized_geometries[p], initial_value, depth_unit,
+                            input_point_cloud.GetPoint(q));
+      ++summary.num_points;
+    }
+  }
+  if (summary.num_points == 0)
+    return summary;
+
+  summary.mean = sum / summary.num_points;
+  summary.resolution_bound /= summary.num_points;
+  if (summary.num_points > 1) {
+    for (int i = 0; i < 2; ++i) {
+      const double variance =
+        max(0.0, (sum2[i] - summary.num_points * summary.mean[i] * summary.mean[i]) /
+            (summary.num_points - 1));
+      summary.standard_error[i] = sqrt(variance / summary.num_points);
+    }
+  }
+  return summary;
+}
   
 }  // namespace structured_indoor_modeling
@@ -71,6 +71,33 @@ void ReportErrors(const FileIO& file_io,
                   const std::vector<Panorama>& panoramas,
                   const RasterizedGeometry& initial_value,
                   const double depth_unit);
+
+// Mean position (relative to depth_unit) and normal (in degrees)
+// errors over all the input points, with the standard error of each
+// mean. Cheap enough to score a coarse rasterization before deciding
+// to evaluate at the full resolution.
+//
+// The standard error only covers the sampling of the points, and
+// vanishes with millions of them. resolution_bound covers the
+// rasterization: per point, half the depth steps from its pixel to the
+// neighboring ones (relative to depth_unit), i.e., how much the
+// rasterized depth may change inside the pixel, averaged over the
+// points. The mean position error at a finer resolution is at most
+// mean[0] + resolution_bound (as long as the geometry is linear inside
+// a pixel; a depth discontinuity next to a pixel counts fully).
+struct ErrorSummary {
+  ErrorSummary() : mean(0, 0), standard_error(0, 0), resolution_bound(0), num_points(0) {}
+  Eigen::Vector2d mean;
+  Eigen::Vector2d standard_error;
+  double resolution_bound;
+  int num_points;
+};
+
+ErrorSummary SummarizeErrors(const std::vector<PointCloud>& input_point_clouds,
+                             const std::vector<std::vector<RasterizedGeometry> >& rasterized_geometries,
+                             const std::vector<Panorama>& panoramas,
+                             const RasterizedGeometry& initial_value,
+                             const double depth_unit);
  
 }  // namespace structured_indoor_modeling
   
@@ -1,15 +1,19 @@
+#include <functional>
 #include <iostream>
 #include <fstream>
 #include <limits>
 #include <vector>
 
 #include <gflags/gflags.h>
+#include <opencv2/opencv.hpp>
 
 #include "../../base/file_io.h"
 #include "../../base/floorplan.h"
 #include "../../base/indoor_polygon.h"
 #include "../../base/panorama.h"
 #include "../../base/point_cloud.h"
+#include "../../base/tracing.h"
+#include "../../base/tracing_flags.h"
 #include "evaluate.h"
 
 #ifdef _WIN32
@@ -28,6 +32,12 @@ DEFINE_bool(evaluate_vgcut_mesh, false, "Evaluate poisson mesh.");
 
 DEFINE_bool(evaluate_all, false, "Evaluate all.");
 
+DEFINE_bool(progressive, false, "Score each reconstruction at a coarse depth resolution first.");
+DEFINE_int32(coarse_level, 2, "Coarse depth resolution is 1 / 2^coarse_level of the full one.");
+DEFINE_double(refine_threshold, 0.05, "Progressive: evaluate at the full resolution too when the full resolution position error may exceed this (the coarse one plus the depth change inside the coarse pixels).");
+DEFINE_bool(refine, false, "Progressive: always evaluate at the full resolution too.");
+DEFINE_string(image_extension, "png", "Format of the depth and error images (cv::imwrite).");
+
 using namespace Eigen;
 using namespace std;
 using namespace structured_indoor_modeling;
@@ -55,20 +65,18 @@ void WriteDepthmap(const Panorama& panorama,
     }
   }  
 
-  ofstream ofstr;
-  ofstr.open(filename.c_str());
-  ofstr << "P3" << endl
-        << width << ' ' << height << endl
-        << 255 << endl;
+  // Holes in red.
+  cv::Mat image(height, width, CV_8UC3);
   for (int i = 0; i < rasterized_geometry.size(); ++i) {
+    cv::Vec3b& pixel = image.at<cv::Vec3b>(i / width, i % width);
     if (rasterized_geometry[i].depth == invalid_depth) {
-      ofstr << "255 0 0 ";
+      pixel = cv::Vec3b(0, 0, 255);
     } else {
       const int itmp = (int)(255 * (rasterized_geometry[i].depth - min_depth) / (max_depth - min_depth));
-      ofstr << itmp << ' ' << itmp << ' ' << itmp << ' ';
+      pixel = cv::Vec3b(itmp, itmp, itmp);
     }
   }
-  ofstr.close();
+  cv::imwrite(filename, image);
 
   //
   /*
@@ -93,6 +101,40 @@ void WriteDepthmap(const Panorama& panorama,
   */
 }
 
+// Blue (no error) to green to red (max_error or more). Black if invalid.
+void WriteErrormap(const std::vector<double>& errors,
+                   const double invalid,
+                   const double max_error,
+                   const int width,
+                   const int height,
+                   const string& filename) {
+  cv::Mat image(height, width, CV_8UC3);
+  int index = 0;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x, ++index) {
+      Vector3f rgb;
+      if (errors[index] == invalid) {
+        rgb = Vector3f(0, 0, 0);
+      } else {
+        const double gray = min(1.0, errors[index] / max_error);
+        if (gray < 0.5) {
+          rgb[1] = 255.0 * 2.0 * gray;
+          rgb[2] = 255.0 - rgb[1];
+          rgb[0] = 0.0;
+        } else {
+          rgb[2] = 0;
+          rgb[0] = 255.0 * 2.0 * (gray - 0.5);
+          rgb[1] = 255.0 - rgb[0];
+        }
+      }
+      image.at<cv::Vec3b>(y, x) = cv::Vec3b(static_cast<int>(round(rgb[2])),
+                                            static_cast<int>(round(rgb[1])),
+                                            static_cast<int>(round(rgb[0])));
+    }
+  }
+  cv::imwrite(filename, image);
+}
+
 void WriteDepthErrormap(const PointCloud& input_point_cloud,
                         const std::vector<RasterizedGeometry>& rasterized_geometry,
                         const Panorama& panorama,
@@ -102,8 +144,6 @@ void WriteDepthErrormap(const PointCloud& input_point_cloud,
                         const string& normal_error_filename) {
   const int width  = panorama.DepthWidth();
   const int height = panorama.DepthHeight();
-  Panorama small_panorama = panorama;
-  small_panorama.Resize(Vector2i(width, height));
   const double kInvalid = -1.0;
   vector<double> depth_errors(width * height, kInvalid);
   vector<double> normal_errors(width * height, kInvalid);
@@ -130,76 +170,12 @@ void WriteDepthErrormap(const PointCloud& input_point_cloud,
     normal_errors[index] = normal_error;
   }
 
-  const double alpha = 0.0;
   const double kMaxDepthError = 0.125;
-  {
-    ofstream ofstr;
-    ofstr.open(depth_error_filename.c_str());
-    ofstr << "P3" << endl
-          << width << ' ' << height << endl
-          << 255 << endl;
-    int index = 0;
-    for (int y = 0; y < height; ++y) {
-      for (int x = 0; x < width; ++x, ++index) {
-        Vector3f rgb;
-        if (depth_errors[index] == kInvalid) {
-          rgb = Vector3f(0, 0, 0);
-        } else {
-          const double gray = min(1.0, depth_errors[index] / (depth_unit * kMaxDepthError));
-          if (gray < 0.5) {
-            rgb[1] = 255.0 * 2.0 * gray;
-            rgb[2] = 255.0 - rgb[1];
-            rgb[0] = 0.0;
-          } else {
-            rgb[2] = 0;
-            rgb[0] = 255.0 * 2.0 * (gray - 0.5);
-            rgb[1] = 255.0 - rgb[0];
-          }
-        }
-        Vector3f color = small_panorama.GetRGB(Vector2d(x, y));
-        swap(color[0], color[2]);
-        color = color * alpha + rgb * (1.0 - alpha);
-        for (int i = 0; i < 3; ++i)
-          ofstr << static_cast<int>(round(color[i])) << ' ';
-      }
-    }
-    ofstr.close();
-  }
-
-  {
-    const double kMaxNormalError = 4.0;
-    ofstream ofstr;
-    ofstr.open(normal_error_filename.c_str());
-    ofstr << "P3" << endl
-          << width << ' ' << height << endl
-          << 255 << endl;
-    int index = 0;
-    for (int y = 0; y < height; ++y) {
-      for (int x = 0; x < width; ++x, ++index) {
-        Vector3f rgb;
-        if (normal_errors[index] == kInvalid) {
-          rgb = Vector3f(0, 0, 0);
-        } else {
-          const double gray = min(1.0, normal_errors[index] / kMaxNormalError);
-          if (gray < 0.5) {
-            rgb[1] = 255.0 * 2.0 * gray;
-            rgb[2] = 255.0 - rgb[1];
-            rgb[0] = 0.0;
-          } else {
-            rgb[2] = 0;
-            rgb[0] = 255.0 * 2.0 * (gray - 0.5);
-            rgb[1] = 255.0 - rgb[0];
-          }
-        }
-        Vector3f color = small_panorama.GetRGB(Vector2d(x, y));
-        swap(color[0], color[2]);
-        color = color * alpha + rgb * (1.0 - alpha);
-        for (int i = 0; i < 3; ++i)
-          ofstr << static_cast<int>(round(color[i])) << ' ';
-      }
-    }
-    ofstr.close();
-  }
+  const double kMaxNormalError = 4.0;
+  WriteErrormap(depth_errors, kInvalid, depth_unit * kMaxDepthError, width, height,
+                depth_error_filename);
+  WriteErrormap(normal_errors, kInvalid, kMaxNormalError, width, height,
+                normal_error_filename);
 }
 
 void VisualizeResults(const FileIO& file_io, const string prefix,
@@ -212,18 +188,18 @@ void VisualizeResults(const FileIO& file_io, const string prefix,
     {
       char depth_filename[1024];
       sprintf(depth_filename,
-              "%s/images/%03d_depth_%s.ppm",
-              file_io.GetEvaluationDirectory().c_str(), p, prefix.c_str());
+              "%s/images/%03d_depth_%s.%s",
+              file_io.GetEvaluationDirectory().c_str(), p, prefix.c_str(), FLAGS_image_extension.c_str());
       WriteDepthmap(panoramas[p], rasterized_geometries[p], invalid_depth, depth_filename);
     }
     {
       char depth_error_filename[1024], normal_error_filename[1024];
       sprintf(depth_error_filename,
-              "%s/images/%03d_depth_error_%s.ppm",
-              file_io.GetEvaluationDirectory().c_str(), p, prefix.c_str());
+              "%s/images/%03d_depth_error_%s.%s",
+              file_io.GetEvaluationDirectory().c_str(), p, prefix.c_str(), FLAGS_image_extension.c_str());
       sprintf(normal_error_filename,
-              "%s/images/%03d_normal_error_%s.ppm",
-              file_io.GetEvaluationDirectory().c_str(), p, prefix.c_str());
+              "%s/images/%03d_normal_error_%s.%s",
+              file_io.GetEvaluationDirectory().c_str(), p, prefix.c_str(), FLAGS_image_extension.c_str());
       WriteDepthErrormap(input_point_clouds[p], rasterized_geometries[p], panoramas[p],
                          invalid_depth, depth_unit, depth_error_filename, normal_error_filename);
     }
@@ -302,6 +278,58 @@ void Initialize(const FileIO& file_io, Floorplan* floorplan, IndoorPolygon* indo
     *indoor_polygon = IndoorPolygon(indoor_polygon_file);
   }
 }
+
+typedef std::function<void (const vector<Panorama>& panoramas,
+                            vector<vector<RasterizedGeometry> >* rasterized_geometries)> Rasterizer;
+
+// Rasterizes and scores one reconstruction. panorama_levels[0] are the
+// full resolution panoramas. In the progressive mode,
+// panorama_levels[1] are the coarse ones: the reconstruction is scored
+// there first (reports with a "_coarse" prefix), and at the full
+// resolution only if asked or if the error may exceed the threshold.
+void Evaluate(const FileIO& file_io,
+              const string& prefix,
+              const Rasterizer& rasterize,
+              const vector<PointCloud>& input_point_clouds,
+              const vector<vector<Panorama> >& panorama_levels,
+              const double depth_unit) {
+  const ScopedTrace trace("Evaluate");
+  const RasterizedGeometry kInitial(numeric_limits<double>::max(), Vector3d(0, 0, 0), kHole);
+  std::vector<std::vector<RasterizedGeometry> > rasterized_geometries;
+
+  if (panorama_levels.size() > 1) {
+    const vector<Panorama>& panoramas = panorama_levels[1];
+    const string coarse_prefix = prefix + "_coarse";
+    Initialize(panoramas, kInitial, &rasterized_geometries);
+    rasterize(panoramas, &rasterized_geometries);
+    VisualizeResults(file_io, coarse_prefix, input_point_clouds, rasterized_geometries, panoramas, kInitial.depth, depth_unit);
+    ReportErrors(file_io, coarse_prefix, input_point_clouds, rasterized_geometries, panoramas, kInitial, depth_unit);
+
+    // The full resolution mean position error is at most the coarse
+    // one plus the depth change inside the coarse pixels, up to the
+    // 95% confidence interval of the point sampling.
+    const double kZ = 1.96;
+    const ErrorSummary summary =
+      SummarizeErrors(input_point_clouds, rasterized_geometries, panoramas, kInitial, depth_unit);
+    const double position_bound =
+      summary.mean[0] + summary.resolution_bound + kZ * summary.standard_error[0];
+    const bool refine = FLAGS_refine || position_bound > FLAGS_refine_threshold;
+    cout << prefix << " at 1/" << (1 << FLAGS_coarse_level) << " resolution ("
+         << summary.num_points << " points): position "
+         << summary.mean[0] << " +- " << kZ * summary.standard_error[0]
+         << " (at most " << position_bound << " at the full resolution), normal "
+         << summary.mean[1] << " +- " << kZ * summary.standard_error[1]
+         << (refine ? ". Refining." : ". Provisional.") << endl;
+    if (!refine)
+      return;
+  }
+
+  const vector<Panorama>& panoramas = panorama_levels[0];
+  Initialize(panoramas, kInitial, &rasterized_geometries);
+  rasterize(panoramas, &rasterized_geometries);
+  VisualizeResults(file_io, prefix, input_point_clouds, rasterized_geometries, panoramas, kInitial.depth, depth_unit);
+  ReportErrors(file_io, prefix, input_point_clouds, rasterized_geometries, panoramas, kInitial, depth_unit);
+}
   
 }  // namespace
 
@@ -315,27 +343,39 @@ int main(int argc, char* argv[]) {
 #else
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 #endif
+  InitTracingFromFlags();
 
   FileIO file_io(argv[1]);
   Floorplan floorplan;
   IndoorPolygon indoor_polygon;
   Initialize(file_io, &floorplan, &indoor_polygon);
 
-  vector<Panorama> panoramas;
-  ReadPanoramas(file_io, &panoramas);
+  vector<vector<Panorama> > panorama_levels;
+  if (FLAGS_progressive && FLAGS_coarse_level > 0) {
+    vector<vector<Panorama> > panorama_pyramids;
+    ReadPanoramaPyramids(file_io, FLAGS_coarse_level + 1, &panorama_pyramids);
+    panorama_levels.resize(2);
+    for (auto& pyramid : panorama_pyramids) {
+      panorama_levels[0].push_back(std::move(pyramid.front()));
+      panorama_levels[1].push_back(std::move(pyramid.back()));
+    }
+  } else {
+    panorama_levels.resize(1);
+    ReadPanoramas(file_io, &panorama_levels[0]);
+  }
   // Adjust the center of panorama to the center of the laser scanner.
-  for (int p = 0; p < panoramas.size(); ++p) {
-    panoramas[p].AdjustCenter(GetLaserCenter(file_io, p));
-  }  
+  for (auto& panoramas : panorama_levels) {
+    for (int p = 0; p < panoramas.size(); ++p) {
+      panoramas[p].AdjustCenter(GetLaserCenter(file_io, p));
+    }
+  }
+  const vector<Panorama>& panoramas = panorama_levels[0];
 
   vector<PointCloud> input_point_clouds, object_point_clouds;
   ReadPointClouds(file_io, &input_point_clouds);
   ReadObjectPointClouds(file_io, floorplan.GetNumRooms(), &object_point_clouds);
 
   // Accuracy and completeness.
-  const RasterizedGeometry kInitial(numeric_limits<double>::max(), Vector3d(0, 0, 0), kHole);
-  std::vector<std::vector<RasterizedGeometry> > rasterized_geometries;
-
   double depth_unit = 0.0;
   for (int p = 0; p < panoramas.size(); ++p)
     depth_unit += panoramas[p].GetAverageDistance();
@@ -344,92 +384,53 @@ int main(int argc, char* argv[]) {
   //----------------------------------------------------------------------
   if (FLAGS_evaluate_all || FLAGS_evaluate_floorplan) {
     // Floorplan only.
-    Initialize(panoramas, kInitial, &rasterized_geometries);
-    RasterizeFloorplan(floorplan, panoramas, &rasterized_geometries);
-    VisualizeResults(file_io, "floorplan", input_point_clouds, rasterized_geometries, panoramas, kInitial.depth, depth_unit);
-    ReportErrors(file_io, "floorplan", input_point_clouds, rasterized_geometries, panoramas, kInitial, depth_unit);
+    Evaluate(file_io, "floorplan",
+             [&](const vector<Panorama>& panoramas, vector<vector<RasterizedGeometry> >* rasterized_geometries) {
+               RasterizeFloorplan(floorplan, panoramas, rasterized_geometries);
+             }, input_point_clouds, panorama_levels, depth_unit);
   }
   
   // Indoor polygon only.
   if (FLAGS_evaluate_all || FLAGS_evaluate_indoor_polygon) {
-    Initialize(panoramas, kInitial, &rasterized_geometries);
-    RasterizeIndoorPolygon(indoor_polygon, panoramas, &rasterized_geometries);
-    VisualizeResults(file_io, "indoor_polygon", input_point_clouds, rasterized_geometries, panoramas, kInitial.depth, depth_unit);
-    ReportErrors(file_io, "indoor_polygon", input_point_clouds, rasterized_geometries, panoramas, kInitial, depth_unit);
+    Evaluate(file_io, "indoor_polygon",
+             [&](const vector<Panorama>& panoramas, vector<vector<RasterizedGeometry> >* rasterized_geometries) {
+               RasterizeIndoorPolygon(indoor_polygon, panoramas, rasterized_geometries);
+             }, input_point_clouds, panorama_levels, depth_unit);
   }
 
   if (FLAGS_evaluate_all || FLAGS_evaluate_indoor_polygon_and_object_point_clouds) {
-    Initialize(panoramas, kInitial, &rasterized_geometries);
-    RasterizeIndoorPolygon(indoor_polygon, panoramas, &rasterized_geometries);
-    RasterizeObjectPointClouds(object_point_clouds, panoramas, &rasterized_geometries);
-    VisualizeResults(file_io, "indoor_polygon_and_object_point_clouds", input_point_clouds, rasterized_geometries, panoramas, kInitial.depth, depth_unit);
-    ReportErrors(file_io, "indoor_polygon_and_object_point_clouds", input_point_clouds, rasterized_geometries, panoramas, kInitial, depth_unit);
+    Evaluate(file_io, "indoor_polygon_and_object_point_clouds",
+             [&](const vector<Panorama>& panoramas, vector<vector<RasterizedGeometry> >* rasterized_geometries) {
+               RasterizeIndoorPolygon(indoor_polygon, panoramas, rasterized_geometries);
+               RasterizeObjectPointClouds(object_point_clouds, panoramas, rasterized_geometries);
+             }, input_point_clouds, panorama_levels, depth_unit);
   }
 
-  if (FLAGS_evaluate_all || FLAGS_evaluate_poisson_mesh) {
-    {
-      const vector<string> filenames = file_io.GetPoissonMeshes();
-      for (int i = 1; i < filenames.size(); ++i) {
-	Mesh poisson_mesh;
-	if (!ReadMesh(filenames[i], &poisson_mesh))
-          continue;
-	Initialize(panoramas, kInitial, &rasterized_geometries);
-	RasterizeMesh(poisson_mesh, panoramas, &rasterized_geometries);
-	
-	char buffer[1024];
-	sprintf(buffer, "poisson%d", i);
-	VisualizeResults(file_io, buffer, input_point_clouds, rasterized_geometries, panoramas, kInitial.depth, depth_unit);
-	ReportErrors(file_io, buffer, input_point_clouds, rasterized_geometries, panoramas, kInitial, depth_unit);
-      }
-    }
-    {
-      const vector<string> filenames = file_io.GetFilteredPoissonMeshes();
-      for (int i = 1; i < filenames.size(); ++i) {
-	Mesh poisson_mesh;
-	if (!ReadMesh(filenames[i], &poisson_mesh))
-          continue;
-	Initialize(panoramas, kInitial, &rasterized_geometries);
-	RasterizeMesh(poisson_mesh, panoramas, &rasterized_geometries);
-	
-	char buffer[1024];
-	sprintf(buffer, "poisson_filtered%d", i);
-	VisualizeResults(file_io, buffer, input_point_clouds, rasterized_geometries, panoramas, kInitial.depth, depth_unit);
-	ReportErrors(file_io, buffer, input_point_clouds, rasterized_geometries, panoramas, kInitial, depth_unit);
-      }
+  // Poisson and vgcut meshes, with the prefixes poisson%d, vgcut%d, ...
+  const auto evaluate_meshes = [&](const vector<string>& filenames,
+                                   const int first,
+                                   const string& name) {
+    for (int i = first; i < filenames.size(); ++i) {
+      Mesh mesh;
+      if (!ReadMesh(filenames[i], &mesh))
+        continue;
+      char buffer[1024];
+      sprintf(buffer, "%s%d", name.c_str(), i);
+      Evaluate(file_io, buffer,
+               [&](const vector<Panorama>& panoramas, vector<vector<RasterizedGeometry> >* rasterized_geometries) {
+                 RasterizeMesh(mesh, panoramas, rasterized_geometries);
+               }, input_point_clouds, panorama_levels, depth_unit);
     }
+  };
+
+  if (FLAGS_evaluate_all || FLAGS_evaluate_poisson_mesh) {
+    evaluate_meshes(file_io.GetPoissonMeshes(), 1, "poisson");
+    evaluate_meshes(file_io.GetFilteredPoissonMeshes(), 1, "poisson_filtered");
   }
 
   if (FLAGS_evaluate_all || FLAGS_evaluate_vgcut_mesh) {
-    {
-      const vector<string> filenames = file_io.GetVgcutMeshes();
-      for (int i = 0; i < filenames.size(); ++i) {
-	Mesh vgcut_mesh;
-	if (!ReadMesh(filenames[i], &vgcut_mesh))
-          continue;
-	Initialize(panoramas, kInitial, &rasterized_geometries);
-	RasterizeMesh(vgcut_mesh, panoramas, &rasterized_geometries);
-	
-	char buffer[1024];
-	sprintf(buffer, "vgcut%d", i);
-	VisualizeResults(file_io, buffer, input_point_clouds, rasterized_geometries, panoramas, kInitial.depth, depth_unit);
-	ReportErrors(file_io, buffer, input_point_clouds, rasterized_geometries, panoramas, kInitial, depth_unit);
-      }
-    }
-    {
-      const vector<string> filenames = file_io.GetFilteredVgcutMeshes();
-      for (int i = 0; i < filenames.size(); ++i) {
-	Mesh vgcut_mesh;
-	if (!ReadMesh(filenames[i], &vgcut_mesh))
-          continue;
-	Initialize(panoramas, kInitial, &rasterized_geometries);
-	RasterizeMesh(vgcut_mesh, panoramas, &rasterized_geometries);
-	
-	char buffer[1024];
-	sprintf(buffer, "vgcut_filtered%d", i);
-	VisualizeResults(file_io, buffer, input_point_clouds, rasterized_geometries, panoramas, kInitial.depth, depth_unit);
-	ReportErrors(file_io, buffer, input_point_clouds, rasterized_geometries, panoramas, kInitial, depth_unit);
-      }
-    }
+    evaluate_meshes(file_io.GetVgcutMeshes(), 0, "vgcut");
+    evaluate_meshes(file_io.GetFilteredVgcutMeshes(), 0, "vgcut_filtered");
   }
   
   return 0;
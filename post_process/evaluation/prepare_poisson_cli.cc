@@ -1,6 +1,27 @@
+/*
+  Writes the oriented points (global positions and normals) of all the
+  panoramas as the input of Poisson surface reconstruction. Panoramas
+  are streamed one at a time, so the memory is bounded by the largest
+  panorama (plus the voxel grid with --voxel_size).
+
+  Formats:
+  npts:  ascii, one point per line (GetPoissonInput). The default, read
+         by the existing Poisson runs.
+  bnpts: binary, 6 floats per point (GetPoissonInputBinary).
+  ply:   binary little endian ply, float x y z nx ny nz (GetPoissonInputPly).
+
+  < Example >
+  ./prepare_poisson_cli data_directory --format=ply --voxel_size=10 --min_normal_confidence=0.2
+*/
+
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
 #include <iostream>
 #include <fstream>
 #include <limits>
+#include <sstream>
+#include <unordered_map>
 #include <vector>
 
 #include <gflags/gflags.h>
@@ -9,14 +30,160 @@
 #include "../../base/point_cloud.h"
 
 #ifdef _WIN32
-#pragma comment (lib, "gflags.lib") 
-#pragma comment (lib, "Shlwapi.lib") 
+#pragma comment (lib, "gflags.lib")
+#pragma comment (lib, "Shlwapi.lib")
 #endif
 
+DEFINE_string(format, "npts", "Output format: npts (ascii), bnpts, or ply.");
+DEFINE_double(voxel_size, 0.0, "If positive, points in the same voxel (global units) are merged.");
+DEFINE_double(min_normal_confidence, 0.0,
+              "Drop points whose normal is within acos(x) of perpendicular to the viewing ray.");
+
 using namespace Eigen;
 using namespace std;
 using namespace structured_indoor_modeling;
 
+namespace {
+
+// Writes oriented points as they come. The ply header is written with a
+// padded vertex count, which is filled in by Close().
+class OrientedPointWriter {
+ public:
+  OrientedPointWriter(const string& format, const string& filename)
+    : format(format), filename(filename), num_points(0) {
+    if (format == "npts")
+      ofstr.open(filename.c_str());
+    else
+      ofstr.open(filename.c_str(), ios::binary);
+    if (!ofstr.is_open()) {
+      cerr << "Cannot open a file: " << filename << endl;
+      exit (1);
+    }
+    if (format == "ply") {
+      ofstr << "ply" << endl
+            << "format binary_little_endian 1.0" << endl
+            << "element vertex ";
+      count_position = ofstr.tellp();
+      ofstr << setw(kCountWidth) << 0 << endl
+            << "property float x" << endl
+            << "property float y" << endl
+            << "property float z" << endl
+            << "property float nx" << endl
+            << "property float ny" << endl
+            << "property float nz" << endl
+            << "end_header" << endl;
+    }
+  }
+
+  void Add(const Vector3d& position, const Vector3d& normal) {
+    ++num_points;
+    if (format == "npts") {
+      for (int i = 0; i < 3; ++i)
+        ofstr << position[i] << ' ';
+      for (int i = 0; i < 3; ++i)
+        ofstr << normal[i] << ' ';
+      ofstr << endl;
+    } else {
+      // Both binary formats are little endian floats (x86).
+      const float values[6] = { static_cast<float>(position[0]),
+                                static_cast<float>(position[1]),
+                                static_cast<float>(position[2]),
+                                static_cast<float>(normal[0]),
+                                static_cast<float>(normal[1]),
+                                static_cast<float>(normal[2]) };
+      ofstr.write(reinterpret_cast<const char*>(values), sizeof(values));
+    }
+  }
+
+  int64_t Close() {
+    if (format == "ply") {
+      ofstr.seekp(count_position);
+      ofstr << setw(kCountWidth) << num_points;
+    }
+    ofstr.close();
+    return num_points;
+  }
+
+ private:
+  static const int kCountWidth = 12;
+
+  const string format;
+  const string filename;
+  ofstream ofstr;
+  streampos count_position;
+  int64_t num_points;
+};
+
+// Averages the points falling in each voxel. The normals are summed
+// before normalization, so that the consistent ones dominate.
+class VoxelConsolidator {
+ public:
+  VoxelConsolidator(const double voxel_size) : voxel_size(voxel_size) {}
+
+  void Add(const Vector3d& position, const Vector3d& normal) {
+    Voxel& voxel = voxels[GetKey(position)];
+    voxel.position_sum += position;
+    voxel.normal_sum += normal;
+    ++voxel.count;
+  }
+
+  void Write(OrientedPointWriter* writer) const {
+    for (const auto& voxel : voxels) {
+      if (voxel.second.normal_sum.squaredNorm() == 0.0)
+        continue;
+      writer->Add(voxel.second.position_sum / voxel.second.count,
+                  voxel.second.normal_sum.normalized());
+    }
+  }
+
+  int GetNumVoxels() const { return static_cast<int>(voxels.size()); }
+
+ private:
+  struct Voxel {
+    Voxel() : position_sum(0, 0, 0), normal_sum(0, 0, 0), count(0) {}
+    Vector3d position_sum;
+    Vector3d normal_sum;
+    int count;
+  };
+
+  // 21 bits per axis, enough for 2M voxels along each axis.
+  uint64_t GetKey(const Vector3d& position) const {
+    const int64_t kOffset = 1 << 20;
+    const int64_t kMask = (1 << 21) - 1;
+    uint64_t key = 0;
+    for (int i = 0; i < 3; ++i) {
+      const int64_t index = static_cast<int64_t>(floor(position[i] / voxel_size)) + kOffset;
+      key = (key << 21) | static_cast<uint64_t>(index & kMask);
+    }
+    return key;
+  }
+
+  const double voxel_size;
+  unordered_map<uint64_t, Voxel> voxels;
+};
+
+// |cos| of the angle between the normal and the viewing ray, in the
+// local frame (the scanner is at the origin). 0 for a missing normal.
+double NormalConfidence(const Point& point) {
+  const double denominator = point.normal.norm() * point.position.norm();
+  if (denominator == 0.0)
+    return 0.0;
+  return fabs(point.normal.dot(point.position)) / denominator;
+}
+
+string GetOutputFilename(const FileIO& file_io, const string& format) {
+  if (format == "bnpts")
+    return file_io.GetPoissonInputBinary();
+  else if (format == "ply")
+    return file_io.GetPoissonInputPly();
+  else if (format == "npts")
+    return file_io.GetPoissonInput();
+  cerr << "Unknown format: " << format << endl;
+  exit (1);
+}
+
+}  // namespace
+
 int main(int argc, char* argv[]) {
   if (argc < 2) {
     cerr << "Usage: " << argv[0] << " data_directory" << endl;
@@ -30,30 +197,44 @@ int main(int argc, char* argv[]) {
 
   FileIO file_io(argv[1]);
   const int num_panoramas = GetNumPanoramas(file_io);
-  vector<vector<double> > oriented_points;
+  OrientedPointWriter writer(FLAGS_format, GetOutputFilename(file_io, FLAGS_format));
+  VoxelConsolidator consolidator(FLAGS_voxel_size);
+  int64_t num_input_points = 0;
+  int64_t num_confident_points = 0;
+
   for (int panorama = 0; panorama < num_panoramas; ++panorama) {
     PointCloud point_cloud;
-    point_cloud.Init(file_io, panorama);
+    if (!point_cloud.Init(file_io, panorama)) {
+      cerr << "Cannot open a file: " << file_io.GetLocalPly(panorama) << endl;
+      exit (1);
+    }
+    // The confidence needs the viewing rays, so it is evaluated before
+    // ToGlobal.
+    vector<bool> confident(point_cloud.GetNumPoints(), true);
+    if (FLAGS_min_normal_confidence > 0.0) {
+      for (int p = 0; p < point_cloud.GetNumPoints(); ++p)
+        confident[p] = NormalConfidence(point_cloud.GetPoint(p)) >= FLAGS_min_normal_confidence;
+    }
     point_cloud.ToGlobal(file_io, panorama);
-    for (int p = 0; p < point_cloud.GetNumPoints(); ++p) {
-      const Point& point = point_cloud.GetPoint(p);
-      vector<double> oriented_point;
-      for (int i = 0; i < 3; ++i)
-        oriented_point.push_back(point.position[i]);
-      for (int i = 0; i < 3; ++i)
-        oriented_point.push_back(point.normal[i]);
-      oriented_points.push_back(oriented_point);
+
+    const PointCloud& global_cloud = point_cloud;
+    num_input_points += global_cloud.GetNumPoints();
+    for (int p = 0; p < global_cloud.GetNumPoints(); ++p) {
+      if (!confident[p])
+        continue;
+      ++num_confident_points;
+      const Point& point = global_cloud.GetPoint(p);
+      if (FLAGS_voxel_size > 0.0)
+        consolidator.Add(point.position, point.normal);
+      else
+        writer.Add(point.position, point.normal);
     }
   }
+  if (FLAGS_voxel_size > 0.0)
+    consolidator.Write(&writer);
+  const int64_t num_output_points = writer.Close();
 
-  ofstream ofstr;
-  ofstr.open(file_io.GetPoissonInput().c_str());
-  for (const auto& oriented_point : oriented_points) {
-    for (const auto& value : oriented_point)
-      ofstr << value << ' ';
-    ofstr << endl;
-  }
-  ofstr.close();  
-  
+  cout << num_input_points << " points, " << num_confident_points << " confident, "
+       << num_output_points << " written." << endl;
   return 0;
 }
@@ -0,0 +1,672 @@
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sys/stat.h>
+#include <opencv2/opencv.hpp>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "synthetic_scene.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace structured_indoor_modeling {
+
+namespace {
+
+struct DepthPixel {
+  double depth;
+  Vector3d normal;
+  Vector3i color;
+};
+
+struct Box {
+  Vector3d min_xyz;
+  Vector3d max_xyz;
+};
+
+struct Room {
+  Vector2d min_xy;
+  Vector2d max_xy;
+  vector<Box> objects;
+  vector<Vector3d> panorama_centers;
+};
+
+Eigen::Vector2d Project(const SyntheticCamera& camera,
+                        const Eigen::Vector3d& global) {
+  const Vector3d local = global - camera.center;
+  const double phi_per_pixel = camera.phi_range / camera.height;
+  // x coordinate.
+  double theta = -atan2(local.y(), local.x());
+  if (theta < 0.0)
+    theta += 2 * M_PI;
+  double theta_ratio = max(0.0, min(1.0, theta / (2 * M_PI)));
+  if (theta_ratio == 1.0)
+    theta_ratio = 0.0;
+
+  Vector2d uv;
+  uv[0] = theta_ratio * camera.width;
+  const double depth = sqrt(local.x() * local.x() +
+                            local.y() * local.y());
+  double phi = atan2(local.z(), depth);
+  const double pixel_offset_from_center = phi / phi_per_pixel;
+  uv[1] = max(0.0, min(camera.height - 1.1,
+                       camera.height / 2.0 -
+                       pixel_offset_from_center));
+
+  return uv;
+}
+
+Eigen::Vector3d Unproject(const SyntheticCamera& camera,
+                          const Eigen::Vector2d& pixel,
+                          const double distance) {
+  const double phi_per_pixel = camera.phi_range / camera.height;
+  const double theta = -2.0 * M_PI * pixel[0] / camera.width;
+  const double phi   = (camera.height / 2.0 - pixel[1]) * phi_per_pixel;
+
+  Vector3d local;
+  local[2] = distance * sin(phi);
+  local[0] = distance * cos(phi) * cos(theta);
+  local[1] = distance * cos(phi) * sin(theta);
+
+  return local + camera.center;
+}
+
+double ComputeUnit(const SyntheticCamera& camera,
+                   const Vector3d& point) {
+  const Vector2d uv = Project(camera, point);
+  const double distance = (camera.center - point).norm();
+  const Vector2d right(uv[0] + 1.0, uv[1]);
+  const Vector3d right_point = Unproject(camera, right, distance);
+
+  return (point - right_point).norm();
+}
+
+void AddPointsFromDepths(const SyntheticCamera& camera,
+                         const vector<DepthPixel>& depths,
+                         const double invalid_depth,
+                         const bool local_coordinate,
+                         vector<SyntheticPoint>* points) {
+  SyntheticCamera camera_to_be_used = camera;
+  if (local_coordinate)
+    camera_to_be_used.center = Vector3d(0, 0, 0);
+
+  int index = 0;
+  for (int y = 0; y < camera_to_be_used.height; ++y) {
+    for (int x = 0; x < camera_to_be_used.width; ++x, ++index) {
+      SyntheticPoint point;
+      point.uv = Vector2i(x + 1, y + 1);
+      if (depths[index].depth == invalid_depth) {
+        point.position = Vector3d(0, 0, 0);
+        point.color = Vector3i(0, 0, 0);
+        point.normal = Vector3d(0, 0, 0);
+        point.intensity = 0;
+      } else {
+        point.position = Unproject(camera_to_be_used, Vector2d(x, y), depths[index].depth);
+        point.color = depths[index].color;
+        point.normal = depths[index].normal;
+        point.intensity = 255;
+      }
+      points->push_back(point);
+    }
+  }
+}
+
+void MakeDirectory(const string& directory) {
+  // Fails harmlessly if the directory exists.
+#ifdef _WIN32
+  _mkdir(directory.c_str());
+#else
+  mkdir(directory.c_str(), 0755);
+#endif
+}
+
+// mt19937 is specified by the standard, but the distributions are
+// not: map the raw numbers ourselves, so that a seed gives the same
+// house with any standard library.
+double Uniform(const double min_value, const double max_value, mt19937* random) {
+  return min_value + (max_value - min_value) * ((*random)() / 4294967296.0);
+}
+
+// Two triangles, ordered so that the rasterized normal points along
+// facing (toward the cameras).
+void AddQuad(const Vector3d& v0, const Vector3d& v1, const Vector3d& v2, const Vector3d& v3,
+             const Vector3d& facing,
+             SyntheticMesh* mesh) {
+  const int base = static_cast<int>(mesh->vertices.size());
+  mesh->vertices.push_back(v0);
+  mesh->vertices.push_back(v1);
+  mesh->vertices.push_back(v2);
+  mesh->vertices.push_back(v3);
+  // RasterizeSyntheticScene negates the cross product.
+  if (-(v1 - v0).cross(v2 - v0).dot(facing) >= 0.0) {
+    mesh->triangles.push_back(Vector3i(base, base + 1, base + 2));
+    mesh->triangles.push_back(Vector3i(base, base + 2, base + 3));
+  } else {
+    mesh->triangles.push_back(Vector3i(base, base + 2, base + 1));
+    mesh->triangles.push_back(Vector3i(base, base + 3, base + 2));
+  }
+}
+
+Vector3i RandomColor(mt19937* random) {
+  Vector3i color;
+  for (int i = 0; i < 3; ++i)
+    color[i] = static_cast<int>(Uniform(64, 256, random));
+  return color;
+}
+
+void GenerateRooms(const SyntheticHouseOptions& options, vector<Room>* rooms) {
+  mt19937 random(options.seed);
+  const int num_columns = max(1, static_cast<int>(ceil(sqrt(static_cast<double>(options.num_rooms)))));
+  const double kMaxScale = 1.3;
+  const double kWallThickness = 200.0;
+  const double cell_size = options.room_size * kMaxScale + kWallThickness;
+  const double kObjectMargin = 300.0;
+  const double kPanoramaMargin = 500.0;
+  const double kPanoramaHeight = 1500.0;
+
+  rooms->resize(options.num_rooms);
+  for (int r = 0; r < options.num_rooms; ++r) {
+    Room& room = rooms->at(r);
+    room.min_xy = Vector2d((r % num_columns) * cell_size, (r / num_columns) * cell_size);
+    room.max_xy = room.min_xy + Vector2d(options.room_size * Uniform(0.7, kMaxScale, &random),
+                                         options.room_size * Uniform(0.7, kMaxScale, &random));
+    for (int o = 0; o < options.objects_per_room; ++o) {
+      Box box;
+      const Vector2d size(Uniform(300, 1000, &random), Uniform(300, 1000, &random));
+      for (int a = 0; a < 2; ++a) {
+        box.min_xyz[a] = Uniform(room.min_xy[a] + kObjectMargin,
+                                 room.max_xy[a] - kObjectMargin - size[a], &random);
+        box.max_xyz[a] = box.min_xyz[a] + size[a];
+      }
+      box.min_xyz[2] = 0.0;
+      box.max_xyz[2] = Uniform(400, 1200, &random);
+      room.objects.push_back(box);
+    }
+    for (int p = 0; p < options.panoramas_per_room; ++p) {
+      room.panorama_centers.push_back(Vector3d(Uniform(room.min_xy[0] + kPanoramaMargin,
+                                                       room.max_xy[0] - kPanoramaMargin, &random),
+                                               Uniform(room.min_xy[1] + kPanoramaMargin,
+                                                       room.max_xy[1] - kPanoramaMargin, &random),
+                                               kPanoramaHeight));
+    }
+  }
+}
+
+// Rooms are closed, so a panorama only sees the meshes of its room.
+void GenerateRoomMeshes(const Room& room,
+                        const double room_height,
+                        mt19937* random,
+                        vector<SyntheticMesh>* meshes) {
+  const Vector3d corners[4] = { Vector3d(room.min_xy[0], room.min_xy[1], 0),
+                                Vector3d(room.max_xy[0], room.min_xy[1], 0),
+                                Vector3d(room.max_xy[0], room.max_xy[1], 0),
+                                Vector3d(room.min_xy[0], room.max_xy[1], 0) };
+  const Vector3d up(0, 0, room_height);
+  {
+    SyntheticMesh floor;
+    floor.color = RandomColor(random);
+    AddQuad(corners[0], corners[1], corners[2], corners[3], Vector3d(0, 0, 1), &floor);
+    meshes->push_back(floor);
+
+    SyntheticMesh ceiling;
+    ceiling.color = RandomColor(random);
+    AddQuad(corners[0] + up, corners[1] + up, corners[2] + up, corners[3] + up,
+            Vector3d(0, 0, -1), &ceiling);
+    meshes->push_back(ceiling);
+  }
+  const Vector2d center = (room.min_xy + room.max_xy) / 2.0;
+  for (int w = 0; w < 4; ++w) {
+    const Vector3d& v0 = corners[w];
+    const Vector3d& v1 = corners[(w + 1) % 4];
+    const Vector3d middle = (v0 + v1) / 2.0;
+    SyntheticMesh wall;
+    wall.color = RandomColor(random);
+    AddQuad(v0, v1, v1 + up, v0 + up,
+            Vector3d(center[0] - middle[0], center[1] - middle[1], 0.0), &wall);
+    meshes->push_back(wall);
+  }
+
+  // Sides and tops of the objects.
+  for (const auto& box : room.objects) {
+    SyntheticMesh object;
+    object.color = RandomColor(random);
+    const Vector3d& a = box.min_xyz;
+    const Vector3d& b = box.max_xyz;
+    AddQuad(Vector3d(a[0], a[1], a[2]), Vector3d(b[0], a[1], a[2]),
+            Vector3d(b[0], a[1], b[2]), Vector3d(a[0], a[1], b[2]), Vector3d(0, -1, 0), &object);
+    AddQuad(Vector3d(b[0], a[1], a[2]), Vector3d(b[0], b[1], a[2]),
+            Vector3d(b[0], b[1], b[2]), Vector3d(b[0], a[1], b[2]), Vector3d(1, 0, 0), &object);
+    AddQuad(Vector3d(b[0], b[1], a[2]), Vector3d(a[0], b[1], a[2]),
+            Vector3d(a[0], b[1], b[2]), Vector3d(b[0], b[1], b[2]), Vector3d(0, 1, 0), &object);
+    AddQuad(Vector3d(a[0], b[1], a[2]), Vector3d(a[0], a[1], a[2]),
+            Vector3d(a[0], a[1], b[2]), Vector3d(a[0], b[1], b[2]), Vector3d(-1, 0, 0), &object);
+    AddQuad(Vector3d(a[0], a[1], b[2]), Vector3d(b[0], a[1], b[2]),
+            Vector3d(b[0], b[1], b[2]), Vector3d(a[0], b[1], b[2]), Vector3d(0, 0, 1), &object);
+    meshes->push_back(object);
+  }
+}
+
+// Depths are the distances from the center, 0 for the invalid pixels.
+void WriteDepthPanorama(const string& filename,
+                        const SyntheticCamera& camera,
+                        const vector<SyntheticPoint>& local_points) {
+  double min_depth = numeric_limits<double>::max();
+  double max_depth = 0.0;
+  vector<double> depths(local_points.size(), 0.0);
+  for (int p = 0; p < (int)local_points.size(); ++p) {
+    if (local_points[p].intensity == 0)
+      continue;
+    depths[p] = local_points[p].position.norm();
+    min_depth = min(min_depth, depths[p]);
+    max_depth = max(max_depth, depths[p]);
+  }
+  if (max_depth == 0.0)
+    min_depth = 0.0;
+
+  ofstream ofstr;
+  ofstr.open(filename.c_str());
+  if (!ofstr.is_open()) {
+    cerr << "Cannot open a file: " << filename << endl;
+    exit (1);
+  }
+  ofstr << "DEPTH" << endl
+        << camera.width << ' ' << camera.height << endl
+        << min_depth << ' ' << max_depth << endl;
+  int index = 0;
+  for (int y = 0; y < camera.height; ++y) {
+    for (int x = 0; x < camera.width; ++x, ++index)
+      ofstr << depths[index] << ' ';
+    ofstr << endl;
+  }
+  ofstr.close();
+}
+
+// Nearest depth pixel, darkened on a 25cm checkerboard so that the
+// images have texture to synthesize from.
+void WritePanoramaImage(const string& filename,
+                        const SyntheticCamera& camera,
+                        const vector<SyntheticPoint>& local_points,
+                        const int image_width) {
+  const int image_height = image_width / 2;
+  const double kTileSize = 250.0;
+  cv::Mat image(image_height, image_width, CV_8UC3);
+  for (int y = 0; y < image_height; ++y) {
+    const int depth_y = min(camera.height - 1, y * camera.height / image_height);
+    for (int x = 0; x < image_width; ++x) {
+      const int depth_x = min(camera.width - 1, x * camera.width / image_width);
+      const SyntheticPoint& point = local_points[depth_y * camera.width + depth_x];
+      if (point.intensity == 0) {
+        image.at<cv::Vec3b>(y, x) = cv::Vec3b(0, 0, 0);
+        continue;
+      }
+      const Vector3d global = point.position + camera.center;
+      const int tile = static_cast<int>(floor(global[0] / kTileSize) +
+                                        floor(global[1] / kTileSize) +
+                                        floor(global[2] / kTileSize));
+      const double scale = (tile % 2 == 0) ? 1.0 : 0.8;
+      // BGR.
+      image.at<cv::Vec3b>(y, x) = cv::Vec3b(static_cast<unsigned char>(point.color[2] * scale),
+                                            static_cast<unsigned char>(point.color[1] * scale),
+                                            static_cast<unsigned char>(point.color[0] * scale));
+    }
+  }
+  cv::imwrite(filename, image);
+}
+
+void WriteFloorplan(const string& filename,
+                    const vector<Room>& rooms,
+                    const double room_height) {
+  ofstream ofstr;
+  ofstr.open(filename.c_str());
+  if (!ofstr.is_open()) {
+    cerr << "Cannot open a file: " << filename << endl;
+    exit (1);
+  }
+  ofstr << "1 0 0" << endl
+        << "0 1 0" << endl
+        << "0 0 1" << endl
+        << rooms.size() << endl;
+  const char* kQuadTriangles = "0 1 2 0 0 0 0 0 0 0\n0 2 3 0 0 0 0 0 0 0\n";
+  for (const auto& room : rooms) {
+    // No name, 4 vertices counter-clockwise.
+    ofstr << 0 << endl
+          << 4 << endl
+          << room.min_xy[0] << ' ' << room.min_xy[1] << ' '
+          << room.max_xy[0] << ' ' << room.min_xy[1] << ' '
+          << room.max_xy[0] << ' ' << room.max_xy[1] << ' '
+          << room.min_xy[0] << ' ' << room.max_xy[1] << endl
+          << 0.0 << ' ' << room_height << endl;
+    for (int w = 0; w < 4; ++w)
+      ofstr << "4 2" << endl << "0 0 1 0 1 1 0 1" << endl << kQuadTriangles;
+    // Floor and ceiling.
+    ofstr << 2 << endl << kQuadTriangles
+          << 2 << endl << kQuadTriangles;
+  }
+  // No doors.
+  ofstr << 0 << endl;
+  ofstr.close();
+}
+
+void WriteSegment(const string& header,
+                  const string& normal,
+                  const Vector3d vertices[4],
+                  ofstream* ofstr) {
+  *ofstr << "SEGMENT" << endl
+         << header << endl
+         << normal << endl
+         << "4 2" << endl;
+  for (int v = 0; v < 4; ++v)
+    *ofstr << vertices[v][0] << ' ' << vertices[v][1] << ' ' << vertices[v][2] << endl;
+  *ofstr << "0 1 2 0 0 0 0 0 0 0" << endl
+         << "0 2 3 0 0 0 0 0 0 0" << endl;
+}
+
+// A floor, a ceiling and 4 walls per room.
+void WriteIndoorPolygon(const string& filename,
+                        const vector<Room>& rooms,
+                        const double room_height) {
+  ofstream ofstr;
+  ofstr.open(filename.c_str());
+  if (!ofstr.is_open()) {
+    cerr << "Cannot open a file: " << filename << endl;
+    exit (1);
+  }
+  ofstr << "INDOOR_POLYGON" << endl
+        << "1 0 0 0" << endl
+        << "0 1 0 0" << endl
+        << "0 0 1 0" << endl
+        << "0 0 0 1" << endl
+        << rooms.size() * 6 << endl;
+  // Inward normals of the walls, in the order of the floorplan vertices.
+  const char* kWallNormals[4] = { "Y", "-X", "-Y", "X" };
+  for (int r = 0; r < (int)rooms.size(); ++r) {
+    const Room& room = rooms[r];
+    const Vector3d floor[4] = { Vector3d(room.min_xy[0], room.min_xy[1], 0),
+                                Vector3d(room.max_xy[0], room.min_xy[1], 0),
+                                Vector3d(room.max_xy[0], room.max_xy[1], 0),
+                                Vector3d(room.min_xy[0], room.max_xy[1], 0) };
+    const Vector3d up(0, 0, room_height);
+    const Vector3d ceiling[4] = { floor[0] + up, floor[1] + up, floor[2] + up, floor[3] + up };
+    WriteSegment("floor " + to_string(r), "Z", floor, &ofstr);
+    WriteSegment("ceiling " + to_string(r), "-Z", ceiling, &ofstr);
+    for (int w = 0; w < 4; ++w) {
+      const int next = (w + 1) % 4;
+      const Vector3d wall[4] = { floor[w], floor[next], ceiling[next], ceiling[w] };
+      WriteSegment("room " + to_string(r) + " wall " + to_string(w), kWallNormals[w], wall, &ofstr);
+    }
+  }
+  ofstr.close();
+}
+
+}  // namespace
+
+void ReadSyntheticCameras(const string& filename,
+                          const int width,
+                          const double phi_range,
+                          vector<SyntheticCamera>* cameras) {
+  ifstream ifstr;
+  ifstr.open(filename.c_str());
+  if (!ifstr.is_open()) {
+    cerr << "Cannot open a file." << filename << endl;
+    exit (1);
+  }
+  while (true) {
+    SyntheticCamera camera;
+    for (int i = 0; i < 3; ++i)
+      ifstr >> camera.center[i];
+    if (ifstr.eof())
+      break;
+
+    camera.width     = width;
+    camera.height    = camera.width / 2;
+    camera.phi_range = phi_range;
+    cameras->push_back(camera);
+  }
+  ifstr.close();
+}
+
+void ReadSyntheticMesh(const string& filename, SyntheticMesh* mesh) {
+  ifstream ifstr;
+  ifstr.open(filename.c_str());
+  string stmp;
+  for (int i = 0; i < 9; ++i)
+    ifstr >> stmp;
+  int num_of_vertices, num_of_faces;
+  ifstr >> num_of_vertices;
+  for (int i = 0; i < 11; ++i)
+    ifstr >> stmp;
+  ifstr >> num_of_faces;
+  for (int i = 0; i < 6; ++i)
+    ifstr >> stmp;
+
+  mesh->vertices.resize(num_of_vertices);
+  mesh->triangles.resize(num_of_faces);
+
+  for (int v = 0; v < num_of_vertices; ++v) {
+    for (int i = 0; i < 3; ++i)
+      ifstr >> mesh->vertices[v][i];
+  }
+
+  for (int f = 0; f < num_of_faces; ++f) {
+    int num;
+    ifstr >> num;
+    if (num != 3) {
+      cerr << "Mesh must have only triangles." << endl;
+      exit (1);
+    }
+    for (int i = 0; i < 3; ++i)
+      ifstr >> mesh->triangles[f][i];
+  }
+
+  ifstr.close();
+}
+
+void RasterizeSyntheticScene(const SyntheticCamera& camera,
+                             const vector<SyntheticMesh>& meshes,
+                             const bool local_coordinate,
+                             const bool verbose,
+                             vector<SyntheticPoint>* points) {
+  const double kInvalidDepth = numeric_limits<double>::max();
+  DepthPixel invalid_depth_pixel;
+  invalid_depth_pixel.depth = kInvalidDepth;
+  invalid_depth_pixel.normal = Vector3d(0, 0, 0);
+  invalid_depth_pixel.color = Vector3i(0, 0, 0);
+
+  vector<DepthPixel> depths(camera.width * camera.height,
+                            invalid_depth_pixel);
+
+  // Rasterize.
+  for (const auto& mesh : meshes) {
+    const int progress_step = max(1, static_cast<int>(mesh.triangles.size() / 10));
+    int count = 0;
+    for (const auto& triangle : mesh.triangles) {
+      ++count;
+      if (verbose && count % progress_step == 0)
+        cerr << '.' << flush;
+
+      const Vector3d vs[3] = { mesh.vertices[triangle[0]],
+                               mesh.vertices[triangle[1]],
+                               mesh.vertices[triangle[2]] };
+      const Vector3d center = (vs[0] + vs[1] + vs[2]) / 3.0;
+      const double unit = min(min(ComputeUnit(camera, vs[0]),
+                                  ComputeUnit(camera, vs[1])),
+                              min(ComputeUnit(camera, vs[2]),
+                                  ComputeUnit(camera, center)));
+
+      Vector3d normal = - (vs[1] - vs[0]).cross(vs[2] - vs[0]);
+      if (normal.norm() == 0) {
+        continue;
+      }
+      normal.normalize();
+
+      const double kSampleScale = 2.0;
+      const int sample01 = max(2, static_cast<int>(round((vs[1] - vs[0]).norm() / unit * kSampleScale)));
+      const int sample02 = max(2, static_cast<int>(round((vs[2] - vs[0]).norm() / unit * kSampleScale)));
+      const int sample_s = max(sample01, sample02);
+      for (int s = 0; s <= sample_s; ++s) {
+        const Vector3d v01 = vs[0] + (vs[1] - vs[0]) * s / sample_s;
+        const Vector3d v02 = vs[0] + (vs[2] - vs[0]) * s / sample_s;
+        const int sample_t = max(2, static_cast<int>(round((v02 - v01).norm() / unit * kSampleScale)));
+        for (int t = 0; t <= sample_t; ++t) {
+          const Vector3d point = v01 + (v02 - v01) * t / sample_t;
+          const double distance = (point - camera.center).norm();
+          Vector2d uv = Project(camera, point);
+          const int u = static_cast<int>(round(uv[0])) % camera.width;
+          const int v = static_cast<int>(round(uv[1]));
+
+          const int index = v * camera.width + u;
+          if (distance < depths[index].depth) {
+            depths[index].depth = distance;
+            depths[index].normal = normal;
+            depths[index].color = mesh.color;
+          }
+        }
+      }
+    }
+    if (verbose)
+      cerr << endl;
+  }
+  for (int x = 0; x < camera.width; ++x) {
+    const int index0 = 0 * camera.width + x;
+    const int index1 = (camera.height - 1) * camera.width + x;
+    depths[index0].depth = kInvalidDepth;
+    depths[index1].depth = kInvalidDepth;
+  }
+
+  // From depths to points.
+  AddPointsFromDepths(camera, depths, kInvalidDepth, local_coordinate, points);
+}
+
+void WriteSyntheticPly(const string& filename,
+                       const vector<SyntheticPoint>& points,
+                       const bool with_comment) {
+  ofstream ofstr;
+  ofstr.open(filename.c_str());
+  ofstr << "ply" << endl
+        << "format ascii 1.0" << endl;
+
+  if (with_comment)
+    ofstr << "comment created by MATLAB plywrite" << endl;
+
+  ofstr << "element vertex " << (int)points.size() << endl
+        << "property int height" << endl
+        << "property int width" << endl
+        << "property float x" << endl
+        << "property float y" << endl
+        << "property float z" << endl
+        << "property uchar red" << endl
+        << "property uchar green" << endl
+        << "property uchar blue" << endl
+        << "property float nx" << endl
+        << "property float ny" << endl
+        << "property float nz" << endl
+        << "property uchar intensity" << endl
+        << "end_header" << endl;
+  for (const auto& point : points) {
+    ofstr << point.uv[0] << ' ' << point.uv[1] << ' '
+          << point.position[0] << ' ' << point.position[1] << ' ' << point.position[2] << ' '
+          << point.color[0] << ' ' << point.color[1] << ' ' << point.color[2] << ' '
+          << point.normal[0] << ' ' << point.normal[1] << ' ' << point.normal[2] << ' '
+          << point.intensity << endl;
+  }
+  ofstr.close();
+}
+
+void WriteSyntheticTransformations(const FileIO& file_io,
+                                   const int panorama,
+                                   const SyntheticCamera& camera) {
+  {
+    ofstream ofstr;
+    ofstr.open(file_io.GetPanoramaToGlobalTransformation(panorama).c_str());
+    ofstr << "CAMERA_TO_GLOBAL" << endl
+          << "1 0 0 " << camera.center[0] << endl
+          << "0 1 0 " << camera.center[1] << endl
+          << "0 0 1 " << camera.center[2] << endl
+          << "0 0 0 1" << endl
+          << camera.phi_range << endl;
+    ofstr.close();
+  }
+  {
+    ofstream ofstr;
+    ofstr.open(file_io.GetLocalToGlobalTransformation(panorama).c_str());
+    ofstr << "[1 0 0 " << camera.center[0] << endl
+          << " 0 1 0 " << camera.center[1] << endl
+          << " 0 0 1 " << camera.center[2] << endl
+          << " 0 0 0 1]" << endl;
+    ofstr.close();
+  }
+}
+
+long long WriteSyntheticHouse(const FileIO& file_io,
+                              const SyntheticHouseOptions& options) {
+  const string& directory = file_io.GetDataDirectory();
+  MakeDirectory(directory);
+  // Never overwrite a dataset, nor keep files of a larger house (the
+  // panoramas are counted until one is missing).
+  vector<cv::String> files;
+  cv::glob(directory + "/*", files, true);
+  if (!files.empty()) {
+    cerr << "Not an empty directory: " << directory << endl;
+    exit (1);
+  }
+  MakeDirectory(directory + "/input");
+  MakeDirectory(directory + "/input/ply");
+  MakeDirectory(directory + "/input/panorama");
+  MakeDirectory(directory + "/input/calibration");
+  MakeDirectory(directory + "/input/transformations");
+
+  vector<Room> rooms;
+  GenerateRooms(options, &rooms);
+  WriteFloorplan(file_io.GetFloorplan(), rooms, options.room_height);
+  WriteIndoorPolygon(file_io.GetIndoorPolygon(), rooms, options.room_height);
+
+  long long num_points = 0;
+  int panorama = 0;
+  for (int r = 0; r < (int)rooms.size(); ++r) {
+    // Colors depend on the room only, not on the other options.
+    mt19937 random(options.seed + 7919 * (r + 1));
+    vector<SyntheticMesh> meshes;
+    GenerateRoomMeshes(rooms[r], options.room_height, &random, &meshes);
+
+    for (const auto& center : rooms[r].panorama_centers) {
+      SyntheticCamera camera;
+      camera.center    = center;
+      camera.width     = options.depth_width;
+      camera.height    = options.depth_width / 2;
+      camera.phi_range = options.phi_range;
+
+      vector<SyntheticPoint> points;
+      const bool kLocalCoordinate = true;
+      const bool kQuiet = false;
+      RasterizeSyntheticScene(camera, meshes, kLocalCoordinate, kQuiet, &points);
+
+      WriteDepthPanorama(file_io.GetDepthPanorama(panorama), camera, points);
+      WritePanoramaImage(file_io.GetPanoramaImage(panorama), camera, points, options.image_width);
+      WriteSyntheticTransformations(file_io, panorama, camera);
+
+      if (options.point_ratio < 1.0) {
+        mt19937 point_random(options.seed + panorama);
+        vector<SyntheticPoint> kept_points;
+        for (const auto& point : points) {
+          if (Uniform(0.0, 1.0, &point_random) < options.point_ratio)
+            kept_points.push_back(point);
+        }
+        points.swap(kept_points);
+      }
+      const bool kWithoutComment = false;
+      WriteSyntheticPly(file_io.GetLocalPly(panorama), points, kWithoutComment);
+      num_points += points.size();
+      ++panorama;
+    }
+  }
+  return num_points;
+}
+
+}  // namespace structured_indoor_modeling
@@ -0,0 +1,123 @@
+#ifndef SYNTHETIC_SCENE_H_
+#define SYNTHETIC_SCENE_H_
+
+/*
+  Rasterizes triangle meshes into synthetic laser scans: one depth
+  panorama per camera, written as the local ply of the camera. Used by
+  generate_synthetic_data_cli (meshes from files) and by the
+  benchmarks, which generate a whole house from a seed with
+  WriteSyntheticHouse.
+
+  A synthetic house is a grid of box shaped rooms (closed by their
+  walls, no doors) with a few box objects on the floor and panoramas at
+  random positions inside. All the inputs of the pipeline are written
+  (local plys, transformations, panorama images, depth panoramas,
+  floorplan and indoor polygon), so any stage can run on it. The same
+  options and seed always give the same files.
+
+  < Example >
+
+  SyntheticHouseOptions options;
+  options.num_rooms = 16;
+  options.depth_width = 1024;
+  WriteSyntheticHouse(FileIO("/tmp/house"), options);
+*/
+
+#include <Eigen/Dense>
+#include <string>
+#include <vector>
+
+#include "../../base/file_io.h"
+
+namespace structured_indoor_modeling {
+
+struct SyntheticPoint {
+  Eigen::Vector2i uv;
+  Eigen::Vector3d position;
+  Eigen::Vector3i color;
+  Eigen::Vector3d normal;
+  int intensity;
+};
+
+struct SyntheticCamera {
+  Eigen::Vector3d center;
+  int width;
+  int height;
+
+  double phi_range;
+};
+
+struct SyntheticMesh {
+  SyntheticMesh() : color(255, 255, 255) {}
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<Eigen::Vector3i> triangles;
+  // Color of the points on the mesh.
+  Eigen::Vector3i color;
+};
+
+struct SyntheticHouseOptions {
+  SyntheticHouseOptions() :
+    num_rooms(4),
+    panoramas_per_room(2),
+    objects_per_room(3),
+    room_size(4000.0),
+    room_height(2500.0),
+    depth_width(512),
+    image_width(1024),
+    phi_range(160.0 * M_PI / 180.0),
+    point_ratio(1.0),
+    seed(0) {
+  }
+
+  // Rooms are laid out on a square grid.
+  int num_rooms;
+  int panoramas_per_room;
+  int objects_per_room;
+  // Average room width, and room height (in mm, as the real data).
+  double room_size;
+  double room_height;
+  // Width of the depth panoramas (and of the local plys), and of the
+  // panorama images.
+  int depth_width;
+  int image_width;
+  double phi_range;
+  // Ratio of the rasterized points kept in the local plys.
+  double point_ratio;
+  unsigned int seed;
+};
+
+// The center of each line of pano_centers.txt.
+void ReadSyntheticCameras(const std::string& filename,
+                          const int width,
+                          const double phi_range,
+                          std::vector<SyntheticCamera>* cameras);
+
+// Ascii ply with triangles only.
+void ReadSyntheticMesh(const std::string& filename, SyntheticMesh* mesh);
+
+// One point per depth pixel, row major, with an invalid (zero) point
+// where no mesh is visible. In the local coordinate system of the
+// camera if local_coordinate.
+void RasterizeSyntheticScene(const SyntheticCamera& camera,
+                             const std::vector<SyntheticMesh>& meshes,
+                             const bool local_coordinate,
+                             const bool verbose,
+                             std::vector<SyntheticPoint>* points);
+
+void WriteSyntheticPly(const std::string& filename,
+                       const std::vector<SyntheticPoint>& points,
+                       const bool with_comment);
+
+// GetPanoramaToGlobalTransformation and GetLocalToGlobalTransformation.
+void WriteSyntheticTransformations(const FileIO& file_io,
+                                   const int panorama,
+                                   const SyntheticCamera& camera);
+
+// The data directory must be missing or empty. Returns the number of
+// points written to the local plys.
+long long WriteSyntheticHouse(const FileIO& file_io,
+                              const SyntheticHouseOptions& options);
+
+}  // namespace structured_indoor_modeling
+
+#endif  // SYNTHETIC_SCENE_H_
@@ -10,6 +10,7 @@
 #include "align_images.h"
 #include "ceres/ceres.h"
 #include "transformation.h"
+#include "../../base/image_pyramid.h"
 
 using namespace cv;
 using namespace Eigen;
@@ -347,33 +348,6 @@ void BlendImageToPanorama(const double* const local_params,
   }
 }
   
-// Convert RGB image to dx/dy gradient image.
-void ConvertRGBToDxDy(const Mat& rgb_image, Mat* dx_image, Mat* dy_image) {
-  *dx_image = Mat(rgb_image.rows, rgb_image.cols, CV_32F);
-  *dy_image = Mat(rgb_image.rows, rgb_image.cols, CV_32F);
-
-  for (int y = 0; y < rgb_image.rows; ++y) {
-    for (int x = 0; x < rgb_image.cols; ++x) {
-      if (x == 0 || x == rgb_image.cols - 1) {
-        dx_image->at<float>(y, x) = 0.0;
-      } else {
-        cv::Vec3b diff = rgb_image.at<cv::Vec3b>(y, x + 1) - rgb_image.at<cv::Vec3b>(y, x - 1);
-        dx_image->at<float>(y, x) = (diff[0] + diff[1] + diff[2]) / 3.0 / 2.0;
-      }        
-    }
-  }
-  for (int y = 0; y < rgb_image.rows; ++y) {
-    for (int x = 0; x < rgb_image.cols; ++x) {
-      if (y == 0 || y == rgb_image.rows - 1) {
-        dy_image->at<float>(y, x) = 0.0;
-      } else {
-        cv::Vec3b diff = rgb_image.at<cv::Vec3b>(y + 1, x) - rgb_image.at<cv::Vec3b>(y - 1, x);
-        dy_image->at<float>(y, x) = (diff[0] + diff[1] + diff[2]) / 3.0 / 2.0;
-      }
-    }
-  }
-}
-
 }  // namespace
 
 //----------------------------------------------------------------------
@@ -528,30 +502,27 @@ void PrepareImages(const FileIO& file_io,
   images->resize(num_pyramid_levels);
   dx_images->resize(num_pyramid_levels);
   dy_images->resize(num_pyramid_levels);
+  for (int level = 0; level < num_pyramid_levels; ++level) {
+    images->at(level).resize(num_images);
+    dx_images->at(level).resize(num_images);
+    dy_images->at(level).resize(num_images);
+  }
 
-  const int kFirstLevel = 0;
-  images->at(kFirstLevel).resize(num_images);
-  dx_images->at(kFirstLevel).resize(num_images);
-  dy_images->at(kFirstLevel).resize(num_images);
   for (int i = 0; i < num_images; ++i) {
-    (*images)[kFirstLevel][i] = cv::imread(file_io.GetRawImage(p, i, dynamic_range_index), 1);
-    if ((*images)[kFirstLevel][i].empty()) {
+    const Mat image = cv::imread(file_io.GetRawImage(p, i, dynamic_range_index), 1);
+    if (image.empty()) {
       cerr << "Image does not exist." << endl;
       exit (1);      
     }
-    
-    ConvertRGBToDxDy((*images)[kFirstLevel][i], &(*dx_images)[kFirstLevel][i], &(*dy_images)[kFirstLevel][i]);
-  }
 
-  for (int level = 1; level < num_pyramid_levels; ++level) {
-    images->at(level).resize(num_images);
-    dx_images->at(level).resize(num_images);
-    dy_images->at(level).resize(num_images);
-    for (int image = 0; image < num_images; ++image) {
-      pyrDown((*images)[level - 1][image], (*images)[level][image],
-              Size((*images)[level - 1][image].cols / 2,
-                   (*images)[level - 1][image].rows / 2));
-      ConvertRGBToDxDy((*images)[level][image], &(*dx_images)[level][image], &(*dy_images)[level][image]);
+    // Levels are views of the pyramids' buffers, which they keep alive.
+    ImagePyramid pyramid, dx_pyramid, dy_pyramid;
+    pyramid.Build(image, num_pyramid_levels, ImagePyramid::kNoHole);
+    BuildGradientPyramids(pyramid, &dx_pyramid, &dy_pyramid);
+    for (int level = 0; level < num_pyramid_levels; ++level) {
+      (*images)[level][i] = pyramid.GetLevel(level);
+      (*dx_images)[level][i] = dx_pyramid.GetLevel(level);
+      (*dy_images)[level][i] = dy_pyramid.GetLevel(level);
     }
   }
 }                   
@@ -11,6 +11,7 @@
 #include "ceres/ceres.h"
 #include "depthmap_refiner.h"
 #include "../../base/file_io.h"
+#include "../../base/image_pyramid.h"
 #include "gflags/gflags.h"
 #include "transformation.h"
 
@@ -888,93 +889,34 @@ void InitializeColorImage(const FileIO& file_io,
   SetColorImage(panorama_raw, depth_width, depth_height, color_image);
 }
 
-void MakeHalf(const int width, const int height,
-              const vector<Vector3d>& image,
-              const int half_width, const int half_height,
-              vector<Vector3d>* half_image) {
-  half_image->resize(half_width * half_height);
-  int index = 0;
-  for (int y = 0; y < half_height; ++y) {
-    for (int x = 0; x < half_width; ++x, ++index) {
-      int denom = 0;
-      half_image->at(index) = Vector3d(0, 0, 0);
-      for (int j = 0; j < 2; ++j) {
-        const int ytmp = 2 * y + j;
-        if (height <= ytmp)
-          continue;
-        for (int i = 0; i < 2; ++i) {
-          const int xtmp = 2 * x + i;
-          if (width <= xtmp)
-            continue;
-          
-          half_image->at(index) += image[ytmp * width + xtmp];
-          ++denom;
-        }
-      }
-      if (denom == 0) {
-        cerr << "Impossible in makehalf." << endl;
-        exit (1);
-      }
-      half_image->at(index) /= denom;
-    }
-  }
-}
-
-void MakeHalf(const int width, const int height,
-              const vector<double>& image,
-              const int half_width, const int half_height,
-              vector<double>* half_image) {
-  half_image->resize(half_width * half_height);
-  int index = 0;
-  for (int y = 0; y < half_height; ++y) {
-    for (int x = 0; x < half_width; ++x, ++index) {
-      int denom = 0;
-      half_image->at(index) = 0.0;
-      for (int j = 0; j < 2; ++j) {
-        const int ytmp = 2 * y + j;
-        if (height <= ytmp)
-          continue;
-        for (int i = 0; i < 2; ++i) {
-          const int xtmp = 2 * x + i;
-          if (width <= xtmp)
-            continue;
-
-          if (image[ytmp * width + xtmp] != kInvalid) {
-            half_image->at(index) += image[ytmp * width + xtmp];
-            ++denom;
-          }
-        }
-      }
-      if (denom == 0) {
-        half_image->at(index) = kInvalid;
-      } else {
-        half_image->at(index) /= denom;
-      }
-    }
-  }
-}
-
+// Color has no holes, depth has kInvalid holes.
 void BuildPyramid(vector<Image>* pyramid) {
-  for (int level = 1; level < pyramid->size(); ++level) {
-    pyramid->at(level).width  = pyramid->at(level - 1).width / 2;
-    pyramid->at(level).height = pyramid->at(level - 1).height / 2;
-
-    if (!pyramid->at(level - 1).color.empty()) {
-      MakeHalf(pyramid->at(level - 1).width,
-               pyramid->at(level - 1).height,
-               pyramid->at(level - 1).color,
-               pyramid->at(level).width,
-               pyramid->at(level).height,
-               &pyramid->at(level).color);
-      DetectEdgeColor(&pyramid->at(level));
+  Image& base = pyramid->at(0);
+  const int num_levels = static_cast<int>(pyramid->size());
+  const bool is_color = !base.color.empty();
+  ImagePyramid image_pyramid;
+  if (is_color)
+    image_pyramid.Build(cv::Mat(base.height, base.width, CV_64FC3, base.color[0].data()),
+                        num_levels, ImagePyramid::kNoHole);
+  else
+    image_pyramid.Build(cv::Mat(base.height, base.width, CV_64FC1, &base.depth[0]),
+                        num_levels, ImagePyramid::kValueHole, kInvalid);
+
+  for (int level = 1; level < num_levels; ++level) {
+    Image& image = pyramid->at(level);
+    image.width  = image_pyramid.GetWidth(level);
+    image.height = image_pyramid.GetHeight(level);
+    const cv::Mat level_image = image_pyramid.GetLevel(level);
+    const double* const data = level_image.ptr<double>(0);
+    const int num_pixels = image.width * image.height;
+    if (is_color) {
+      image.color.resize(num_pixels);
+      for (int i = 0; i < num_pixels; ++i)
+        image.color[i] = Vector3d(data[3 * i], data[3 * i + 1], data[3 * i + 2]);
+      DetectEdgeColor(&image);
     } else {
-      MakeHalf(pyramid->at(level - 1).width,
-               pyramid->at(level - 1).height,
-               pyramid->at(level - 1).depth,
-               pyramid->at(level).width,
-               pyramid->at(level).height,
-               &pyramid->at(level).depth);
-      DetectEdgeDepth(&pyramid->at(level));
+      image.depth.assign(data, data + num_pixels);
+      DetectEdgeDepth(&image);
     }
   }
 }
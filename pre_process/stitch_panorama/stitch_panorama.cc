@@ -3,6 +3,7 @@
 #include <opencv2/highgui/highgui.hpp>
 #include "ceres/ceres.h"
 #include "stitch_panorama.h"
+#include "../../base/tracing.h"
 
 using cv::imread;
 using cv::imshow;
@@ -1153,6 +1154,7 @@ Eigen::Vector3d StitchPanorama::Project(const int camera, const Eigen::Vector3d&
 }
 
 bool StitchPanorama::Stitch(const Input& input) {
+  const structured_indoor_modeling::ScopedTrace trace("StitchPanorama::Stitch");
   directory  = input.directory;
   out_width  = input.out_width;
   out_height = input.out_height;
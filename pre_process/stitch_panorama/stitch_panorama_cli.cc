@@ -3,7 +3,9 @@
 #include <iostream>
 #include <vector>
 #include "stitch_panorama.h"
+#include "../../base/tracing_flags.h"
 #include <Eigen/Dense>
+#include <gflags/gflags.h>
 
 using std::cerr;
 using std::endl;
@@ -17,6 +19,12 @@ int main(int argc, char* argv[]) {
     cerr << argv[0] << " directory width height num_levels subsample" << endl;
     return 1;
   }
+#ifdef __APPLE__
+  google::ParseCommandLineFlags(&argc, &argv, true);
+#else
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+#endif
+  structured_indoor_modeling::InitTracingFromFlags();
 
   const int width = atoi(argv[2]);
   const int height = atoi(argv[3]);
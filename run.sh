@@ -1,4 +1,7 @@
 #! /bin/bash
+# The same stages can run in one process, sharing the loaded data:
+# ./main_process/pipeline/run_pipeline_cli $1 --stages=floorplan_texture,indoor_polygon_texture,thumbnail
+
 # Textures and images for viewer.
 ./main_process/texture/generate_texture_floorplan_cli $1
 ./main_process/texture/generate_texture_indoor_polygon_cli $1
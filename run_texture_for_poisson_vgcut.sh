@@ -1,13 +1,22 @@
 #! /bin/bash
-./main_process/texture/generate_texture_indoor_polygon_cli $1 --binary_ply='input/poisson/poisson1.ply'
-./main_process/texture/generate_texture_indoor_polygon_cli $1 --binary_ply='input/poisson/poisson2.ply'
-./main_process/texture/generate_texture_indoor_polygon_cli $1 --binary_ply='input/poisson/poisson3.ply'
-./main_process/texture/generate_texture_indoor_polygon_cli $1 --binary_ply='input/poisson/poisson_filtered1.ply'
-./main_process/texture/generate_texture_indoor_polygon_cli $1 --binary_ply='input/poisson/poisson_filtered2.ply'
-./main_process/texture/generate_texture_indoor_polygon_cli $1 --binary_ply='input/poisson/poisson_filtered3.ply'
-./main_process/texture/generate_texture_indoor_polygon_cli $1 --ascii_ply='input/vgcut/vgcut0.ply'
-./main_process/texture/generate_texture_indoor_polygon_cli $1 --ascii_ply='input/vgcut/vgcut1.ply'
-./main_process/texture/generate_texture_indoor_polygon_cli $1 --ascii_ply='input/vgcut/vgcut2.ply'
-./main_process/texture/generate_texture_indoor_polygon_cli $1 --ascii_ply='input/vgcut/vgcut_filtered0.ply'
-./main_process/texture/generate_texture_indoor_polygon_cli $1 --ascii_ply='input/vgcut/vgcut_filtered1.ply'
-./main_process/texture/generate_texture_indoor_polygon_cli $1 --ascii_ply='input/vgcut/vgcut_filtered2.ply'
+# All the meshes in one process: panoramas are loaded once and the
+# meshes are textured in parallel.
+mesh_list=$(mktemp)
+cat > $mesh_list <<END
+binary input/poisson/poisson1.ply
+binary input/poisson/poisson2.ply
+binary input/poisson/poisson3.ply
+binary input/poisson/poisson_filtered1.ply
+binary input/poisson/poisson_filtered2.ply
+binary input/poisson/poisson_filtered3.ply
+ascii input/vgcut/vgcut0.ply
+ascii input/vgcut/vgcut1.ply
+ascii input/vgcut/vgcut2.ply
+ascii input/vgcut/vgcut_filtered0.ply
+ascii input/vgcut/vgcut_filtered1.ply
+ascii input/vgcut/vgcut_filtered2.ply
+END
+./main_process/texture/generate_texture_indoor_polygon_cli $1 --mesh_list=$mesh_list
+status=$?
+rm -f $mesh_list
+exit $status
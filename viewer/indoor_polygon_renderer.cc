@@ -15,6 +15,10 @@
 using namespace Eigen;
 using namespace std;
 
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
 namespace structured_indoor_modeling {
 
 IndoorPolygonRenderer::IndoorPolygonRenderer(const Floorplan& floorplan,
@@ -22,6 +26,7 @@ IndoorPolygonRenderer::IndoorPolygonRenderer(const Floorplan& floorplan,
                                              const Navigation& navigation)
   : floorplan(floorplan), indoor_polygon(indoor_polygon), navigation(navigation) {
   render_mode = kBackWallFaceTransparent;
+  texture_min_filter = GL_NEAREST;
 }
 
 IndoorPolygonRenderer::~IndoorPolygonRenderer() {
@@ -44,9 +49,19 @@ void IndoorPolygonRenderer::Init(const string& data_directory,
     if (!ifstr.is_open())
       break;
   }
-  texture_images.resize(num_texture_images);
+  // Use the block compressed images if all of them are there.
+  compressed_images.resize(num_texture_images);
   for (int t = 0; t < num_texture_images; ++t) {
-    texture_images[t].load(file_io.GetTextureImageIndoorPolygon(t, suffix).c_str());
+    if (!ReadDDS(file_io.GetTextureImageIndoorPolygonDDS(t, suffix), &compressed_images[t])) {
+      compressed_images.clear();
+      break;
+    }
+  }
+  if (compressed_images.empty()) {
+    texture_images.resize(num_texture_images);
+    for (int t = 0; t < num_texture_images; ++t) {
+      texture_images[t].load(file_io.GetTextureImageIndoorPolygon(t, suffix).c_str());
+    }
   }
 
   //----------------------------------------------------------------------
@@ -119,11 +134,31 @@ void IndoorPolygonRenderer::Init(const string& data_directory,
 void IndoorPolygonRenderer::InitGL() {
   initializeGLFunctions();
 
-  texture_ids.resize(texture_images.size());
-  
   glEnable(GL_TEXTURE_2D);
-  for (int t = 0; t < (int)texture_images.size(); ++t) {
-    texture_ids[t] = widget->bindTexture(texture_images[t]);
+  if (!compressed_images.empty()) {
+    // Upload the precomputed mip chain as is. It is stored bottom row
+    // first, as bindTexture uploads the PNG images.
+    texture_ids.resize(compressed_images.size());
+    for (int t = 0; t < (int)compressed_images.size(); ++t) {
+      const CompressedImage& image = compressed_images[t];
+      GLuint texture_id;
+      glGenTextures(1, &texture_id);
+      glBindTexture(GL_TEXTURE_2D, texture_id);
+      for (int level = 0; level < image.GetNumLevels(); ++level) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+                               image.GetWidth(level), image.GetHeight(level), 0,
+                               image.levels[level].size(), &image.levels[level][0]);
+      }
+      texture_ids[t] = texture_id;
+    }
+    compressed_images.clear();
+    texture_min_filter = GL_LINEAR_MIPMAP_LINEAR;
+  } else {
+    texture_ids.resize(texture_images.size());
+    for (int t = 0; t < (int)texture_images.size(); ++t) {
+      texture_ids[t] = widget->bindTexture(texture_images[t]);
+    }
+    texture_min_filter = GL_NEAREST;
   }
 }
 
@@ -168,7 +203,7 @@ void IndoorPolygonRenderer::RenderTextureMappedRooms(const double top_intensity,
     // For each texture.
     for (int texture = 0; texture < (int)texture_ids.size(); ++texture) {
       glBindTexture(GL_TEXTURE_2D, texture_ids[texture]);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture_min_filter);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -209,7 +244,7 @@ void IndoorPolygonRenderer::RenderTextureMappedRooms(const double top_intensity,
 
     for (int texture = 0; texture < (int)texture_ids.size(); ++texture) {
       glBindTexture(GL_TEXTURE_2D, texture_ids[texture]);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture_min_filter);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -254,7 +289,7 @@ void IndoorPolygonRenderer::RenderTextureMappedRooms(const double top_intensity,
 
     for (int texture = 0; texture < (int)texture_ids.size(); ++texture) {
       glBindTexture(GL_TEXTURE_2D, texture_ids[texture]);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture_min_filter);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -301,7 +336,7 @@ void IndoorPolygonRenderer::RenderTextureMappedRooms(const double top_intensity,
   // For each texture.
   for (int texture = 0; texture < (int)texture_ids.size(); ++texture) {
     glBindTexture(GL_TEXTURE_2D, texture_ids[texture]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture_min_filter);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
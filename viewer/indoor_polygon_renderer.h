@@ -4,6 +4,8 @@
 #include <QGLFunctions>
 #include <QImage>
 
+#include "../base/texture_compression.h"
+
 namespace structured_indoor_modeling {
 
 class Floorplan;
@@ -45,7 +47,12 @@ class IndoorPolygonRenderer : protected QGLFunctions {
   const Navigation& navigation;
 
   std::vector<QImage> texture_images;
+  // Used instead of texture_images when DDS files exist.
+  std::vector<CompressedImage> compressed_images;
   std::vector<GLint> texture_ids;
+  // GL_LINEAR_MIPMAP_LINEAR for compressed textures (they come with
+  // mipmaps), GL_NEAREST otherwise.
+  GLint texture_min_filter;
 
   // Floor outline.
   std::map<int, std::vector<std::vector<Eigen::Vector3d> > > wire_frames;
@@ -10,6 +10,10 @@
 using namespace Eigen;
 using namespace std;
 
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
 namespace structured_indoor_modeling {
 
 namespace {
@@ -190,7 +194,8 @@ Vector3d GenerateRoomColor(const int room) {
 } // namespace
 
 
-PolygonRenderer::PolygonRenderer(const Floorplan& floorplan) : floorplan(floorplan) {
+PolygonRenderer::PolygonRenderer(const Floorplan& floorplan)
+  : floorplan(floorplan), texture_min_filter(GL_NEAREST) {
 }
 
 PolygonRenderer::~PolygonRenderer() {
@@ -269,20 +274,50 @@ void PolygonRenderer::Init(const string data_directory, QGLWidget* widget_tmp) {
     if (!ifstr.is_open())
       break;
   }
-  texture_images.resize(num_texture_images);
+  // Use the block compressed images if all of them are there.
+  compressed_images.resize(num_texture_images);
   for (int t = 0; t < num_texture_images; ++t) {
-    texture_images[t].load(file_io.GetTextureImage(t).c_str());
+    if (!ReadDDS(file_io.GetTextureImageDDS(t), &compressed_images[t])) {
+      compressed_images.clear();
+      break;
+    }
+  }
+  if (compressed_images.empty()) {
+    texture_images.resize(num_texture_images);
+    for (int t = 0; t < num_texture_images; ++t) {
+      texture_images[t].load(file_io.GetTextureImage(t).c_str());
+    }
   }
 }
 
 void PolygonRenderer::InitGL() {
   initializeGLFunctions();
 
-  texture_ids.resize(texture_images.size());
-  
   glEnable(GL_TEXTURE_2D);
-  for (int t = 0; t < (int)texture_images.size(); ++t) {
-    texture_ids[t] = widget->bindTexture(texture_images[t]);
+  if (!compressed_images.empty()) {
+    // Upload the precomputed mip chain as is. It is stored bottom row
+    // first, as bindTexture uploads the PNG images.
+    texture_ids.resize(compressed_images.size());
+    for (int t = 0; t < (int)compressed_images.size(); ++t) {
+      const CompressedImage& image = compressed_images[t];
+      GLuint texture_id;
+      glGenTextures(1, &texture_id);
+      glBindTexture(GL_TEXTURE_2D, texture_id);
+      for (int level = 0; level < image.GetNumLevels(); ++level) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+                               image.GetWidth(level), image.GetHeight(level), 0,
+                               image.levels[level].size(), &image.levels[level][0]);
+      }
+      texture_ids[t] = texture_id;
+    }
+    compressed_images.clear();
+    texture_min_filter = GL_LINEAR_MIPMAP_LINEAR;
+  } else {
+    texture_ids.resize(texture_images.size());
+    for (int t = 0; t < (int)texture_images.size(); ++t) {
+      texture_ids[t] = widget->bindTexture(texture_images[t]);
+    }
+    texture_min_filter = GL_NEAREST;
   }
 }
 
@@ -290,7 +325,7 @@ void PolygonRenderer::RenderTextureMappedRooms(const double top_alpha, const dou
   // For each texture.
   for (int texture = 0; texture < (int)texture_ids.size(); ++texture) {
     glBindTexture(GL_TEXTURE_2D, texture_ids[texture]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture_min_filter);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -419,7 +454,7 @@ void PolygonRenderer::RenderTextureMappedRooms(const double top_alpha,
   // For each texture.
   for (int texture = 0; texture < (int)texture_ids.size(); ++texture) {
     glBindTexture(GL_TEXTURE_2D, texture_ids[texture]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture_min_filter);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -521,7 +556,7 @@ void PolygonRenderer::RenderTextureMappedRooms(const double top_alpha,
   // For each texture.
   for (int texture = 0; texture < (int)texture_ids.size(); ++texture) {
     glBindTexture(GL_TEXTURE_2D, texture_ids[texture]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture_min_filter);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -5,6 +5,8 @@
 #include <QGLFunctions>
 #include <QImage>
 
+#include "../base/texture_compression.h"
+
 #include "../base/floorplan.h"
 
 namespace structured_indoor_modeling {
@@ -86,7 +88,12 @@ class PolygonRenderer : protected QGLFunctions {
   const Floorplan& floorplan;
 
   std::vector<QImage> texture_images;
+  // Used instead of texture_images when DDS files exist.
+  std::vector<CompressedImage> compressed_images;
   std::vector<GLint> texture_ids;
+  // GL_LINEAR_MIPMAP_LINEAR for compressed textures (they come with
+  // mipmaps), GL_NEAREST otherwise.
+  GLint texture_min_filter;
 };
 
 }  // namespace structured_indoor_modeling
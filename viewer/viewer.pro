@@ -30,8 +30,11 @@ qtHaveModule(opengl) {
        ../base/detection.cc \
        ../base/floorplan.cc \       
        ../base/indoor_polygon.cc \
+       ../base/image_pyramid.cc \
        ../base/panorama.cc \
-       ../base/point_cloud.cc
+       ../base/point_cloud.cc \
+       ../base/texture_compression.cc \
+       ../base/tracing.cc
 
     HEADERS += \
         main_widget.h \
@@ -50,8 +53,11 @@ qtHaveModule(opengl) {
         ../base/floorplan.h \
         ../base/indoor_polygon.h \
         ../base/geometry.h \
+        ../base/image_pyramid.h \
         ../base/panorama.h \
-        ../base/point_cloud.h
+        ../base/point_cloud.h \
+        ../base/texture_compression.h \
+        ../base/tracing.h
 
     RESOURCES += \
         shaders.qrc
@@ -60,7 +66,7 @@ qtHaveModule(opengl) {
         INCLUDEPATH += '/usr/include'
         INCLUDEPATH += '/usr/include/eigen3'
         INCLUDEPATH += '/usr/local/include'
-        LIBS += -L/usr/lib/x86_64-linux-gnu/ -lGLU -lopencv_core -lopencv_highgui -lopencv_imgproc
+        LIBS += -L/usr/lib/x86_64-linux-gnu/ -lGLU -lopencv_core -lopencv_highgui -lopencv_imgproc -lpthread
     }
 
     macx{